@@ -43,6 +43,7 @@ namespace Database
             auto query{ session.getDboSession().query<ResultType>("SELECT DISTINCT " + std::string{ itemToSelect } + " FROM artist a") };
             if (params.sortMethod == ArtistSortMethod::LastWritten
                 || params.writtenAfter.isValid()
+                || params.addedAfter.isValid()
                 || params.linkType
                 || params.track.isValid()
                 || params.release.isValid()
@@ -58,6 +59,9 @@ namespace Database
             if (params.writtenAfter.isValid())
                 query.where("t.file_last_write > ?").bind(params.writtenAfter);
 
+            if (params.addedAfter.isValid())
+                query.where("t.file_added > ?").bind(params.addedAfter);
+
             if (!params.keywords.empty())
             {
                 std::vector<std::string> clauses;
@@ -176,6 +176,50 @@ namespace Database
         return Utils::execQuery<ListenId>(query, parameters.range);
     }
 
+    void Listen::find(Session& session, UserId userId, ScrobblingBackend backend, SyncState syncState, ListenId& lastRetrievedId, std::size_t count, const std::function<void(ListenId, TrackId, const Wt::WDateTime&)>& func)
+    {
+        session.checkReadTransaction();
+
+        auto query{ session.getDboSession().query<std::tuple<ListenId, TrackId, Wt::WDateTime>>("SELECT id, track_id, date_time FROM listen")
+            .where("user_id = ?").bind(userId)
+            .where("backend = ?").bind(backend)
+            .where("sync_state = ?").bind(syncState)
+            .where("id > ?").bind(lastRetrievedId)
+            .orderBy("id")
+            .limit(static_cast<int>(count)) };
+
+        for (const auto& [listenId, trackId, dateTime] : query.resultList())
+        {
+            func(listenId, trackId, dateTime);
+            lastRetrievedId = listenId;
+        }
+    }
+
+    void Listen::updateSyncState(Session& session, const std::vector<ListenId>& listenIds, SyncState syncState)
+    {
+        session.checkWriteTransaction();
+
+        constexpr std::size_t maxBoundListenCount{ 500 }; // per query, stay well below the max number of bound parameters
+
+        for (std::size_t first{}; first < listenIds.size(); first += maxBoundListenCount)
+        {
+            const std::size_t count{ std::min(maxBoundListenCount, listenIds.size() - first) };
+
+            std::ostringstream oss;
+            for (std::size_t i{}; i < count; ++i)
+            {
+                if (i > 0)
+                    oss << ", ";
+                oss << "?";
+            }
+
+            auto statement{ session.getDboSession().execute("UPDATE listen SET sync_state = ? WHERE id IN (" + oss.str() + ")") };
+            statement.bind(syncState);
+            for (std::size_t i{}; i < count; ++i)
+                statement.bind(listenIds[first + i]);
+        }
+    }
+
     Listen::pointer Listen::find(Session& session, UserId userId, TrackId trackId, ScrobblingBackend backend, const Wt::WDateTime& dateTime)
     {
         session.checkReadTransaction();
@@ -47,6 +47,7 @@ namespace Database
                 || params.sortMethod == ReleaseSortMethod::OriginalDate
                 || params.sortMethod == ReleaseSortMethod::OriginalDateDesc
                 || params.writtenAfter.isValid()
+                || params.addedAfter.isValid()
                 || params.dateRange
                 || params.artist.isValid()
                 || params.clusters.size() == 1)
@@ -64,6 +65,9 @@ namespace Database
             if (params.writtenAfter.isValid())
                 query.where("t.file_last_write > ?").bind(params.writtenAfter);
 
+            if (params.addedAfter.isValid())
+                query.where("t.file_added > ?").bind(params.addedAfter);
+
             if (params.dateRange)
             {
                 query.where("t.date >= ?").bind(params.dateRange->begin);
@@ -19,6 +19,9 @@
 
 #include "database/Track.hpp"
 
+#include <algorithm>
+#include <tuple>
+
 #include <Wt/Dbo/WtSqlTraits.h>
 
 #include "database/Artist.hpp"
@@ -365,6 +368,120 @@ namespace Database
         return Utils::execQuery<TrackId>(query, range);
     }
 
+    void Track::findClusterLinks(Session& session, TrackId& lastRetrievedId, std::size_t count, const std::function<void(const ClusterLinks&)>& func)
+    {
+        session.checkReadTransaction();
+
+        std::vector<ClusterLinks> tracks;
+        {
+            auto query{ session.getDboSession().query<std::tuple<TrackId, ReleaseId>>("SELECT t.id, t.release_id FROM track t")
+                .where("t.id > ?").bind(lastRetrievedId)
+                .orderBy("t.id")
+                .limit(static_cast<int>(count)) };
+
+            for (const auto& [trackId, releaseId] : query.resultList())
+                tracks.push_back(ClusterLinks{ trackId, releaseId, {}, {} });
+        }
+
+        if (tracks.empty())
+            return;
+
+        const TrackId firstTrackId{ tracks.front().trackId };
+        const TrackId lastTrackId{ tracks.back().trackId };
+
+        auto getTrack{ [&](TrackId trackId) -> ClusterLinks*
+        {
+            auto it{ std::lower_bound(std::begin(tracks), std::end(tracks), trackId, [](const ClusterLinks& track, TrackId id) { return track.trackId < id; }) };
+            return (it != std::end(tracks) && it->trackId == trackId) ? &(*it) : nullptr;
+        } };
+
+        {
+            auto query{ session.getDboSession().query<std::tuple<TrackId, ClusterId>>("SELECT t_c.track_id, t_c.cluster_id FROM track_cluster t_c")
+                .where("t_c.track_id >= ? AND t_c.track_id <= ?").bind(firstTrackId).bind(lastTrackId) };
+
+            for (const auto& [trackId, clusterId] : query.resultList())
+            {
+                if (ClusterLinks* track{ getTrack(trackId) })
+                    track->clusterIds.push_back(clusterId);
+            }
+        }
+
+        {
+            auto query{ session.getDboSession().query<std::tuple<TrackId, ArtistId, TrackArtistLinkType>>("SELECT t_a_l.track_id, t_a_l.artist_id, t_a_l.type FROM track_artist_link t_a_l")
+                .where("t_a_l.track_id >= ? AND t_a_l.track_id <= ?").bind(firstTrackId).bind(lastTrackId) };
+
+            for (const auto& [trackId, artistId, linkType] : query.resultList())
+            {
+                if (ClusterLinks* track{ getTrack(trackId) })
+                    track->artistLinks.emplace_back(artistId, linkType);
+            }
+        }
+
+        for (const ClusterLinks& track : tracks)
+            func(track);
+
+        lastRetrievedId = lastTrackId;
+    }
+
+    void Track::findReleaseAndArtistIds(Session& session, const std::vector<TrackId>& trackIds, const std::function<void(TrackId, ReleaseId, const std::vector<ArtistId>&)>& func)
+    {
+        session.checkReadTransaction();
+
+        constexpr std::size_t maxBoundTrackCount{ 500 }; // per query, stay well below the max number of bound parameters
+
+        std::vector<ArtistId> artistIds;
+        for (std::size_t first{}; first < trackIds.size(); first += maxBoundTrackCount)
+        {
+            const std::size_t count{ std::min(maxBoundTrackCount, trackIds.size() - first) };
+
+            std::ostringstream oss;
+            for (std::size_t i{}; i < count; ++i)
+            {
+                if (i > 0)
+                    oss << ", ";
+                oss << "?";
+            }
+
+            std::vector<std::tuple<TrackId, ReleaseId>> tracks;
+            {
+                auto query{ session.getDboSession().query<std::tuple<TrackId, ReleaseId>>("SELECT t.id, t.release_id FROM track t")
+                    .where("t.id IN (" + oss.str() + ")")
+                    .orderBy("t.id") };
+                for (std::size_t i{}; i < count; ++i)
+                    query.bind(trackIds[first + i]);
+
+                for (const auto& track : query.resultList())
+                    tracks.push_back(track);
+            }
+
+            std::vector<std::tuple<TrackId, ArtistId>> trackArtists;
+            {
+                auto query{ session.getDboSession().query<std::tuple<TrackId, ArtistId>>("SELECT DISTINCT t_a_l.track_id, t_a_l.artist_id FROM track_artist_link t_a_l")
+                    .where("t_a_l.track_id IN (" + oss.str() + ")")
+                    .orderBy("t_a_l.track_id") };
+                for (std::size_t i{}; i < count; ++i)
+                    query.bind(trackIds[first + i]);
+
+                for (const auto& trackArtist : query.resultList())
+                    trackArtists.push_back(trackArtist);
+            }
+
+            // both sorted by track id
+            auto itTrackArtist{ std::cbegin(trackArtists) };
+            for (const auto& [trackId, releaseId] : tracks)
+            {
+                while (itTrackArtist != std::cend(trackArtists) && std::get<TrackId>(*itTrackArtist) < trackId)
+                    ++itTrackArtist;
+
+                artistIds.clear();
+                for (; itTrackArtist != std::cend(trackArtists) && std::get<TrackId>(*itTrackArtist) == trackId; ++itTrackArtist)
+                    artistIds.push_back(std::get<ArtistId>(*itTrackArtist));
+
+                func(trackId, releaseId, artistIds);
+            }
+        }
+    }
+
     void Track::clearArtistLinks()
     {
         _trackArtistLinks.clear();
@@ -30,6 +30,38 @@
 
 namespace Database {
 
+    namespace
+    {
+        FeatureValuesMap parseFeatures(const std::string& jsonEncodedFeatures, const std::unordered_set<FeatureName>& featureNames)
+        {
+            FeatureValuesMap res;
+
+            std::istringstream iss{ jsonEncodedFeatures };
+            boost::property_tree::ptree root;
+
+            boost::property_tree::read_json(iss, root);
+
+            for (const FeatureName& featureName : featureNames)
+            {
+                FeatureValues& featureValues{ res[featureName] };
+
+                auto node{ root.get_child(featureName) };
+
+                bool hasChildren = false;
+                for (const auto& child : node.get_child(""))
+                {
+                    hasChildren = true;
+                    featureValues.push_back(child.second.get_value<double>());
+                }
+
+                if (!hasChildren)
+                    featureValues.push_back(node.get_value<double>());
+            }
+
+            return res;
+        }
+    }
+
     TrackFeatures::TrackFeatures(ObjectPtr<Track> track, const std::string& jsonEncodedFeatures)
         : _data{ jsonEncodedFeatures },
         _track{ getDboPtr(track) }
@@ -75,47 +107,63 @@ namespace Database {
         return Utils::execQuery<TrackFeaturesId>(query, range);
     }
 
-    FeatureValues TrackFeatures::getFeatureValues(const FeatureName& featureNode) const
+    RangeResults<TrackId> TrackFeatures::findTrackIds(Session& session, std::optional<Range> range)
     {
-        FeatureValuesMap featuresValuesMap{ getFeatureValuesMap({featureNode}) };
-        return std::move(featuresValuesMap[featureNode]);
+        session.checkReadTransaction();
+
+        auto query{ session.getDboSession().query<TrackId>("SELECT track_id from track_features") };
+
+        return Utils::execQuery<TrackId>(query, range);
     }
 
-    FeatureValuesMap TrackFeatures::getFeatureValuesMap(const std::unordered_set<FeatureName>& featureNames) const
+    void TrackFeatures::find(Session& session, TrackFeaturesId& lastRetrievedId, std::size_t count, const std::function<void(TrackId trackId, const std::string& jsonEncodedFeatures)>& func)
     {
-        FeatureValuesMap res;
+        session.checkReadTransaction();
 
-        try
-        {
-            std::istringstream iss{ _data };
-            boost::property_tree::ptree root;
+        auto query{ session.getDboSession().query<std::tuple<TrackFeaturesId, TrackId, std::string>>("SELECT id, track_id, data FROM track_features")
+            .where("id > ?").bind(lastRetrievedId)
+            .orderBy("id")
+            .limit(static_cast<int>(count)) };
 
-            boost::property_tree::read_json(iss, root);
+        for (const auto& [trackFeaturesId, trackId, data] : query.resultList())
+        {
+            func(trackId, data);
+            lastRetrievedId = trackFeaturesId;
+        }
+    }
 
-            for (const FeatureName& featureName : featureNames)
-            {
-                FeatureValues& featureValues{ res[featureName] };
+    FeatureValuesMap TrackFeatures::parseFeatureValuesMap(const std::string& jsonEncodedFeatures, const std::unordered_set<FeatureName>& featureNames)
+    {
+        try
+        {
+            return parseFeatures(jsonEncodedFeatures, featureNames);
+        }
+        catch (boost::property_tree::ptree_error& error)
+        {
+            LMS_LOG(DB, ERROR, "Cannot parse track features: ptree exception: " << error.what());
+        }
 
-                auto node{ root.get_child(featureName) };
+        return {};
+    }
 
-                bool hasChildren = false;
-                for (const auto& child : node.get_child(""))
-                {
-                    hasChildren = true;
-                    featureValues.push_back(child.second.get_value<double>());
-                }
+    FeatureValues TrackFeatures::getFeatureValues(const FeatureName& featureNode) const
+    {
+        FeatureValuesMap featuresValuesMap{ getFeatureValuesMap({featureNode}) };
+        return std::move(featuresValuesMap[featureNode]);
+    }
 
-                if (!hasChildren)
-                    featureValues.push_back(node.get_value<double>());
-            }
+    FeatureValuesMap TrackFeatures::getFeatureValuesMap(const std::unordered_set<FeatureName>& featureNames) const
+    {
+        try
+        {
+            return parseFeatures(_data, featureNames);
         }
         catch (boost::property_tree::ptree_error& error)
         {
             LMS_LOG(DB, ERROR, "Track " << _track.id() << ": ptree exception: " << error.what());
-            res.clear();
         }
 
-        return res;
+        return {};
     }
 
 } // namespace Database
@@ -60,6 +60,7 @@ namespace Database
             ArtistSortMethod					sortMethod{ ArtistSortMethod::None };
             std::optional<Range>				range;
             Wt::WDateTime						writtenAfter;
+            Wt::WDateTime						addedAfter;	// if set, artists involved in at least one track added or updated after this time
             UserId								starringUser;	// only artists starred by this user
             std::optional<FeedbackBackend>		feedbackBackend; // and for this feedback backend
             TrackId								track;		// artists involved in this track
@@ -71,6 +72,7 @@ namespace Database
             FindParameters& setSortMethod(ArtistSortMethod _sortMethod) { sortMethod = _sortMethod; return *this; }
             FindParameters& setRange(std::optional<Range> _range) { range = _range; return *this; }
             FindParameters& setWrittenAfter(const Wt::WDateTime& _after) { writtenAfter = _after; return *this; }
+            FindParameters& setAddedAfter(const Wt::WDateTime& _after) { addedAfter = _after; return *this; }
             FindParameters& setStarringUser(UserId _user, FeedbackBackend _feedbackBackend) { starringUser = _user; feedbackBackend = _feedbackBackend; return *this; }
             FindParameters& setTrack(TrackId _track) { track = _track; return *this; }
             FindParameters& setRelease(ReleaseId _release) { release = _release; return *this; }
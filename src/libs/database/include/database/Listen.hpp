@@ -19,7 +19,9 @@
 
 #pragma once
 
+#include <functional>
 #include <optional>
+#include <vector>
 
 #include <Wt/Dbo/Dbo.h>
 #include <Wt/WDateTime.h>
@@ -63,6 +65,11 @@ namespace Database
         static pointer                  find(Session& session, ListenId id);
         static pointer                  find(Session& session, UserId userId, TrackId trackId, ScrobblingBackend backend, const Wt::WDateTime& dateTime);
         static RangeResults<ListenId>   find(Session& session, const FindParameters& parameters);
+        // listens of the user in the given sync state, by increasing id
+        static void                     find(Session& session, UserId userId, ScrobblingBackend backend, SyncState syncState, ListenId& lastRetrievedId, std::size_t count, const std::function<void(ListenId listenId, TrackId trackId, const Wt::WDateTime& dateTime)>& func);
+
+        // Bulk update, in a single statement per chunk of ids: objects already loaded in the session are not updated
+        static void                     updateSyncState(Session& session, const std::vector<ListenId>& listenIds, SyncState syncState);
 
         // Stats
         static RangeResults<ArtistId>   getTopArtists(Session& session, UserId userId, ScrobblingBackend backend, const std::vector<ClusterId>& clusterIds, std::optional<TrackArtistLinkType> linkType, std::optional<Range> range = std::nullopt);
@@ -86,6 +86,7 @@ namespace Database
             ReleaseSortMethod                   sortMethod{ ReleaseSortMethod::None };
             std::optional<Range>                range;
             Wt::WDateTime                       writtenAfter;
+            Wt::WDateTime                       addedAfter;     // if set, releases that have at least one track added or updated after this time
             std::optional<DateRange>            dateRange;
             UserId                              starringUser;				// only releases starred by this user
             std::optional<FeedbackBackend>      feedbackBackend;		    //    and for this backend
@@ -99,6 +100,7 @@ namespace Database
             FindParameters& setSortMethod(ReleaseSortMethod _sortMethod) { sortMethod = _sortMethod; return *this; }
             FindParameters& setRange(std::optional<Range> _range) { range = _range; return *this; }
             FindParameters& setWrittenAfter(const Wt::WDateTime& _after) { writtenAfter = _after; return *this; }
+            FindParameters& setAddedAfter(const Wt::WDateTime& _after) { addedAfter = _after; return *this; }
             FindParameters& setDateRange(const std::optional<DateRange>& _dateRange) { dateRange = _dateRange; return *this; }
             FindParameters& setStarringUser(UserId _user, FeedbackBackend _feedbackBackend) { starringUser = _user; feedbackBackend = _feedbackBackend; return *this; }
             FindParameters& setArtist(ArtistId _artist, EnumSet<TrackArtistLinkType> _trackArtistLinkTypes = {}, EnumSet<TrackArtistLinkType> _excludedTrackArtistLinkTypes = {})
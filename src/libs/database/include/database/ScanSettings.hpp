@@ -55,6 +55,7 @@ namespace Database
             Clusters = 0,
             Features,
             None,
+            FeaturesNearestNeighbours,
         };
 
         static void init(Session& session);
@@ -101,6 +101,14 @@ namespace Database {
             std::filesystem::path	path;
         };
 
+        struct ClusterLinks
+        {
+            TrackId								trackId;
+            ReleaseId							releaseId;	// invalid if none
+            std::vector<ClusterId>				clusterIds;
+            std::vector<std::pair<ArtistId, TrackArtistLinkType>>	artistLinks;
+        };
+
         Track() = default;
 
         // Find utility functions
@@ -111,6 +119,10 @@ namespace Database {
         static std::vector<pointer>		findByRecordingMBID(Session& session, const UUID& MBID);
         static std::vector<pointer>		findByMBID(Session& session, const UUID& MBID);
         static RangeResults<TrackId>	findSimilarTrackIds(Session& session, const std::vector<TrackId>& trackIds, std::optional<Range> range = std::nullopt);
+        // Visits at most count tracks whose id is greater than lastRetrievedId, ordered by id. lastRetrievedId is updated
+        static void						findClusterLinks(Session& session, TrackId& lastRetrievedId, std::size_t count, const std::function<void(const ClusterLinks&)>& func);
+        // Visits the release (invalid if none) and the distinct artists of each existing track, in no particular order
+        static void						findReleaseAndArtistIds(Session& session, const std::vector<TrackId>& trackIds, const std::function<void(TrackId, ReleaseId, const std::vector<ArtistId>&)>& func);
 
         static RangeResults<TrackId>	findIds(Session& session, const FindParameters& parameters);
         static RangeResults<pointer>	find(Session& session, const FindParameters& parameters);
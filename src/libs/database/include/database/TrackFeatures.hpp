@@ -19,6 +19,7 @@
 
 #pragma once
 
+#include <functional>
 #include <optional>
 #include <string>
 #include <unordered_map>
@@ -53,6 +54,12 @@ class TrackFeatures final : public Object<TrackFeatures, TrackFeaturesId>
 		static pointer							find(Session& session, TrackFeaturesId id);
 		static pointer							find(Session& session, TrackId trackId);
 		static RangeResults<TrackFeaturesId>	find(Session& session, std::optional<Range> range = std::nullopt);
+		static RangeResults<TrackId>			findTrackIds(Session& session, std::optional<Range> range = std::nullopt);
+		// Visits at most count track features whose id is greater than lastRetrievedId, ordered by id. lastRetrievedId is updated
+		static void								find(Session& session, TrackFeaturesId& lastRetrievedId, std::size_t count, const std::function<void(TrackId trackId, const std::string& jsonEncodedFeatures)>& func);
+
+		// Returns an empty map if the data cannot be parsed
+		static FeatureValuesMap	parseFeatureValuesMap(const std::string& jsonEncodedFeatures, const std::unordered_set<FeatureName>& featureNames);
 
 		FeatureValues		getFeatureValues(const FeatureName& feature) const;
 		FeatureValuesMap	getFeatureValuesMap(const std::unordered_set<FeatureName>& featureNames) const;
@@ -193,6 +193,7 @@ namespace Database
         PendingAdd = 0,
         Synchronized = 1,
         PendingRemove = 2,
+        Rejected = 3,       // cannot be synchronized, never sent again
     };
 
     enum class UserType
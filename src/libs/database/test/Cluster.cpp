@@ -595,6 +595,55 @@ TEST_F(DatabaseFixture, SingleTrackSingleReleaseSingleArtistSingleCluster)
     }
 }
 
+TEST_F(DatabaseFixture, TrackClusterLinks)
+{
+    ScopedTrack track1{ session, "MyTrack1" };
+    ScopedTrack track2{ session, "MyTrack2" };
+    ScopedRelease release{ session, "MyRelease" };
+    ScopedArtist artist{ session, "MyArtist" };
+    ScopedClusterType clusterType{ session, "MyType" };
+    ScopedCluster cluster1{ session, clusterType.lockAndGet(), "MyCluster1" };
+    ScopedCluster cluster2{ session, clusterType.lockAndGet(), "MyCluster2" };
+
+    {
+        auto transaction{ session.createWriteTransaction() };
+
+        TrackArtistLink::create(session, track1.get(), artist.get(), TrackArtistLinkType::Composer);
+        track1.get().modify()->setRelease(release.get());
+        cluster1.get().modify()->addTrack(track1.get());
+        cluster2.get().modify()->addTrack(track1.get());
+        cluster2.get().modify()->addTrack(track2.get());
+    }
+
+    {
+        auto transaction{ session.createReadTransaction() };
+
+        std::vector<Track::ClusterLinks> visitedTracks;
+        TrackId lastRetrievedId;
+        Track::findClusterLinks(session, lastRetrievedId, 1, [&](const Track::ClusterLinks& track) { visitedTracks.push_back(track); });
+        ASSERT_EQ(visitedTracks.size(), 1);
+        EXPECT_EQ(lastRetrievedId, track1.getId());
+        Track::findClusterLinks(session, lastRetrievedId, 10, [&](const Track::ClusterLinks& track) { visitedTracks.push_back(track); });
+        ASSERT_EQ(visitedTracks.size(), 2);
+        EXPECT_EQ(lastRetrievedId, track2.getId());
+        Track::findClusterLinks(session, lastRetrievedId, 10, [&](const Track::ClusterLinks& track) { visitedTracks.push_back(track); });
+        ASSERT_EQ(visitedTracks.size(), 2);
+
+        EXPECT_EQ(visitedTracks[0].trackId, track1.getId());
+        EXPECT_EQ(visitedTracks[0].releaseId, release.getId());
+        EXPECT_EQ(visitedTracks[0].clusterIds.size(), 2);
+        ASSERT_EQ(visitedTracks[0].artistLinks.size(), 1);
+        EXPECT_EQ(visitedTracks[0].artistLinks.front().first, artist.getId());
+        EXPECT_EQ(visitedTracks[0].artistLinks.front().second, TrackArtistLinkType::Composer);
+
+        EXPECT_EQ(visitedTracks[1].trackId, track2.getId());
+        EXPECT_FALSE(visitedTracks[1].releaseId.isValid());
+        ASSERT_EQ(visitedTracks[1].clusterIds.size(), 1);
+        EXPECT_EQ(visitedTracks[1].clusterIds.front(), cluster2.getId());
+        EXPECT_TRUE(visitedTracks[1].artistLinks.empty());
+    }
+}
+
 TEST_F(DatabaseFixture, SingleTrackSingleReleaseSingleArtistMultiClusters)
 {
     ScopedTrack track{ session, "MyTrack" };
@@ -143,6 +143,70 @@ TEST_F(DatabaseFixture, Listen_get_byDateTime)
     }
 }
 
+TEST_F(DatabaseFixture, Listen_find_syncState)
+{
+    ScopedTrack track{ session, "MyTrack" };
+    ScopedUser user{ session, "MyUser" };
+    ScopedUser otherUser{ session, "MyOtherUser" };
+    ScopedListen listen1{ session, user.lockAndGet(), track.lockAndGet(), ScrobblingBackend::ListenBrainz, Wt::WDateTime {Wt::WDate{2000, 1, 2}, Wt::WTime{12, 0, 1}} };
+    ScopedListen listen2{ session, user.lockAndGet(), track.lockAndGet(), ScrobblingBackend::ListenBrainz, Wt::WDateTime {Wt::WDate{2000, 1, 2}, Wt::WTime{12, 0, 2}} };
+    ScopedListen listen3{ session, user.lockAndGet(), track.lockAndGet(), ScrobblingBackend::ListenBrainz, Wt::WDateTime {Wt::WDate{2000, 1, 2}, Wt::WTime{12, 0, 3}} };
+    ScopedListen otherBackendListen{ session, user.lockAndGet(), track.lockAndGet(), ScrobblingBackend::Internal, Wt::WDateTime {Wt::WDate{2000, 1, 2}, Wt::WTime{12, 0, 4}} };
+    ScopedListen otherUserListen{ session, otherUser.lockAndGet(), track.lockAndGet(), ScrobblingBackend::ListenBrainz, Wt::WDateTime {Wt::WDate{2000, 1, 2}, Wt::WTime{12, 0, 5}} };
+
+    auto findPendingListens{ [&](ListenId& lastRetrievedId, std::size_t count)
+    {
+        std::vector<ListenId> res;
+
+        auto transaction{ session.createReadTransaction() };
+        Listen::find(session, user.getId(), ScrobblingBackend::ListenBrainz, SyncState::PendingAdd, lastRetrievedId, count, [&](ListenId listenId, TrackId trackId, const Wt::WDateTime& dateTime)
+            {
+                EXPECT_EQ(trackId, track.getId());
+                EXPECT_TRUE(dateTime.isValid());
+                res.push_back(listenId);
+            });
+
+        return res;
+    } };
+
+    {
+        ListenId lastRetrievedId;
+        std::vector<ListenId> listenIds{ findPendingListens(lastRetrievedId, 2) };
+        ASSERT_EQ(listenIds.size(), 2);
+        EXPECT_EQ(listenIds[0], listen1.getId());
+        EXPECT_EQ(listenIds[1], listen2.getId());
+        EXPECT_EQ(lastRetrievedId, listen2.getId());
+
+        listenIds = findPendingListens(lastRetrievedId, 2);
+        ASSERT_EQ(listenIds.size(), 1);
+        EXPECT_EQ(listenIds[0], listen3.getId());
+
+        EXPECT_TRUE(findPendingListens(lastRetrievedId, 2).empty());
+        EXPECT_EQ(lastRetrievedId, listen3.getId());
+    }
+
+    {
+        auto transaction{ session.createWriteTransaction() };
+        Listen::updateSyncState(session, { listen1.getId(), listen3.getId() }, SyncState::Synchronized);
+    }
+
+    {
+        ListenId lastRetrievedId;
+        const std::vector<ListenId> listenIds{ findPendingListens(lastRetrievedId, 10) };
+        ASSERT_EQ(listenIds.size(), 1);
+        EXPECT_EQ(listenIds[0], listen2.getId());
+    }
+
+    {
+        auto transaction{ session.createReadTransaction() };
+
+        const auto listens{ Listen::find(session, Listen::FindParameters{}.setUser(user->getId()).setScrobblingBackend(ScrobblingBackend::ListenBrainz).setSyncState(SyncState::Synchronized)) };
+        ASSERT_EQ(listens.results.size(), 2);
+        EXPECT_EQ(listens.results[0], listen1.getId());
+        EXPECT_EQ(listens.results[1], listen3.getId());
+    }
+}
+
 TEST_F(DatabaseFixture, Listen_getTopArtists)
 {
     ScopedTrack track1{ session, "MyTrack" };
@@ -454,6 +454,32 @@ TEST_F(DatabaseFixture, Release_writtenAfter)
     }
 }
 
+TEST_F(DatabaseFixture, Release_addedAfter)
+{
+    ScopedRelease release{ session, "MyRelease" };
+    ScopedTrack track{ session, "MyTrack" };
+
+    const Wt::WDateTime dateTime{ Wt::WDate {1950, 1, 1}, Wt::WTime {12, 30, 20} };
+
+    {
+        auto transaction{ session.createWriteTransaction() };
+        track.get().modify()->setAddedTime(dateTime);
+        track.get().modify()->setRelease(release.get());
+    }
+
+    {
+        auto transaction{ session.createReadTransaction() };
+        const auto releases{ Release::findIds(session, Release::FindParameters {}.setAddedAfter(dateTime.addSecs(-1))) };
+        EXPECT_EQ(releases.results.size(), 1);
+    }
+
+    {
+        auto transaction{ session.createReadTransaction() };
+        const auto releases{ Release::findIds(session, Release::FindParameters {}.setAddedAfter(dateTime.addSecs(+1))) };
+        EXPECT_EQ(releases.results.size(), 0);
+    }
+}
+
 TEST_F(DatabaseFixture, Release_artist)
 {
     ScopedRelease release{ session, "MyRelease" };
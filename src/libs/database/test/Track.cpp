@@ -176,3 +176,44 @@ TEST_F(DatabaseFixture, Track_writtenAfter)
     }
 }
 
+TEST_F(DatabaseFixture, Track_findReleaseAndArtistIds)
+{
+    ScopedTrack track1{ session, "MyTrackFile1" };
+    ScopedTrack track2{ session, "MyTrackFile2" };
+    ScopedRelease release{ session, "MyRelease" };
+    ScopedArtist artist1{ session, "MyArtist1" };
+    ScopedArtist artist2{ session, "MyArtist2" };
+
+    {
+        auto transaction{ session.createWriteTransaction() };
+
+        track1.get().modify()->setRelease(release.get());
+        TrackArtistLink::create(session, track1.get(), artist1.get(), TrackArtistLinkType::Artist);
+        TrackArtistLink::create(session, track1.get(), artist1.get(), TrackArtistLinkType::Composer);
+        TrackArtistLink::create(session, track1.get(), artist2.get(), TrackArtistLinkType::Artist);
+    }
+
+    {
+        auto transaction{ session.createReadTransaction() };
+
+        std::size_t visitedTrackCount{};
+        Track::findReleaseAndArtistIds(session, { track1.getId(), track2.getId(), TrackId{ track2.getId().getValue() + 1 } }, [&](TrackId trackId, ReleaseId releaseId, const std::vector<ArtistId>& artistIds)
+            {
+                visitedTrackCount++;
+                if (trackId == track1.getId())
+                {
+                    EXPECT_EQ(releaseId, release.getId());
+                    ASSERT_EQ(artistIds.size(), 2);
+                    EXPECT_TRUE(std::find(std::cbegin(artistIds), std::cend(artistIds), artist1.getId()) != std::cend(artistIds));
+                    EXPECT_TRUE(std::find(std::cbegin(artistIds), std::cend(artistIds), artist2.getId()) != std::cend(artistIds));
+                }
+                else
+                {
+                    EXPECT_EQ(trackId, track2.getId());
+                    EXPECT_FALSE(releaseId.isValid());
+                    EXPECT_TRUE(artistIds.empty());
+                }
+            });
+        EXPECT_EQ(visitedTrackCount, 2);
+    }
+}
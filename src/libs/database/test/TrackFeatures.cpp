@@ -44,5 +44,33 @@ TEST_F(DatabaseFixture, TrackFeatures)
 		auto allTrackFeatures {TrackFeatures::find(session)};
 		ASSERT_EQ(allTrackFeatures.results.size(), 1);
 		EXPECT_EQ(allTrackFeatures.results.front(), trackFeatures.getId());
+
+		auto trackIds {TrackFeatures::findTrackIds(session)};
+		ASSERT_EQ(trackIds.results.size(), 1);
+		EXPECT_EQ(trackIds.results.front(), track.getId());
+
+		TrackFeaturesId lastRetrievedId;
+		std::size_t visitedCount {};
+		TrackFeatures::find(session, lastRetrievedId, 10, [&](TrackId trackId, const std::string& data)
+		{
+			visitedCount++;
+			EXPECT_EQ(trackId, track.getId());
+			EXPECT_EQ(data, "");
+		});
+		EXPECT_EQ(visitedCount, 1);
+		EXPECT_EQ(lastRetrievedId, trackFeatures.getId());
+
+		TrackFeatures::find(session, lastRetrievedId, 10, [&](TrackId, const std::string&) { visitedCount++; });
+		EXPECT_EQ(visitedCount, 1);
 	}
 }
+
+TEST(TrackFeatures, parseFeatureValuesMap)
+{
+	const FeatureValuesMap values {TrackFeatures::parseFeatureValuesMap(R"({"lowlevel": {"average_loudness": 0.5, "erbbands": {"mean": [1, 2, 3]}}})", {"lowlevel.average_loudness", "lowlevel.erbbands.mean"})};
+	ASSERT_EQ(values.size(), 2);
+	EXPECT_EQ(values.at("lowlevel.average_loudness"), FeatureValues {0.5});
+	EXPECT_EQ(values.at("lowlevel.erbbands.mean"), (FeatureValues {1, 2, 3}));
+
+	EXPECT_TRUE(TrackFeatures::parseFeatureValuesMap("not json", {"lowlevel.average_loudness"}).empty());
+}
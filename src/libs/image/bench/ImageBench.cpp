@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) 2023 Emeric Poupon
+ *
+ * This file is part of LMS.
+ *
+ * LMS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LMS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Compares the cover resize and encode pipeline against the other available backends
+// Usage: bench-image [image file] [iteration count]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#define STB_IMAGE_RESIZE_STATIC
+#define STB_IMAGE_RESIZE_IMPLEMENTATION
+#define STBIR_DEFAULT_FILTER_DOWNSAMPLE   STBIR_FILTER_MITCHELL
+#define STBIR_DEFAULT_FILTER_UPSAMPLE   STBIR_FILTER_CATMULLROM
+#include <stb_image_resize.h>
+
+#define STB_IMAGE_WRITE_STATIC
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+#if LMS_BENCH_GM
+#include <Magick++.h>
+#endif
+
+#include "image/IEncodedImage.hpp"
+#include "image/IRawImage.hpp"
+#include "stb/RawImage.hpp"
+#include "stb/Resize.hpp"
+
+namespace
+{
+	struct Pixels
+	{
+		int width {};
+		int height {};
+		std::vector<unsigned char> data;
+	};
+
+	Pixels generatePixels(int width, int height)
+	{
+		// smooth gradients plus some noise, to look a bit like a real picture for the encoder
+		std::mt19937 rng {42};
+		std::uniform_int_distribution<int> noise {-8, 8};
+
+		Pixels pixels {width, height, std::vector<unsigned char>(static_cast<std::size_t>(width) * height * 3)};
+		for (int y {}; y < height; ++y)
+		{
+			for (int x {}; x < width; ++x)
+			{
+				unsigned char* pixel {&pixels.data[(static_cast<std::size_t>(y) * width + x) * 3]};
+				pixel[0] = static_cast<unsigned char>(std::clamp(x * 255 / width + noise(rng), 0, 255));
+				pixel[1] = static_cast<unsigned char>(std::clamp(y * 255 / height + noise(rng), 0, 255));
+				pixel[2] = static_cast<unsigned char>(std::clamp((x + y) * 127 / (width + height) + noise(rng), 0, 255));
+			}
+		}
+
+		return pixels;
+	}
+
+	Pixels loadPixels(const std::string& path)
+	{
+		const std::unique_ptr<Image::IRawImage> image {Image::decodeImage(path)};
+		const auto& stbImage {static_cast<const Image::STB::RawImage&>(*image)};
+
+		Pixels pixels {static_cast<int>(image->getWidth()), static_cast<int>(image->getHeight()), {}};
+		const unsigned char* data {reinterpret_cast<const unsigned char*>(stbImage.getData())};
+		pixels.data.assign(data, data + static_cast<std::size_t>(pixels.width) * pixels.height * 3);
+
+		return pixels;
+	}
+
+	template <typename Func>
+	double measureMs(unsigned iterationCount, Func&& func)
+	{
+		func(); // warm up
+
+		const auto start {std::chrono::steady_clock::now()};
+		for (unsigned i {}; i < iterationCount; ++i)
+			func();
+
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / iterationCount;
+	}
+
+	void benchResize(const Pixels& input, int outputWidth, int outputHeight, unsigned iterationCount)
+	{
+		std::vector<unsigned char> output(static_cast<std::size_t>(outputWidth) * outputHeight * 3);
+
+		const double lmsMs {measureMs(iterationCount, [&]
+		{
+			Image::STB::resizeRGB8(input.data.data(), input.width, input.height, output.data(), outputWidth, outputHeight);
+		})};
+
+		const double stbMs {measureMs(iterationCount, [&]
+		{
+			stbir_resize_uint8_srgb(input.data.data(), input.width, input.height, 0, output.data(), outputWidth, outputHeight, 0, 3, STBIR_ALPHA_CHANNEL_NONE, 0);
+		})};
+
+		std::cout << "resize " << input.width << "x" << input.height << " -> " << outputWidth << "x" << outputHeight
+			<< ": lms " << lmsMs << " ms, stbir " << stbMs << " ms";
+
+#if LMS_BENCH_GM
+		const Magick::Image gmInput {static_cast<unsigned>(input.width), static_cast<unsigned>(input.height), "RGB", Magick::CharPixel, input.data.data()};
+		const double gmMs {measureMs(iterationCount, [&]
+		{
+			Magick::Image image {gmInput};
+			image.resize(Magick::Geometry {static_cast<unsigned>(outputWidth), static_cast<unsigned>(outputHeight)});
+		})};
+		std::cout << ", graphicsmagick " << gmMs << " ms";
+#endif
+		std::cout << std::endl;
+	}
+
+	void benchEncode(const Pixels& input, int outputWidth, unsigned iterationCount)
+	{
+		std::vector<unsigned char> encoded;
+		stbi_write_jpg_to_func([](void* ctx, void* data, int size)
+		{
+			auto& output {*static_cast<std::vector<unsigned char>*>(ctx)};
+			output.insert(std::end(output), static_cast<unsigned char*>(data), static_cast<unsigned char*>(data) + size);
+		}, &encoded, input.width, input.height, 3, input.data.data(), 95);
+
+		std::unique_ptr<Image::IRawImage> image {Image::decodeImage(reinterpret_cast<const std::byte*>(encoded.data()), encoded.size())};
+		image->resize(outputWidth);
+
+		const double lmsMs {measureMs(iterationCount, [&]
+		{
+			image->encodeToJPEG(75);
+		})};
+
+		// previous implementation: buffer grown on each write
+		const auto& stbImage {static_cast<const Image::STB::RawImage&>(*image)};
+		const double growMs {measureMs(iterationCount, [&]
+		{
+			std::vector<std::byte> output;
+			stbi_write_jpg_to_func([](void* ctx, void* data, int size)
+			{
+				auto& output {*static_cast<std::vector<std::byte>*>(ctx)};
+				const std::size_t currentOutputSize {output.size()};
+				output.resize(currentOutputSize + size);
+				std::copy(static_cast<const std::byte*>(data), static_cast<const std::byte*>(data) + size, output.data() + currentOutputSize);
+			}, &output, image->getWidth(), image->getHeight(), 3, stbImage.getData(), 75);
+		})};
+
+		std::cout << "encode jpeg " << image->getWidth() << "x" << image->getHeight() << ": lms " << lmsMs << " ms, growing buffer " << growMs << " ms" << std::endl;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	try
+	{
+		const Pixels input {argc > 1 ? loadPixels(argv[1]) : generatePixels(1400, 1400)};
+		const unsigned iterationCount {argc > 2 ? static_cast<unsigned>(std::stoul(argv[2])) : 20};
+
+#if LMS_BENCH_GM
+		Magick::InitializeMagick(nullptr);
+#endif
+
+		std::cout << std::fixed << std::setprecision(3);
+		for (const int size : {128, 256, 512, 1024})
+		{
+			const int outputHeight {static_cast<int>(static_cast<float>(size) / input.width * input.height)};
+			benchResize(input, size, std::max(1, outputHeight), iterationCount);
+		}
+		for (const int size : {128, 512})
+			benchEncode(input, size, iterationCount);
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "Caught exception: " << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
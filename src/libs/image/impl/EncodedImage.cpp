@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2023 Emeric Poupon
+ *
+ * This file is part of LMS.
+ *
+ * LMS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LMS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "EncodedImage.hpp"
+
+namespace Image
+{
+	std::unique_ptr<IEncodedImage> createEncodedImage(std::vector<std::byte> encodedData, std::string_view mimeType)
+	{
+		return std::make_unique<EncodedImage>(std::move(encodedData), mimeType);
+	}
+
+	EncodedImage::EncodedImage(std::vector<std::byte> data, std::string_view mimeType)
+		: _data {std::move(data)}
+		, _mimeType {mimeType}
+	{
+	}
+
+	const std::byte*
+	EncodedImage::getData() const
+	{
+		if (_data.empty())
+			return nullptr;
+
+		return _data.data();
+	}
+
+	std::size_t
+	EncodedImage::getDataSize() const
+	{
+		return _data.size();
+	}
+}
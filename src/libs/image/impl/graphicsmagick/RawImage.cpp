@@ -22,19 +22,20 @@
 #include <magick/resource.h>
 
 #include "JPEGImage.hpp"
+#include "WebPImage.hpp"
 #include "image/Exception.hpp"
 #include "utils/ILogger.hpp"
 
 namespace Image
 {
-	std::unique_ptr<IRawImage> decodeImage(const std::byte* encodedData, std::size_t encodedDataSize)
+	std::unique_ptr<IRawImage> decodeImage(const std::byte* encodedData, std::size_t encodedDataSize, std::optional<ImageSize> targetSize)
 	{
-		return std::make_unique<GraphicsMagick::RawImage>(encodedData, encodedDataSize);
+		return std::make_unique<GraphicsMagick::RawImage>(encodedData, encodedDataSize, targetSize);
 	}
 
-	std::unique_ptr<IRawImage> decodeImage(const std::filesystem::path& path)
+	std::unique_ptr<IRawImage> decodeImage(const std::filesystem::path& path, std::optional<ImageSize> targetSize)
 	{
-		return std::make_unique<GraphicsMagick::RawImage>(path);
+		return std::make_unique<GraphicsMagick::RawImage>(path, targetSize);
 	}
 
 	void
@@ -53,16 +54,38 @@ namespace Image
 
 		LMS_LOG(COVER, INFO, "Magick threads resource limit = " << GetMagickResourceLimit(MagickLib::ThreadsResource));
 		LMS_LOG(COVER, INFO, "Magick Disk resource limit = " << GetMagickResourceLimit(MagickLib::DiskResource));
+		LMS_LOG(COVER, INFO, "Magick WebP encoding support = " << isWebPEncodingSupported());
+	}
+
+	bool
+	isWebPEncodingSupported()
+	{
+		// depends on the delegates GraphicsMagick has been built with
+		static const bool isSupported {[]
+		{
+			try
+			{
+				return Magick::CoderInfo {"WEBP"}.isWritable();
+			}
+			catch (Magick::Exception&)
+			{
+				return false;
+			}
+		}()};
+
+		return isSupported;
 	}
 }
 
 namespace Image::GraphicsMagick
 {
 
-RawImage::RawImage(const std::byte* encodedData, std::size_t encodedDataSize)
+RawImage::RawImage(const std::byte* encodedData, std::size_t encodedDataSize, std::optional<ImageSize> targetSize)
 {
 	try
 	{
+		setSizeHint(targetSize);
+
 		Magick::Blob blob {encodedData, encodedDataSize};
 		_image.read(blob);
 	}
@@ -82,10 +105,12 @@ RawImage::RawImage(const std::byte* encodedData, std::size_t encodedDataSize)
 	}
 }
 
-RawImage::RawImage(const std::filesystem::path& p)
+RawImage::RawImage(const std::filesystem::path& p, std::optional<ImageSize> targetSize)
 {
 	try
 	{
+		setSizeHint(targetSize);
+
 		_image.read(p.string().c_str());
 	}
 	catch (Magick::WarningCoder& e)
@@ -104,6 +129,27 @@ RawImage::RawImage(const std::filesystem::path& p)
 	}
 }
 
+void
+RawImage::setSizeHint(std::optional<ImageSize> targetSize)
+{
+	// The JPEG coder uses the size hint to decode at a reduced resolution (DCT scaling)
+	// The decoded image is at least as large as the hint
+	if (targetSize)
+		_image.size(Magick::Geometry {static_cast<unsigned int>(*targetSize), static_cast<unsigned int>(*targetSize)});
+}
+
+ImageSize
+RawImage::getWidth() const
+{
+	return _image.columns();
+}
+
+ImageSize
+RawImage::getHeight() const
+{
+	return _image.rows();
+}
+
 void
 RawImage::resize(ImageSize width)
 {
@@ -124,6 +170,12 @@ RawImage::encodeToJPEG(unsigned quality) const
 	return std::make_unique<JPEGImage>(*this, quality);
 }
 
+std::unique_ptr<IEncodedImage>
+RawImage::encodeToWebP(unsigned quality) const
+{
+	return std::make_unique<WebPImage>(*this, quality);
+}
+
 Magick::Image
 RawImage::getMagickImage() const
 {
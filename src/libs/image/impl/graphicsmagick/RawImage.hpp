@@ -27,6 +27,7 @@
 
 #include <cstddef>
 #include <filesystem>
+#include <optional>
 
 #include "image/IEncodedImage.hpp"
 #include "image/IRawImage.hpp"
@@ -36,14 +37,21 @@ namespace Image::GraphicsMagick
 	class RawImage : public IRawImage
 	{
 		public:
-			RawImage(const std::byte* encodedData, std::size_t encodedDataSize);
-			RawImage(const std::filesystem::path& path);
+			RawImage(const std::byte* encodedData, std::size_t encodedDataSize, std::optional<ImageSize> targetSize = std::nullopt);
+			RawImage(const std::filesystem::path& path, std::optional<ImageSize> targetSize = std::nullopt);
+
+			ImageSize getWidth() const override;
+			ImageSize getHeight() const override;
 
 			void resize(ImageSize width) override;
 			std::unique_ptr<IEncodedImage> encodeToJPEG(unsigned quality) const override;
+			std::unique_ptr<IEncodedImage> encodeToWebP(unsigned quality) const override;
 
 		private:
 			friend class JPEGImage;
+			friend class WebPImage;
+			void setSizeHint(std::optional<ImageSize> targetSize);
+
 			Magick::Image getMagickImage() const;
 
 			Magick::Image _image;
@@ -27,16 +27,27 @@
 
 namespace Image::STB
 {
+	namespace
+	{
+		std::size_t estimateEncodedSize(ImageSize width, ImageSize height, unsigned quality)
+		{
+			// roughly 1 byte per pixel at high quality, much less at usual qualities
+			const std::size_t bytesPerHundredPixels {quality >= 90 ? 100u : (quality >= 75 ? 40u : 25u)};
+			return 1024 + width * height * bytesPerHundredPixels / 100;
+		}
+	}
+
 	JPEGImage::JPEGImage(const RawImage& rawImage, unsigned quality)
 	{
 		auto writeCb {[](void* ctx, void* writeData, int writeSize)
 		{
 			auto& output {*reinterpret_cast<std::vector<std::byte>*>(ctx)};
-			const std::size_t currentOutputSize {output.size()};
-			output.resize(currentOutputSize + writeSize);
-			std::copy(reinterpret_cast<const std::byte*>(writeData), reinterpret_cast<const std::byte*>(writeData) + writeSize, output.data() + currentOutputSize);
+			output.insert(std::end(output), reinterpret_cast<const std::byte*>(writeData), reinterpret_cast<const std::byte*>(writeData) + writeSize);
 		}};
 
+		// stb writes in small chunks: reserve enough for most covers to avoid reallocations and copies
+		_data.reserve(estimateEncodedSize(rawImage.getWidth(), rawImage.getHeight(), quality));
+
 		if (stbi_write_jpg_to_func(writeCb, &_data, rawImage.getWidth(), rawImage.getHeight(), 3, rawImage.getData(), quality) == 0)
 		{
 			_data.clear();
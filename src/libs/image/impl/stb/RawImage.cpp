@@ -19,55 +19,124 @@
 
 #include "RawImage.hpp"
 
-#define STB_IMAGE_IMPLEMENTATION
-#define STB_IMAGE_RESIZE_IMPLEMENTATION
-
-#define STBIR_DEFAULT_FILTER_DOWNSAMPLE   STBIR_FILTER_MITCHELL
-#define STBIR_DEFAULT_FILTER_UPSAMPLE   STBIR_FILTER_CATMULLROM
+#include <fstream>
+#include <vector>
 
+#define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
-#include <stb_image_resize.h>
 
 #include "JPEGImage.hpp"
+#include "Resize.hpp"
+#if LMS_SUPPORT_IMAGE_LIBJPEG
+#include "ScaledJPEGDecoder.hpp"
+#endif
+#if LMS_SUPPORT_IMAGE_WEBP
+#include "WebPImage.hpp"
+#endif
 
 #include "image/Exception.hpp"
 
 namespace Image
 {
-	std::unique_ptr<IRawImage> decodeImage(const std::byte* encodedData, std::size_t encodedDataSize)
+	std::unique_ptr<IRawImage> decodeImage(const std::byte* encodedData, std::size_t encodedDataSize, std::optional<ImageSize> targetSize)
 	{
-		return std::make_unique<STB::RawImage>(encodedData, encodedDataSize);
+		return std::make_unique<STB::RawImage>(encodedData, encodedDataSize, targetSize);
 	}
 
-	std::unique_ptr<IRawImage> decodeImage(const std::filesystem::path& path)
+	std::unique_ptr<IRawImage> decodeImage(const std::filesystem::path& path, std::optional<ImageSize> targetSize)
 	{
-		return std::make_unique<STB::RawImage>(path);
+		return std::make_unique<STB::RawImage>(path, targetSize);
 	}
 
 	void
 	init(const std::filesystem::path&)
 	{
 	}
+
+	bool
+	isWebPEncodingSupported()
+	{
+#if LMS_SUPPORT_IMAGE_WEBP
+		return true;
+#else
+		return false;
+#endif
+	}
 }
 
 namespace Image::STB
 {
-	RawImage::RawImage(const std::byte* encodedData, std::size_t encodedDataSize)
+	RawImage::RawImage(const std::byte* encodedData, std::size_t encodedDataSize, std::optional<ImageSize> targetSize)
 	{
+		if (targetSize && tryDecodeScaledJPEG(encodedData, encodedDataSize, *targetSize))
+			return;
+
 		int n;
 		_data = UniquePtrFree {stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(encodedData), encodedDataSize, &_width, &_height, &n, 3), std::free};
 		if (!_data)
 			throw ImageException {"Cannot load image from memory"};
 	}
 
-	RawImage::RawImage(const std::filesystem::path& p)
+	RawImage::RawImage(const std::filesystem::path& p, std::optional<ImageSize> targetSize)
 	{
+#if LMS_SUPPORT_IMAGE_LIBJPEG
+		if (targetSize)
+		{
+			std::ifstream ifs {p, std::ios_base::binary | std::ios_base::ate};
+			if (ifs)
+			{
+				std::vector<std::byte> encodedData(static_cast<std::size_t>(ifs.tellg()));
+				ifs.seekg(0);
+				ifs.read(reinterpret_cast<char*>(encodedData.data()), encodedData.size());
+				if (ifs)
+				{
+					if (tryDecodeScaledJPEG(encodedData.data(), encodedData.size(), *targetSize))
+						return;
+
+					// Not a JPEG or not scalable: decode the buffer already read instead of reading the file again
+					int n;
+					_data = UniquePtrFree {stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(encodedData.data()), encodedData.size(), &_width, &_height, &n, 3), std::free};
+					if (!_data)
+						throw ImageException {"Cannot load image from memory"};
+
+					return;
+				}
+			}
+		}
+#else
+		(void)targetSize;
+#endif
+
 		int n;
 		_data = UniquePtrFree {stbi_load(p.string().c_str(), &_width, &_height, &n, 3), std::free};
 		if (!_data)
 			throw ImageException {"Cannot load image from memory"};
 	}
 
+	bool
+	RawImage::tryDecodeScaledJPEG(const std::byte* encodedData, std::size_t encodedDataSize, ImageSize targetSize)
+	{
+#if LMS_SUPPORT_IMAGE_LIBJPEG
+		if (!isJPEG(encodedData, encodedDataSize))
+			return false;
+
+		std::optional<ScaledJPEG> scaledJPEG {decodeScaledJPEG(encodedData, encodedDataSize, targetSize)};
+		if (!scaledJPEG)
+			return false; // fallback on stb
+
+		_data = UniquePtrFree {scaledJPEG->data.release(), std::free};
+		_width = scaledJPEG->width;
+		_height = scaledJPEG->height;
+
+		return true;
+#else
+		(void)encodedData;
+		(void)encodedDataSize;
+		(void)targetSize;
+		return false;
+#endif
+	}
+
 	void
 	RawImage::resize(ImageSize width)
 	{
@@ -90,12 +159,7 @@ namespace Image::STB
 		if (!resizedData)
 			throw ImageException {"Cannot allocate memory for resized image!"};
 
-		if (stbir_resize_uint8_srgb(reinterpret_cast<const unsigned char*>(_data.get()), _width, _height, 0,
-					reinterpret_cast<unsigned char*>(resizedData.get()), width, height, 0,
-					3, STBIR_ALPHA_CHANNEL_NONE, 0) == 0)
-		{
-			throw ImageException {"Failed to resize image!"};
-		}
+		resizeRGB8(_data.get(), _width, _height, resizedData.get(), width, height);
 
 		_data = std::move(resizedData);
 		_height = height;
@@ -108,6 +172,17 @@ namespace Image::STB
 		return std::make_unique<JPEGImage>(*this, quality);
 	}
 
+	std::unique_ptr<IEncodedImage>
+	RawImage::encodeToWebP(unsigned quality) const
+	{
+#if LMS_SUPPORT_IMAGE_WEBP
+		return std::make_unique<WebPImage>(*this, quality);
+#else
+		(void)quality;
+		throw ImageException {"WebP encoding not supported!"};
+#endif
+	}
+
 	ImageSize
 	RawImage::getWidth() const
 	{
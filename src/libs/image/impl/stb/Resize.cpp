@@ -0,0 +1,335 @@
+/*
+ * Copyright (C) 2023 Emeric Poupon
+ *
+ * This file is part of LMS.
+ *
+ * LMS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LMS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Resize.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LMS_IMAGE_RESIZE_X86 1
+#include <immintrin.h>
+#endif
+
+#include "image/Exception.hpp"
+
+namespace Image::STB
+{
+	namespace
+	{
+		constexpr std::size_t channelCount {3};
+		constexpr std::size_t linearToSRGBTableSize {16384};
+
+		struct ColorTables
+		{
+			ColorTables()
+			{
+				for (std::size_t i {}; i < sRGBToLinear.size(); ++i)
+				{
+					const float c {static_cast<float>(i) / 255.f};
+					sRGBToLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+				}
+
+				for (std::size_t i {}; i < linearToSRGB.size(); ++i)
+				{
+					const float l {static_cast<float>(i) / (linearToSRGB.size() - 1)};
+					const float c {l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.f / 2.4f) - 0.055f};
+					linearToSRGB[i] = static_cast<unsigned char>(std::clamp(c * 255.f + 0.5f, 0.f, 255.f));
+				}
+			}
+
+			std::array<float, 256> sRGBToLinear;
+			std::array<unsigned char, linearToSRGBTableSize> linearToSRGB;
+		};
+
+		const ColorTables& getColorTables()
+		{
+			static const ColorTables tables;
+			return tables;
+		}
+
+		// Mitchell-Netravali family of cubic filters
+		float cubicFilter(float x, float b, float c)
+		{
+			x = std::abs(x);
+			if (x < 1.f)
+				return ((12.f - 9.f * b - 6.f * c) * x * x * x + (-18.f + 12.f * b + 6.f * c) * x * x + (6.f - 2.f * b)) / 6.f;
+			if (x < 2.f)
+				return ((-b - 6.f * c) * x * x * x + (6.f * b + 30.f * c) * x * x + (-12.f * b - 48.f * c) * x + (8.f * b + 24.f * c)) / 6.f;
+
+			return 0.f;
+		}
+
+		// Weights of the input pixels that contribute to each output pixel, along one axis
+		struct Contributions
+		{
+			struct Contributor
+			{
+				int first;
+				int count;
+				std::size_t weightOffset;
+			};
+
+			std::vector<Contributor> contributors;
+			std::vector<float> weights;
+		};
+
+		Contributions computeContributions(int inputSize, int outputSize)
+		{
+			const float scale {static_cast<float>(outputSize) / inputSize};
+			const bool downsample {scale < 1.f};
+			const float b {downsample ? 1.f / 3.f : 0.f};
+			const float c {downsample ? 1.f / 3.f : 0.5f};
+			// when downsampling, the filter is stretched so that all the input pixels contribute
+			const float filterScale {downsample ? scale : 1.f};
+			const float support {2.f / filterScale};
+
+			Contributions res;
+			res.contributors.reserve(outputSize);
+			for (int i {}; i < outputSize; ++i)
+			{
+				const float center {(i + 0.5f) / scale};
+				const int first {std::max(0, static_cast<int>(std::floor(center - support)))};
+				const int last {std::min(inputSize - 1, static_cast<int>(std::ceil(center + support)))};
+
+				const std::size_t weightOffset {res.weights.size()};
+				float total {};
+				for (int j {first}; j <= last; ++j)
+				{
+					const float weight {cubicFilter((j + 0.5f - center) * filterScale, b, c)};
+					res.weights.push_back(weight);
+					total += weight;
+				}
+
+				// edges are clamped: renormalize what remains of the filter
+				if (total != 0.f)
+				{
+					for (std::size_t j {weightOffset}; j < res.weights.size(); ++j)
+						res.weights[j] /= total;
+				}
+
+				res.contributors.push_back({first, last - first + 1, weightOffset});
+			}
+
+			return res;
+		}
+
+		// Input and output rows must have one extra float at the end: SIMD kernels load and store 4 floats per pixel
+		using ResizeRowKernel = void(*)(const float* input, float* output, const Contributions& contributions);
+		using AccumulateRowKernel = void(*)(float* accumulator, const float* row, float weight, std::size_t count);
+		using RowToSRGBKernel = void(*)(const float* input, unsigned char* output, std::size_t count, const unsigned char* table);
+
+		void resizeRowScalar(const float* input, float* output, const Contributions& contributions)
+		{
+			for (const Contributions::Contributor& contributor : contributions.contributors)
+			{
+				const float* weights {&contributions.weights[contributor.weightOffset]};
+				const float* pixel {input + contributor.first * channelCount};
+
+				float r {};
+				float g {};
+				float b {};
+				for (int k {}; k < contributor.count; ++k, pixel += channelCount)
+				{
+					r += weights[k] * pixel[0];
+					g += weights[k] * pixel[1];
+					b += weights[k] * pixel[2];
+				}
+
+				output[0] = r;
+				output[1] = g;
+				output[2] = b;
+				output += channelCount;
+			}
+		}
+
+		void accumulateRowScalar(float* accumulator, const float* row, float weight, std::size_t count)
+		{
+			for (std::size_t i {}; i < count; ++i)
+				accumulator[i] += weight * row[i];
+		}
+
+		void rowToSRGBScalar(const float* input, unsigned char* output, std::size_t count, const unsigned char* table)
+		{
+			for (std::size_t i {}; i < count; ++i)
+			{
+				const float value {std::clamp(input[i], 0.f, 1.f)};
+				output[i] = table[static_cast<std::size_t>(value * (linearToSRGBTableSize - 1) + 0.5f)];
+			}
+		}
+
+#if LMS_IMAGE_RESIZE_X86
+		__attribute__((target("sse2")))
+		void resizeRowSSE(const float* input, float* output, const Contributions& contributions)
+		{
+			for (const Contributions::Contributor& contributor : contributions.contributors)
+			{
+				const float* weights {&contributions.weights[contributor.weightOffset]};
+				const float* pixel {input + contributor.first * channelCount};
+
+				__m128 acc {_mm_setzero_ps()};
+				for (int k {}; k < contributor.count; ++k, pixel += channelCount)
+					acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(pixel), _mm_set1_ps(weights[k])));
+
+				// the 4th lane is overwritten by the next pixel
+				_mm_storeu_ps(output, acc);
+				output += channelCount;
+			}
+		}
+
+		__attribute__((target("sse2")))
+		void accumulateRowSSE(float* accumulator, const float* row, float weight, std::size_t count)
+		{
+			const __m128 w {_mm_set1_ps(weight)};
+
+			std::size_t i {};
+			for (; i + 4 <= count; i += 4)
+				_mm_storeu_ps(accumulator + i, _mm_add_ps(_mm_loadu_ps(accumulator + i), _mm_mul_ps(_mm_loadu_ps(row + i), w)));
+			for (; i < count; ++i)
+				accumulator[i] += weight * row[i];
+		}
+
+		__attribute__((target("avx2")))
+		void accumulateRowAVX2(float* accumulator, const float* row, float weight, std::size_t count)
+		{
+			const __m256 w {_mm256_set1_ps(weight)};
+
+			std::size_t i {};
+			for (; i + 8 <= count; i += 8)
+				_mm256_storeu_ps(accumulator + i, _mm256_add_ps(_mm256_loadu_ps(accumulator + i), _mm256_mul_ps(_mm256_loadu_ps(row + i), w)));
+			for (; i < count; ++i)
+				accumulator[i] += weight * row[i];
+		}
+
+		__attribute__((target("sse2")))
+		void rowToSRGBSSE(const float* input, unsigned char* output, std::size_t count, const unsigned char* table)
+		{
+			const __m128 zero {_mm_setzero_ps()};
+			const __m128 scale {_mm_set1_ps(static_cast<float>(linearToSRGBTableSize - 1))};
+
+			alignas(16) std::int32_t indexes[4];
+			std::size_t i {};
+			for (; i + 4 <= count; i += 4)
+			{
+				const __m128 value {_mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(input + i), zero), _mm_set1_ps(1.f)), scale)};
+				_mm_store_si128(reinterpret_cast<__m128i*>(indexes), _mm_cvtps_epi32(value));
+
+				output[i] = table[indexes[0]];
+				output[i + 1] = table[indexes[1]];
+				output[i + 2] = table[indexes[2]];
+				output[i + 3] = table[indexes[3]];
+			}
+			rowToSRGBScalar(input + i, output + i, count - i, table);
+		}
+#endif // LMS_IMAGE_RESIZE_X86
+
+		struct Kernels
+		{
+			ResizeRowKernel resizeRow {resizeRowScalar};
+			AccumulateRowKernel accumulateRow {accumulateRowScalar};
+			RowToSRGBKernel rowToSRGB {rowToSRGBScalar};
+		};
+
+		Kernels selectKernels()
+		{
+			Kernels kernels;
+
+#if LMS_IMAGE_RESIZE_X86
+			__builtin_cpu_init();
+			if (__builtin_cpu_supports("sse2"))
+			{
+				kernels.resizeRow = resizeRowSSE;
+				kernels.accumulateRow = accumulateRowSSE;
+				kernels.rowToSRGB = rowToSRGBSSE;
+			}
+			if (__builtin_cpu_supports("avx2"))
+				kernels.accumulateRow = accumulateRowAVX2;
+#endif
+
+			return kernels;
+		}
+
+		const Kernels& getKernels()
+		{
+			static const Kernels kernels {selectKernels()};
+			return kernels;
+		}
+	}
+
+	void
+	resizeRGB8(const unsigned char* input, int inputWidth, int inputHeight, unsigned char* output, int outputWidth, int outputHeight)
+	{
+		if (inputWidth <= 0 || inputHeight <= 0 || outputWidth <= 0 || outputHeight <= 0)
+			throw ImageException {"Bad image size!"};
+
+		const std::size_t inputRowSize {static_cast<std::size_t>(inputWidth) * channelCount};
+		const std::size_t outputRowSize {static_cast<std::size_t>(outputWidth) * channelCount};
+
+		if (inputWidth == outputWidth && inputHeight == outputHeight)
+		{
+			std::memcpy(output, input, inputRowSize * inputHeight);
+			return;
+		}
+
+		const ColorTables& tables {getColorTables()};
+		const Kernels& kernels {getKernels()};
+		const Contributions horizontalContributions {computeContributions(inputWidth, outputWidth)};
+		const Contributions verticalContributions {computeContributions(inputHeight, outputHeight)};
+
+		// Horizontal pass first, in linear light: the intermediate rows are as narrow as the output
+		// Only the rows the vertical filter currently covers are kept, in a ring buffer
+		std::size_t ringRowCount {1};
+		for (const Contributions::Contributor& contributor : verticalContributions.contributors)
+			ringRowCount = std::max(ringRowCount, static_cast<std::size_t>(contributor.count));
+
+		const std::size_t ringRowStride {outputRowSize + 1}; // SIMD kernels write one extra float past the row end
+		std::vector<float> ringRows(ringRowStride * ringRowCount);
+		auto getIntermediateRow {[&](int y) { return &ringRows[(y % ringRowCount) * ringRowStride]; }};
+
+		std::vector<float> linearRow(inputRowSize + 1);
+		int nextInputRow {};
+
+		// Vertical pass: each output row is a weighted sum of contiguous intermediate rows
+		// Contributors only move forward, so the intermediate rows are computed as needed, in order
+		std::vector<float> accumulator(outputRowSize);
+		for (int y {}; y < outputHeight; ++y)
+		{
+			const Contributions::Contributor& contributor {verticalContributions.contributors[y]};
+
+			for (; nextInputRow < contributor.first + contributor.count; ++nextInputRow)
+			{
+				const unsigned char* inputRow {input + nextInputRow * inputRowSize};
+				for (std::size_t i {}; i < inputRowSize; ++i)
+					linearRow[i] = tables.sRGBToLinear[inputRow[i]];
+
+				kernels.resizeRow(linearRow.data(), getIntermediateRow(nextInputRow), horizontalContributions);
+			}
+
+			std::fill(std::begin(accumulator), std::end(accumulator), 0.f);
+			for (int k {}; k < contributor.count; ++k)
+				kernels.accumulateRow(accumulator.data(), getIntermediateRow(contributor.first + k), verticalContributions.weights[contributor.weightOffset + k], outputRowSize);
+
+			kernels.rowToSRGB(accumulator.data(), output + y * outputRowSize, outputRowSize, tables.linearToSRGB.data());
+		}
+	}
+}
@@ -0,0 +1,32 @@
+/*
+ * Copyright (C) 2023 Emeric Poupon
+ *
+ * This file is part of LMS.
+ *
+ * LMS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LMS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifndef LMS_SUPPORT_IMAGE_STB
+#error "Bad configuration"
+#endif
+
+namespace Image::STB
+{
+	// Resizes packed 8-bit RGB pixels using separable cubic filters (Mitchell when downsampling, Catmull-Rom when upsampling)
+	// Filtering is done in linear light, like stbir_resize_uint8_srgb does
+	// Uses SSE kernels (and an AVX2 one for the vertical pass) when available at runtime, and falls back on scalar code otherwise
+	void resizeRGB8(const unsigned char* input, int inputWidth, int inputHeight, unsigned char* output, int outputWidth, int outputHeight);
+}
@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2023 Emeric Poupon
+ *
+ * This file is part of LMS.
+ *
+ * LMS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LMS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ScaledJPEGDecoder.hpp"
+
+#include <algorithm>
+#include <csetjmp>
+#include <cstdio>
+
+#include <jpeglib.h>
+
+#include "utils/ILogger.hpp"
+
+namespace Image::STB
+{
+	namespace
+	{
+		struct ErrorManager
+		{
+			jpeg_error_mgr pub;
+			std::jmp_buf jmpBuffer;
+		};
+
+		void errorExit(j_common_ptr cinfo)
+		{
+			char message[JMSG_LENGTH_MAX];
+			(*cinfo->err->format_message)(cinfo, message);
+			LMS_LOG(COVER, DEBUG, "libjpeg error: " << message);
+
+			std::longjmp(reinterpret_cast<ErrorManager*>(cinfo->err)->jmpBuffer, 1);
+		}
+
+		void outputMessage(j_common_ptr)
+		{
+			// silence warnings on corrupted data
+		}
+
+		// no object with a non trivial destructor must live in this function, because of longjmp
+		bool decode(const std::byte* encodedData, std::size_t encodedDataSize, ImageSize targetSize, unsigned char*& pixels, int& width, int& height)
+		{
+			jpeg_decompress_struct cinfo;
+			ErrorManager errorManager;
+
+			cinfo.err = jpeg_std_error(&errorManager.pub);
+			errorManager.pub.error_exit = errorExit;
+			errorManager.pub.output_message = outputMessage;
+
+			if (setjmp(errorManager.jmpBuffer))
+			{
+				jpeg_destroy_decompress(&cinfo);
+				std::free(pixels);
+				pixels = nullptr;
+				return false;
+			}
+
+			jpeg_create_decompress(&cinfo);
+			jpeg_mem_src(&cinfo, const_cast<unsigned char*>(reinterpret_cast<const unsigned char*>(encodedData)), encodedDataSize);
+			jpeg_read_header(&cinfo, TRUE);
+
+			cinfo.out_color_space = JCS_RGB;
+			cinfo.scale_num = 1;
+			cinfo.scale_denom = computeScaleDenom(cinfo.image_width, cinfo.image_height, targetSize);
+
+			jpeg_start_decompress(&cinfo);
+
+			const std::size_t rowStride {static_cast<std::size_t>(cinfo.output_width) * cinfo.output_components};
+			pixels = static_cast<unsigned char*>(std::malloc(rowStride * cinfo.output_height));
+			if (!pixels || cinfo.output_components != 3)
+			{
+				jpeg_destroy_decompress(&cinfo);
+				std::free(pixels);
+				pixels = nullptr;
+				return false;
+			}
+
+			while (cinfo.output_scanline < cinfo.output_height)
+			{
+				JSAMPROW row {pixels + cinfo.output_scanline * rowStride};
+				jpeg_read_scanlines(&cinfo, &row, 1);
+			}
+
+			width = cinfo.output_width;
+			height = cinfo.output_height;
+
+			jpeg_finish_decompress(&cinfo);
+			jpeg_destroy_decompress(&cinfo);
+
+			return true;
+		}
+	}
+
+	bool isJPEG(const std::byte* encodedData, std::size_t encodedDataSize)
+	{
+		return encodedDataSize >= 3
+			&& encodedData[0] == std::byte {0xFF}
+			&& encodedData[1] == std::byte {0xD8}
+			&& encodedData[2] == std::byte {0xFF};
+	}
+
+	unsigned computeScaleDenom(ImageSize width, ImageSize height, ImageSize targetSize)
+	{
+		const ImageSize size {std::max(width, height)};
+
+		for (unsigned scaleDenom : {8, 4, 2})
+		{
+			// libjpeg rounds up the scaled dimensions
+			if ((size + scaleDenom - 1) / scaleDenom >= targetSize)
+				return scaleDenom;
+		}
+
+		return 1;
+	}
+
+	std::optional<ScaledJPEG> decodeScaledJPEG(const std::byte* encodedData, std::size_t encodedDataSize, ImageSize targetSize)
+	{
+		unsigned char* pixels {};
+		int width {};
+		int height {};
+
+		if (!decode(encodedData, encodedDataSize, targetSize, pixels, width, height))
+			return std::nullopt;
+
+		ScaledJPEG res;
+		res.data = ScaledJPEG::UniquePtrFree {pixels, std::free};
+		res.width = width;
+		res.height = height;
+
+		return res;
+	}
+}
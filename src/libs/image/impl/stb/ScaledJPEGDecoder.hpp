@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2023 Emeric Poupon
+ *
+ * This file is part of LMS.
+ *
+ * LMS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LMS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifndef LMS_SUPPORT_IMAGE_LIBJPEG
+#error "Bad configuration"
+#endif
+
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+#include <optional>
+
+#include "image/IEncodedImage.hpp"
+
+namespace Image::STB
+{
+	// Uses libjpeg DCT scaling to directly decode JPEG images at 1/2, 1/4 or 1/8 of their size
+	// This is much cheaper than decoding at full resolution and then resizing
+	struct ScaledJPEG
+	{
+		using UniquePtrFree = std::unique_ptr<unsigned char, decltype(&std::free)>;
+
+		UniquePtrFree data {nullptr, std::free}; // RGB pixels
+		int width {};
+		int height {};
+	};
+
+	bool isJPEG(const std::byte* encodedData, std::size_t encodedDataSize);
+
+	// Picks the largest scale so that the largest side of the decoded image is still at least targetSize
+	unsigned computeScaleDenom(ImageSize width, ImageSize height, ImageSize targetSize);
+
+	std::optional<ScaledJPEG> decodeScaledJPEG(const std::byte* encodedData, std::size_t encodedDataSize, ImageSize targetSize);
+}
@@ -20,12 +20,20 @@
 #pragma once
 
 #include <cstddef>
+#include <memory>
 #include <string_view>
+#include <vector>
 
 namespace Image
 {
 	using ImageSize = std::size_t;
 
+	enum class EncodingFormat
+	{
+		JPEG,
+		WebP,
+	};
+
 	class IEncodedImage
 	{
 		public:
@@ -36,5 +44,8 @@ namespace Image
 			virtual std::string_view getMimeType() const = 0;
 	};
 
+	// Wraps already encoded data (ex: read back from a cache)
+	std::unique_ptr<IEncodedImage> createEncodedImage(std::vector<std::byte> encodedData, std::string_view mimeType);
+
 } // namespace Cover
 
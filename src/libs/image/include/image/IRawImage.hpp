@@ -21,6 +21,7 @@
 
 #include <filesystem>
 #include <memory>
+#include <optional>
 
 #include "image/IEncodedImage.hpp"
 
@@ -30,12 +31,20 @@ namespace Image
 	{
 		public:
 			virtual ~IRawImage() = default;
+
+			virtual ImageSize getWidth() const = 0;
+			virtual ImageSize getHeight() const = 0;
+
 			virtual void resize(ImageSize width) = 0;
 			virtual std::unique_ptr<IEncodedImage> encodeToJPEG(unsigned quality) const = 0;
+			virtual std::unique_ptr<IEncodedImage> encodeToWebP(unsigned quality) const = 0; // throws if WebP encoding is not supported
 	};
 
 	void init(const std::filesystem::path& path);
-	std::unique_ptr<IRawImage> decodeImage(const std::byte* encodedData, std::size_t encodedDataSize);
-	std::unique_ptr<IRawImage> decodeImage(const std::filesystem::path& path);
+	bool isWebPEncodingSupported();
+
+	// If targetSize is set, the image may be decoded at a reduced resolution (but its largest side is still at least targetSize)
+	std::unique_ptr<IRawImage> decodeImage(const std::byte* encodedData, std::size_t encodedDataSize, std::optional<ImageSize> targetSize = std::nullopt);
+	std::unique_ptr<IRawImage> decodeImage(const std::filesystem::path& path, std::optional<ImageSize> targetSize = std::nullopt);
 }
 
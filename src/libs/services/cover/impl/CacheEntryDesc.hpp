@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2023 Emeric Poupon
+ *
+ * This file is part of LMS.
+ *
+ * LMS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LMS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <variant>
+
+#include "database/ArtistId.hpp"
+#include "database/ReleaseId.hpp"
+#include "database/TrackId.hpp"
+#include "image/IEncodedImage.hpp"
+
+namespace Cover
+{
+    struct CacheEntryDesc
+    {
+        std::variant<Database::ArtistId, Database::ReleaseId, Database::TrackId> id;
+        std::size_t			size;
+        Image::EncodingFormat format;
+
+        bool operator==(const CacheEntryDesc& other) const
+        {
+            return id == other.id
+                && size == other.size
+                && format == other.format;
+        }
+    };
+} // ns Cover
+
+namespace std
+{
+    template<>
+    class hash<Cover::CacheEntryDesc>
+    {
+    public:
+        size_t operator()(const Cover::CacheEntryDesc& e) const
+        {
+            size_t h{};
+            std::visit([&](auto id)
+                {
+                    using IdType = std::decay_t<decltype(id)>;
+                    h ^= std::hash<IdType>()(id);
+                }, e.id);
+            h ^= std::hash<std::size_t>()(e.size) << 1;
+            h ^= std::hash<int>()(static_cast<int>(e.format)) << 2;
+            return h;
+        }
+    };
+
+} // ns std
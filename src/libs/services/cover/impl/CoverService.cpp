@@ -19,10 +19,13 @@
 
 #include "CoverService.hpp"
 
+#include <algorithm>
+#include <future>
 #include <set>
 
 #include "av/IAudioFile.hpp"
 
+#include "database/Artist.hpp"
 #include "database/Db.hpp"
 #include "database/Release.hpp"
 #include "database/Session.hpp"
@@ -33,7 +36,6 @@
 #include "utils/IConfig.hpp"
 #include "utils/ILogger.hpp"
 #include "utils/Path.hpp"
-#include "utils/Random.hpp"
 #include "utils/String.hpp"
 #include "utils/Utils.hpp"
 
@@ -41,37 +43,19 @@ namespace Cover
 {
     namespace
     {
-        struct TrackInfo
+        // Last write time, in seconds since Epoch. 0 if not available
+        std::int64_t getLastWriteTime(const std::filesystem::path& path)
         {
-            bool hasCover{};
-            bool isMultiDisc{};
-            std::filesystem::path trackPath;
-            std::optional<Database::ReleaseId> releaseId;
-        };
-
-        std::optional<TrackInfo> getTrackInfo(Database::Session& dbSession, Database::TrackId trackId)
-        {
-            std::optional<TrackInfo> res;
-
-            auto transaction{ dbSession.createReadTransaction() };
-
-            const Database::Track::pointer track{ Database::Track::find(dbSession, trackId) };
-            if (!track)
-                return res;
-
-            res = TrackInfo{};
-
-            res->hasCover = track->hasCover();
-            res->trackPath = track->getPath();
-
-            if (const Database::Release::pointer & release{ track->getRelease() })
+            try
             {
-                res->releaseId = release->getId();
-                if (release->getTotalDisc() > 1)
-                    res->isMultiDisc = true;
+                return PathUtils::getLastWriteTime(path).toTime_t();
+            }
+            catch (const LmsException& e)
+            {
+                LMS_LOG(COVER, DEBUG, "Cannot get last write time: " << e.what());
             }
 
-            return res;
+            return 0;
         }
 
         std::vector<std::string> constructPreferredFileNames()
@@ -100,6 +84,58 @@ namespace Cover
             return res;
         }
 
+        std::unique_ptr<DiskCache> createDiskCache()
+        {
+            const std::size_t maxSize{ Service<IConfig>::get()->getULong("cover-max-disk-cache-size", 500) * 1000 * 1000 };
+            if (maxSize == 0)
+                return nullptr;
+
+            return std::make_unique<DiskCache>(Service<IConfig>::get()->getPath("working-dir") / "cache" / "covers", maxSize);
+        }
+
+        std::vector<Image::ImageSize> constructSizeBuckets()
+        {
+            std::vector<Image::ImageSize> res;
+
+            Service<IConfig>::get()->visitStrings("cover-size-buckets",
+                [&res](std::string_view size)
+                {
+                    if (const std::optional<Image::ImageSize> value{ StringUtils::readAs<Image::ImageSize>(size) }; value && *value > 0)
+                        res.push_back(*value);
+                    else
+                        LMS_LOG(COVER, ERROR, "Invalid cover size bucket '" << size << "'");
+                }, { "128", "256", "512", "1024", "2048" });
+
+            if (res.empty())
+                throw LmsException{ "No valid value for 'cover-size-buckets'" };
+
+            std::sort(std::begin(res), std::end(res));
+            res.erase(std::unique(std::begin(res), std::end(res)), std::end(res));
+
+            return res;
+        }
+
+        std::string computeETag(const DiskCache::EntryKey& entryKey)
+        {
+            std::string res{ std::visit([](auto id)
+                {
+                    using IdType = std::decay_t<decltype(id)>;
+                    if constexpr (std::is_same_v<IdType, Database::TrackId>)
+                        return "t" + id.toString();
+                    else if constexpr (std::is_same_v<IdType, Database::ReleaseId>)
+                        return "r" + id.toString();
+                    else
+                        return "a" + id.toString();
+                }, entryKey.desc.id) };
+
+            res += "-" + std::to_string(entryKey.desc.size);
+            res += entryKey.desc.format == Image::EncodingFormat::WebP ? "-webp" : "-jpeg";
+            res += "-" + std::to_string(entryKey.quality);
+            res += "-" + std::to_string(entryKey.sourceTimestamp);
+
+            return res;
+        }
+
         bool isFileSupported(const std::filesystem::path& file, const std::vector<std::filesystem::path>& extensions)
         {
             return (std::find(std::cbegin(extensions), std::cend(extensions), file.extension()) != std::cend(extensions));
@@ -119,16 +155,28 @@ namespace Cover
         : _db{ db }
         , _defaultCoverPath{ defaultCoverPath }
         , _maxCacheSize{ Service<IConfig>::get()->getULong("cover-max-cache-size", 30) * 1000 * 1000 }
+        , _cache{ _maxCacheSize }
         , _maxFileSize{ Service<IConfig>::get()->getULong("cover-max-file-size", 10) * 1000 * 1000 }
         , _preferredFileNames{ constructPreferredFileNames() }
         , _artistFileNames{ constructArtistFileNames() }
+        , _sizeBuckets{ constructSizeBuckets() }
     {
+        _diskCache = createDiskCache();
+
         setJpegQuality(Service<IConfig>::get()->getULong("cover-jpeg-quality", 75));
+        setWebPQuality(Service<IConfig>::get()->getULong("cover-webp-quality", 75));
 
         LMS_LOG(COVER, INFO, "Default cover path = '" << _defaultCoverPath.string() << "'");
         LMS_LOG(COVER, INFO, "Max cache size = " << _maxCacheSize);
+        LMS_LOG(COVER, INFO, "Disk cache " << (_diskCache ? "enabled" : "disabled"));
+        LMS_LOG(COVER, INFO, "WebP encoding " << (isEncodingFormatSupported(EncodingFormat::WebP) ? "supported" : "not supported"));
         LMS_LOG(COVER, INFO, "Max file size = " << _maxFileSize);
         LMS_LOG(COVER, INFO, "Preferred file names: " << StringUtils::joinStrings(_preferredFileNames, ","));
+        {
+            std::vector<std::string> sizeBuckets;
+            std::transform(std::cbegin(_sizeBuckets), std::cend(_sizeBuckets), std::back_inserter(sizeBuckets), [](ImageSize size) { return std::to_string(size); });
+            LMS_LOG(COVER, INFO, "Size buckets: " << StringUtils::joinStrings(sizeBuckets, ","));
+        }
 
 #if LMS_SUPPORT_IMAGE_GM
         GraphicsMagick::init(execPath);
@@ -138,7 +186,7 @@ namespace Cover
 
         try
         {
-            getDefault(512);
+            getDefault(512, EncodingFormat::JPEG);
         }
         catch (const Image::ImageException& e)
         {
@@ -146,9 +194,155 @@ namespace Cover
         }
     }
 
-    std::unique_ptr<IEncodedImage> CoverService::getFromAvMediaFile(const Av::IAudioFile& input, ImageSize width) const
+    std::optional<CoverService::TrackInfo> CoverService::getTrackInfo(Database::Session& dbSession, Database::TrackId trackId) const
     {
-        std::unique_ptr<IEncodedImage> image;
+        std::optional<TrackInfo> res;
+
+        {
+            auto transaction{ dbSession.createReadTransaction() };
+
+            const Database::Track::pointer track{ Database::Track::find(dbSession, trackId) };
+            if (!track)
+                return res;
+
+            res = TrackInfo{};
+
+            res->hasCover = track->hasCover();
+            res->trackPath = track->getPath();
+            res->sourceTimestamp = track->getLastWriteTime().toTime_t();
+
+            if (const Database::Release::pointer & release{ track->getRelease() })
+            {
+                res->releaseId = release->getId();
+                if (release->getTotalDisc() > 1)
+                    res->isMultiDisc = true;
+
+                // the release cover may be used as a fallback
+                res->sourceTimestamp = std::max<std::int64_t>(res->sourceTimestamp, release->getLastWritten().toTime_t());
+            }
+        }
+
+        // cover files may have been added, removed or overwritten since the last scan
+        if (res->hasCover)
+            res->sourceTimestamp = std::max(res->sourceTimestamp, getLastWriteTime(res->trackPath));
+        res->sourceTimestamp = std::max(res->sourceTimestamp, getSameNamedFilesLastWriteTime(res->trackPath));
+        res->sourceTimestamp = std::max(res->sourceTimestamp, getDirectoryLastWriteTime(res->trackPath.parent_path()));
+        if (res->isMultiDisc && res->trackPath.parent_path().has_parent_path())
+            res->sourceTimestamp = std::max(res->sourceTimestamp, getDirectoryLastWriteTime(res->trackPath.parent_path().parent_path()));
+
+        return res;
+    }
+
+    std::optional<CoverService::ReleaseInfo> CoverService::getReleaseInfo(Database::ReleaseId releaseId) const
+    {
+        using namespace Database;
+
+        std::optional<ReleaseInfo> res;
+
+        {
+            Session& session{ _db.getTLSSession() };
+            auto transaction{ session.createReadTransaction() };
+
+            // get a track in this release, consider the release is in a single directory
+            const auto tracks{ Track::find(session, Track::FindParameters {}.setRelease(releaseId).setRange(Range{ 0, 1 }).setSortMethod(TrackSortMethod::Release)) };
+            if (tracks.results.empty())
+                return res;
+
+            const Track::pointer& track{ tracks.results.front() };
+            const Release::pointer release{ track->getRelease() };
+
+            res = ReleaseInfo{};
+            res->firstTrackPath = track->getPath();
+            res->firstTrackHasCover = track->hasCover();
+            res->isMultiDisc = release->getTotalDisc() > 1;
+            res->releaseDirectory = track->getPath().parent_path();
+            res->sourceTimestamp = release->getLastWritten().toTime_t();
+        }
+
+        // cover files may have been added, removed or overwritten since the last scan
+        if (res->firstTrackHasCover)
+            res->sourceTimestamp = std::max(res->sourceTimestamp, getLastWriteTime(res->firstTrackPath));
+        res->sourceTimestamp = std::max(res->sourceTimestamp, getSameNamedFilesLastWriteTime(res->firstTrackPath));
+        res->sourceTimestamp = std::max(res->sourceTimestamp, getDirectoryLastWriteTime(res->releaseDirectory));
+        if (res->isMultiDisc && res->releaseDirectory.has_parent_path())
+            res->sourceTimestamp = std::max(res->sourceTimestamp, getDirectoryLastWriteTime(res->releaseDirectory.parent_path()));
+
+        return res;
+    }
+
+    std::optional<CoverService::ArtistInfo> CoverService::getArtistInfo(Database::ArtistId artistId) const
+    {
+        using namespace Database;
+
+        std::optional<ArtistInfo> res;
+
+        std::set<std::filesystem::path> parentPaths;
+        std::int64_t sourceTimestamp{};
+        {
+            Session& session{ _db.getTLSSession() };
+            auto transaction{ session.createReadTransaction() };
+
+            const Artist::pointer artist{ Artist::find(session, artistId) };
+            if (!artist)
+                return res;
+
+            Track::find(session, Track::FindParameters{}.setArtist(artistId), [&](const Track::pointer& track)
+                {
+                    parentPaths.insert(track->getPath().parent_path());
+                    sourceTimestamp = std::max<std::int64_t>(sourceTimestamp, track->getLastWriteTime().toTime_t());
+                });
+        }
+
+        if (parentPaths.empty())
+            return res;
+
+        res = ArtistInfo{};
+
+        if (parentPaths.size() == 1)
+            res->searchPaths.push_back(parentPaths.begin()->parent_path());
+        else
+            res->searchPaths.push_back(PathUtils::getLongestCommonPath(std::cbegin(parentPaths), std::cend(parentPaths)));
+        res->searchPaths.insert(std::end(res->searchPaths), std::cbegin(parentPaths), std::cend(parentPaths));
+
+        // artist image files may have been added, removed or overwritten since the last scan
+        for (const std::filesystem::path& searchPath : res->searchPaths)
+            sourceTimestamp = std::max(sourceTimestamp, getDirectoryLastWriteTime(searchPath));
+
+        res->sourceTimestamp = sourceTimestamp;
+
+        return res;
+    }
+
+    std::int64_t CoverService::getDirectoryLastWriteTime(const std::filesystem::path& directory) const
+    {
+        // overwriting a cover file in place does not change the last write time of its directory
+        std::int64_t res{ getLastWriteTime(directory) };
+        for (const auto& [fileName, coverPath] : getCoverPaths(directory))
+            res = std::max(res, getLastWriteTime(coverPath));
+
+        return res;
+    }
+
+    std::int64_t CoverService::getSameNamedFilesLastWriteTime(const std::filesystem::path& filePath) const
+    {
+        std::int64_t res{};
+
+        std::filesystem::path path{ filePath };
+        for (const std::filesystem::path& extension : _fileExtensions)
+        {
+            path.replace_extension(extension);
+
+            std::error_code ec;
+            if (std::filesystem::exists(path, ec))
+                res = std::max(res, getLastWriteTime(path));
+        }
+
+        return res;
+    }
+
+    std::unique_ptr<IRawImage> CoverService::getFromAvMediaFile(const Av::IAudioFile& input, ImageSize width) const
+    {
+        std::unique_ptr<IRawImage> image;
 
         input.visitAttachedPictures([&](const Av::Picture& picture)
             {
@@ -157,9 +351,7 @@ namespace Cover
 
                 try
                 {
-                    std::unique_ptr<IRawImage> rawImage{ decodeImage(picture.data, picture.dataSize) };
-                    rawImage->resize(width);
-                    image = rawImage->encodeToJPEG(_jpegQuality);
+                    image = decodeImage(picture.data, picture.dataSize, width);
                 }
                 catch (const Image::ImageException& e)
                 {
@@ -170,15 +362,13 @@ namespace Cover
         return image;
     }
 
-    std::unique_ptr<IEncodedImage> CoverService::getFromCoverFile(const std::filesystem::path& p, ImageSize width) const
+    std::unique_ptr<IRawImage> CoverService::getFromCoverFile(const std::filesystem::path& p, ImageSize width) const
     {
-        std::unique_ptr<IEncodedImage> image;
+        std::unique_ptr<IRawImage> image;
 
         try
         {
-            std::unique_ptr<IRawImage> rawImage{ decodeImage(p) };
-            rawImage->resize(width);
-            image = rawImage->encodeToJPEG(_jpegQuality);
+            image = decodeImage(p, width);
         }
         catch (const ImageException& e)
         {
@@ -188,48 +378,86 @@ namespace Cover
         return image;
     }
 
-    std::shared_ptr<IEncodedImage> CoverService::getDefault(ImageSize width)
+    std::shared_ptr<IEncodedImage> CoverService::getDefault(ImageSize width, EncodingFormat format)
     {
+        width = getSizeBucket(width);
+        format = getSupportedFormat(format);
+
+        const auto key{ std::make_pair(width, format) };
+
         {
-            std::shared_lock lock{ _cacheMutex };
+            std::shared_lock lock{ _defaultCoverCacheMutex };
 
-            if (auto it{ _defaultCoverCache.find(width) }; it != std::cend(_defaultCoverCache))
+            if (auto it{ _defaultCoverCache.find(key) }; it != std::cend(_defaultCoverCache))
                 return it->second;
         }
 
         {
-            std::unique_lock lock{ _cacheMutex };
+            std::unique_lock lock{ _defaultCoverCacheMutex };
 
-            if (auto it{ _defaultCoverCache.find(width) }; it != std::cend(_defaultCoverCache))
+            if (auto it{ _defaultCoverCache.find(key) }; it != std::cend(_defaultCoverCache))
                 return it->second;
 
-            std::shared_ptr<IEncodedImage> image{ getFromCoverFile(_defaultCoverPath, width) };
-            _defaultCoverCache[width] = image;
+            std::shared_ptr<IEncodedImage> image;
+            if (std::unique_ptr<IRawImage> rawImage{ getFromCoverFile(_defaultCoverPath, width) })
+                image = resizeAndEncode(*rawImage, width, format);
+
+            _defaultCoverCache[key] = image;
             LMS_LOG(COVER, DEBUG, "Default cache entries = " << _defaultCoverCache.size());
 
             return image;
         }
     }
 
-    std::unique_ptr<IEncodedImage> CoverService::getFromDirectory(const std::filesystem::path& directory, ImageSize width, const std::vector<std::string>& preferredFileNames, bool allowPickRandom) const
+    std::string CoverService::getETag(Database::TrackId trackId, ImageSize width, EncodingFormat format)
+    {
+        const std::optional<TrackInfo> trackInfo{ getTrackInfo(_db.getTLSSession(), trackId) };
+        if (!trackInfo)
+            return "";
+
+        return computeETag(getEntryKey(CacheEntryDesc{ trackId, width, format }, trackInfo->sourceTimestamp));
+    }
+
+    std::string CoverService::getETag(Database::ReleaseId releaseId, ImageSize width, EncodingFormat format)
+    {
+        const std::optional<ReleaseInfo> releaseInfo{ getReleaseInfo(releaseId) };
+        if (!releaseInfo)
+            return "";
+
+        return computeETag(getEntryKey(CacheEntryDesc{ releaseId, width, format }, releaseInfo->sourceTimestamp));
+    }
+
+    std::string CoverService::getETag(Database::ArtistId artistId, ImageSize width, EncodingFormat format)
+    {
+        const std::optional<ArtistInfo> artistInfo{ getArtistInfo(artistId) };
+        if (!artistInfo)
+            return "";
+
+        return computeETag(getEntryKey(CacheEntryDesc{ artistId, width, format }, artistInfo->sourceTimestamp));
+    }
+
+    std::unique_ptr<IRawImage> CoverService::getFromDirectory(const std::filesystem::path& directory, ImageSize width, const std::vector<std::string>& preferredFileNames, bool allowPickRandom, std::filesystem::path& coverPath) const
     {
         const std::multimap<std::string, std::filesystem::path> coverPaths{ getCoverPaths(directory) };
 
         auto tryLoadImageFromFilename = [&](std::string_view fileName)
             {
-                std::unique_ptr<IEncodedImage> image;
+                std::unique_ptr<IRawImage> image;
 
                 auto range{ coverPaths.equal_range(std::string {fileName}) };
                 for (auto it{ range.first }; it != range.second; ++it)
                 {
                     image = getFromCoverFile(it->second, width);
                     if (image)
+                    {
+                        coverPath = it->second;
                         break;
+                    }
                 }
                 return image;
             };
 
-        std::unique_ptr<IEncodedImage> image;
+        std::unique_ptr<IRawImage> image;
 
         for (std::string_view filename : preferredFileNames)
         {
@@ -240,37 +468,69 @@ namespace Cover
 
         if (allowPickRandom)
         {
-            for (const auto& [filename, coverPath] : coverPaths)
+            for (const auto& [filename, path] : coverPaths)
             {
-                image = getFromCoverFile(coverPath, width);
+                image = getFromCoverFile(path, width);
                 if (image)
+                {
+                    coverPath = path;
                     return image;
+                }
             }
         }
 
         return image;
     }
 
-    std::unique_ptr<IEncodedImage> CoverService::getFromSameNamedFile(const std::filesystem::path& filePath, ImageSize width) const
+    std::unique_ptr<IRawImage> CoverService::getFromSameNamedFile(const std::filesystem::path& filePath, ImageSize width, std::filesystem::path& coverPath) const
     {
-        std::unique_ptr<IEncodedImage> res;
+        std::unique_ptr<IRawImage> res;
 
-        std::filesystem::path coverPath{ filePath };
+        std::filesystem::path path{ filePath };
         for (const std::filesystem::path& extension : _fileExtensions)
         {
-            coverPath.replace_extension(extension);
+            path.replace_extension(extension);
 
-            if (!checkCoverFile(coverPath))
+            if (!checkCoverFile(path))
                 continue;
 
-            res = getFromCoverFile(coverPath, width);
+            res = getFromCoverFile(path, width);
             if (res)
+            {
+                coverPath = path;
                 break;
+            }
         }
 
         return res;
     }
 
+    std::unique_ptr<IRawImage> CoverService::getFromTrackOrSameNamedFile(const std::filesystem::path& trackPath, bool hasEmbeddedCover, ImageSize width, std::filesystem::path& coverPath) const
+    {
+        std::unique_ptr<IRawImage> rawImage;
+
+        if (hasEmbeddedCover)
+        {
+            rawImage = getFromTrack(trackPath, width);
+            if (rawImage)
+                coverPath = trackPath;
+        }
+
+        if (!rawImage)
+            rawImage = getFromSameNamedFile(trackPath, width, coverPath);
+
+        return rawImage;
+    }
+
+    std::unique_ptr<IRawImage> CoverService::getFromCoverSource(const std::filesystem::path& coverSource, ImageSize width) const
+    {
+        // cover source is either an image file or an audio file with an embedded cover
+        if (isFileSupported(coverSource, _fileExtensions))
+            return checkCoverFile(coverSource) ? getFromCoverFile(coverSource, width) : nullptr;
+
+        return getFromTrack(coverSource, width);
+    }
+
     bool CoverService::checkCoverFile(const std::filesystem::path& filePath) const
     {
         std::error_code ec;
@@ -294,6 +554,35 @@ namespace Cover
     }
 
     std::multimap<std::string, std::filesystem::path> CoverService::getCoverPaths(const std::filesystem::path& directoryPath) const
+    {
+        // Listing directories may be expensive (network file systems, etc.): reuse the previous listing if the directory has not been modified since
+        std::error_code ec;
+        const std::filesystem::file_time_type directoryLastWriteTime{ std::filesystem::last_write_time(directoryPath, ec) };
+        if (ec)
+            return listCoverPaths(directoryPath);
+
+        {
+            std::shared_lock lock{ _coverPathsCacheMutex };
+
+            if (auto it{ _coverPathsCache.find(directoryPath.string()) }; it != std::cend(_coverPathsCache) && it->second.directoryLastWriteTime == directoryLastWriteTime)
+                return it->second.coverPaths;
+        }
+
+        std::multimap<std::string, std::filesystem::path> res{ listCoverPaths(directoryPath) };
+
+        {
+            std::unique_lock lock{ _coverPathsCacheMutex };
+
+            if (_coverPathsCache.size() >= _maxCoverPathsCacheEntryCount)
+                _coverPathsCache.clear();
+
+            _coverPathsCache[directoryPath.string()] = CoverPathsCacheEntry{ directoryLastWriteTime, res };
+        }
+
+        return res;
+    }
+
+    std::multimap<std::string, std::filesystem::path> CoverService::listCoverPaths(const std::filesystem::path& directoryPath) const
     {
         std::multimap<std::string, std::filesystem::path> res;
         std::error_code ec;
@@ -313,9 +602,9 @@ namespace Cover
         return res;
     }
 
-    std::unique_ptr<IEncodedImage> CoverService::getFromTrack(const std::filesystem::path& p, ImageSize width) const
+    std::unique_ptr<IRawImage> CoverService::getFromTrack(const std::filesystem::path& p, ImageSize width) const
     {
-        std::unique_ptr<IEncodedImage> image;
+        std::unique_ptr<IRawImage> image;
 
         try
         {
@@ -329,149 +618,347 @@ namespace Cover
         return image;
     }
 
-    std::shared_ptr<IEncodedImage> CoverService::getFromTrack(Database::TrackId trackId, ImageSize width)
+    std::shared_ptr<IEncodedImage> CoverService::getFromTrack(Database::TrackId trackId, ImageSize width, EncodingFormat format)
     {
-        return getFromTrack(_db.getTLSSession(), trackId, width, true /* allow release fallback*/);
-    }
+        const std::optional<TrackInfo> trackInfo{ getTrackInfo(_db.getTLSSession(), trackId) };
+        if (!trackInfo)
+            return nullptr;
 
-    std::shared_ptr<IEncodedImage> CoverService::getFromTrack(Database::Session& dbSession, Database::TrackId trackId, ImageSize width, bool allowReleaseFallback)
-    {
-        using namespace Database;
+        const DiskCache::EntryKey entryKey{ getEntryKey(CacheEntryDesc{ trackId, width, format }, trackInfo->sourceTimestamp) };
 
-        const CacheEntryDesc cacheEntryDesc{ trackId, width };
+        return getOrCreate(entryKey, [&] { return createFromTrack(*trackInfo, entryKey); });
+    }
 
-        std::shared_ptr<IEncodedImage> cover{ loadFromCache(cacheEntryDesc) };
+    std::shared_ptr<IEncodedImage> CoverService::createFromTrack(const TrackInfo& trackInfo, const DiskCache::EntryKey& diskCacheEntryKey)
+    {
+        std::shared_ptr<IEncodedImage> cover{ loadFromDiskCache(diskCacheEntryKey) };
         if (cover)
             return cover;
 
-        if (const std::optional<TrackInfo> trackInfo{ getTrackInfo(dbSession, trackId) })
+        bool isReleaseCover{};
+        cover = createFromLargerBucket(diskCacheEntryKey);
+        if (!cover)
         {
-            if (trackInfo->hasCover)
-                cover = getFromTrack(trackInfo->trackPath, width);
+            std::filesystem::path coverPath;
+            std::unique_ptr<IRawImage> rawImage{ getFromTrackOrSameNamedFile(trackInfo.trackPath, trackInfo.hasCover, diskCacheEntryKey.desc.size, coverPath) };
 
-            if (!cover)
-                cover = getFromSameNamedFile(trackInfo->trackPath, width);
-
-            if (!cover && trackInfo->releaseId && allowReleaseFallback)
-                cover = getFromRelease(*trackInfo->releaseId, width);
+            if (rawImage)
+                cover = createFromRawImage(diskCacheEntryKey, *rawImage);
+            else if (trackInfo.releaseId)
+            {
+                cover = getFromRelease(*trackInfo.releaseId, diskCacheEntryKey.desc.size, diskCacheEntryKey.desc.format);
+                isReleaseCover = static_cast<bool>(cover);
+            }
 
-            if (!cover && trackInfo->isMultiDisc)
+            if (!cover && trackInfo.isMultiDisc && trackInfo.trackPath.parent_path().has_parent_path())
             {
-                if (trackInfo->trackPath.parent_path().has_parent_path())
-                    cover = getFromDirectory(trackInfo->trackPath.parent_path().parent_path(), width, _preferredFileNames, true);
+                rawImage = getFromDirectory(trackInfo.trackPath.parent_path().parent_path(), diskCacheEntryKey.desc.size, _preferredFileNames, true, coverPath);
+                if (rawImage)
+                    cover = createFromRawImage(diskCacheEntryKey, *rawImage);
             }
         }
 
-        if (cover)
-            saveToCache(cacheEntryDesc, cover);
+        // the release cover already has its own disk cache entry, that follows the release changes
+        if (cover && !isReleaseCover)
+            saveToDiskCache(diskCacheEntryKey, *cover);
 
         return cover;
     }
 
-    std::shared_ptr<IEncodedImage> CoverService::getFromRelease(Database::ReleaseId releaseId, ImageSize width)
+    std::shared_ptr<IEncodedImage> CoverService::getFromRelease(Database::ReleaseId releaseId, ImageSize width, EncodingFormat format)
     {
-        using namespace Database;
-        const CacheEntryDesc cacheEntryDesc{ releaseId, width };
+        const std::optional<ReleaseInfo> releaseInfo{ getReleaseInfo(releaseId) };
+        if (!releaseInfo)
+            return nullptr;
+
+        const DiskCache::EntryKey entryKey{ getEntryKey(CacheEntryDesc{ releaseId, width, format }, releaseInfo->sourceTimestamp) };
+
+        return getOrCreate(entryKey, [&] { return createFromRelease(*releaseInfo, entryKey); });
+    }
+
+    std::shared_ptr<IEncodedImage> CoverService::createFromRelease(const ReleaseInfo& releaseInfo, const DiskCache::EntryKey& diskCacheEntryKey)
+    {
+        const Database::ReleaseId releaseId{ std::get<Database::ReleaseId>(diskCacheEntryKey.desc.id) };
+        const ImageSize width{ diskCacheEntryKey.desc.size };
 
-        std::shared_ptr<IEncodedImage> cover{ loadFromCache(cacheEntryDesc) };
+        std::shared_ptr<IEncodedImage> cover{ loadFromDiskCache(diskCacheEntryKey) };
         if (cover)
             return cover;
 
-        struct ReleaseInfo
+        cover = createFromLargerBucket(diskCacheEntryKey);
+        if (!cover)
         {
-            TrackId firstTrackId;
-            std::filesystem::path releaseDirectory;
-        };
+            std::unique_ptr<IRawImage> rawImage;
 
-        Session& session{ _db.getTLSSession() };
+            // Reuse the cover source resolved earlier if nothing changed since, so that we only have to decode it
+            const std::optional<std::filesystem::path> coverSource{ getCoverSource(releaseId, releaseInfo.sourceTimestamp) };
+            if (coverSource && !coverSource->empty())
+                rawImage = getFromCoverSource(*coverSource, width);
 
-        auto getReleaseInfo{ [&]
-        {
-            std::optional<ReleaseInfo> res;
+            if (!rawImage && !(coverSource && coverSource->empty()))
+            {
+                std::filesystem::path coverPath;
 
-            auto transaction{ session.createReadTransaction() };
+                rawImage = getFromDirectory(releaseInfo.releaseDirectory, width, _preferredFileNames, true, coverPath);
+                if (!rawImage)
+                    rawImage = getFromTrackOrSameNamedFile(releaseInfo.firstTrackPath, releaseInfo.firstTrackHasCover, width, coverPath);
+                if (!rawImage && releaseInfo.isMultiDisc && releaseInfo.releaseDirectory.has_parent_path())
+                    rawImage = getFromDirectory(releaseInfo.releaseDirectory.parent_path(), width, _preferredFileNames, true, coverPath);
 
-            // get a track in this release, consider the release is in a single directory
-            const auto tracks{ Track::find(session, Track::FindParameters {}.setRelease(releaseId).setRange(Range{ 0, 1 }).setSortMethod(TrackSortMethod::Release)) };
-            if (!tracks.results.empty())
-            {
-                const Track::pointer& track{ tracks.results.front() };
-                res = ReleaseInfo{};
-                res->firstTrackId = track->getId();
-                res->releaseDirectory = track->getPath().parent_path();
+                storeCoverSource(releaseId, rawImage ? coverPath : std::filesystem::path{}, releaseInfo.sourceTimestamp);
             }
 
-            return res;
-        } };
-
-        if (const std::optional<ReleaseInfo> releaseInfo{ getReleaseInfo() })
-        {
-            cover = getFromDirectory(releaseInfo->releaseDirectory, width, _preferredFileNames, true);
-            if (!cover)
-                cover = getFromTrack(session, releaseInfo->firstTrackId, width, false /* no release fallback */);
+            if (rawImage)
+                cover = createFromRawImage(diskCacheEntryKey, *rawImage);
         }
 
         if (cover)
-            saveToCache(cacheEntryDesc, cover);
+            saveToDiskCache(diskCacheEntryKey, *cover);
 
         return cover;
     }
 
-    std::shared_ptr<IEncodedImage> CoverService::getFromArtist(Database::ArtistId artistId, ImageSize width)
+    std::shared_ptr<IEncodedImage> CoverService::getFromArtist(Database::ArtistId artistId, ImageSize width, EncodingFormat format)
     {
-        using namespace Database;
-        const CacheEntryDesc cacheEntryDesc{ artistId, width };
+        const std::optional<ArtistInfo> artistInfo{ getArtistInfo(artistId) };
+        if (!artistInfo)
+            return nullptr;
+
+        const DiskCache::EntryKey entryKey{ getEntryKey(CacheEntryDesc{ artistId, width, format }, artistInfo->sourceTimestamp) };
+
+        return getOrCreate(entryKey, [&] { return createFromArtist(*artistInfo, entryKey); });
+    }
 
-        std::shared_ptr<IEncodedImage> artistImage{ loadFromCache(cacheEntryDesc) };
+    std::shared_ptr<IEncodedImage> CoverService::createFromArtist(const ArtistInfo& artistInfo, const DiskCache::EntryKey& diskCacheEntryKey)
+    {
+        const Database::ArtistId artistId{ std::get<Database::ArtistId>(diskCacheEntryKey.desc.id) };
+        const ImageSize width{ diskCacheEntryKey.desc.size };
+
+        std::shared_ptr<IEncodedImage> artistImage{ loadFromDiskCache(diskCacheEntryKey) };
         if (artistImage)
             return artistImage;
 
-        std::set<std::filesystem::path> parentPaths;
+        artistImage = createFromLargerBucket(diskCacheEntryKey);
+        if (!artistImage)
         {
-            Session& session{ _db.getTLSSession() };
-            auto transaction{ session.createReadTransaction() };
+            std::unique_ptr<IRawImage> rawImage;
 
-            Track::find(session, Track::FindParameters{}.setArtist(artistId), [&](const Track::pointer& track)
+            // Reuse the image source resolved earlier if nothing changed since, so that we only have to decode it
+            const std::optional<std::filesystem::path> imageSource{ getCoverSource(artistId, artistInfo.sourceTimestamp) };
+            if (imageSource && !imageSource->empty())
+                rawImage = getFromCoverSource(*imageSource, width);
+
+            if (!rawImage && !(imageSource && imageSource->empty()))
+            {
+                std::filesystem::path imagePath;
+
+                for (const std::filesystem::path& searchPath : artistInfo.searchPaths)
                 {
-                    parentPaths.insert(track->getPath().parent_path());
-                });
+                    rawImage = getFromDirectory(searchPath, width, _artistFileNames, false, imagePath);
+                    if (rawImage)
+                        break;
+                }
+
+                storeCoverSource(artistId, rawImage ? imagePath : std::filesystem::path{}, artistInfo.sourceTimestamp);
+            }
+
+            if (rawImage)
+                artistImage = createFromRawImage(diskCacheEntryKey, *rawImage);
         }
 
-        if (parentPaths.size() == 1)
-            artistImage = getFromDirectory(parentPaths.begin()->parent_path(), width, _artistFileNames, false);
-        else if (parentPaths.size() > 1)
+        if (artistImage)
+            saveToDiskCache(diskCacheEntryKey, *artistImage);
+
+        return artistImage;
+    }
+
+    std::shared_ptr<IEncodedImage> CoverService::createFromLargerBucket(const DiskCache::EntryKey& entryKey)
+    {
+        // decoding and downscaling an already resized image is much cheaper than decoding the original one again
+        // Larger buckets are always looked up in JPEG, as all the image backends can decode it
+        for (auto itSize{ std::upper_bound(std::cbegin(_sizeBuckets), std::cend(_sizeBuckets), entryKey.desc.size) }; itSize != std::cend(_sizeBuckets); ++itSize)
         {
-            const std::filesystem::path longestCommonPath{ PathUtils::getLongestCommonPath(std::cbegin(parentPaths), std::cend(parentPaths)) };
-            artistImage = getFromDirectory(longestCommonPath, width, _artistFileNames, false);
+            const DiskCache::EntryKey largerEntryKey{ CacheEntryDesc{ entryKey.desc.id, *itSize, EncodingFormat::JPEG }, entryKey.sourceTimestamp, _jpegQuality };
+
+            std::shared_ptr<IEncodedImage> largerImage{ loadFromCache(largerEntryKey) };
+            if (!largerImage)
+                largerImage = loadFromDiskCache(largerEntryKey);
+            if (!largerImage)
+                continue;
+
+            try
+            {
+                std::unique_ptr<IRawImage> rawImage{ decodeImage(largerImage->getData(), largerImage->getDataSize(), entryKey.desc.size) };
+                return resizeAndEncode(*rawImage, entryKey.desc.size, entryKey.desc.format);
+            }
+            catch (const ImageException& e)
+            {
+                LMS_LOG(COVER, ERROR, "Cannot decode cached cover: " << e.what());
+            }
         }
 
-        if (!artistImage)
+        return nullptr;
+    }
+
+    std::shared_ptr<IEncodedImage> CoverService::createFromRawImage(const DiskCache::EntryKey& entryKey, IRawImage& rawImage)
+    {
+        // Also keep the largest bucket the decoded image can provide: smaller buckets will be derived from it
+        // Note the original image may have been decoded at a reduced resolution, close to the requested size
+        // This reference bucket is always encoded in JPEG, so that it can be decoded by all the image backends
+        const ImageSize originalSize{ std::max(rawImage.getWidth(), rawImage.getHeight()) };
+        if (auto itReferenceSize{ std::upper_bound(std::cbegin(_sizeBuckets), std::cend(_sizeBuckets), originalSize) }; itReferenceSize != std::cbegin(_sizeBuckets))
         {
-            for (const std::filesystem::path& parentPath : parentPaths)
+            const CacheEntryDesc referenceEntryDesc{ entryKey.desc.id, *std::prev(itReferenceSize), EncodingFormat::JPEG };
+            if (referenceEntryDesc.size > entryKey.desc.size)
             {
-                artistImage = getFromDirectory(parentPath, width, _artistFileNames, false);
-                if (artistImage)
-                    break;
+                if (std::shared_ptr<IEncodedImage> referenceImage{ resizeAndEncode(rawImage, referenceEntryDesc.size, referenceEntryDesc.format) })
+                {
+                    const DiskCache::EntryKey referenceEntryKey{ referenceEntryDesc, entryKey.sourceTimestamp, _jpegQuality };
+                    if (_diskCache)
+                        saveToDiskCache(referenceEntryKey, *referenceImage);
+                    else
+                        saveToCache(referenceEntryKey, referenceImage);
+                }
             }
         }
 
-        if (artistImage)
-            saveToCache(cacheEntryDesc, artistImage);
+        return resizeAndEncode(rawImage, entryKey.desc.size, entryKey.desc.format);
+    }
 
-        return artistImage;
+    std::unique_ptr<IEncodedImage> CoverService::resizeAndEncode(IRawImage& rawImage, ImageSize width, EncodingFormat format) const
+    {
+        std::unique_ptr<IEncodedImage> image;
+
+        try
+        {
+            rawImage.resize(width);
+            switch (format)
+            {
+            case EncodingFormat::JPEG:
+                image = rawImage.encodeToJPEG(_jpegQuality);
+                break;
+            case EncodingFormat::WebP:
+                image = rawImage.encodeToWebP(_webpQuality);
+                break;
+            }
+        }
+        catch (const ImageException& e)
+        {
+            LMS_LOG(COVER, ERROR, "Cannot resize and encode cover: " << e.what());
+        }
+
+        return image;
+    }
+
+    ImageSize CoverService::getSizeBucket(ImageSize size) const
+    {
+        // smallest bucket that can hold the requested size
+        const auto itSize{ std::lower_bound(std::cbegin(_sizeBuckets), std::cend(_sizeBuckets), size) };
+        return itSize != std::cend(_sizeBuckets) ? *itSize : _sizeBuckets.back();
+    }
+
+    EncodingFormat CoverService::getSupportedFormat(EncodingFormat format) const
+    {
+        return isEncodingFormatSupported(format) ? format : EncodingFormat::JPEG;
+    }
+
+    unsigned CoverService::getQuality(EncodingFormat format) const
+    {
+        switch (format)
+        {
+        case EncodingFormat::JPEG:
+            return _jpegQuality;
+        case EncodingFormat::WebP:
+            return _webpQuality;
+        }
+
+        return _jpegQuality;
+    }
+
+    bool CoverService::isEncodingFormatSupported(EncodingFormat format) const
+    {
+        switch (format)
+        {
+        case EncodingFormat::JPEG:
+            return true;
+        case EncodingFormat::WebP:
+            return isWebPEncodingSupported();
+        }
+
+        return false;
+    }
+
+    DiskCache::EntryKey CoverService::getEntryKey(const CacheEntryDesc& entryDesc, std::int64_t sourceTimestamp) const
+    {
+        const EncodingFormat format{ getSupportedFormat(entryDesc.format) };
+        return DiskCache::EntryKey{ CacheEntryDesc{ entryDesc.id, getSizeBucket(entryDesc.size), format }, sourceTimestamp, getQuality(format) };
+    }
+
+    std::shared_ptr<IEncodedImage> CoverService::getOrCreate(const DiskCache::EntryKey& entryKey, const std::function<std::shared_ptr<IEncodedImage>()>& createFunc)
+    {
+        const CacheEntryDesc& cacheEntryDesc{ entryKey.desc };
+
+        std::shared_ptr<IEncodedImage> cover{ loadFromCache(entryKey) };
+        if (cover)
+            return cover;
+
+        // Coalesce concurrent requests: only the first one creates the cover, the others wait for its result
+        // Note: creating a track cover may wait for a release cover, but not the opposite (no deadlock possible)
+        std::promise<std::shared_ptr<IEncodedImage>> promise;
+        {
+            std::unique_lock lock{ _pendingCreationsMutex };
+
+            if (auto itPending{ _pendingCreations.find(cacheEntryDesc) }; itPending != std::cend(_pendingCreations))
+            {
+                std::shared_future<std::shared_ptr<IEncodedImage>> pendingCreation{ itPending->second };
+                lock.unlock();
+
+                return pendingCreation.get();
+            }
+
+            _pendingCreations.emplace(cacheEntryDesc, promise.get_future().share());
+        }
+
+        auto removePendingCreation{ [&]
+        {
+            const std::scoped_lock lock{ _pendingCreationsMutex };
+            _pendingCreations.erase(cacheEntryDesc);
+        } };
+
+        try
+        {
+            cover = createFunc();
+        }
+        catch (...)
+        {
+            promise.set_exception(std::current_exception());
+            removePendingCreation();
+            throw;
+        }
+
+        if (cover)
+            saveToCache(entryKey, cover);
+
+        promise.set_value(cover);
+        removePendingCreation();
+
+        return cover;
     }
 
     void CoverService::flushCache()
     {
-        std::unique_lock lock{ _cacheMutex };
+        const std::vector<CacheShardStats> stats{ _cache.getStats() };
+        for (std::size_t i{}; i < stats.size(); ++i)
+            LMS_LOG(COVER, DEBUG, "Cache shard " << i << " stats: hits = " << stats[i].hits << ", misses = " << stats[i].misses << ", nb entries = " << stats[i].entryCount << ", size = " << stats[i].size << "/" << stats[i].maxSize);
 
-        LMS_LOG(COVER, DEBUG, "Cache stats: hits = " << _cacheHits << ", misses = " << _cacheMisses << ", nb entries = " << _cache.size() << ", size = " << _cacheSize);
-        _cacheHits = 0;
-        _cacheMisses = 0;
-        _cacheSize = 0;
         _cache.clear();
     }
 
+    std::vector<CacheShardStats> CoverService::getCacheStats() const
+    {
+        return _cache.getStats();
+    }
+
     void CoverService::setJpegQuality(unsigned quality)
     {
         _jpegQuality = Utils::clamp<unsigned>(quality, 1, 100);
@@ -479,34 +966,55 @@ namespace Cover
         LMS_LOG(COVER, INFO, "JPEG export quality = " << _jpegQuality);
     }
 
-    void CoverService::saveToCache(const CacheEntryDesc& entryDesc, std::shared_ptr<IEncodedImage> image)
+    void CoverService::setWebPQuality(unsigned quality)
     {
-        std::unique_lock lock{ _cacheMutex };
+        _webpQuality = Utils::clamp<unsigned>(quality, 1, 100);
 
-        while (_cacheSize + image->getDataSize() > _maxCacheSize && !_cache.empty())
-        {
-            auto itRandom{ Random::pickRandom(_cache) };
-            _cacheSize -= itRandom->second->getDataSize();
-            _cache.erase(itRandom);
-        }
+        LMS_LOG(COVER, INFO, "WebP export quality = " << _webpQuality);
+    }
 
-        _cacheSize += image->getDataSize();
-        _cache[entryDesc] = image;
+    void CoverService::saveToCache(const DiskCache::EntryKey& entryKey, std::shared_ptr<IEncodedImage> image)
+    {
+        _cache.save(entryKey.desc, std::move(image), entryKey.sourceTimestamp);
     }
 
-    std::shared_ptr<IEncodedImage> CoverService::loadFromCache(const CacheEntryDesc& entryDesc)
+    std::shared_ptr<IEncodedImage> CoverService::loadFromCache(const DiskCache::EntryKey& entryKey)
     {
-        std::shared_lock lock{ _cacheMutex };
+        return _cache.load(entryKey.desc, entryKey.sourceTimestamp);
+    }
 
-        auto it{ _cache.find(entryDesc) };
-        if (it == std::cend(_cache))
-        {
-            ++_cacheMisses;
+    void CoverService::saveToDiskCache(const DiskCache::EntryKey& entryKey, const IEncodedImage& image)
+    {
+        if (_diskCache)
+            _diskCache->save(entryKey, image);
+    }
+
+    std::shared_ptr<IEncodedImage> CoverService::loadFromDiskCache(const DiskCache::EntryKey& entryKey)
+    {
+        if (!_diskCache)
             return nullptr;
-        }
 
-        ++_cacheHits;
-        return it->second;
+        return _diskCache->load(entryKey);
+    }
+
+    std::optional<std::filesystem::path> CoverService::getCoverSource(const CoverSourceId& id, std::int64_t sourceTimestamp) const
+    {
+        std::shared_lock lock{ _coverSourcesCacheMutex };
+
+        if (auto it{ _coverSourcesCache.find(id) }; it != std::cend(_coverSourcesCache) && it->second.sourceTimestamp == sourceTimestamp)
+            return it->second.coverSource;
+
+        return std::nullopt;
+    }
+
+    void CoverService::storeCoverSource(const CoverSourceId& id, const std::filesystem::path& coverSource, std::int64_t sourceTimestamp)
+    {
+        std::unique_lock lock{ _coverSourcesCacheMutex };
+
+        if (_coverSourcesCache.size() >= _maxCoverSourcesCacheEntryCount)
+            _coverSourcesCache.clear();
+
+        _coverSourcesCache[id] = CoverSourceCacheEntry{ sourceTimestamp, coverSource };
     }
 
 } // namespace Cover
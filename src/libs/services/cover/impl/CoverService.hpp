@@ -21,7 +21,10 @@
 
 #include <atomic>
 #include <filesystem>
+#include <functional>
+#include <future>
 #include <map>
+#include <mutex>
 #include <optional>
 #include <shared_mutex>
 #include <string_view>
@@ -30,7 +33,13 @@
 #include <vector>
 
 #include "services/cover/ICoverService.hpp"
+#include "CacheEntryDesc.hpp"
+#include "DiskCache.hpp"
+#include "MemoryCache.hpp"
 #include "image/IEncodedImage.hpp"
+#include "image/IRawImage.hpp"
+#include "database/ArtistId.hpp"
+#include "database/ReleaseId.hpp"
 #include "database/Types.hpp"
 
 namespace Database
@@ -43,42 +52,6 @@ namespace Av
     class IAudioFile;
 }
 
-namespace Cover
-{
-    struct CacheEntryDesc
-    {
-        std::variant<Database::ArtistId, Database::ReleaseId, Database::TrackId> id;
-        std::size_t			size;
-
-        bool operator==(const CacheEntryDesc& other) const
-        {
-            return id == other.id
-                && size == other.size;
-        }
-    };
-} // ns Cover
-
-namespace std
-{
-    template<>
-    class hash<Cover::CacheEntryDesc>
-    {
-    public:
-        size_t operator()(const Cover::CacheEntryDesc& e) const
-        {
-            size_t h{};
-            std::visit([&](auto id)
-                {
-                    using IdType = std::decay_t<decltype(id)>;
-                    h ^= std::hash<IdType>()(id);
-                }, e.id);
-            h ^= std::hash<std::size_t>()(e.size) << 1;
-            return h;
-        }
-    };
-
-} // ns std
-
 namespace Cover
 {
     class CoverService : public ICoverService
@@ -90,43 +63,127 @@ namespace Cover
         CoverService& operator=(const CoverService&) = delete;
 
     private:
-        std::shared_ptr<Image::IEncodedImage>   getFromTrack(Database::TrackId trackId, Image::ImageSize width) override;
-        std::shared_ptr<Image::IEncodedImage>   getFromRelease(Database::ReleaseId releaseId, Image::ImageSize width) override;
-        std::shared_ptr<Image::IEncodedImage>   getFromArtist(Database::ArtistId artistId, Image::ImageSize width) override;
-        std::shared_ptr<Image::IEncodedImage>   getDefault(Image::ImageSize width) override;
+        std::shared_ptr<Image::IEncodedImage>   getFromTrack(Database::TrackId trackId, Image::ImageSize width, Image::EncodingFormat format) override;
+        std::shared_ptr<Image::IEncodedImage>   getFromRelease(Database::ReleaseId releaseId, Image::ImageSize width, Image::EncodingFormat format) override;
+        std::shared_ptr<Image::IEncodedImage>   getFromArtist(Database::ArtistId artistId, Image::ImageSize width, Image::EncodingFormat format) override;
+        std::string                             getETag(Database::TrackId trackId, Image::ImageSize width, Image::EncodingFormat format) override;
+        std::string                             getETag(Database::ReleaseId releaseId, Image::ImageSize width, Image::EncodingFormat format) override;
+        std::string                             getETag(Database::ArtistId artistId, Image::ImageSize width, Image::EncodingFormat format) override;
+        std::shared_ptr<Image::IEncodedImage>   getDefault(Image::ImageSize width, Image::EncodingFormat format) override;
+        bool                                    isEncodingFormatSupported(Image::EncodingFormat format) const override;
         void                                    flushCache() override;
+        std::vector<CacheShardStats>            getCacheStats() const override;
         void                                    setJpegQuality(unsigned quality) override;
+        void                                    setWebPQuality(unsigned quality) override;
 
-        std::shared_ptr<Image::IEncodedImage>   getFromTrack(Database::Session& dbSession, Database::TrackId trackId, Image::ImageSize width, bool allowReleaseFallback);
-        std::unique_ptr<Image::IEncodedImage>   getFromAvMediaFile(const Av::IAudioFile& input, Image::ImageSize width) const;
-        std::unique_ptr<Image::IEncodedImage>   getFromCoverFile(const std::filesystem::path& p, Image::ImageSize width) const;
+        DiskCache::EntryKey                     getEntryKey(const CacheEntryDesc& entryDesc, std::int64_t sourceTimestamp) const;
+        std::shared_ptr<Image::IEncodedImage>   getOrCreate(const DiskCache::EntryKey& entryKey, const std::function<std::shared_ptr<Image::IEncodedImage>()>& createFunc);
+        std::shared_ptr<Image::IEncodedImage>   createFromLargerBucket(const DiskCache::EntryKey& entryKey);
+        std::shared_ptr<Image::IEncodedImage>   createFromRawImage(const DiskCache::EntryKey& entryKey, Image::IRawImage& rawImage);
+        std::unique_ptr<Image::IEncodedImage>   resizeAndEncode(Image::IRawImage& rawImage, Image::ImageSize width, Image::EncodingFormat format) const;
+        Image::ImageSize                        getSizeBucket(Image::ImageSize size) const;
+        Image::EncodingFormat                   getSupportedFormat(Image::EncodingFormat format) const;
+        unsigned                                getQuality(Image::EncodingFormat format) const;
 
-        std::unique_ptr<Image::IEncodedImage>   getFromTrack(const std::filesystem::path& path, Image::ImageSize width) const;
+        std::unique_ptr<Image::IRawImage>       getFromAvMediaFile(const Av::IAudioFile& input, Image::ImageSize width) const;
+        std::unique_ptr<Image::IRawImage>       getFromCoverFile(const std::filesystem::path& p, Image::ImageSize width) const;
+
+        std::unique_ptr<Image::IRawImage>       getFromTrack(const std::filesystem::path& path, Image::ImageSize width) const;
         std::multimap<std::string, std::filesystem::path>   getCoverPaths(const std::filesystem::path& directoryPath) const;
-        std::unique_ptr<Image::IEncodedImage>   getFromDirectory(const std::filesystem::path& directory, Image::ImageSize width, const std::vector<std::string>& preferredFileNames, bool allowPickRandom) const;
-        std::unique_ptr<Image::IEncodedImage>   getFromSameNamedFile(const std::filesystem::path& filePath, Image::ImageSize width) const;
+        std::multimap<std::string, std::filesystem::path>   listCoverPaths(const std::filesystem::path& directoryPath) const;
+        std::unique_ptr<Image::IRawImage>       getFromDirectory(const std::filesystem::path& directory, Image::ImageSize width, const std::vector<std::string>& preferredFileNames, bool allowPickRandom, std::filesystem::path& coverPath) const;
+        std::unique_ptr<Image::IRawImage>       getFromSameNamedFile(const std::filesystem::path& filePath, Image::ImageSize width, std::filesystem::path& coverPath) const;
+        std::unique_ptr<Image::IRawImage>       getFromTrackOrSameNamedFile(const std::filesystem::path& trackPath, bool hasEmbeddedCover, Image::ImageSize width, std::filesystem::path& coverPath) const;
+        std::unique_ptr<Image::IRawImage>       getFromCoverSource(const std::filesystem::path& coverSource, Image::ImageSize width) const;
+
+        using CoverSourceId = std::variant<Database::ArtistId, Database::ReleaseId>;
+        std::optional<std::filesystem::path>    getCoverSource(const CoverSourceId& id, std::int64_t sourceTimestamp) const;
+        void                                    storeCoverSource(const CoverSourceId& id, const std::filesystem::path& coverSource, std::int64_t sourceTimestamp);
 
         bool                                    checkCoverFile(const std::filesystem::path& directoryPath) const;
 
+        // sourceTimestamp is the max last write time of everything the cover may come from (database, audio files, directories and cover files)
+        struct TrackInfo
+        {
+            bool hasCover{};
+            bool isMultiDisc{};
+            std::int64_t sourceTimestamp{};
+            std::filesystem::path trackPath;
+            std::optional<Database::ReleaseId> releaseId;
+        };
+        std::optional<TrackInfo>                getTrackInfo(Database::Session& dbSession, Database::TrackId trackId) const;
+
+        struct ReleaseInfo
+        {
+            std::filesystem::path firstTrackPath;
+            bool firstTrackHasCover{};
+            bool isMultiDisc{};
+            std::filesystem::path releaseDirectory;
+            std::int64_t sourceTimestamp{};
+        };
+        std::optional<ReleaseInfo>              getReleaseInfo(Database::ReleaseId releaseId) const;
+
+        struct ArtistInfo
+        {
+            std::vector<std::filesystem::path> searchPaths; // by order of preference
+            std::int64_t sourceTimestamp{};
+        };
+        std::optional<ArtistInfo>               getArtistInfo(Database::ArtistId artistId) const;
+
+        std::int64_t                            getDirectoryLastWriteTime(const std::filesystem::path& directory) const;
+        std::int64_t                            getSameNamedFilesLastWriteTime(const std::filesystem::path& filePath) const;
+
+        std::shared_ptr<Image::IEncodedImage>   createFromTrack(const TrackInfo& trackInfo, const DiskCache::EntryKey& entryKey);
+        std::shared_ptr<Image::IEncodedImage>   createFromRelease(const ReleaseInfo& releaseInfo, const DiskCache::EntryKey& entryKey);
+        std::shared_ptr<Image::IEncodedImage>   createFromArtist(const ArtistInfo& artistInfo, const DiskCache::EntryKey& entryKey);
+
         Database::Db& _db;
 
-        std::shared_mutex _cacheMutex;
-        std::unordered_map<CacheEntryDesc, std::shared_ptr<Image::IEncodedImage>> _cache;
-        std::unordered_map<Image::ImageSize, std::shared_ptr<Image::IEncodedImage>> _defaultCoverCache;
-        std::atomic<std::size_t>    _cacheMisses{};
-        std::atomic<std::size_t>    _cacheHits{};
-        std::size_t                 _cacheSize{};
+        std::shared_mutex _defaultCoverCacheMutex;
+        std::map<std::pair<Image::ImageSize, Image::EncodingFormat>, std::shared_ptr<Image::IEncodedImage>> _defaultCoverCache;
+
+        void saveToCache(const DiskCache::EntryKey& entryKey, std::shared_ptr<Image::IEncodedImage> image);
+        std::shared_ptr<Image::IEncodedImage> loadFromCache(const DiskCache::EntryKey& entryKey);
+
+        void saveToDiskCache(const DiskCache::EntryKey& entryKey, const Image::IEncodedImage& image);
+        std::shared_ptr<Image::IEncodedImage> loadFromDiskCache(const DiskCache::EntryKey& entryKey);
+
+        std::unique_ptr<DiskCache> _diskCache;
+
+        // cover candidates of directories, invalidated as soon as the directory is modified
+        struct CoverPathsCacheEntry
+        {
+            std::filesystem::file_time_type directoryLastWriteTime;
+            std::multimap<std::string, std::filesystem::path> coverPaths;
+        };
+        static constexpr std::size_t _maxCoverPathsCacheEntryCount{ 10'000 };
+        mutable std::shared_mutex _coverPathsCacheMutex;
+        mutable std::unordered_map<std::string, CoverPathsCacheEntry> _coverPathsCache;
+
+        // resolved cover sources of releases and artists (image file or audio file with an embedded cover, empty if none)
+        // a source is only used as long as the timestamp it was resolved for still matches
+        struct CoverSourceCacheEntry
+        {
+            std::int64_t sourceTimestamp;
+            std::filesystem::path coverSource;
+        };
+        static constexpr std::size_t _maxCoverSourcesCacheEntryCount{ 100'000 };
+        mutable std::shared_mutex _coverSourcesCacheMutex;
+        std::unordered_map<CoverSourceId, CoverSourceCacheEntry> _coverSourcesCache;
 
-        void saveToCache(const CacheEntryDesc& entryDesc, std::shared_ptr<Image::IEncodedImage> image);
-        std::shared_ptr<Image::IEncodedImage> loadFromCache(const CacheEntryDesc& entryDesc);
+        std::mutex _pendingCreationsMutex;
+        std::unordered_map<CacheEntryDesc, std::shared_future<std::shared_ptr<Image::IEncodedImage>>> _pendingCreations;
 
         const std::filesystem::path _defaultCoverPath;
         const std::size_t _maxCacheSize;
+        MemoryCache _cache;
         static inline const std::vector<std::filesystem::path> _fileExtensions{ ".jpg", ".jpeg", ".png", ".bmp" }; // TODO parametrize
         const std::size_t _maxFileSize;
         const std::vector<std::string> _preferredFileNames;
         const std::vector<std::string> _artistFileNames;
+        const std::vector<Image::ImageSize> _sizeBuckets; // sorted
         unsigned _jpegQuality;
+        unsigned _webpQuality;
     };
 
 } // namespace Cover
@@ -0,0 +1,235 @@
+/*
+ * Copyright (C) 2023 Emeric Poupon
+ *
+ * This file is part of LMS.
+ *
+ * LMS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LMS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "DiskCache.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <thread>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+#include <boost/asio/post.hpp>
+
+#include "utils/ILogger.hpp"
+
+namespace Cover
+{
+    namespace
+    {
+        // once over budget, evict entries until this ratio of the budget is reached
+        constexpr float evictionLowWatermark{ 0.9 };
+
+        struct EntryFileInfo
+        {
+            std::filesystem::path path;
+            std::filesystem::file_time_type lastWriteTime;
+            std::uintmax_t size;
+        };
+
+        template <typename Callback>
+        void visitEntryFiles(const std::filesystem::path& directory, Callback&& callback)
+        {
+            std::error_code ec;
+            std::filesystem::recursive_directory_iterator itPath{ directory, ec };
+            const std::filesystem::recursive_directory_iterator itEnd;
+            while (!ec && itPath != itEnd)
+            {
+                if (itPath->is_regular_file(ec))
+                {
+                    EntryFileInfo info;
+                    info.path = itPath->path();
+                    info.size = itPath->file_size(ec);
+                    if (!ec)
+                        info.lastWriteTime = itPath->last_write_time(ec);
+                    if (!ec)
+                        callback(info);
+                }
+
+                itPath.increment(ec);
+            }
+        }
+    }
+
+    DiskCache::DiskCache(const std::filesystem::path& directory, std::size_t maxSize)
+        : _directory{ directory }
+        , _maxSize{ maxSize }
+    {
+        std::filesystem::create_directories(_directory);
+
+        boost::asio::post(_ioContext, [this] { computeCurrentSize(); });
+    }
+
+    DiskCache::~DiskCache()
+    {
+        LMS_LOG(COVER, DEBUG, "Disk cache stats: hits = " << _hits << ", misses = " << _misses << ", size = " << _currentSize);
+    }
+
+    std::unique_ptr<Image::IEncodedImage> DiskCache::load(const EntryKey& key)
+    {
+        const std::filesystem::path entryPath{ getEntryPath(key) };
+
+        std::ifstream ifs{ entryPath, std::ios_base::binary | std::ios_base::ate };
+        if (!ifs)
+        {
+            _misses++;
+            return nullptr;
+        }
+
+        std::vector<std::byte> data(static_cast<std::size_t>(ifs.tellg()));
+        ifs.seekg(0);
+        ifs.read(reinterpret_cast<char*>(data.data()), data.size());
+        if (!ifs || data.empty())
+        {
+            LMS_LOG(COVER, ERROR, "Cannot read cached cover '" << entryPath.string() << "'");
+            _misses++;
+            return nullptr;
+        }
+
+        // last write time is used as last access time for the eviction
+        std::error_code ec;
+        std::filesystem::last_write_time(entryPath, std::filesystem::file_time_type::clock::now(), ec);
+
+        _hits++;
+        return Image::createEncodedImage(std::move(data), key.desc.format == Image::EncodingFormat::WebP ? "image/webp" : "image/jpeg");
+    }
+
+    void DiskCache::save(const EntryKey& key, const Image::IEncodedImage& image)
+    {
+        const std::filesystem::path entryPath{ getEntryPath(key) };
+        std::filesystem::path tmpEntryPath{ entryPath };
+        tmpEntryPath += "." + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())) + ".tmp";
+
+        std::error_code ec;
+        std::filesystem::create_directories(entryPath.parent_path(), ec);
+
+        // the entry may already exist (same cover created concurrently, etc.): do not account for its size twice
+        std::uintmax_t replacedSize{ std::filesystem::file_size(entryPath, ec) };
+        if (ec)
+            replacedSize = 0;
+
+        {
+            std::ofstream ofs{ tmpEntryPath, std::ios_base::binary | std::ios_base::trunc };
+            ofs.write(reinterpret_cast<const char*>(image.getData()), image.getDataSize());
+            if (!ofs)
+            {
+                LMS_LOG(COVER, ERROR, "Cannot write cached cover '" << tmpEntryPath.string() << "'");
+                ofs.close();
+                std::filesystem::remove(tmpEntryPath, ec);
+                return;
+            }
+        }
+
+        // rename is atomic: concurrent readers either see the full entry or nothing
+        std::filesystem::rename(tmpEntryPath, entryPath, ec);
+        if (ec)
+        {
+            LMS_LOG(COVER, ERROR, "Cannot rename cached cover '" << tmpEntryPath.string() << "': " << ec.message());
+            std::filesystem::remove(tmpEntryPath, ec);
+            return;
+        }
+
+        _currentSize += image.getDataSize();
+        _currentSize -= replacedSize;
+        scheduleEvictionIfNeeded();
+    }
+
+    std::filesystem::path DiskCache::getEntryPath(const EntryKey& key) const
+    {
+        std::filesystem::path res{ _directory };
+
+        std::visit([&](auto id)
+            {
+                using IdType = std::decay_t<decltype(id)>;
+
+                if constexpr (std::is_same_v<IdType, Database::ArtistId>)
+                    res /= "artist";
+                else if constexpr (std::is_same_v<IdType, Database::ReleaseId>)
+                    res /= "release";
+                else if constexpr (std::is_same_v<IdType, Database::TrackId>)
+                    res /= "track";
+
+                res /= std::to_string(id.getValue()) + "_" + std::to_string(key.desc.size) + "_" + std::to_string(key.quality) + "_" + std::to_string(key.sourceTimestamp) + (key.desc.format == Image::EncodingFormat::WebP ? ".webp" : ".jpg");
+            }, key.desc.id);
+
+        return res;
+    }
+
+    void DiskCache::computeCurrentSize()
+    {
+        std::size_t size{};
+        visitEntryFiles(_directory, [&](const EntryFileInfo& info)
+            {
+                size += info.size;
+            });
+
+        _currentSize += size;
+        LMS_LOG(COVER, INFO, "Disk cache size = " << _currentSize << ", max size = " << _maxSize);
+
+        scheduleEvictionIfNeeded();
+    }
+
+    void DiskCache::scheduleEvictionIfNeeded()
+    {
+        if (_currentSize <= _maxSize)
+            return;
+
+        if (_evictionScheduled.exchange(true))
+            return;
+
+        boost::asio::post(_ioContext, [this]
+            {
+                evict();
+                _evictionScheduled = false;
+            });
+    }
+
+    void DiskCache::evict()
+    {
+        std::vector<EntryFileInfo> entries;
+        std::size_t totalSize{};
+        visitEntryFiles(_directory, [&](const EntryFileInfo& info)
+            {
+                totalSize += info.size;
+                entries.push_back(info);
+            });
+
+        // least recently used first
+        std::sort(std::begin(entries), std::end(entries), [](const EntryFileInfo& lhs, const EntryFileInfo& rhs) { return lhs.lastWriteTime < rhs.lastWriteTime; });
+
+        const std::size_t targetSize{ static_cast<std::size_t>(_maxSize * evictionLowWatermark) };
+        std::size_t evictedCount{};
+        for (const EntryFileInfo& entry : entries)
+        {
+            if (totalSize <= targetSize)
+                break;
+
+            std::error_code ec;
+            if (std::filesystem::remove(entry.path, ec))
+            {
+                totalSize -= entry.size;
+                evictedCount++;
+            }
+        }
+
+        _currentSize = totalSize;
+        LMS_LOG(COVER, DEBUG, "Disk cache: evicted " << evictedCount << " entries, size = " << totalSize);
+    }
+} // ns Cover
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2023 Emeric Poupon
+ *
+ * This file is part of LMS.
+ *
+ * LMS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LMS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+
+#include <boost/asio/io_context.hpp>
+
+#include "image/IEncodedImage.hpp"
+#include "utils/IOContextRunner.hpp"
+#include "CacheEntryDesc.hpp"
+
+namespace Cover
+{
+    // Persistent cache tier, survives restarts and memory cache flushes
+    // Entries are never invalidated explicitly: the source timestamp and the quality are part of the key,
+    // outdated entries are just no longer hit and eventually evicted
+    class DiskCache
+    {
+    public:
+        struct EntryKey
+        {
+            CacheEntryDesc desc;
+            std::int64_t sourceTimestamp; // last write time of the cover source, in seconds since Epoch
+            unsigned quality;
+        };
+
+        DiskCache(const std::filesystem::path& directory, std::size_t maxSize);
+        ~DiskCache();
+
+        DiskCache(const DiskCache&) = delete;
+        DiskCache& operator=(const DiskCache&) = delete;
+
+        std::unique_ptr<Image::IEncodedImage> load(const EntryKey& key);
+        void save(const EntryKey& key, const Image::IEncodedImage& image);
+
+    private:
+        std::filesystem::path getEntryPath(const EntryKey& key) const;
+        void computeCurrentSize();
+        void scheduleEvictionIfNeeded();
+        void evict();
+
+        const std::filesystem::path _directory;
+        const std::size_t _maxSize;
+        std::atomic<std::size_t> _currentSize{};
+        std::atomic<bool> _evictionScheduled{};
+        std::atomic<std::size_t> _hits{};
+        std::atomic<std::size_t> _misses{};
+
+        boost::asio::io_context _ioContext;
+        IOContextRunner _ioContextRunner{ _ioContext, 1 };
+    };
+} // ns Cover
@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2023 Emeric Poupon
+ *
+ * This file is part of LMS.
+ *
+ * LMS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LMS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "MemoryCache.hpp"
+
+namespace Cover
+{
+    namespace
+    {
+        constexpr float protectedSegmentRatio{ 0.8 };
+        constexpr float maxEntrySizeRatio{ 0.25 }; // bigger entries would evict too many entries at once
+    }
+
+    MemoryCache::MemoryCache(std::size_t maxSize)
+        : _maxShardSize{ maxSize / _shardCount }
+        , _maxProtectedSize{ static_cast<std::size_t>(_maxShardSize * protectedSegmentRatio) }
+        , _maxEntrySize{ static_cast<std::size_t>(_maxShardSize * maxEntrySizeRatio) }
+    {
+    }
+
+    std::shared_ptr<Image::IEncodedImage> MemoryCache::load(const CacheEntryDesc& entryDesc, std::int64_t sourceTimestamp)
+    {
+        Shard& shard{ getShard(entryDesc) };
+        const std::scoped_lock lock{ shard.mutex };
+
+        auto itEntry{ shard.entries.find(entryDesc) };
+        if (itEntry == std::cend(shard.entries) || itEntry->second->sourceTimestamp != sourceTimestamp)
+        {
+            shard.misses++;
+            return nullptr;
+        }
+
+        shard.hits++;
+        promote(shard, itEntry->second);
+
+        return itEntry->second->image;
+    }
+
+    void MemoryCache::save(const CacheEntryDesc& entryDesc, std::shared_ptr<Image::IEncodedImage> image, std::int64_t sourceTimestamp)
+    {
+        const std::size_t imageSize{ image->getDataSize() };
+        if (imageSize > _maxEntrySize)
+            return;
+
+        Shard& shard{ getShard(entryDesc) };
+        const std::scoped_lock lock{ shard.mutex };
+
+        if (auto itEntry{ shard.entries.find(entryDesc) }; itEntry != std::cend(shard.entries))
+        {
+            if (itEntry->second->sourceTimestamp == sourceTimestamp)
+            {
+                // may happen if several threads computed the same entry
+                promote(shard, itEntry->second);
+                return;
+            }
+
+            // the source has changed
+            erase(shard, itEntry->second);
+        }
+
+        evict(shard, imageSize);
+
+        shard.probationaryEntries.push_front(Entry{ entryDesc, std::move(image), sourceTimestamp, Segment::Probationary });
+        shard.probationarySize += imageSize;
+        shard.entries.emplace(entryDesc, std::begin(shard.probationaryEntries));
+    }
+
+    void MemoryCache::clear()
+    {
+        for (Shard& shard : _shards)
+        {
+            const std::scoped_lock lock{ shard.mutex };
+
+            shard.entries.clear();
+            shard.probationaryEntries.clear();
+            shard.protectedEntries.clear();
+            shard.probationarySize = 0;
+            shard.protectedSize = 0;
+            shard.hits = 0;
+            shard.misses = 0;
+        }
+    }
+
+    std::vector<CacheShardStats> MemoryCache::getStats() const
+    {
+        std::vector<CacheShardStats> res;
+        res.reserve(_shardCount);
+
+        for (const Shard& shard : _shards)
+        {
+            const std::scoped_lock lock{ shard.mutex };
+
+            CacheShardStats& stats{ res.emplace_back() };
+            stats.hits = shard.hits;
+            stats.misses = shard.misses;
+            stats.entryCount = shard.entries.size();
+            stats.size = shard.probationarySize + shard.protectedSize;
+            stats.maxSize = _maxShardSize;
+        }
+
+        return res;
+    }
+
+    MemoryCache::Shard& MemoryCache::getShard(const CacheEntryDesc& entryDesc)
+    {
+        return _shards[std::hash<CacheEntryDesc>{}(entryDesc) % _shardCount];
+    }
+
+    void MemoryCache::promote(Shard& shard, EntryList::iterator it)
+    {
+        const std::size_t entrySize{ it->image->getDataSize() };
+
+        if (it->segment == Segment::Protected)
+        {
+            shard.protectedEntries.splice(std::begin(shard.protectedEntries), shard.protectedEntries, it);
+            return;
+        }
+
+        it->segment = Segment::Protected;
+        shard.protectedEntries.splice(std::begin(shard.protectedEntries), shard.probationaryEntries, it);
+        shard.probationarySize -= entrySize;
+        shard.protectedSize += entrySize;
+
+        // demote the least recently used protected entries, they get another chance in the probationary segment
+        while (shard.protectedSize > _maxProtectedSize)
+        {
+            auto itDemoted{ std::prev(std::end(shard.protectedEntries)) };
+            const std::size_t demotedSize{ itDemoted->image->getDataSize() };
+
+            itDemoted->segment = Segment::Probationary;
+            shard.probationaryEntries.splice(std::begin(shard.probationaryEntries), shard.protectedEntries, itDemoted);
+            shard.protectedSize -= demotedSize;
+            shard.probationarySize += demotedSize;
+        }
+    }
+
+    void MemoryCache::erase(Shard& shard, EntryList::iterator it)
+    {
+        const bool isProtected{ it->segment == Segment::Protected };
+        (isProtected ? shard.protectedSize : shard.probationarySize) -= it->image->getDataSize();
+        shard.entries.erase(it->desc);
+        (isProtected ? shard.protectedEntries : shard.probationaryEntries).erase(it);
+    }
+
+    void MemoryCache::evict(Shard& shard, std::size_t requiredSize)
+    {
+        while (shard.probationarySize + shard.protectedSize + requiredSize > _maxShardSize)
+        {
+            const bool evictProtected{ shard.probationaryEntries.empty() };
+            EntryList& entries{ evictProtected ? shard.protectedEntries : shard.probationaryEntries };
+            if (entries.empty())
+                break;
+
+            const Entry& entry{ entries.back() };
+            (evictProtected ? shard.protectedSize : shard.probationarySize) -= entry.image->getDataSize();
+            shard.entries.erase(entry.desc);
+            entries.pop_back();
+        }
+    }
+} // ns Cover
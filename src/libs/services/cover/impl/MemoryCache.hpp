@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2023 Emeric Poupon
+ *
+ * This file is part of LMS.
+ *
+ * LMS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LMS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "image/IEncodedImage.hpp"
+#include "services/cover/ICoverService.hpp"
+#include "CacheEntryDesc.hpp"
+
+namespace Cover
+{
+    // Size-aware segmented LRU cache, sharded to reduce lock contention
+    // New entries go to the probationary segment, entries hit at least twice are promoted to the protected segment
+    // One-off entries are therefore evicted first and cannot flush hot ones
+    class MemoryCache
+    {
+    public:
+        MemoryCache(std::size_t maxSize);
+
+        MemoryCache(const MemoryCache&) = delete;
+        MemoryCache& operator=(const MemoryCache&) = delete;
+
+        // Entries created from an older source (different source timestamp) are not returned
+        std::shared_ptr<Image::IEncodedImage> load(const CacheEntryDesc& entryDesc, std::int64_t sourceTimestamp);
+        void save(const CacheEntryDesc& entryDesc, std::shared_ptr<Image::IEncodedImage> image, std::int64_t sourceTimestamp);
+        void clear();
+
+        std::vector<CacheShardStats> getStats() const;
+
+    private:
+        enum class Segment
+        {
+            Probationary,
+            Protected,
+        };
+
+        struct Entry
+        {
+            CacheEntryDesc desc;
+            std::shared_ptr<Image::IEncodedImage> image;
+            std::int64_t sourceTimestamp;
+            Segment segment;
+        };
+        using EntryList = std::list<Entry>; // most recently used first
+
+        struct Shard
+        {
+            mutable std::mutex mutex;
+            std::unordered_map<CacheEntryDesc, EntryList::iterator> entries;
+            EntryList probationaryEntries;
+            EntryList protectedEntries;
+            std::size_t probationarySize{};
+            std::size_t protectedSize{};
+            std::size_t hits{};
+            std::size_t misses{};
+        };
+
+        Shard& getShard(const CacheEntryDesc& entryDesc);
+        void promote(Shard& shard, EntryList::iterator it);
+        void erase(Shard& shard, EntryList::iterator it);
+        void evict(Shard& shard, std::size_t requiredSize);
+
+        static constexpr std::size_t _shardCount{ 8 };
+        const std::size_t _maxShardSize;
+        const std::size_t _maxProtectedSize;
+        const std::size_t _maxEntrySize;
+        std::array<Shard, _shardCount> _shards;
+    };
+} // ns Cover
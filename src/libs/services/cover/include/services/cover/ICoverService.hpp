@@ -21,6 +21,8 @@
 
 #include <filesystem>
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "database/ArtistId.hpp"
 #include "database/ReleaseId.hpp"
@@ -34,20 +36,39 @@ namespace Database
 
 namespace Cover
 {
+    struct CacheShardStats
+    {
+        std::size_t hits{};
+        std::size_t misses{};
+        std::size_t entryCount{};
+        std::size_t size{}; // in bytes
+        std::size_t maxSize{}; // in bytes
+    };
+
     class ICoverService
     {
     public:
         virtual ~ICoverService() = default;
 
-        virtual std::shared_ptr<Image::IEncodedImage> getFromTrack(Database::TrackId trackId, Image::ImageSize width) = 0;
-        virtual std::shared_ptr<Image::IEncodedImage> getFromRelease(Database::ReleaseId releaseId, Image::ImageSize width) = 0;
-        virtual std::shared_ptr<Image::IEncodedImage> getFromArtist(Database::ArtistId artistId, Image::ImageSize width) = 0;
+        // If the requested format cannot be encoded, JPEG is used instead (see the returned image mime type)
+        virtual std::shared_ptr<Image::IEncodedImage> getFromTrack(Database::TrackId trackId, Image::ImageSize width, Image::EncodingFormat format) = 0;
+        virtual std::shared_ptr<Image::IEncodedImage> getFromRelease(Database::ReleaseId releaseId, Image::ImageSize width, Image::EncodingFormat format) = 0;
+        virtual std::shared_ptr<Image::IEncodedImage> getFromArtist(Database::ArtistId artistId, Image::ImageSize width, Image::EncodingFormat format) = 0;
+
+        // Opaque tag (to be quoted) identifying the image returned for the same parameters, can be used to build HTTP validators without getting the image
+        // Only changes when the cover source or the encoding settings change. Empty if there is no such track, release or artist
+        virtual std::string getETag(Database::TrackId trackId, Image::ImageSize width, Image::EncodingFormat format) = 0;
+        virtual std::string getETag(Database::ReleaseId releaseId, Image::ImageSize width, Image::EncodingFormat format) = 0;
+        virtual std::string getETag(Database::ArtistId artistId, Image::ImageSize width, Image::EncodingFormat format) = 0;
 
-        virtual std::shared_ptr<Image::IEncodedImage> getDefault(Image::ImageSize width) = 0;
+        virtual std::shared_ptr<Image::IEncodedImage> getDefault(Image::ImageSize width, Image::EncodingFormat format) = 0;
+        virtual bool isEncodingFormatSupported(Image::EncodingFormat format) const = 0;
 
         virtual void flushCache() = 0;
+        virtual std::vector<CacheShardStats> getCacheStats() const = 0;
 
         virtual void setJpegQuality(unsigned quality) = 0; // from 1 to 100
+        virtual void setWebPQuality(unsigned quality) = 0; // from 1 to 100
     };
 
     std::unique_ptr<ICoverService> createCoverService(Database::Db& db, const std::filesystem::path& execPath, const std::filesystem::path& defaultCoverPath);
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2023 Emeric Poupon
+ *
+ * This file is part of LMS.
+ *
+ * LMS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LMS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Helpers to read and write the binary cache files, in native byte order
+namespace Recommendation::BinaryFile
+{
+    // FNV-1a, 64 bits
+    class Checksum
+    {
+    public:
+        void update(const void* data, std::size_t size)
+        {
+            const auto* bytes{ static_cast<const unsigned char*>(data) };
+            for (std::size_t i{}; i < size; ++i)
+            {
+                _hash ^= bytes[i];
+                _hash *= 0x100000001b3ULL;
+            }
+        }
+
+        std::uint64_t getValue() const { return _hash; }
+
+    private:
+        std::uint64_t _hash{ 0xcbf29ce484222325ULL };
+    };
+
+    class MappedFile
+    {
+    public:
+        MappedFile(const std::filesystem::path& path)
+        {
+            const int fd{ ::open(path.c_str(), O_RDONLY) };
+            if (fd < 0)
+                return;
+
+            struct stat fileStat;
+            if (::fstat(fd, &fileStat) == 0 && fileStat.st_size > 0)
+            {
+                void* data{ ::mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0) };
+                if (data != MAP_FAILED)
+                {
+                    _data = static_cast<const std::byte*>(data);
+                    _size = fileStat.st_size;
+                }
+            }
+
+            ::close(fd);
+        }
+
+        ~MappedFile()
+        {
+            if (_data)
+                ::munmap(const_cast<std::byte*>(_data), _size);
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        const std::byte* getData() const { return _data; }
+        std::size_t getSize() const { return _size; }
+
+    private:
+        const std::byte* _data{};
+        std::size_t _size{};
+    };
+
+    template <typename T>
+    T readValue(const std::byte*& data)
+    {
+        T value;
+        std::memcpy(&value, data, sizeof(T));
+        data += sizeof(T);
+
+        return value;
+    }
+
+    template <typename T>
+    void readValues(const std::byte*& data, T* values, std::size_t count)
+    {
+        if (count == 0)
+            return; // values may be null
+
+        std::memcpy(values, data, sizeof(T) * count);
+        data += sizeof(T) * count;
+    }
+
+    template <typename T>
+    void writeValue(std::ofstream& ofs, Checksum& checksum, const T& value)
+    {
+        ofs.write(reinterpret_cast<const char*>(&value), sizeof(T));
+        checksum.update(&value, sizeof(T));
+    }
+
+    template <typename T>
+    void writeValues(std::ofstream& ofs, Checksum& checksum, const T* values, std::size_t count)
+    {
+        ofs.write(reinterpret_cast<const char*>(values), sizeof(T) * count);
+        checksum.update(values, sizeof(T) * count);
+    }
+} // namespace Recommendation::BinaryFile
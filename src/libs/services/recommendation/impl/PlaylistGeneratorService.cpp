@@ -19,6 +19,9 @@
 
 #include "PlaylistGeneratorService.hpp"
 
+#include <algorithm>
+#include <limits>
+
 #include "database/Db.hpp"
 #include "database/Session.hpp"
 #include "database/Track.hpp"
@@ -26,6 +29,7 @@
 #include "playlist-constraints/ConsecutiveArtists.hpp"
 #include "playlist-constraints/ConsecutiveReleases.hpp"
 #include "playlist-constraints/DuplicateTracks.hpp"
+#include "playlist-constraints/TrackTable.hpp"
 #include "utils/ILogger.hpp"
 
 namespace Recommendation
@@ -41,8 +45,8 @@ namespace Recommendation
         : _db{ db }
         , _recommendationService{ recommendationService }
     {
-        _constraints.push_back(std::make_unique<PlaylistGeneratorConstraint::ConsecutiveArtists>(_db));
-        _constraints.push_back(std::make_unique<PlaylistGeneratorConstraint::ConsecutiveReleases>(_db));
+        _constraints.push_back(std::make_unique<PlaylistGeneratorConstraint::ConsecutiveArtists>());
+        _constraints.push_back(std::make_unique<PlaylistGeneratorConstraint::ConsecutiveReleases>());
         _constraints.push_back(std::make_unique<PlaylistGeneratorConstraint::DuplicateTracks>());
     }
 
@@ -51,12 +55,31 @@ namespace Recommendation
         LMS_LOG(RECOMMENDATION, DEBUG, "Requested to extend playlist by " << maxCount << " similar tracks");
 
         // supposed to be ordered from most similar to least similar
-        std::vector<TrackId> similarTracks{ _recommendationService.findSimilarTracks(tracklistId, maxCount * 2) }; // ask for more tracks than we need as it will be easier to respect constraints
+        const std::vector<TrackId> similarTrackIds{ _recommendationService.findSimilarTracks(tracklistId, maxCount * 2) }; // ask for more tracks than we need as it will be easier to respect constraints
+        if (similarTrackIds.empty())
+            return {};
+
+        const std::vector<TrackId> startingTrackIds{ getTracksFromTrackList(tracklistId) };
 
-        const std::vector<TrackId> startingTracks{ getTracksFromTrackList(tracklistId) };
+        // Constraints only work on prefetched data
+        using PlaylistGeneratorConstraint::TrackTable;
+        const TrackTable trackTable{ _db, [&]
+        {
+            std::vector<TrackId> trackIds{ startingTrackIds };
+            trackIds.insert(std::end(trackIds), std::cbegin(similarTrackIds), std::cend(similarTrackIds));
+            return trackIds;
+        }() };
 
-        std::vector<TrackId> finalResult = startingTracks;
-        finalResult.reserve(startingTracks.size() + maxCount);
+        auto toTrackIndexes{ [&](const std::vector<TrackId>& trackIds)
+        {
+            std::vector<TrackTable::TrackIndex> res;
+            res.reserve(trackIds.size() + maxCount);
+            std::transform(std::cbegin(trackIds), std::cend(trackIds), std::back_inserter(res), [&](TrackId trackId) { return trackTable.getIndex(trackId); });
+            return res;
+        } };
+
+        std::vector<TrackTable::TrackIndex> similarTracks{ toTrackIndexes(similarTrackIds) };
+        std::vector<TrackTable::TrackIndex> finalResult{ toTrackIndexes(startingTrackIds) };
 
         std::vector<float> scores;
         for (std::size_t i{}; i < maxCount; ++i)
@@ -64,18 +87,17 @@ namespace Recommendation
             if (similarTracks.empty())
                 break;
 
-            scores.resize(similarTracks.size(), {});
+            // tracks not evaluated because of the early exit must not be selected
+            scores.assign(similarTracks.size(), std::numeric_limits<float>::max());
 
             // select the similar track that has the best score
             for (std::size_t trackIndex{}; trackIndex < similarTracks.size(); ++trackIndex)
             {
-                using namespace Database::Debug;
-
                 finalResult.push_back(similarTracks[trackIndex]);
 
                 scores[trackIndex] = 0;
                 for (const auto& constraint : _constraints)
-                    scores[trackIndex] += constraint->computeScore(finalResult, finalResult.size() - 1);
+                    scores[trackIndex] += constraint->computeScore(trackTable, finalResult, finalResult.size() - 1);
 
                 finalResult.pop_back();
 
@@ -92,7 +114,11 @@ namespace Recommendation
         }
 
         // for now, just get some more similar tracks
-        return std::vector(std::cbegin(finalResult) + startingTracks.size(), std::cend(finalResult));
+        TrackContainer res;
+        res.reserve(finalResult.size() - startingTrackIds.size());
+        std::transform(std::cbegin(finalResult) + startingTrackIds.size(), std::cend(finalResult), std::back_inserter(res), [&](TrackTable::TrackIndex index) { return trackTable.getTrackId(index); });
+
+        return res;
     }
 
     TrackContainer PlaylistGeneratorService::getTracksFromTrackList(Database::TrackListId tracklistId) const
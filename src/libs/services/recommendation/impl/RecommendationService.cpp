@@ -19,105 +19,275 @@
 
 #include "RecommendationService.hpp"
 
+#include <algorithm>
 #include <unordered_map>
 #include <vector>
 
+#include <boost/asio/post.hpp>
+
 #include "ClustersEngineCreator.hpp"
 #include "FeaturesEngineCreator.hpp"
+#include "HnswEngineCreator.hpp"
 
 #include "database/Db.hpp"
 #include "database/Session.hpp"
 #include "database/ScanSettings.hpp"
 #include "utils/Exception.hpp"
+#include "utils/IConfig.hpp"
 #include "utils/ILogger.hpp"
+#include "utils/Service.hpp"
 
 namespace Recommendation
 {
     namespace
     {
-        Database::ScanSettings::SimilarityEngineType getSimilarityEngineType(Database::Session& session)
+        std::optional<EngineType> getEngineTypeFromScanSettings(Database::Session& session)
+        {
+            using namespace Database;
+
+            ScanSettings::SimilarityEngineType similarityEngineType;
+            {
+                auto transaction{ session.createReadTransaction() };
+                similarityEngineType = ScanSettings::get(session)->getSimilarityEngineType();
+            }
+
+            switch (similarityEngineType)
+            {
+            case ScanSettings::SimilarityEngineType::Clusters:
+                return EngineType::Clusters;
+
+            case ScanSettings::SimilarityEngineType::FeaturesNearestNeighbours:
+                return EngineType::Hnsw;
+
+            case ScanSettings::SimilarityEngineType::Features:
+            case ScanSettings::SimilarityEngineType::None:
+                break;
+            }
+
+            return std::nullopt;
+        }
+
+        template <typename IdType>
+        ResultCache::Result toCacheResult(const std::vector<IdType>& ids)
         {
-            auto transaction{ session.createReadTransaction() };
+            ResultCache::Result res;
+            res.reserve(ids.size());
+            std::transform(std::cbegin(ids), std::cend(ids), std::back_inserter(res), [](IdType id) { return id.getValue(); });
 
-            return Database::ScanSettings::get(session)->getSimilarityEngineType();
+            return res;
+        }
+
+        template <typename IdType>
+        std::vector<IdType> fromCacheResult(const ResultCache::Result& result)
+        {
+            std::vector<IdType> res;
+            res.reserve(result.size());
+            std::transform(std::cbegin(result), std::cend(result), std::back_inserter(res), [](Database::IdType::ValueType id) { return IdType{ id }; });
+
+            return res;
+        }
+
+        // generation must be retrieved before the engine used by computeFunc
+        template <typename IdType, typename ComputeFunc>
+        std::vector<IdType> findOrCompute(ResultCache& cache, std::size_t generation, const ResultCache::Key& key, ComputeFunc computeFunc)
+        {
+            if (const std::optional<ResultCache::Result> result{ cache.find(key) })
+                return fromCacheResult<IdType>(*result);
+
+            std::vector<IdType> res{ computeFunc() };
+            cache.insert(key, toCacheResult(res), generation);
+
+            return res;
         }
     }
 
-    std::unique_ptr<IRecommendationService> createRecommendationService(Database::Db& db)
+    std::unique_ptr<IRecommendationService> createRecommendationService(Database::Db& db, std::optional<EngineType> engineType)
     {
-        return std::make_unique<RecommendationService>(db);
+        return std::make_unique<RecommendationService>(db, engineType);
     }
 
-    RecommendationService::RecommendationService(Database::Db& db)
+    RecommendationService::RecommendationService(Database::Db& db, std::optional<EngineType> engineType)
         : _db{ db }
+        , _forcedEngineType{ engineType }
+        , _cache{ Service<IConfig>::get()->getULong("recommendation-max-cache-entry-count", 1000) }
     {
         load();
     }
 
+    RecommendationService::~RecommendationService()
+    {
+        const std::scoped_lock lock{ _loadMutex };
+        cancelPendingLoad();
+    }
+
     TrackContainer RecommendationService::findSimilarTracks(Database::TrackListId trackListId, std::size_t maxCount) const
     {
         TrackContainer res;
 
-        if (!_engine)
+        const std::shared_ptr<IEngine> engine{ getEngine() };
+        if (!engine)
             return res;
 
-        return _engine->findSimilarTracksFromTrackList(trackListId, maxCount);
+        // Not cached: tracklists (play queues) change between calls
+        return engine->findSimilarTracksFromTrackList(trackListId, maxCount);
     }
 
     TrackContainer RecommendationService::findSimilarTracks(const std::vector<Database::TrackId>& trackIds, std::size_t maxCount) const
     {
         TrackContainer res;
 
-        if (!_engine)
+        const std::size_t cacheGeneration{ _cache.getGeneration() };
+        const std::shared_ptr<IEngine> engine{ getEngine() };
+        if (!engine)
             return res;
 
-        return _engine->findSimilarTracks(trackIds, maxCount);
+        ResultCache::Key key{ ResultCache::Key::Type::SimilarTracks, toCacheResult(trackIds), {}, maxCount };
+        std::sort(std::begin(key.ids), std::end(key.ids));
+        key.ids.erase(std::unique(std::begin(key.ids), std::end(key.ids)), std::end(key.ids));
+
+        return findOrCompute<Database::TrackId>(_cache, cacheGeneration, key, [&] { return engine->findSimilarTracks(trackIds, maxCount); });
     }
 
     ReleaseContainer RecommendationService::getSimilarReleases(Database::ReleaseId releaseId, std::size_t maxCount) const
     {
         ReleaseContainer res;
 
-        if (!_engine)
+        const std::size_t cacheGeneration{ _cache.getGeneration() };
+        const std::shared_ptr<IEngine> engine{ getEngine() };
+        if (!engine)
             return res;
 
-        return _engine->getSimilarReleases(releaseId, maxCount);;
+        const ResultCache::Key key{ ResultCache::Key::Type::SimilarReleases, { releaseId.getValue() }, {}, maxCount };
+        return findOrCompute<Database::ReleaseId>(_cache, cacheGeneration, key, [&] { return engine->getSimilarReleases(releaseId, maxCount); });
     }
 
     ArtistContainer RecommendationService::getSimilarArtists(Database::ArtistId artistId, EnumSet<Database::TrackArtistLinkType> linkTypes, std::size_t maxCount) const
     {
         ArtistContainer res;
 
-        if (!_engine)
+        const std::size_t cacheGeneration{ _cache.getGeneration() };
+        const std::shared_ptr<IEngine> engine{ getEngine() };
+        if (!engine)
             return res;
 
-        return _engine->getSimilarArtists(artistId, linkTypes, maxCount);
+        const ResultCache::Key key{ ResultCache::Key::Type::SimilarArtists, { artistId.getValue() }, linkTypes.getBitfield(), maxCount };
+        return findOrCompute<Database::ArtistId>(_cache, cacheGeneration, key, [&] { return engine->getSimilarArtists(artistId, linkTypes, maxCount); });
+    }
+
+    void RecommendationService::flushCache()
+    {
+        const CacheStats stats{ _cache.getStats() };
+        const std::size_t requestCount{ stats.hits + stats.misses };
+        LMS_LOG(RECOMMENDATION, DEBUG, "Cache stats: hits = " << stats.hits << ", misses = " << stats.misses << ", hit rate = " << (requestCount ? (stats.hits * 100 / requestCount) : 0) << "%, nb entries = " << stats.entryCount << "/" << stats.maxEntryCount);
+
+        _cache.clear();
+    }
 
-        return res;
+    CacheStats RecommendationService::getCacheStats() const
+    {
+        return _cache.getStats();
     }
 
     void RecommendationService::load()
     {
-        using namespace Database;
+        const std::scoped_lock lock{ _loadMutex };
 
-        switch (getSimilarityEngineType(_db.getTLSSession()))
+        cancelPendingLoad();
+
+        const std::optional<EngineType> engineType{ getEngineType() };
+        const std::shared_ptr<IEngine> engine{ engineType ? createEngine(*engineType) : nullptr };
+        if (!engine)
         {
-        case ScanSettings::SimilarityEngineType::Clusters:
-            if (_engineType != EngineType::Clusters)
+            std::atomic_store(&_engine, std::shared_ptr<IEngine>{});
+            flushCache();
+            return;
+        }
+
+        // The clusters engine can already answer using the database while its similarity tables are computed:
+        // use it right away if there is no other engine to serve meanwhile
+        if (*engineType == EngineType::Clusters && !getEngine())
+        {
+            std::atomic_store(&_engine, engine);
+            flushCache();
+        }
+
+        // Build the new engine off to the side, the current one is still used meanwhile
+        _pendingEngine = engine;
+        auto loadTask{ std::make_shared<std::packaged_task<void()>>([this, engine]
+        {
+            try
+            {
+                engine->load(false);
+            }
+            catch (const std::exception& e)
             {
-                _engineType = EngineType::Clusters;
-                _engine = createClustersEngine(_db);
+                LMS_LOG(RECOMMENDATION, ERROR, "Cannot load recommendation engine: " << e.what());
+                return;
             }
-            break;
 
-        case ScanSettings::SimilarityEngineType::Features:
-        case ScanSettings::SimilarityEngineType::None:
-            _engineType.reset();
-            _engine.reset();
-            break;
+            // A partially loaded engine must not be used
+            if (_pendingLoadCancelled)
+                return;
+
+            std::atomic_store(&_engine, engine);
+            flushCache();
+            LMS_LOG(RECOMMENDATION, INFO, "New recommendation engine in use");
+        }) };
+
+        _pendingLoad = loadTask->get_future();
+        boost::asio::post(_loadIoContext, [loadTask] { (*loadTask)(); });
+    }
+
+    void RecommendationService::waitForLoad()
+    {
+        const std::scoped_lock lock{ _loadMutex };
+
+        if (_pendingLoad.valid())
+            _pendingLoad.wait();
+        _pendingEngine.reset();
+    }
+
+    std::optional<EngineType> RecommendationService::getEngineType() const
+    {
+        return _forcedEngineType ? _forcedEngineType : getEngineTypeFromScanSettings(_db.getTLSSession());
+    }
+
+    std::shared_ptr<IEngine> RecommendationService::createEngine(EngineType engineType) const
+    {
+        switch (engineType)
+        {
+        case EngineType::Clusters:
+            return createClustersEngine(_db);
+
+        case EngineType::Features:
+            return createFeaturesEngine(_db);
+
+        case EngineType::Hnsw:
+            return createHnswEngine(_db);
         }
 
-        if (_engine)
-            _engine->load(false);
+        return {};
+    }
+
+    std::shared_ptr<IEngine> RecommendationService::getEngine() const
+    {
+        return std::atomic_load(&_engine);
+    }
+
+    void RecommendationService::cancelPendingLoad()
+    {
+        // must be called with _loadMutex held
+        if (_pendingEngine)
+        {
+            _pendingLoadCancelled = true;
+            _pendingEngine->requestCancelLoad();
+        }
+
+        if (_pendingLoad.valid())
+            _pendingLoad.wait();
+
+        _pendingLoad = {};
+        _pendingEngine.reset();
+        _pendingLoadCancelled = false;
     }
 } // ns Similarity
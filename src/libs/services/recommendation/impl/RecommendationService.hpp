@@ -19,10 +19,18 @@
 
 #pragma once
 
+#include <atomic>
+#include <future>
+#include <memory>
+#include <mutex>
 #include <optional>
 
+#include <boost/asio/io_context.hpp>
+
 #include "services/recommendation/IRecommendationService.hpp"
+#include "utils/IOContextRunner.hpp"
 #include "IEngine.hpp"
+#include "ResultCache.hpp"
 
 namespace Database
 {
@@ -31,36 +39,45 @@ namespace Database
 
 namespace Recommendation
 {
-    enum class EngineType
-    {
-        Clusters,
-        Features,
-    };
-
     class RecommendationService : public IRecommendationService
     {
     public:
-        RecommendationService(Database::Db& db);
-        ~RecommendationService() = default;
+        RecommendationService(Database::Db& db, std::optional<EngineType> engineType);
+        ~RecommendationService();
 
         RecommendationService(const RecommendationService&) = delete;
         RecommendationService& operator=(const RecommendationService&) = delete;
 
     private:
         void load() override;
+        void waitForLoad() override;
 
         TrackContainer findSimilarTracks(Database::TrackListId tracklistId, std::size_t maxCount) const override;
         TrackContainer findSimilarTracks(const std::vector<Database::TrackId>& tracksId, std::size_t maxCount) const override;
         ReleaseContainer getSimilarReleases(Database::ReleaseId releaseId, std::size_t maxCount) const override;
         ArtistContainer getSimilarArtists(Database::ArtistId artistId, EnumSet<Database::TrackArtistLinkType> linkTypes, std::size_t maxCount) const override;
 
-        void setEnginePriorities(const std::vector<EngineType>& engineTypes);
-        void clearEngines();
-        void loadPendingEngine(EngineType engineType, std::unique_ptr<IEngine> engine, bool forceReload, const ProgressCallback& progressCallback);
+        void flushCache() override;
+        CacheStats getCacheStats() const override;
+
+        std::optional<EngineType> getEngineType() const;
+        std::shared_ptr<IEngine> createEngine(EngineType engineType) const;
+        std::shared_ptr<IEngine> getEngine() const;
+        void cancelPendingLoad();
 
         Database::Db& _db;
-        std::optional<EngineType> _engineType;
-        std::unique_ptr<IEngine> _engine;
+        const std::optional<EngineType> _forcedEngineType;
+        std::shared_ptr<IEngine> _engine;	// only accessed using atomic operations, replaced once a new engine is fully loaded
+        mutable ResultCache _cache;
+
+        std::mutex _loadMutex;	// serializes load requests
+        std::shared_ptr<IEngine> _pendingEngine;	// being loaded by the load thread
+        std::atomic<bool> _pendingLoadCancelled{};
+        std::future<void> _pendingLoad;
+
+        // Single long-lived load thread: database sessions are per thread and kept as long as the database is
+        boost::asio::io_context _loadIoContext;
+        IOContextRunner _loadIoContextRunner{ _loadIoContext, 1 };
     };
 
 } // ns Recommendation
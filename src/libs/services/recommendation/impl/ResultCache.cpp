@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2023 Emeric Poupon
+ *
+ * This file is part of LMS.
+ *
+ * LMS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LMS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ResultCache.hpp"
+
+namespace Recommendation
+{
+    ResultCache::ResultCache(std::size_t maxEntryCount)
+        : _maxEntryCount{ maxEntryCount }
+    {
+    }
+
+    std::size_t ResultCache::getGeneration() const
+    {
+        const std::scoped_lock lock{ _mutex };
+        return _generation;
+    }
+
+    std::optional<ResultCache::Result> ResultCache::find(const Key& key)
+    {
+        const std::scoped_lock lock{ _mutex };
+
+        auto itEntry{ _entries.find(key) };
+        if (itEntry == std::cend(_entries))
+        {
+            _misses++;
+            return std::nullopt;
+        }
+
+        _hits++;
+        _entryList.splice(std::begin(_entryList), _entryList, itEntry->second);
+
+        return itEntry->second->result;
+    }
+
+    void ResultCache::insert(const Key& key, Result result, std::size_t generation)
+    {
+        if (_maxEntryCount == 0)
+            return;
+
+        const std::scoped_lock lock{ _mutex };
+
+        // computed using a previous engine
+        if (generation != _generation)
+            return;
+
+        // may happen if several threads computed the same entry
+        if (_entries.find(key) != std::cend(_entries))
+            return;
+
+        if (_entries.size() == _maxEntryCount)
+        {
+            _entries.erase(_entryList.back().key);
+            _entryList.pop_back();
+        }
+
+        _entryList.push_front(Entry{ key, std::move(result) });
+        _entries.emplace(key, std::begin(_entryList));
+    }
+
+    void ResultCache::clear()
+    {
+        const std::scoped_lock lock{ _mutex };
+
+        _entries.clear();
+        _entryList.clear();
+        _generation++;
+        _hits = 0;
+        _misses = 0;
+    }
+
+    CacheStats ResultCache::getStats() const
+    {
+        const std::scoped_lock lock{ _mutex };
+
+        CacheStats stats;
+        stats.hits = _hits;
+        stats.misses = _misses;
+        stats.entryCount = _entries.size();
+        stats.maxEntryCount = _maxEntryCount;
+
+        return stats;
+    }
+} // ns Recommendation
@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2023 Emeric Poupon
+ *
+ * This file is part of LMS.
+ *
+ * LMS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LMS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "database/IdType.hpp"
+#include "database/Types.hpp"
+#include "services/recommendation/IRecommendationService.hpp"
+#include "utils/EnumSet.hpp"
+
+namespace Recommendation
+{
+    struct ResultCacheKey
+    {
+        enum class Type
+        {
+            SimilarTracks,
+            SimilarReleases,
+            SimilarArtists,
+        };
+
+        Type type;
+        std::vector<Database::IdType::ValueType> ids;
+        EnumSet<Database::TrackArtistLinkType>::ValueType linkTypes{};
+        std::size_t maxCount{};
+
+        bool operator==(const ResultCacheKey& other) const
+        {
+            return type == other.type
+                && ids == other.ids
+                && linkTypes == other.linkTypes
+                && maxCount == other.maxCount;
+        }
+    };
+} // ns Recommendation
+
+namespace std
+{
+    template<>
+    class hash<Recommendation::ResultCacheKey>
+    {
+    public:
+        size_t operator()(const Recommendation::ResultCacheKey& key) const
+        {
+            size_t h{ std::hash<int>()(static_cast<int>(key.type)) };
+            for (const Database::IdType::ValueType id : key.ids)
+                h = h * 31 + std::hash<Database::IdType::ValueType>()(id);
+            h ^= std::hash<std::size_t>()(key.linkTypes) << 1;
+            h ^= std::hash<std::size_t>()(key.maxCount) << 2;
+            return h;
+        }
+    };
+} // ns std
+
+namespace Recommendation
+{
+    // Bounded LRU cache of recommendation results
+    // Results are only valid for the engine that computed them: the cache is cleared when the engine is reloaded,
+    // and results computed before that are discarded thanks to the generation
+    class ResultCache
+    {
+    public:
+        using Key = ResultCacheKey;
+        using Result = std::vector<Database::IdType::ValueType>;
+
+        ResultCache(std::size_t maxEntryCount);
+
+        ResultCache(const ResultCache&) = delete;
+        ResultCache& operator=(const ResultCache&) = delete;
+
+        std::size_t getGeneration() const;
+        std::optional<Result> find(const Key& key);
+        // generation must be retrieved before computing the result
+        void insert(const Key& key, Result result, std::size_t generation);
+        void clear();
+
+        CacheStats getStats() const;
+
+    private:
+        struct Entry
+        {
+            Key key;
+            Result result;
+        };
+        using EntryList = std::list<Entry>; // most recently used first
+
+        const std::size_t _maxEntryCount;
+        mutable std::mutex _mutex;
+        std::unordered_map<Key, EntryList::iterator> _entries;
+        EntryList _entryList;
+        std::size_t _generation{};
+        std::size_t _hits{};
+        std::size_t _misses{};
+    };
+} // ns Recommendation
@@ -0,0 +1,292 @@
+/*
+ * Copyright (C) 2023 Emeric Poupon
+ *
+ * This file is part of LMS.
+ *
+ * LMS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LMS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ClusterSimilarities.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <thread>
+
+namespace Recommendation
+{
+    namespace
+    {
+        using ItemIndex = ClusterSets::ItemIndex;
+        using ClusterIndex = ClusterSets::ClusterIndex;
+        using Entry = ClusterSimilarities::Entry;
+
+        struct Candidate
+        {
+            ItemIndex index;
+            float score;
+            std::uint32_t tieBreaker;
+        };
+
+        // Clusters shared by too many targets (think of a "Rock" genre) are not used to find candidates, unless there are not enough
+        // of them. Such clusters have a low weight anyway, and they are taken into account when rescoring the best candidates
+        constexpr std::size_t maxVisitedTargetCountPerCluster{ 1024 };
+        constexpr std::size_t rescoredCandidateCountFactor{ 8 };
+        constexpr std::size_t sourceCountPerChunk{ 256 };
+
+        std::uint32_t mix(std::uint64_t value)
+        {
+            value ^= value >> 33;
+            value *= 0xff51afd7ed558ccdULL;
+            value ^= value >> 33;
+            value *= 0xc4ceb9fe1a85ec53ULL;
+            value ^= value >> 33;
+            return static_cast<std::uint32_t>(value);
+        }
+
+        // Postings: for each cluster, the targets that belong to it
+        class Postings
+        {
+        public:
+            Postings(const ClusterSets& targets, std::size_t clusterCount)
+                : _offsets(clusterCount + 1, 0)
+            {
+                for (ItemIndex target{}; target < targets.getItemCount(); ++target)
+                {
+                    for (const ClusterIndex* cluster{ targets.begin(target) }; cluster != targets.end(target); ++cluster)
+                        _offsets[*cluster + 1]++;
+                }
+
+                for (std::size_t i{ 1 }; i < _offsets.size(); ++i)
+                    _offsets[i] += _offsets[i - 1];
+
+                _targets.resize(_offsets.back());
+                std::vector<std::size_t> positions(std::cbegin(_offsets), std::prev(std::cend(_offsets)));
+                for (ItemIndex target{}; target < targets.getItemCount(); ++target)
+                {
+                    for (const ClusterIndex* cluster{ targets.begin(target) }; cluster != targets.end(target); ++cluster)
+                        _targets[positions[*cluster]++] = target;
+                }
+            }
+
+            std::size_t getTargetCount(ClusterIndex cluster) const { return _offsets[cluster + 1] - _offsets[cluster]; }
+            const ItemIndex* begin(ClusterIndex cluster) const { return _targets.data() + _offsets[cluster]; }
+
+        private:
+            std::vector<std::size_t> _offsets;
+            std::vector<ItemIndex> _targets;
+        };
+
+        float computeScore(const ClusterSets& sources, ItemIndex source, const ClusterSets& targets, ItemIndex target, const std::vector<float>& clusterWeights)
+        {
+            float score{};
+
+            const ClusterIndex* itSource{ sources.begin(source) };
+            const ClusterIndex* itTarget{ targets.begin(target) };
+            while (itSource != sources.end(source) && itTarget != targets.end(target))
+            {
+                if (*itSource < *itTarget)
+                    ++itSource;
+                else if (*itTarget < *itSource)
+                    ++itTarget;
+                else
+                {
+                    score += clusterWeights[*itSource];
+                    ++itSource;
+                    ++itTarget;
+                }
+            }
+
+            return score;
+        }
+    }
+
+    ClusterSets::ClusterSets(std::vector<Membership> memberships, std::size_t itemCount)
+    {
+        std::sort(std::begin(memberships), std::end(memberships));
+        memberships.erase(std::unique(std::begin(memberships), std::end(memberships)), std::end(memberships));
+
+        _offsets.assign(itemCount + 1, 0);
+        _clusters.reserve(memberships.size());
+        for (const auto& [item, cluster] : memberships)
+        {
+            assert(item < itemCount);
+            _offsets[item + 1]++;
+            _clusters.push_back(cluster);
+        }
+
+        for (std::size_t i{ 1 }; i < _offsets.size(); ++i)
+            _offsets[i] += _offsets[i - 1];
+    }
+
+    ClusterSimilarities ClusterSimilarities::compute(const ClusterSets& sources, const ClusterSets& targets, std::size_t clusterCount, std::size_t maxEntryCount, std::size_t threadCount, const CancelCallback& cancelCallback)
+    {
+        const std::size_t sourceCount{ sources.getItemCount() };
+        const Postings postings{ targets, clusterCount };
+
+        std::vector<float> clusterWeights(clusterCount);
+        for (ClusterIndex cluster{}; cluster < clusterCount; ++cluster)
+        {
+            const std::size_t targetCount{ postings.getTargetCount(cluster) };
+            if (targetCount > 0)
+                clusterWeights[cluster] = static_cast<float>(std::log1p(static_cast<double>(targets.getItemCount()) / targetCount));
+        }
+
+        const std::size_t rescoredCandidateCount{ maxEntryCount * rescoredCandidateCountFactor };
+
+        // Each source has a fixed size slot, compacted at the end
+        std::vector<Entry> entries(sourceCount * maxEntryCount);
+        std::vector<std::size_t> entryCounts(sourceCount);
+
+        std::atomic<std::size_t> nextChunk{};
+        std::atomic<bool> cancelled{};
+
+        auto processSources{ [&]
+        {
+            std::vector<float> scores(targets.getItemCount(), 0);
+            std::vector<ItemIndex> touchedTargets;
+            std::vector<Candidate> candidates;
+
+            auto visitTargets{ [&](ItemIndex source, const ItemIndex* first, const ItemIndex* last, float weight)
+            {
+                for (const ItemIndex* target{ first }; target != last; ++target)
+                {
+                    if (*target == source)
+                        continue;
+
+                    if (scores[*target] == 0)
+                        touchedTargets.push_back(*target);
+                    scores[*target] += weight;
+                }
+            } };
+
+            auto processSource{ [&](ItemIndex source)
+            {
+                // Exact partial scores using the clusters that are not too common
+                bool hasCommonClusters{};
+                for (const ClusterIndex* cluster{ sources.begin(source) }; cluster != sources.end(source); ++cluster)
+                {
+                    const std::size_t targetCount{ postings.getTargetCount(*cluster) };
+                    if (targetCount > maxVisitedTargetCountPerCluster)
+                        hasCommonClusters = true;
+                    else
+                        visitTargets(source, postings.begin(*cluster), postings.begin(*cluster) + targetCount, clusterWeights[*cluster]);
+                }
+
+                // Not enough candidates: use a window of the targets of the common clusters, starting at a pseudo random position
+                if (hasCommonClusters && touchedTargets.size() < maxEntryCount)
+                {
+                    for (const ClusterIndex* cluster{ sources.begin(source) }; cluster != sources.end(source); ++cluster)
+                    {
+                        const std::size_t targetCount{ postings.getTargetCount(*cluster) };
+                        if (targetCount <= maxVisitedTargetCountPerCluster)
+                            continue;
+
+                        const ItemIndex* clusterTargets{ postings.begin(*cluster) };
+                        const std::size_t firstVisitedTarget{ mix(source) % targetCount };
+                        const std::size_t visitedTargetCount{ std::min(maxVisitedTargetCountPerCluster, targetCount - firstVisitedTarget) };
+                        visitTargets(source, clusterTargets + firstVisitedTarget, clusterTargets + firstVisitedTarget + visitedTargetCount, clusterWeights[*cluster]);
+                        visitTargets(source, clusterTargets, clusterTargets + (maxVisitedTargetCountPerCluster - visitedTargetCount), clusterWeights[*cluster]);
+                    }
+                }
+
+                candidates.clear();
+                for (const ItemIndex target : touchedTargets)
+                {
+                    // Pseudo random order for ties
+                    candidates.push_back(Candidate{ target, scores[target], mix((static_cast<std::uint64_t>(source) << 32) | target) });
+                    scores[target] = 0;
+                }
+                touchedTargets.clear();
+
+                auto isBetter{ [](const Candidate& a, const Candidate& b)
+                {
+                    if (a.score != b.score)
+                        return a.score > b.score;
+
+                    return a.tieBreaker < b.tieBreaker;
+                } };
+
+                // Add the contribution of the common clusters to the best candidates
+                if (hasCommonClusters)
+                {
+                    if (candidates.size() > rescoredCandidateCount)
+                    {
+                        std::nth_element(std::begin(candidates), std::next(std::begin(candidates), rescoredCandidateCount), std::end(candidates), isBetter);
+                        candidates.resize(rescoredCandidateCount);
+                    }
+
+                    for (Candidate& candidate : candidates)
+                        candidate.score = computeScore(sources, source, targets, candidate.index, clusterWeights);
+                }
+
+                const std::size_t entryCount{ std::min(candidates.size(), maxEntryCount) };
+                std::partial_sort(std::begin(candidates), std::next(std::begin(candidates), entryCount), std::end(candidates), isBetter);
+                std::transform(std::cbegin(candidates), std::next(std::cbegin(candidates), entryCount), std::next(std::begin(entries), source * maxEntryCount),
+                    [](const Candidate& candidate) { return Entry{ candidate.index, candidate.score }; });
+                entryCounts[source] = entryCount;
+            } };
+
+            while (true)
+            {
+                const std::size_t chunk{ nextChunk++ };
+                const std::size_t firstSource{ chunk * sourceCountPerChunk };
+                if (firstSource >= sourceCount || cancelled)
+                    break;
+
+                if (cancelCallback && cancelCallback())
+                {
+                    cancelled = true;
+                    break;
+                }
+
+                const std::size_t lastSource{ std::min(firstSource + sourceCountPerChunk, sourceCount) };
+                for (std::size_t source{ firstSource }; source < lastSource; ++source)
+                    processSource(static_cast<ItemIndex>(source));
+            }
+        } };
+
+        {
+            std::vector<std::thread> threads;
+            for (std::size_t i{ 1 }; i < threadCount; ++i)
+                threads.emplace_back(processSources);
+
+            processSources();
+
+            for (std::thread& thread : threads)
+                thread.join();
+        }
+
+        if (cancelled)
+            return {};
+
+        // Compact the slots, entries are only moved towards the front
+        ClusterSimilarities res;
+        res._maxEntryCount = maxEntryCount;
+        res._offsets.resize(sourceCount + 1);
+        res._offsets[0] = 0;
+        for (std::size_t source{}; source < sourceCount; ++source)
+        {
+            const auto itSlot{ std::next(std::cbegin(entries), source * maxEntryCount) };
+            std::copy(itSlot, std::next(itSlot, entryCounts[source]), std::next(std::begin(entries), res._offsets[source]));
+            res._offsets[source + 1] = res._offsets[source] + entryCounts[source];
+        }
+        entries.resize(res._offsets.back());
+        entries.shrink_to_fit();
+        res._entries = std::move(entries);
+
+        return res;
+    }
+} // namespace Recommendation
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2023 Emeric Poupon
+ *
+ * This file is part of LMS.
+ *
+ * LMS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LMS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+namespace Recommendation
+{
+	// Items (tracks, releases, artists) as sorted sets of clusters, in compressed rows
+	class ClusterSets
+	{
+		public:
+			using ItemIndex = std::uint32_t;
+			using ClusterIndex = std::uint32_t;
+			using Membership = std::pair<ItemIndex, ClusterIndex>;
+
+			ClusterSets() = default;
+			// memberships may contain duplicates, itemCount must be greater than any item index
+			ClusterSets(std::vector<Membership> memberships, std::size_t itemCount);
+
+			std::size_t getItemCount() const { return _offsets.size() - 1; }
+			const ClusterIndex* begin(ItemIndex item) const { return _clusters.data() + _offsets[item]; }
+			const ClusterIndex* end(ItemIndex item) const { return _clusters.data() + _offsets[item + 1]; }
+
+		private:
+			std::vector<std::size_t> _offsets {0};
+			std::vector<ClusterIndex> _clusters;
+	};
+
+	// For each source item, the target items sharing the most weighted clusters with it
+	// Clusters are weighted by their inverse frequency in targets, so that shared rare clusters matter more than shared common ones
+	// Source and target indexes refer to the same items, an item is never reported as similar to itself
+	class ClusterSimilarities
+	{
+		public:
+			using ItemIndex = ClusterSets::ItemIndex;
+
+			struct Entry
+			{
+				ItemIndex index;
+				float score;
+			};
+
+			using CancelCallback = std::function<bool()>;
+
+			ClusterSimilarities() = default;
+
+			// Keeps at most maxEntryCount entries per source item, by decreasing score
+			// Returns an empty object if cancelled
+			static ClusterSimilarities compute(const ClusterSets& sources, const ClusterSets& targets, std::size_t clusterCount, std::size_t maxEntryCount, std::size_t threadCount, const CancelCallback& cancelCallback);
+
+			std::size_t getItemCount() const { return _offsets.size() - 1; }
+			std::size_t getMaxEntryCount() const { return _maxEntryCount; }
+			const Entry* begin(ItemIndex item) const { return _entries.data() + _offsets[item]; }
+			const Entry* end(ItemIndex item) const { return _entries.data() + _offsets[item + 1]; }
+			// true if some similar items may have been left out
+			bool isTruncated(ItemIndex item) const { return _offsets[item + 1] - _offsets[item] == _maxEntryCount; }
+
+		private:
+			std::size_t _maxEntryCount {};
+			std::vector<std::size_t> _offsets {0};
+			std::vector<Entry> _entries;
+	};
+} // namespace Recommendation
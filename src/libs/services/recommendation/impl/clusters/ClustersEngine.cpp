@@ -19,6 +19,11 @@
 
 #include "ClustersEngine.hpp"
 
+#include <algorithm>
+#include <array>
+#include <thread>
+#include <unordered_map>
+
 #include "database/Artist.hpp"
 #include "database/Cluster.hpp"
 #include "database/Db.hpp"
@@ -26,6 +31,8 @@
 #include "database/Session.hpp"
 #include "database/Track.hpp"
 #include "database/TrackList.hpp"
+#include "utils/ILogger.hpp"
+#include "utils/Random.hpp"
 
 namespace Recommendation {
 
@@ -36,11 +43,256 @@ namespace Recommendation {
         return std::make_unique<ClusterEngine>(db);
     }
 
+    namespace
+    {
+        using ItemIndex = ClusterSimilarities::ItemIndex;
+        using Entry = ClusterSimilarities::Entry;
+
+        constexpr std::size_t transactionTrackCount{ 1000 };
+        constexpr std::size_t maxEntryCount{ 32 };	// per object, keeps the tables small
+        // Artist similarities are only precomputed for the link types actually requested (empty means any type)
+        constexpr std::array<EnumSet<TrackArtistLinkType>, 2> precomputedArtistLinkTypes{ EnumSet<TrackArtistLinkType>{}, EnumSet<TrackArtistLinkType>{ TrackArtistLinkType::Artist, TrackArtistLinkType::ReleaseArtist } };
+
+        template <typename IdType>
+        std::optional<ItemIndex> getItemIndex(const std::vector<IdType>& ids, IdType id)
+        {
+            const auto it{ std::lower_bound(std::cbegin(ids), std::cend(ids), id) };
+            if (it == std::cend(ids) || *it != id)
+                return std::nullopt;
+
+            return static_cast<ItemIndex>(std::distance(std::cbegin(ids), it));
+        }
+
+        // Sums the scores of the similar items of all the given items, which are excluded from the result
+        // Returns std::nullopt if some other items may have been left out of the tables
+        template <typename IdType>
+        std::optional<std::vector<IdType>> findSimilarIds(const ClusterSimilarities& similarities, const std::vector<IdType>& ids, const std::vector<ItemIndex>& items, std::size_t maxCount)
+        {
+            std::unordered_map<ItemIndex, float> scores;
+            for (const ItemIndex item : items)
+            {
+                for (const Entry* entry{ similarities.begin(item) }; entry != similarities.end(item); ++entry)
+                    scores[entry->index] += entry->score;
+            }
+
+            for (const ItemIndex item : items)
+                scores.erase(item);
+
+            if (scores.size() < maxCount
+                && std::any_of(std::cbegin(items), std::cend(items), [&](ItemIndex item) { return similarities.isTruncated(item); }))
+            {
+                return std::nullopt;
+            }
+
+            std::vector<Entry> entries;
+            entries.reserve(scores.size());
+            std::transform(std::cbegin(scores), std::cend(scores), std::back_inserter(entries), [](const auto& itScore) { return Entry{ itScore.first, itScore.second }; });
+
+            // Like the database queries, pick randomly among equally similar items
+            Random::shuffleContainer(entries);
+            std::stable_sort(std::begin(entries), std::end(entries), [](const Entry& a, const Entry& b) { return a.score > b.score; });
+            if (entries.size() > maxCount)
+                entries.resize(maxCount);
+
+            std::vector<IdType> res;
+            res.reserve(entries.size());
+            std::transform(std::cbegin(entries), std::cend(entries), std::back_inserter(res), [&](const Entry& entry) { return ids[entry.index]; });
+
+            return res;
+        }
+
+        // Tables are computed after scans, objects may have been removed since then
+        template <typename ObjectType, typename IdType>
+        void removeNonExistingIds(Db& db, std::vector<IdType>& ids)
+        {
+            Session& session{ db.getTLSSession() };
+            auto transaction{ session.createReadTransaction() };
+
+            ids.erase(std::remove_if(std::begin(ids), std::end(ids), [&](IdType id) { return !ObjectType::exists(session, id); }), std::end(ids));
+        }
+
+        template <typename IdType>
+        void sortAndRemoveDuplicates(std::vector<IdType>& ids)
+        {
+            std::sort(std::begin(ids), std::end(ids));
+            ids.erase(std::unique(std::begin(ids), std::end(ids)), std::end(ids));
+        }
+    }
+
+    void ClusterEngine::load(bool, const ProgressCallback& progressCallback)
+    {
+        LMS_LOG(RECOMMENDATION, INFO, "Computing cluster similarity tables...");
+
+        std::shared_ptr<const SimilarityTables> similarityTables{ computeSimilarityTables(progressCallback) };
+        if (!similarityTables)
+        {
+            LMS_LOG(RECOMMENDATION, INFO, "Cluster similarity tables computation cancelled");
+            return;
+        }
+
+        LMS_LOG(RECOMMENDATION, INFO, "Cluster similarity tables computed (" << similarityTables->trackIds.size() << " tracks, " << similarityTables->releaseIds.size() << " releases, " << similarityTables->artistIds.size() << " artists)");
+
+        // Queries keep using the previous tables until they are done with them
+        std::atomic_store(&_similarityTables, std::move(similarityTables));
+    }
+
+    void ClusterEngine::requestCancelLoad()
+    {
+        LMS_LOG(RECOMMENDATION, DEBUG, "Requesting init cancellation");
+        _loadCancelled = true;
+    }
+
+    std::shared_ptr<const ClusterEngine::SimilarityTables> ClusterEngine::getSimilarityTables() const
+    {
+        return std::atomic_load(&_similarityTables);
+    }
+
+    std::shared_ptr<const ClusterEngine::SimilarityTables> ClusterEngine::computeSimilarityTables(const ProgressCallback& progressCallback) const
+    {
+        using Membership = ClusterSets::Membership;
+
+        struct TrackArtistLink
+        {
+            ArtistId artistId;
+            TrackArtistLinkType linkType;
+            ItemIndex track;
+        };
+
+        auto tables{ std::make_shared<SimilarityTables>() };
+
+        std::unordered_map<ClusterId, ClusterSets::ClusterIndex> clusterIndexes;
+        std::vector<Membership> trackMemberships;
+        std::vector<std::pair<ReleaseId, ItemIndex>> trackReleases;
+        std::vector<TrackArtistLink> trackArtistLinks;
+
+        {
+            Session& session{ _db.getTLSSession() };
+
+            TrackId lastRetrievedId;
+            while (!_loadCancelled)
+            {
+                const std::size_t previousTrackCount{ tables->trackIds.size() };
+                {
+                    auto transaction{ session.createReadTransaction() };
+
+                    Track::findClusterLinks(session, lastRetrievedId, transactionTrackCount, [&](const Track::ClusterLinks& clusterLinks)
+                    {
+                        const ItemIndex track{ static_cast<ItemIndex>(tables->trackIds.size()) };
+                        tables->trackIds.push_back(clusterLinks.trackId);
+
+                        for (const ClusterId clusterId : clusterLinks.clusterIds)
+                        {
+                            const auto [itCluster, inserted]{ clusterIndexes.emplace(clusterId, static_cast<ClusterSets::ClusterIndex>(clusterIndexes.size())) };
+                            trackMemberships.emplace_back(track, itCluster->second);
+                        }
+
+                        if (clusterLinks.releaseId.isValid())
+                            trackReleases.emplace_back(clusterLinks.releaseId, track);
+
+                        for (const auto& [artistId, linkType] : clusterLinks.artistLinks)
+                            trackArtistLinks.push_back(TrackArtistLink{ artistId, linkType, track });
+                    });
+                }
+
+                if (tables->trackIds.size() == previousTrackCount)
+                    break;
+            }
+        }
+
+        if (_loadCancelled)
+            return {};
+
+        const std::size_t clusterCount{ clusterIndexes.size() };
+        const std::size_t threadCount{ std::max<std::size_t>(1, std::thread::hardware_concurrency()) };
+        const auto cancelCallback{ [this] { return _loadCancelled.load(); } };
+
+        Progress progress{ 2 + precomputedArtistLinkTypes.size(), 0 };
+        auto notifyProgress{ [&]
+        {
+            progress.processedElems++;
+            if (progressCallback)
+                progressCallback(progress);
+        } };
+
+        // Tracks, ids are visited in order
+        const ClusterSets trackClusterSets{ std::move(trackMemberships), tables->trackIds.size() };
+        tables->tracks = ClusterSimilarities::compute(trackClusterSets, trackClusterSets, clusterCount, maxEntryCount, threadCount, cancelCallback);
+        if (_loadCancelled)
+            return {};
+        notifyProgress();
+
+        // Releases, using the clusters of their tracks
+        {
+            for (const auto& [releaseId, track] : trackReleases)
+                tables->releaseIds.push_back(releaseId);
+            sortAndRemoveDuplicates(tables->releaseIds);
+
+            std::vector<Membership> releaseMemberships;
+            for (const auto& [releaseId, track] : trackReleases)
+            {
+                const ItemIndex release{ *getItemIndex(tables->releaseIds, releaseId) };
+                for (const ClusterSets::ClusterIndex* cluster{ trackClusterSets.begin(track) }; cluster != trackClusterSets.end(track); ++cluster)
+                    releaseMemberships.emplace_back(release, *cluster);
+            }
+
+            const ClusterSets releaseClusterSets{ std::move(releaseMemberships), tables->releaseIds.size() };
+            tables->releases = ClusterSimilarities::compute(releaseClusterSets, releaseClusterSets, clusterCount, maxEntryCount, threadCount, cancelCallback);
+            if (_loadCancelled)
+                return {};
+            notifyProgress();
+        }
+
+        // Artists, using the clusters of the tracks they are linked to
+        // The clusters of the similar artists are restricted to the requested link types
+        {
+            for (const TrackArtistLink& trackArtistLink : trackArtistLinks)
+                tables->artistIds.push_back(trackArtistLink.artistId);
+            sortAndRemoveDuplicates(tables->artistIds);
+
+            auto getArtistClusterSets{ [&](EnumSet<TrackArtistLinkType> linkTypes)
+            {
+                std::vector<Membership> artistMemberships;
+                for (const TrackArtistLink& trackArtistLink : trackArtistLinks)
+                {
+                    if (!linkTypes.empty() && !linkTypes.contains(trackArtistLink.linkType))
+                        continue;
+
+                    const ItemIndex artist{ *getItemIndex(tables->artistIds, trackArtistLink.artistId) };
+                    for (const ClusterSets::ClusterIndex* cluster{ trackClusterSets.begin(trackArtistLink.track) }; cluster != trackClusterSets.end(trackArtistLink.track); ++cluster)
+                        artistMemberships.emplace_back(artist, *cluster);
+                }
+
+                return ClusterSets{ std::move(artistMemberships), tables->artistIds.size() };
+            } };
+
+            const ClusterSets artistClusterSets{ getArtistClusterSets({}) };
+            for (const EnumSet<TrackArtistLinkType> linkTypes : precomputedArtistLinkTypes)
+            {
+                ClusterSimilarities similarities;
+                if (linkTypes.empty())
+                    similarities = ClusterSimilarities::compute(artistClusterSets, artistClusterSets, clusterCount, maxEntryCount, threadCount, cancelCallback);
+                else
+                    similarities = ClusterSimilarities::compute(artistClusterSets, getArtistClusterSets(linkTypes), clusterCount, maxEntryCount, threadCount, cancelCallback);
+
+                if (_loadCancelled)
+                    return {};
+
+                tables->artists.emplace_back(linkTypes, std::move(similarities));
+                notifyProgress();
+            }
+        }
+
+        return tables;
+    }
+
     TrackContainer ClusterEngine::findSimilarTracks(const std::vector<TrackId>& trackIds, std::size_t maxCount) const
     {
-        if (maxCount == 0)
+        if (maxCount == 0 || trackIds.empty())
             return {};
 
+        if (std::optional<TrackContainer> res{ findSimilarTracksInTables(trackIds, maxCount) })
+            return std::move(*res);
+
         Session& dbSession{ _db.getTLSSession() };
         auto transaction{ dbSession.createReadTransaction() };
 
@@ -54,6 +306,21 @@ namespace Recommendation {
         if (maxCount == 0)
             return res;
 
+        if (getSimilarityTables())
+        {
+            const TrackContainer trackIds{ [&]
+            {
+                Session& dbSession{ _db.getTLSSession() };
+                auto transaction{ dbSession.createReadTransaction() };
+
+                const TrackList::pointer trackList{ TrackList::find(dbSession, tracklistId) };
+                return trackList ? trackList->getTrackIds() : TrackContainer{};
+            }() };
+
+            if (std::optional<TrackContainer> similarTrackIds{ findSimilarTracksInTables(trackIds, maxCount) })
+                return std::move(*similarTrackIds);
+        }
+
         {
             Session& dbSession{ _db.getTLSSession() };
             auto transaction{ dbSession.createReadTransaction() };
@@ -76,6 +343,9 @@ namespace Recommendation {
         if (maxCount == 0)
             return res;
 
+        if (std::optional<ReleaseContainer> similarReleaseIds{ getSimilarReleasesInTables(releaseId, maxCount) })
+            return std::move(*similarReleaseIds);
+
         {
             Session& dbSession{ _db.getTLSSession() };
             auto transaction{ dbSession.createReadTransaction() };
@@ -97,6 +367,9 @@ namespace Recommendation {
         if (maxCount == 0)
             return {};
 
+        if (std::optional<ArtistContainer> res{ getSimilarArtistsInTables(artistId, artistLinkTypes, maxCount) })
+            return std::move(*res);
+
         Session& dbSession{ _db.getTLSSession() };
         auto transaction{ dbSession.createReadTransaction() };
 
@@ -108,4 +381,66 @@ namespace Recommendation {
         return std::move(similarArtistIds.results);
     }
 
+    std::optional<TrackContainer> ClusterEngine::findSimilarTracksInTables(const std::vector<TrackId>& trackIds, std::size_t maxCount) const
+    {
+        const std::shared_ptr<const SimilarityTables> tables{ getSimilarityTables() };
+        if (!tables)
+            return std::nullopt;
+
+        std::vector<ItemIndex> tracks;
+        tracks.reserve(trackIds.size());
+        for (const TrackId trackId : trackIds)
+        {
+            const std::optional<ItemIndex> track{ getItemIndex(tables->trackIds, trackId) };
+            if (!track)
+                return std::nullopt;
+
+            tracks.push_back(*track);
+        }
+
+        std::optional<TrackContainer> res{ findSimilarIds(tables->tracks, tables->trackIds, tracks, maxCount) };
+        if (res)
+            removeNonExistingIds<Track>(_db, *res);
+
+        return res;
+    }
+
+    std::optional<ReleaseContainer> ClusterEngine::getSimilarReleasesInTables(ReleaseId releaseId, std::size_t maxCount) const
+    {
+        const std::shared_ptr<const SimilarityTables> tables{ getSimilarityTables() };
+        if (!tables)
+            return std::nullopt;
+
+        const std::optional<ItemIndex> release{ getItemIndex(tables->releaseIds, releaseId) };
+        if (!release)
+            return std::nullopt;
+
+        std::optional<ReleaseContainer> res{ findSimilarIds(tables->releases, tables->releaseIds, { *release }, maxCount) };
+        if (res)
+            removeNonExistingIds<Release>(_db, *res);
+
+        return res;
+    }
+
+    std::optional<ArtistContainer> ClusterEngine::getSimilarArtistsInTables(ArtistId artistId, EnumSet<TrackArtistLinkType> linkTypes, std::size_t maxCount) const
+    {
+        const std::shared_ptr<const SimilarityTables> tables{ getSimilarityTables() };
+        if (!tables)
+            return std::nullopt;
+
+        const auto itSimilarities{ std::find_if(std::cbegin(tables->artists), std::cend(tables->artists), [&](const auto& artistSimilarities) { return artistSimilarities.first == linkTypes; }) };
+        if (itSimilarities == std::cend(tables->artists))
+            return std::nullopt;
+
+        const std::optional<ItemIndex> artist{ getItemIndex(tables->artistIds, artistId) };
+        if (!artist)
+            return std::nullopt;
+
+        std::optional<ArtistContainer> res{ findSimilarIds(itSimilarities->second, tables->artistIds, { *artist }, maxCount) };
+        if (res)
+            removeNonExistingIds<Artist>(_db, *res);
+
+        return res;
+    }
+
 } // namespace Recommendation
@@ -19,7 +19,17 @@
 
 #pragma once
 
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "database/ArtistId.hpp"
+#include "database/ReleaseId.hpp"
+#include "database/TrackId.hpp"
 #include "IEngine.hpp"
+#include "ClusterSimilarities.hpp"
 
 namespace Recommendation
 {
@@ -35,15 +45,37 @@ namespace Recommendation
 			ClusterEngine& operator=(ClusterEngine&&) = delete;
 
 		private:
-			void load(bool, const ProgressCallback&) override {}
-			void requestCancelLoad() override {}
+			void load(bool forceReload, const ProgressCallback& progressCallback) override;
+			void requestCancelLoad() override;
 
 			TrackContainer		findSimilarTracksFromTrackList(Database::TrackListId tracklistId, std::size_t maxCount) const override;
 			TrackContainer		findSimilarTracks(const std::vector<Database::TrackId>& tracksId, std::size_t maxCount) const override;
 			ReleaseContainer	getSimilarReleases(Database::ReleaseId releaseId, std::size_t maxCount) const override;
 			ArtistContainer		getSimilarArtists(Database::ArtistId artistId, EnumSet<Database::TrackArtistLinkType> linkTypes, std::size_t maxCount) const override;
 
+			// Top-K similarity tables, computed from cluster memberships when loading
+			// Item indexes are positions in the sorted id vectors
+			struct SimilarityTables
+			{
+				std::vector<Database::TrackId> trackIds;
+				ClusterSimilarities tracks;
+				std::vector<Database::ReleaseId> releaseIds;
+				ClusterSimilarities releases;
+				std::vector<Database::ArtistId> artistIds;
+				std::vector<std::pair<EnumSet<Database::TrackArtistLinkType>, ClusterSimilarities>> artists;	// only for precomputed link types
+			};
+
+			std::shared_ptr<const SimilarityTables> computeSimilarityTables(const ProgressCallback& progressCallback) const;
+			std::shared_ptr<const SimilarityTables> getSimilarityTables() const;
+
+			// Return std::nullopt if the tables cannot answer (not loaded yet, unknown objects or not enough precomputed entries), the database has to be queried instead
+			std::optional<TrackContainer>	findSimilarTracksInTables(const std::vector<Database::TrackId>& tracksId, std::size_t maxCount) const;
+			std::optional<ReleaseContainer>	getSimilarReleasesInTables(Database::ReleaseId releaseId, std::size_t maxCount) const;
+			std::optional<ArtistContainer>	getSimilarArtistsInTables(Database::ArtistId artistId, EnumSet<Database::TrackArtistLinkType> linkTypes, std::size_t maxCount) const;
+
 			Database::Db& _db;
+			std::atomic<bool> _loadCancelled {};
+			std::shared_ptr<const SimilarityTables> _similarityTables;	// only accessed using atomic operations, as queries may be concurrent with a reload
 	};
 
 } // namespace Recommendation
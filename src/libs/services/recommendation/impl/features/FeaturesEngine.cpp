@@ -20,6 +20,7 @@
 #include "FeaturesEngine.hpp"
 
 #include <numeric>
+#include <thread>
 
 #include "database/Artist.hpp"
 #include "database/Db.hpp"
@@ -30,8 +31,11 @@
 #include "database/TrackFeatures.hpp"
 #include "database/TrackList.hpp"
 #include "som/DataNormalizer.hpp"
+#include "utils/IConfig.hpp"
 #include "utils/ILogger.hpp"
 #include "utils/Random.hpp"
+#include "utils/Service.hpp"
+#include "FeaturesExtractor.hpp"
 
 namespace Recommendation
 {
@@ -42,46 +46,6 @@ namespace Recommendation
         return std::make_unique<FeaturesEngine>(db);
     }
 
-    namespace
-    {
-        std::optional<SOM::InputVector> convertFeatureValuesMapToInputVector(const FeatureValuesMap& featureValuesMap, std::size_t nbDimensions)
-        {
-            std::size_t i{};
-            std::optional<SOM::InputVector> res{ SOM::InputVector {nbDimensions} };
-            for (const auto& [featureName, values] : featureValuesMap)
-            {
-                if (values.size() != getFeatureDef(featureName).nbDimensions)
-                {
-                    LMS_LOG(RECOMMENDATION, WARNING, "Dimension mismatch for feature '" << featureName << "'. Expected " << getFeatureDef(featureName).nbDimensions << ", got " << values.size());
-                    res.reset();
-                    break;
-                }
-
-                for (double val : values)
-                    (*res)[i++] = val;
-            }
-
-            return res;
-        }
-
-        SOM::InputVector getInputVectorWeights(const FeatureSettingsMap& featureSettingsMap, std::size_t nbDimensions)
-        {
-            SOM::InputVector weights{ nbDimensions };
-            std::size_t index{};
-            for (const auto& [featureName, featureSettings] : featureSettingsMap)
-            {
-                const std::size_t featureNbDimensions{ getFeatureDef(featureName).nbDimensions };
-
-                for (std::size_t i{}; i < featureNbDimensions; ++i)
-                    weights[index++] = (1. / featureNbDimensions * featureSettings.weight);
-            }
-
-            assert(index == nbDimensions);
-
-            return weights;
-        }
-    }
-
     const FeatureSettingsMap& FeaturesEngine::getDefaultTrainFeatureSettings()
     {
         static const FeatureSettingsMap defaultTrainFeatureSettings
@@ -109,48 +73,11 @@ namespace Recommendation
 
         LMS_LOG(RECOMMENDATION, DEBUG, "Features dimension = " << nbDimensions);
 
-        Session & session{ _db.getTLSSession() };
-
-        RangeResults<TrackFeaturesId> trackFeaturesIds;
-        {
-            auto transaction{ session.createReadTransaction() };
-
-            LMS_LOG(RECOMMENDATION, DEBUG, "Getting Track features...");
-            trackFeaturesIds = TrackFeatures::find(session);
-            LMS_LOG(RECOMMENDATION, DEBUG, "Getting Track features DONE (found " << trackFeaturesIds.results.size() << " track features)");
-        }
-
         std::vector<SOM::InputVector> samples;
         std::vector<TrackId> samplesTrackIds;
-
-        samples.reserve(trackFeaturesIds.results.size());
-        samplesTrackIds.reserve(trackFeaturesIds.results.size());
-
-        LMS_LOG(RECOMMENDATION, DEBUG, "Extracting features...");
-        // TODO handle errors using exceptions
-        for (const TrackFeaturesId trackFeaturesId : trackFeaturesIds.results)
-        {
-            if (_loadCancelled)
-                return;
-
-            auto transaction{ session.createReadTransaction() };
-
-            TrackFeatures::pointer trackFeatures{ TrackFeatures::find(session, trackFeaturesId) };
-            if (!trackFeatures)
-                continue;
-
-            FeatureValuesMap featureValuesMap{ trackFeatures->getFeatureValuesMap(featureNames) };
-            if (featureValuesMap.empty())
-                continue;
-
-            std::optional<SOM::InputVector> inputVector{ convertFeatureValuesMapToInputVector(featureValuesMap, nbDimensions) };
-            if (!inputVector)
-                continue;
-
-            samples.emplace_back(std::move(*inputVector));
-            samplesTrackIds.emplace_back(trackFeatures->getTrack()->getId());
-        }
-        LMS_LOG(RECOMMENDATION, DEBUG, "Extracting features DONE");
+        extractFeatures(_db, featureNames, nbDimensions, trainSettings.threadCount, [this] { return _loadCancelled.load(); }, samples, samplesTrackIds);
+        if (_loadCancelled)
+            return;
 
         if (samples.empty())
         {
@@ -184,34 +111,210 @@ namespace Recommendation
             progressCallback(Progress {iter.idIteration, iter.iterationCount});
         } };
 
-        LMS_LOG(RECOMMENDATION, DEBUG, "Training network...");
-        network.train(samples, trainSettings.iterationCount,
-            progressCallback ? somProgressCallback : SOM::Network::ProgressCallback{},
-            [this] { return _loadCancelled; });
+        LMS_LOG(RECOMMENDATION, DEBUG, "Training network using " << trainSettings.threadCount << " thread(s)...");
+        if (trainSettings.threadCount > 1)
+        {
+            network.trainBatch(samples, trainSettings.iterationCount, trainSettings.threadCount,
+                progressCallback ? somProgressCallback : SOM::Network::ProgressCallback{},
+                [this] { return _loadCancelled.load(); });
+        }
+        else
+        {
+            network.train(samples, trainSettings.iterationCount,
+                progressCallback ? somProgressCallback : SOM::Network::ProgressCallback{},
+                [this] { return _loadCancelled.load(); });
+        }
         LMS_LOG(RECOMMENDATION, DEBUG, "Training network DONE");
 
         LMS_LOG(RECOMMENDATION, DEBUG, "Classifying tracks...");
-        TrackPositions trackPositions;
+        const SOM::Network::DistanceFunc distanceFunc{ network.getDistanceFunc() };
+        double distanceSum{};
+        TrackPositionList trackPositions;
+        trackPositions.reserve(samples.size());
         for (std::size_t i{}; i < samples.size(); ++i)
         {
             if (_loadCancelled)
                 return;
 
             const SOM::Position position{ network.getClosestRefVectorPosition(samples[i]) };
+            distanceSum += distanceFunc(samples[i], network.getRefVector(position), network.getDataWeights());
 
-            trackPositions[samplesTrackIds[i]].push_back(position);
+            trackPositions.emplace_back(samplesTrackIds[i], position);
         }
 
         LMS_LOG(RECOMMENDATION, DEBUG, "Classifying tracks DONE");
 
-        load(std::move(network), std::move(trackPositions));
+        load(std::make_unique<SOM::Network>(std::move(network)), std::move(trackPositions));
+
+        _dataNormalizer.emplace(dataNormalizer);
+        _rejectedTrackIds.clear();
+        _classificationStats = TrackClassificationStats{};
+        _classificationStats.trainedTrackCount = samples.size();
+        _classificationStats.trainedTrackDistanceMean = distanceSum / samples.size();
     }
 
-    void FeaturesEngine::loadFromCache(FeaturesEngineCache&& cache)
+    FeaturesEngine::IncrementalLoadResult FeaturesEngine::loadFromCache(FeaturesEngineCache&& cache)
     {
         LMS_LOG(RECOMMENDATION, INFO, "Constructing features classifier from cache...");
 
-        load(std::move(cache._network), cache._trackPositions);
+        auto network{ std::make_unique<SOM::Network>(std::move(cache._network)) };
+
+        // DataNormalizer is not assignable
+        _dataNormalizer.reset();
+        if (cache._dataNormalizer)
+            _dataNormalizer.emplace(std::move(*cache._dataNormalizer));
+        _classificationStats = cache._classificationStats;
+        _rejectedTrackIds = std::move(cache._rejectedTrackIds);
+
+        TrackPositionList trackPositions{ std::move(cache._trackPositions) };
+        const IncrementalLoadResult result{ classifyNewTracks(*network, trackPositions) };
+        if (result == IncrementalLoadResult::TrainingRequired || _loadCancelled)
+            return result;
+
+        load(std::move(network), std::move(trackPositions));
+
+        return result;
+    }
+
+    FeaturesEngine::IncrementalLoadResult FeaturesEngine::classifyNewTracks(const SOM::Network& network, TrackPositionList& trackPositions)
+    {
+        // Full training if new tracks represent more than this ratio of the trained tracks
+        constexpr double maxAddedTrackRatio{ 0.1 };
+        // Full training if new tracks are on average further from their matching ref vector than trained tracks were, by this factor
+        constexpr double maxAddedTrackDistanceFactor{ 1.5 };
+
+        Session& session{ _db.getTLSSession() };
+
+        std::unordered_set<TrackId> knownTrackIds;
+        for (const auto& [trackId, position] : trackPositions)
+            knownTrackIds.insert(trackId);
+
+        const std::unordered_set<TrackId> rejectedTrackIds(std::cbegin(_rejectedTrackIds), std::cend(_rejectedTrackIds));
+
+        std::vector<TrackId> newTrackIds;
+        _rejectedTrackIds.clear(); // only keep the rejected tracks that still have features
+        {
+            auto transaction{ session.createReadTransaction() };
+
+            for (const TrackId trackId : TrackFeatures::findTrackIds(session).results)
+            {
+                if (rejectedTrackIds.count(trackId))
+                    _rejectedTrackIds.push_back(trackId);
+                else if (!knownTrackIds.count(trackId))
+                    newTrackIds.push_back(trackId);
+            }
+        }
+        const std::size_t previousRejectedTrackCount{ _rejectedTrackIds.size() };
+        const bool rejectedTracksRemoved{ previousRejectedTrackCount != rejectedTrackIds.size() };
+
+        if (newTrackIds.empty())
+            return rejectedTracksRemoved ? IncrementalLoadResult::Done : IncrementalLoadResult::NothingToDo;
+
+        LMS_LOG(RECOMMENDATION, DEBUG, "Found " << newTrackIds.size() << " new tracks with features");
+
+        if (!_dataNormalizer)
+            return IncrementalLoadResult::TrainingRequired;
+
+        const std::size_t addedTrackCount{ _classificationStats.addedTrackCount + newTrackIds.size() };
+        if (addedTrackCount > _classificationStats.trainedTrackCount * maxAddedTrackRatio)
+        {
+            LMS_LOG(RECOMMENDATION, INFO, "Too many tracks added since last training (" << addedTrackCount << " for " << _classificationStats.trainedTrackCount << " trained tracks)");
+            return IncrementalLoadResult::TrainingRequired;
+        }
+
+        const FeatureSettingsMap& featureSettingsMap{ getDefaultTrainFeatureSettings() };
+        std::unordered_set<FeatureName> featureNames;
+        std::transform(std::cbegin(featureSettingsMap), std::cend(featureSettingsMap), std::inserter(featureNames, std::begin(featureNames)),
+            [](const auto& itFeatureSetting) { return itFeatureSetting.first; });
+
+        const std::size_t nbDimensions{ network.getInputDimCount() };
+        const SOM::Network::DistanceFunc distanceFunc{ network.getDistanceFunc() };
+
+        TrackPositionList newTrackPositions;
+        double addedTrackDistanceSum{ _classificationStats.addedTrackDistanceSum };
+
+        // Track features are fetched by pages, each page using its own short read transaction
+        // The features of the new tracks are classified once their page is fetched
+        constexpr std::size_t trackFeaturesCountPerTransaction{ 1000 };
+
+        const std::unordered_set<TrackId> newTrackIdSet(std::cbegin(newTrackIds), std::cend(newTrackIds));
+        std::vector<std::pair<TrackId, std::string>> newTrackFeatures;
+
+        TrackFeaturesId lastRetrievedId;
+        std::size_t remainingNewTrackCount{ newTrackIdSet.size() };
+        while (remainingNewTrackCount > 0)
+        {
+            if (_loadCancelled)
+                return IncrementalLoadResult::NothingToDo;
+
+            bool endReached{ true };
+            newTrackFeatures.clear();
+            {
+                auto transaction{ session.createReadTransaction() };
+
+                TrackFeatures::find(session, lastRetrievedId, trackFeaturesCountPerTransaction, [&](TrackId trackId, const std::string& jsonEncodedFeatures)
+                {
+                    endReached = false;
+
+                    if (newTrackIdSet.count(trackId))
+                        newTrackFeatures.emplace_back(trackId, jsonEncodedFeatures);
+                });
+            }
+
+            if (endReached)
+                break;
+
+            for (const auto& [trackId, jsonEncodedFeatures] : newTrackFeatures)
+            {
+                // remember the tracks that cannot be classified, so that they are not fetched again on next loads
+                const FeatureValuesMap featureValuesMap{ TrackFeatures::parseFeatureValuesMap(jsonEncodedFeatures, featureNames) };
+                if (featureValuesMap.empty())
+                {
+                    _rejectedTrackIds.push_back(trackId);
+                    continue;
+                }
+
+                SOM::InputVector inputVector{ nbDimensions };
+                if (!convertFeatureValuesMapToInputVector(featureValuesMap, inputVector))
+                {
+                    _rejectedTrackIds.push_back(trackId);
+                    continue;
+                }
+
+                _dataNormalizer->normalizeData(inputVector);
+
+                const SOM::Position position{ network.getClosestRefVectorPosition(inputVector) };
+                addedTrackDistanceSum += distanceFunc(inputVector, network.getRefVector(position), network.getDataWeights());
+
+                newTrackPositions.emplace_back(trackId, position);
+            }
+
+            remainingNewTrackCount -= newTrackFeatures.size();
+        }
+
+        const std::size_t newRejectedTrackCount{ _rejectedTrackIds.size() - previousRejectedTrackCount };
+        if (newRejectedTrackCount > 0)
+            LMS_LOG(RECOMMENDATION, INFO, "Rejected " << newRejectedTrackCount << " new tracks with unusable features");
+
+        if (newTrackPositions.empty())
+            return (newRejectedTrackCount > 0 || rejectedTracksRemoved) ? IncrementalLoadResult::Done : IncrementalLoadResult::NothingToDo;
+
+        const std::size_t classifiedTrackCount{ _classificationStats.addedTrackCount + newTrackPositions.size() };
+        const double addedTrackDistanceMean{ addedTrackDistanceSum / classifiedTrackCount };
+        if (addedTrackDistanceMean > _classificationStats.trainedTrackDistanceMean * maxAddedTrackDistanceFactor)
+        {
+            LMS_LOG(RECOMMENDATION, INFO, "Tracks added since last training do not fit the network well enough (mean distance = " << addedTrackDistanceMean << ", was " << _classificationStats.trainedTrackDistanceMean << " for trained tracks)");
+            return IncrementalLoadResult::TrainingRequired;
+        }
+
+        trackPositions.insert(std::end(trackPositions), std::cbegin(newTrackPositions), std::cend(newTrackPositions));
+
+        _classificationStats.addedTrackCount = classifiedTrackCount;
+        _classificationStats.addedTrackDistanceSum = addedTrackDistanceSum;
+
+        LMS_LOG(RECOMMENDATION, INFO, "Classified " << newTrackPositions.size() << " new tracks without training");
+
+        return IncrementalLoadResult::Done;
     }
 
     TrackContainer FeaturesEngine::findSimilarTracksFromTrackList(TrackListId trackListId, std::size_t maxCount) const
@@ -236,7 +339,7 @@ namespace Recommendation
 
     TrackContainer FeaturesEngine::findSimilarTracks(const std::vector<TrackId>& tracksIds, std::size_t maxCount) const
     {
-        auto similarTrackIds{ getSimilarObjects(tracksIds, _trackMatrix, _trackPositions, maxCount) };
+        auto similarTrackIds{ getSimilarObjects(tracksIds, _trackPositions, _trackPositions, maxCount) };
 
         Session& session{ _db.getTLSSession() };
 
@@ -256,7 +359,7 @@ namespace Recommendation
 
     ReleaseContainer FeaturesEngine::getSimilarReleases(ReleaseId releaseId, std::size_t maxCount) const
     {
-        auto similarReleaseIds{ getSimilarObjects({releaseId}, _releaseMatrix, _releasePositions, maxCount) };
+        auto similarReleaseIds{ getSimilarObjects({releaseId}, _releasePositions, _releasePositions, maxCount) };
 
         Session& session{ _db.getTLSSession() };
 
@@ -281,13 +384,13 @@ namespace Recommendation
         {
             ArtistContainer similarArtistIds;
 
-            const auto itArtists {_artistMatrix.find(linkType)};
-            if (itArtists == std::cend(_artistMatrix))
+            const auto itArtists {_artistPositionsByLinkType.find(linkType)};
+            if (itArtists == std::cend(_artistPositionsByLinkType))
             {
                 return similarArtistIds;
             }
 
-            return getSimilarObjects({artistId}, itArtists->second, _artistPositions, maxCount);
+            return getSimilarObjects({artistId}, _artistPositions, itArtists->second, maxCount);
         } };
 
         std::unordered_set<ArtistId> similarArtistIds;
@@ -320,7 +423,11 @@ namespace Recommendation
 
     FeaturesEngineCache FeaturesEngine::toCache() const
     {
-        return FeaturesEngineCache{ *_network, _trackPositions };
+        TrackPositionList trackPositions;
+        trackPositions.reserve(_trackPositions.getObjectCount());
+        _trackPositions.visit([&](TrackId trackId, const SOM::Position& position) { trackPositions.emplace_back(trackId, position); });
+
+        return FeaturesEngineCache{ *_network, std::move(trackPositions), _dataNormalizer, _classificationStats, _rejectedTrackIds };
     }
 
     void FeaturesEngine::load(bool forceReload, const ProgressCallback& progressCallback)
@@ -331,12 +438,31 @@ namespace Recommendation
         }
         else if (std::optional<FeaturesEngineCache> cache{ FeaturesEngineCache::read() })
         {
-            loadFromCache(std::move(*cache));
-            return;
+            const IncrementalLoadResult result{ loadFromCache(std::move(*cache)) };
+            if (_loadCancelled)
+                return;
+
+            switch (result)
+            {
+            case IncrementalLoadResult::NothingToDo:
+                return;
+
+            case IncrementalLoadResult::Done:
+                toCache().write();
+                return;
+
+            case IncrementalLoadResult::TrainingRequired:
+                LMS_LOG(RECOMMENDATION, INFO, "Full training required");
+                break;
+            }
         }
 
         TrainSettings trainSettings;
         trainSettings.featureSettingsMap = getDefaultTrainFeatureSettings();
+        if (const std::size_t threadCount{ Service<IConfig>::get()->getULong("features-train-thread-count", 0) })
+            trainSettings.threadCount = threadCount;
+        else
+            trainSettings.threadCount = std::max<std::size_t>(1, std::thread::hardware_concurrency());
 
         loadFromTraining(trainSettings, progressCallback);
         if (!_loadCancelled && _network)
@@ -349,65 +475,77 @@ namespace Recommendation
         _loadCancelled = true;
     }
 
-    void FeaturesEngine::load(const SOM::Network& network, const TrackPositions& trackPositions)
+    void FeaturesEngine::load(std::unique_ptr<SOM::Network> network, TrackPositionList trackPositions)
     {
-        using namespace Database;
-
-        _networkRefVectorsDistanceMedian = network.computeRefVectorsDistanceMedian();
+        _networkRefVectorsDistanceMedian = network->computeRefVectorsDistanceMedian();
         LMS_LOG(RECOMMENDATION, DEBUG, "Median distance betweend ref vectors = " << _networkRefVectorsDistanceMedian);
 
-        const SOM::Coordinate width{ network.getWidth() };
-        const SOM::Coordinate height{ network.getHeight() };
+        buildObjectPositions(network->getWidth(), network->getHeight(), std::move(trackPositions));
+        if (_loadCancelled)
+            return;
+
+        _network = std::move(network);
 
-        _releaseMatrix = ReleaseMatrix{ width, height };
-        _trackMatrix = TrackMatrix{ width, height };
+        LMS_LOG(RECOMMENDATION, INFO, "Classifier successfully loaded!");
+    }
 
+    void FeaturesEngine::buildObjectPositions(SOM::Coordinate width, SOM::Coordinate height, TrackPositionList trackPositions)
+    {
         LMS_LOG(RECOMMENDATION, DEBUG, "Constructing maps...");
 
-        Session & session{ _db.getTLSSession() };
+        // Needed to look up the positions of each track while walking the tracks
+        TrackPositions allTrackPositions{ width, height, std::move(trackPositions) };
 
-        for (const auto& [trackId, positions] : trackPositions)
-        {
-            if (_loadCancelled)
-                return;
+        TrackPositionList existingTrackPositions;
+        std::vector<ReleasePositions::ObjectPosition> releasePositions;
+        std::vector<ArtistPositions::ObjectPosition> artistPositions;
+        std::unordered_map<TrackArtistLinkType, std::vector<ArtistPositions::ObjectPosition>> artistPositionsByLinkType;
 
-            auto transaction{ session.createReadTransaction() };
+        {
+            constexpr std::size_t trackCountPerTransaction{ 1000 };
 
-            const Track::pointer track{ Track::find(session, trackId) };
-            if (!track)
-                continue;
+            Session& session{ _db.getTLSSession() };
 
-            for (const SOM::Position& position : positions)
+            TrackId lastRetrievedId;
+            bool endReached{};
+            while (!endReached)
             {
-                Utils::push_back_if_not_present(_trackPositions[trackId], position);
-                Utils::push_back_if_not_present(_trackMatrix[position], trackId);
+                if (_loadCancelled)
+                    return;
 
-                if (Release::pointer release{ track->getRelease() })
-                {
-                    const ReleaseId releaseId{ release->getId() };
-                    Utils::push_back_if_not_present(_releasePositions[releaseId], position);
-                    Utils::push_back_if_not_present(_releaseMatrix[position], releaseId);
-                }
-                for (const TrackArtistLink::pointer& artistLink : track->getArtistLinks())
+                endReached = true;
+
+                auto transaction{ session.createReadTransaction() };
+
+                Track::findClusterLinks(session, lastRetrievedId, trackCountPerTransaction, [&](const Track::ClusterLinks& clusterLinks)
                 {
-                    const ArtistId artistId{ artistLink->getArtist()->getId() };
+                    endReached = false;
 
-                    Utils::push_back_if_not_present(_artistPositions[artistId], position);
-                    auto itArtists{ _artistMatrix.find(artistLink->getType()) };
-                    if (itArtists == std::cend(_artistMatrix))
+                    for (const SOM::Position& position : allTrackPositions.getPositions(clusterLinks.trackId))
                     {
-                        [[maybe_unused]] auto [it, inserted] = _artistMatrix.try_emplace(artistLink->getType(), ArtistMatrix{ width, height });
-                        assert(inserted);
-                        itArtists = it;
+                        existingTrackPositions.emplace_back(clusterLinks.trackId, position);
+
+                        if (clusterLinks.releaseId.isValid())
+                            releasePositions.emplace_back(clusterLinks.releaseId, position);
+
+                        for (const auto& [artistId, linkType] : clusterLinks.artistLinks)
+                        {
+                            artistPositions.emplace_back(artistId, position);
+                            artistPositionsByLinkType[linkType].emplace_back(artistId, position);
+                        }
                     }
-                    Utils::push_back_if_not_present(itArtists->second[position], artistId);
-                }
+                });
             }
         }
 
-        _network = std::make_unique<SOM::Network>(network);
+        _trackPositions = TrackPositions{ width, height, std::move(existingTrackPositions) };
+        _releasePositions = ReleasePositions{ width, height, std::move(releasePositions) };
+        _artistPositions = ArtistPositions{ width, height, std::move(artistPositions) };
+        _artistPositionsByLinkType.clear();
+        for (auto& [linkType, positions] : artistPositionsByLinkType)
+            _artistPositionsByLinkType.emplace(linkType, ArtistPositions{ width, height, std::move(positions) });
 
-        LMS_LOG(RECOMMENDATION, INFO, "Classifier successfully loaded!");
+        LMS_LOG(RECOMMENDATION, DEBUG, "Constructing maps DONE: " << _trackPositions.getObjectCount() << " tracks, " << _releasePositions.getObjectCount() << " releases, " << _artistPositions.getObjectCount() << " artists");
     }
 
 } // ns Recommendation
@@ -20,7 +20,9 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
 #include <functional>
+#include <memory>
 #include <unordered_map>
 #include <optional>
 #include <string>
@@ -32,6 +34,7 @@
 #include "IEngine.hpp"
 #include "FeaturesEngineCache.hpp"
 #include "FeaturesDefs.hpp"
+#include "ObjectPositionIndex.hpp"
 
 namespace Database
 {
@@ -63,31 +66,41 @@ class FeaturesEngine : public IEngine
 		ReleaseContainer getSimilarReleases(Database::ReleaseId releaseId, std::size_t maxCount) const override;
 		ArtistContainer getSimilarArtists(Database::ArtistId artistId, EnumSet<Database::TrackArtistLinkType> linkTypes, std::size_t maxCount) const override;
 
-		void loadFromCache(FeaturesEngineCache&& cache);
 
 		// Use training (may be very slow)
 		struct TrainSettings
 		{
 			std::size_t iterationCount {10};
 			float sampleCountPerNeuron {4};
+			std::size_t threadCount {1}; // more than 1 uses parallel batch training
 			FeatureSettingsMap featureSettingsMap;
 		};
 		void loadFromTraining(const TrainSettings& trainSettings, const ProgressCallback& progressCallback);
 
 		template <typename IdType>
-		using ObjectPositions = std::unordered_map<IdType, std::vector<SOM::Position>>;
+		using ObjectPositions = ObjectPositionIndex<IdType>;
 
 		using ArtistPositions = ObjectPositions<Database::ArtistId>;
 		using ReleasePositions = ObjectPositions<Database::ReleaseId>;
 		using TrackPositions = ObjectPositions<Database::TrackId>;
+		using TrackPositionList = FeaturesEngineCache::TrackPositions;
 
-		template <typename IdType>
-		using ObjectMatrix = SOM::Matrix<std::vector<IdType>>;
-		using ArtistMatrix = ObjectMatrix<Database::ArtistId>;
-		using ReleaseMatrix = ObjectMatrix<Database::ReleaseId>;
-		using TrackMatrix = ObjectMatrix<Database::TrackId>;
+		enum class IncrementalLoadResult
+		{
+			NothingToDo,
+			Done,
+			TrainingRequired,	// too many new tracks, or they don't fit the network well enough
+		};
+		// Also classifies the new tracks before building the object positions, so that tracks are walked only once
+		IncrementalLoadResult loadFromCache(FeaturesEngineCache&& cache);
+
+		// Classifies tracks that have features but are not known yet, using the given network and the current normalization factors
+		// Their positions are appended to trackPositions
+		IncrementalLoadResult classifyNewTracks(const SOM::Network& network, TrackPositionList& trackPositions);
 
-		void load(const SOM::Network& network, const TrackPositions& tracksPosition);
+		void load(std::unique_ptr<SOM::Network> network, TrackPositionList trackPositions);
+		// Builds all the object positions from the track positions, tracks that no longer exist are ignored
+		void buildObjectPositions(SOM::Coordinate width, SOM::Coordinate height, TrackPositionList trackPositions);
 
 		FeaturesEngineCache toCache() const;
 
@@ -95,27 +108,27 @@ class FeaturesEngine : public IEngine
 		static std::vector<SOM::Position> getMatchingRefVectorsPosition(const std::vector<IdType>& ids, const ObjectPositions<IdType>& objectPositions);
 
 		template <typename IdType>
-		static std::vector<IdType> getObjectsIds(const std::vector<SOM::Position>& positions, const ObjectMatrix<IdType>& objectsMatrix);
+		static std::vector<IdType> getObjectsIds(const std::vector<SOM::Position>& positions, const ObjectPositions<IdType>& objectPositions);
 
+		// positions of ids are searched in objectPositions, similar objects are searched in similarObjectPositions
 		template <typename IdType>
 		std::vector<IdType> getSimilarObjects(const std::vector<IdType>& ids,
-				const ObjectMatrix<IdType>& objectMatrix,
 				const ObjectPositions<IdType>& objectPositions,
+				const ObjectPositions<IdType>& similarObjectPositions,
 				std::size_t maxCount) const;
 
 		Database::Db&		_db;
-		bool				_loadCancelled {};
+		std::atomic<bool>	_loadCancelled {};
 		std::unique_ptr<SOM::Network>	_network;
 		double				_networkRefVectorsDistanceMedian {};
+		std::optional<SOM::DataNormalizer>	_dataNormalizer;
+		TrackClassificationStats	_classificationStats;
+		std::vector<Database::TrackId>	_rejectedTrackIds;	// tracks with features that cannot be classified, not to be fetched again
 
-		ArtistPositions     _artistPositions;
-		std::unordered_map<Database::TrackArtistLinkType, ArtistMatrix> _artistMatrix;
-
+		ArtistPositions     _artistPositions;	// all link types
+		std::unordered_map<Database::TrackArtistLinkType, ArtistPositions> _artistPositionsByLinkType;
 		ReleasePositions	_releasePositions;
-		ReleaseMatrix		_releaseMatrix;
-
 		TrackPositions		_trackPositions;
-		TrackMatrix			_trackMatrix;
 };
 
 template <typename IdType>
@@ -129,11 +142,7 @@ FeaturesEngine::getMatchingRefVectorsPosition(const std::vector<IdType>& ids, co
 
 	for (const IdType id : ids)
 	{
-		auto it = objectPositions.find(id);
-		if (it == objectPositions.end())
-			continue;
-
-		for (const SOM::Position& position : it->second)
+		for (const SOM::Position& position : objectPositions.getPositions(id))
 			Utils::push_back_if_not_present(res, position);
 	}
 
@@ -142,13 +151,13 @@ FeaturesEngine::getMatchingRefVectorsPosition(const std::vector<IdType>& ids, co
 
 template <typename IdType>
 std::vector<IdType>
-FeaturesEngine::getObjectsIds(const std::vector<SOM::Position>& positions, const ObjectMatrix<IdType>& objectMatrix)
+FeaturesEngine::getObjectsIds(const std::vector<SOM::Position>& positions, const ObjectPositions<IdType>& objectPositions)
 {
 	std::vector<IdType> res;
 
 	for (const SOM::Position& position : positions)
 	{
-		for (const IdType id : objectMatrix.get(position))
+		for (const IdType id : objectPositions.getObjects(position))
 			Utils::push_back_if_not_present(res, id);
 	}
 
@@ -158,8 +167,8 @@ FeaturesEngine::getObjectsIds(const std::vector<SOM::Position>& positions, const
 template <typename IdType>
 std::vector<IdType>
 FeaturesEngine::getSimilarObjects(const std::vector<IdType>& ids,
-		const ObjectMatrix<IdType>& objectMatrix,
 		const ObjectPositions<IdType>& objectPositions,
+		const ObjectPositions<IdType>& similarObjectPositions,
 		std::size_t maxCount) const
 {
 	std::vector<IdType> res;
@@ -170,7 +179,7 @@ FeaturesEngine::getSimilarObjects(const std::vector<IdType>& ids,
 
 	while (1)
 	{
-		std::vector<IdType> closestObjectIds {getObjectsIds(searchedRefVectorsPosition, objectMatrix)};
+		std::vector<IdType> closestObjectIds {getObjectsIds(searchedRefVectorsPosition, similarObjectPositions)};
 
 		// Remove objects that are already in input or already reported
 		closestObjectIds.erase(std::remove_if(std::begin(closestObjectIds), std::end(closestObjectIds),
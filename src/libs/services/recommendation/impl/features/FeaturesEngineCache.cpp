@@ -19,15 +19,23 @@
 
 #include "FeaturesEngineCache.hpp"
 
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/xml_parser.hpp>
 
 #include "utils/IConfig.hpp"
 #include "utils/ILogger.hpp"
 #include "utils/Service.hpp"
+#include "BinaryFile.hpp"
 
 namespace Recommendation
 {
+    using namespace BinaryFile;
+
     namespace
     {
         std::filesystem::path getCacheDirectory()
@@ -35,6 +43,7 @@ namespace Recommendation
             return Service<IConfig>::get()->getPath("working-dir") / "cache" / "features";
         }
 
+        // Legacy XML cache files, only read to migrate them
         std::filesystem::path getCacheNetworkFilePath()
         {
             return getCacheDirectory() / "network";
@@ -45,46 +54,45 @@ namespace Recommendation
             return getCacheDirectory() / "track_positions";
         }
 
-        bool networkToCacheFile(const SOM::Network& network, std::filesystem::path path)
+        // Binary cache file layout, in native byte order:
+        // header, weights (dimCount doubles), normalization factors (dimCount min/max doubles, if any),
+        // ref vectors (width * height * dimCount doubles, row major), track positions
+        // and rejected tracks (count then ids, if any)
+        constexpr std::array<char, 8> binaryCacheMagic{ 'L', 'M', 'S', 'F', 'E', 'A', 'T', '\0' };
+        constexpr std::uint32_t binaryCacheVersion{ 2 };
+        constexpr std::uint32_t binaryCacheFlagHasDataNormalizer{ 0x1 };
+        constexpr std::uint32_t binaryCacheFlagHasRejectedTracks{ 0x2 };
+        constexpr std::uint32_t binaryCacheByteOrderMark{ 0x01020304 };
+
+        struct BinaryCacheHeader
         {
-            try
-            {
-                boost::property_tree::ptree root;
-
-                root.put("width", network.getWidth());
-                root.put("height", network.getHeight());
-                root.put("dim_count", network.getInputDimCount());
-
-                for (SOM::InputVector::value_type weight : network.getDataWeights())
-                    root.add("weights.weight", weight);
-
-                for (SOM::Coordinate x = 0; x < network.getWidth(); ++x)
-                {
-                    for (SOM::Coordinate y = 0; y < network.getWidth(); ++y)
-                    {
-                        const auto& refVector = network.getRefVector({ x, y });
-
-                        boost::property_tree::ptree node;
-                        for (const auto& value : refVector)
-                            node.add("values.value", value);
-
-                        node.put("coord_x", x);
-                        node.put("coord_y", y);
-
-                        root.add_child("ref_vectors.ref_vector", node);
-                    }
-                }
-
-                boost::property_tree::write_xml(path.string(), root);
+            std::array<char, 8> magic;
+            std::uint32_t version;
+            std::uint32_t byteOrderMark;
+            std::uint32_t width;
+            std::uint32_t height;
+            std::uint32_t dimCount;
+            std::uint32_t flags;
+            std::uint64_t trackPositionCount;
+            std::uint64_t trainedTrackCount;
+            std::uint64_t addedTrackCount;
+            double trainedTrackDistanceMean;
+            double addedTrackDistanceSum;
+            std::uint64_t checksum; // of everything after the header, then of the header itself with a zero checksum
+        };
+        static_assert(sizeof(BinaryCacheHeader) == 80);
+
+        struct BinaryTrackPosition
+        {
+            std::int64_t trackId;
+            std::uint32_t x;
+            std::uint32_t y;
+        };
+        static_assert(sizeof(BinaryTrackPosition) == 16);
 
-                LMS_LOG(RECOMMENDATION, DEBUG, "Created network cache");
-                return true;
-            }
-            catch (boost::property_tree::ptree_error& error)
-            {
-                LMS_LOG(RECOMMENDATION, ERROR, "Cannot create network cache: " << error.what());
-                return false;
-            }
+        std::filesystem::path getCacheFilePath()
+        {
+            return getCacheDirectory() / "features.bin";
         }
     }
 
@@ -140,83 +148,258 @@ namespace Recommendation
         }
     }
 
-    bool FeaturesEngineCache::objectPositionToCacheFile(const TrackPositions& trackPositions, const std::filesystem::path& path)
+    std::optional<FeaturesEngineCache::TrackPositions> FeaturesEngineCache::createObjectPositionsFromCacheFile(const std::filesystem::path& path)
     {
         try
         {
+            LMS_LOG(RECOMMENDATION, INFO, "Reading object position from cache...");
+
             boost::property_tree::ptree root;
 
-            for (const auto& [id, positions] : trackPositions)
-            {
-                boost::property_tree::ptree node;
+            boost::property_tree::read_xml(path.string(), root);
 
-                node.put("id", id.getValue());
+            TrackPositions res;
 
-                for (const SOM::Position& position : positions)
+            for (const auto& object : root.get_child("objects"))
+            {
+                const Database::TrackId id{ object.second.get<Database::IdType::ValueType>("id") };
+                for (const auto& position : object.second.get_child("position"))
                 {
-                    boost::property_tree::ptree positionNode;
-                    positionNode.put("x", position.x);
-                    positionNode.put("y", position.y);
+                    auto x = position.second.get<SOM::Coordinate>("x");
+                    auto y = position.second.get<SOM::Coordinate>("y");
 
-                    node.add_child("position.position", positionNode);
+                    res.emplace_back(id, SOM::Position{ x, y });
                 }
-
-                root.add_child("objects.object", node);
             }
 
-            boost::property_tree::write_xml(path.string(), root);
-            return true;
+            LMS_LOG(RECOMMENDATION, INFO, "Successfully read object position from cache");
+
+            return res;
         }
         catch (boost::property_tree::ptree_error& error)
         {
-            LMS_LOG(RECOMMENDATION, ERROR, "Cannot cache object position: " << error.what());
-            return false;
+            LMS_LOG(RECOMMENDATION, ERROR, "Cannot create object position from cache file: " << error.what());
+            return std::nullopt;
         }
     }
 
-    std::optional<FeaturesEngineCache::TrackPositions> FeaturesEngineCache::createObjectPositionsFromCacheFile(const std::filesystem::path& path)
+    std::optional<FeaturesEngineCache> FeaturesEngineCache::createFromBinaryCacheFile(const std::filesystem::path& path)
     {
-        try
+        if (!std::filesystem::exists(path))
+            return std::nullopt;
+
+        LMS_LOG(RECOMMENDATION, INFO, "Reading features cache...");
+
+        const MappedFile file{ path };
+        if (!file.getData() || file.getSize() < sizeof(BinaryCacheHeader))
         {
-            LMS_LOG(RECOMMENDATION, INFO, "Reading object position from cache...");
+            LMS_LOG(RECOMMENDATION, ERROR, "Cannot read features cache: cannot map file or file too small");
+            return std::nullopt;
+        }
 
-            boost::property_tree::ptree root;
+        const std::byte* data{ file.getData() };
+        const BinaryCacheHeader header{ readValue<BinaryCacheHeader>(data) };
+        if (header.magic != binaryCacheMagic || header.version != binaryCacheVersion || header.byteOrderMark != binaryCacheByteOrderMark)
+        {
+            LMS_LOG(RECOMMENDATION, INFO, "Features cache has an unsupported format, ignoring it");
+            return std::nullopt;
+        }
 
-            boost::property_tree::read_xml(path.string(), root);
+        const bool hasDataNormalizer{ (header.flags & binaryCacheFlagHasDataNormalizer) != 0 };
+        const std::size_t refVectorCount{ static_cast<std::size_t>(header.width) * header.height };
+        const bool hasRejectedTracks{ (header.flags & binaryCacheFlagHasRejectedTracks) != 0 };
+        const std::size_t rejectedTrackCountOffset{ sizeof(BinaryCacheHeader)
+            + sizeof(SOM::InputVector::value_type) * header.dimCount * (1 + (hasDataNormalizer ? 2 : 0) + refVectorCount)
+            + sizeof(BinaryTrackPosition) * header.trackPositionCount };
+        std::uint64_t rejectedTrackCount{};
+        if (hasRejectedTracks && file.getSize() >= rejectedTrackCountOffset + sizeof(rejectedTrackCount))
+        {
+            const std::byte* rejectedTrackCountData{ file.getData() + rejectedTrackCountOffset };
+            rejectedTrackCount = readValue<std::uint64_t>(rejectedTrackCountData);
+        }
+        const std::size_t expectedSize{ rejectedTrackCountOffset
+            + (hasRejectedTracks ? sizeof(rejectedTrackCount) + sizeof(std::int64_t) * rejectedTrackCount : 0) };
+        if (header.width == 0 || header.height == 0 || header.dimCount == 0 || file.getSize() != expectedSize)
+        {
+            LMS_LOG(RECOMMENDATION, ERROR, "Cannot read features cache: unexpected size");
+            return std::nullopt;
+        }
 
-            TrackPositions res;
+        Checksum checksum;
+        checksum.update(data, file.getSize() - sizeof(BinaryCacheHeader));
+        BinaryCacheHeader checksumHeader{ header };
+        checksumHeader.checksum = 0;
+        checksum.update(&checksumHeader, sizeof(checksumHeader));
+        if (checksum.getValue() != header.checksum)
+        {
+            LMS_LOG(RECOMMENDATION, ERROR, "Cannot read features cache: bad checksum");
+            return std::nullopt;
+        }
 
-            for (const auto& object : root.get_child("objects"))
+        SOM::Network network{ header.width, header.height, header.dimCount };
+
+        // a single vector is reused for all ref vectors
+        SOM::InputVector values{ header.dimCount };
+        for (SOM::InputVector::value_type& value : values)
+            value = readValue<SOM::InputVector::value_type>(data);
+        network.setDataWeights(values);
+
+        std::optional<SOM::DataNormalizer> dataNormalizer;
+        if (hasDataNormalizer)
+        {
+            dataNormalizer.emplace(header.dimCount);
+            for (std::size_t i{}; i < header.dimCount; ++i)
             {
-                const Database::TrackId id{ object.second.get<Database::IdType::ValueType>("id") };
-                for (const auto& position : object.second.get_child("position"))
+                const SOM::InputVector::value_type min{ readValue<SOM::InputVector::value_type>(data) };
+                const SOM::InputVector::value_type max{ readValue<SOM::InputVector::value_type>(data) };
+                dataNormalizer->setValue(i, { min, max });
+            }
+        }
+
+        for (SOM::Coordinate y{}; y < header.height; ++y)
+        {
+            for (SOM::Coordinate x{}; x < header.width; ++x)
+            {
+                for (SOM::InputVector::value_type& value : values)
+                    value = readValue<SOM::InputVector::value_type>(data);
+                network.setRefVector({ x, y }, values);
+            }
+        }
+
+        TrackPositions trackPositions;
+        trackPositions.reserve(header.trackPositionCount);
+        for (std::uint64_t i{}; i < header.trackPositionCount; ++i)
+        {
+            const BinaryTrackPosition trackPosition{ readValue<BinaryTrackPosition>(data) };
+            if (trackPosition.x >= header.width || trackPosition.y >= header.height)
+            {
+                LMS_LOG(RECOMMENDATION, ERROR, "Cannot read features cache: bad track position");
+                return std::nullopt;
+            }
+
+            trackPositions.emplace_back(Database::TrackId{ trackPosition.trackId }, SOM::Position{ trackPosition.x, trackPosition.y });
+        }
+
+        TrackIds rejectedTrackIds;
+        if (hasRejectedTracks)
+        {
+            readValue<std::uint64_t>(data); // count, already read
+            rejectedTrackIds.reserve(rejectedTrackCount);
+            for (std::uint64_t i{}; i < rejectedTrackCount; ++i)
+                rejectedTrackIds.emplace_back(readValue<std::int64_t>(data));
+        }
+
+        TrackClassificationStats classificationStats;
+        classificationStats.trainedTrackCount = header.trainedTrackCount;
+        classificationStats.trainedTrackDistanceMean = header.trainedTrackDistanceMean;
+        classificationStats.addedTrackCount = header.addedTrackCount;
+        classificationStats.addedTrackDistanceSum = header.addedTrackDistanceSum;
+
+        LMS_LOG(RECOMMENDATION, INFO, "Successfully read features cache");
+
+        return FeaturesEngineCache{ std::move(network), std::move(trackPositions), std::move(dataNormalizer), classificationStats, std::move(rejectedTrackIds) };
+    }
+
+    bool FeaturesEngineCache::writeBinaryCacheFile(const std::filesystem::path& path) const
+    {
+        // write in a temporary file first, so that an interrupted write does not leave a truncated cache
+        std::filesystem::path tmpPath{ path };
+        tmpPath += ".tmp";
+
+        {
+            std::ofstream ofs{ tmpPath, std::ios_base::binary | std::ios_base::trunc };
+            if (!ofs)
+            {
+                LMS_LOG(RECOMMENDATION, ERROR, "Cannot create features cache file '" << tmpPath.string() << "'");
+                return false;
+            }
+
+            BinaryCacheHeader header{};
+            header.magic = binaryCacheMagic;
+            header.version = binaryCacheVersion;
+            header.byteOrderMark = binaryCacheByteOrderMark;
+            header.width = _network.getWidth();
+            header.height = _network.getHeight();
+            header.dimCount = _network.getInputDimCount();
+            header.flags = (_dataNormalizer ? binaryCacheFlagHasDataNormalizer : 0) | (!_rejectedTrackIds.empty() ? binaryCacheFlagHasRejectedTracks : 0);
+            header.trainedTrackCount = _classificationStats.trainedTrackCount;
+            header.addedTrackCount = _classificationStats.addedTrackCount;
+            header.trainedTrackDistanceMean = _classificationStats.trainedTrackDistanceMean;
+            header.addedTrackDistanceSum = _classificationStats.addedTrackDistanceSum;
+            header.trackPositionCount = _trackPositions.size();
+
+            // the header is written again once the checksum is known
+            ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+            Checksum checksum;
+            for (SOM::InputVector::value_type weight : _network.getDataWeights())
+                writeValue(ofs, checksum, weight);
+
+            if (_dataNormalizer)
+            {
+                for (std::size_t i{}; i < _dataNormalizer->getInputDimCount(); ++i)
                 {
-                    auto x = position.second.get<SOM::Coordinate>("x");
-                    auto y = position.second.get<SOM::Coordinate>("y");
+                    writeValue(ofs, checksum, _dataNormalizer->getValue(i).min);
+                    writeValue(ofs, checksum, _dataNormalizer->getValue(i).max);
+                }
+            }
 
-                    res[id].push_back({ x, y });
+            for (SOM::Coordinate y{}; y < _network.getHeight(); ++y)
+            {
+                for (SOM::Coordinate x{}; x < _network.getWidth(); ++x)
+                {
+                    for (SOM::InputVector::value_type value : _network.getRefVector({ x, y }))
+                        writeValue(ofs, checksum, value);
                 }
             }
 
-            LMS_LOG(RECOMMENDATION, INFO, "Successfully read object position from cache");
+            for (const auto& [trackId, position] : _trackPositions)
+                writeValue(ofs, checksum, BinaryTrackPosition{ trackId.getValue(), position.x, position.y });
 
-            return res;
+            if (!_rejectedTrackIds.empty())
+            {
+                writeValue(ofs, checksum, static_cast<std::uint64_t>(_rejectedTrackIds.size()));
+                for (const Database::TrackId trackId : _rejectedTrackIds)
+                    writeValue(ofs, checksum, static_cast<std::int64_t>(trackId.getValue()));
+            }
+
+            checksum.update(&header, sizeof(header));
+            header.checksum = checksum.getValue();
+            ofs.seekp(0);
+            ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+            if (!ofs)
+            {
+                LMS_LOG(RECOMMENDATION, ERROR, "Cannot write features cache file '" << tmpPath.string() << "'");
+                return false;
+            }
         }
-        catch (boost::property_tree::ptree_error& error)
+
+        std::error_code ec;
+        std::filesystem::rename(tmpPath, path, ec);
+        if (ec)
         {
-            LMS_LOG(RECOMMENDATION, ERROR, "Cannot create object position from cache file: " << error.what());
-            return std::nullopt;
+            LMS_LOG(RECOMMENDATION, ERROR, "Cannot rename features cache file: " << ec.message());
+            return false;
         }
+
+        LMS_LOG(RECOMMENDATION, DEBUG, "Created features cache");
+        return true;
     }
 
     void FeaturesEngineCache::invalidate()
     {
+        std::filesystem::remove(getCacheFilePath());
         std::filesystem::remove(getCacheNetworkFilePath());
         std::filesystem::remove(getCacheTrackPositionsFilePath());
     }
 
     std::optional<FeaturesEngineCache> FeaturesEngineCache::read()
     {
+        if (std::optional<FeaturesEngineCache> cache{ createFromBinaryCacheFile(getCacheFilePath()) })
+            return cache;
+
+        // Fallback on the legacy XML cache, and migrate it to the binary format
         auto network{ createNetworkFromCacheFile(getCacheNetworkFilePath()) };
         if (!network)
             return std::nullopt;
@@ -225,23 +408,34 @@ namespace Recommendation
         if (!trackPositions)
             return std::nullopt;
 
-        return FeaturesEngineCache{ std::move(*network), std::move(*trackPositions) };
+        FeaturesEngineCache cache{ std::move(*network), std::move(*trackPositions) };
+
+        LMS_LOG(RECOMMENDATION, INFO, "Migrating features cache to binary format");
+        cache.write();
+
+        return cache;
     }
 
     void FeaturesEngineCache::write() const
     {
-        std::filesystem::create_directories(Service<IConfig>::get()->getPath("working-dir") / "cache" / "features");
+        std::filesystem::create_directories(getCacheDirectory());
 
-        if (!networkToCacheFile(_network, getCacheNetworkFilePath())
-            || !objectPositionToCacheFile(_trackPositions, getCacheTrackPositionsFilePath()))
+        if (!writeBinaryCacheFile(getCacheFilePath()))
         {
             invalidate();
+            return;
         }
+
+        std::filesystem::remove(getCacheNetworkFilePath());
+        std::filesystem::remove(getCacheTrackPositionsFilePath());
     }
 
-    FeaturesEngineCache::FeaturesEngineCache(SOM::Network network, TrackPositions trackPositions)
+    FeaturesEngineCache::FeaturesEngineCache(SOM::Network network, TrackPositions trackPositions, std::optional<SOM::DataNormalizer> dataNormalizer, const TrackClassificationStats& classificationStats, TrackIds rejectedTrackIds)
         : _network{ std::move(network) },
-        _trackPositions{ std::move(trackPositions) }
+        _trackPositions{ std::move(trackPositions) },
+        _dataNormalizer{ std::move(dataNormalizer) },
+        _classificationStats{ classificationStats },
+        _rejectedTrackIds{ std::move(rejectedTrackIds) }
     {
     }
 
@@ -20,13 +20,25 @@
 #pragma once
 
 #include <filesystem>
-#include <unordered_map>
+#include <optional>
+#include <utility>
+#include <vector>
 
 #include "database/TrackId.hpp"
+#include "som/DataNormalizer.hpp"
 #include "som/Network.hpp"
 
 namespace Recommendation {
 
+// Used to decide when tracks classified without training are too many or too far from the network
+struct TrackClassificationStats
+{
+	std::size_t trainedTrackCount {};
+	double trainedTrackDistanceMean {};	// mean distance between trained tracks and their matching ref vector
+	std::size_t addedTrackCount {};		// tracks classified after the training
+	double addedTrackDistanceSum {};
+};
+
 class FeaturesEngineCache
 {
 	public:
@@ -36,18 +48,26 @@ class FeaturesEngineCache
 		void write() const;
 
 	private:
-		using TrackPositions = std::unordered_map<Database::TrackId, std::vector<SOM::Position>>;
+		using TrackPositions = std::vector<std::pair<Database::TrackId, SOM::Position>>;
+		using TrackIds = std::vector<Database::TrackId>;
+
+		FeaturesEngineCache(SOM::Network network, TrackPositions trackPositions, std::optional<SOM::DataNormalizer> dataNormalizer = std::nullopt, const TrackClassificationStats& classificationStats = {}, TrackIds rejectedTrackIds = {});
 
-		FeaturesEngineCache(SOM::Network network, TrackPositions trackPositions);
+		static std::optional<FeaturesEngineCache> createFromBinaryCacheFile(const std::filesystem::path& path);
+		bool writeBinaryCacheFile(const std::filesystem::path& path) const;
 
+		// legacy XML format
 		static std::optional<SOM::Network> createNetworkFromCacheFile(const std::filesystem::path& path);
 		static std::optional<TrackPositions> createObjectPositionsFromCacheFile(const std::filesystem::path& path);
-		static bool objectPositionToCacheFile(const TrackPositions& trackPositions, const std::filesystem::path& path);
 
 		friend class FeaturesEngine;
+		friend class FeaturesEngineCacheTest;
 
 		SOM::Network		_network;
 		TrackPositions		_trackPositions;
+		std::optional<SOM::DataNormalizer>	_dataNormalizer;	// not available in legacy caches
+		TrackClassificationStats			_classificationStats;
+		TrackIds			_rejectedTrackIds;	// tracks whose features cannot be classified
 };
 
 } // namespace Recommendation
@@ -0,0 +1,210 @@
+/*
+ * Copyright (C) 2023 Emeric Poupon
+ *
+ * This file is part of LMS.
+ *
+ * LMS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LMS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "FeaturesExtractor.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "database/Db.hpp"
+#include "database/Session.hpp"
+#include "database/TrackFeatures.hpp"
+#include "utils/ILogger.hpp"
+
+namespace Recommendation
+{
+    using namespace Database;
+
+    bool convertFeatureValuesMapToInputVector(const FeatureValuesMap& featureValuesMap, SOM::InputVector& res)
+    {
+        std::size_t i{};
+        for (const auto& [featureName, values] : featureValuesMap)
+        {
+            if (values.size() != getFeatureDef(featureName).nbDimensions)
+            {
+                LMS_LOG(RECOMMENDATION, WARNING, "Dimension mismatch for feature '" << featureName << "'. Expected " << getFeatureDef(featureName).nbDimensions << ", got " << values.size());
+                return false;
+            }
+
+            for (double val : values)
+                res[i++] = val;
+        }
+
+        return true;
+    }
+
+    SOM::InputVector getInputVectorWeights(const FeatureSettingsMap& featureSettingsMap, std::size_t nbDimensions)
+    {
+        SOM::InputVector weights{ nbDimensions };
+        std::size_t index{};
+        for (const auto& [featureName, featureSettings] : featureSettingsMap)
+        {
+            const std::size_t featureNbDimensions{ getFeatureDef(featureName).nbDimensions };
+
+            for (std::size_t i{}; i < featureNbDimensions; ++i)
+                weights[index++] = (1. / featureNbDimensions * featureSettings.weight);
+        }
+
+        assert(index == nbDimensions);
+
+        return weights;
+    }
+
+    void extractFeatures(Db& db, const FeatureNames& featureNames, std::size_t nbDimensions, std::size_t threadCount, const RequestStopCallback& requestStopCallback, std::vector<SOM::InputVector>& samples, std::vector<TrackId>& samplesTrackIds)
+    {
+        // Track features are fetched by pages on this thread, each page using its own short read transaction
+        // Pages are decoded by worker threads, directly into their preallocated slots
+        constexpr std::size_t pageSize{ 1000 };
+
+        struct Page
+        {
+            std::size_t firstIndex;
+            std::vector<std::string> encodedFeatures;
+        };
+
+        const auto start{ std::chrono::steady_clock::now() };
+
+        Session& session{ db.getTLSSession() };
+
+        std::size_t trackFeaturesCount;
+        {
+            auto transaction{ session.createReadTransaction() };
+            trackFeaturesCount = TrackFeatures::getCount(session);
+        }
+
+        samples.assign(trackFeaturesCount, SOM::InputVector{ nbDimensions });
+        samplesTrackIds.assign(trackFeaturesCount, TrackId{});
+        std::vector<char> validSamples(trackFeaturesCount);
+
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::deque<Page> pendingPages;
+        bool fetchDone{};
+        const std::size_t workerCount{ std::max<std::size_t>(1, threadCount) };
+        const std::size_t maxPendingPageCount{ workerCount * 2 };
+
+        LMS_LOG(RECOMMENDATION, DEBUG, "Extracting features from " << trackFeaturesCount << " track features using " << workerCount << " thread(s)...");
+
+        auto decodePages{ [&]
+        {
+            while (true)
+            {
+                Page page;
+                {
+                    std::unique_lock lock{ mutex };
+                    cv.wait(lock, [&] { return !pendingPages.empty() || fetchDone; });
+                    if (pendingPages.empty())
+                        return;
+
+                    page = std::move(pendingPages.front());
+                    pendingPages.pop_front();
+                }
+                cv.notify_all();
+
+                for (std::size_t i{}; i < page.encodedFeatures.size(); ++i)
+                {
+                    const std::size_t index{ page.firstIndex + i };
+
+                    const FeatureValuesMap featureValuesMap{ TrackFeatures::parseFeatureValuesMap(page.encodedFeatures[i], featureNames) };
+                    if (featureValuesMap.empty())
+                        continue;
+
+                    validSamples[index] = convertFeatureValuesMapToInputVector(featureValuesMap, samples[index]);
+                }
+            }
+        } };
+
+        std::vector<std::thread> workers;
+        for (std::size_t i{}; i < workerCount; ++i)
+            workers.emplace_back(decodePages);
+
+        TrackFeaturesId lastRetrievedId;
+        std::size_t fetchedCount{};
+        bool stopRequested{};
+        while (fetchedCount < trackFeaturesCount)
+        {
+            if (requestStopCallback && requestStopCallback())
+            {
+                stopRequested = true;
+                break;
+            }
+
+            Page page{ fetchedCount, {} };
+            page.encodedFeatures.reserve(pageSize);
+            {
+                auto transaction{ session.createReadTransaction() };
+
+                // track features added since the count was taken are handled by the next load
+                TrackFeatures::find(session, lastRetrievedId, std::min(pageSize, trackFeaturesCount - fetchedCount), [&](TrackId trackId, const std::string& jsonEncodedFeatures)
+                {
+                    samplesTrackIds[fetchedCount++] = trackId;
+                    page.encodedFeatures.push_back(jsonEncodedFeatures);
+                });
+            }
+
+            if (page.encodedFeatures.empty())
+                break;
+
+            {
+                std::unique_lock lock{ mutex };
+                cv.wait(lock, [&] { return pendingPages.size() < maxPendingPageCount; });
+                pendingPages.push_back(std::move(page));
+            }
+            cv.notify_all();
+        }
+
+        {
+            std::scoped_lock lock{ mutex };
+            fetchDone = true;
+            if (stopRequested)
+                pendingPages.clear();
+        }
+        cv.notify_all();
+
+        for (std::thread& worker : workers)
+            worker.join();
+
+        if (stopRequested)
+            return;
+
+        // Remove the slots that could not be decoded (or were not fetched at all)
+        std::size_t validCount{};
+        for (std::size_t i{}; i < fetchedCount; ++i)
+        {
+            if (!validSamples[i])
+                continue;
+
+            if (validCount != i)
+            {
+                samples[validCount] = std::move(samples[i]);
+                samplesTrackIds[validCount] = samplesTrackIds[i];
+            }
+            validCount++;
+        }
+        samples.erase(std::begin(samples) + validCount, std::end(samples));
+        samplesTrackIds.erase(std::begin(samplesTrackIds) + validCount, std::end(samplesTrackIds));
+
+        LMS_LOG(RECOMMENDATION, DEBUG, "Extracting features DONE (" << samples.size() << " valid samples out of " << fetchedCount << " track features, took " << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count() << " ms)");
+    }
+} // namespace Recommendation
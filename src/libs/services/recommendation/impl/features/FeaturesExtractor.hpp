@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2023 Emeric Poupon
+ *
+ * This file is part of LMS.
+ *
+ * LMS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LMS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <functional>
+#include <vector>
+
+#include "database/TrackId.hpp"
+#include "som/InputVector.hpp"
+#include "FeaturesDefs.hpp"
+
+namespace Database
+{
+	class Db;
+}
+
+namespace Recommendation
+{
+	// Fills res with the feature values, in the featureValuesMap order. Returns false on dimension mismatch
+	bool convertFeatureValuesMapToInputVector(const FeatureValuesMap& featureValuesMap, SOM::InputVector& res);
+
+	SOM::InputVector getInputVectorWeights(const FeatureSettingsMap& featureSettingsMap, std::size_t nbDimensions);
+
+	// Extracts the features of all the tracks, in pages using short read transactions, decoding on threadCount threads
+	// Tracks whose features cannot be decoded are skipped. RequestStopCallback is only called from the calling thread
+	using RequestStopCallback = std::function<bool()>;
+	void extractFeatures(Database::Db& db, const FeatureNames& featureNames, std::size_t nbDimensions, std::size_t threadCount, const RequestStopCallback& requestStopCallback,
+			std::vector<SOM::InputVector>& samples, std::vector<Database::TrackId>& samplesTrackIds);
+}
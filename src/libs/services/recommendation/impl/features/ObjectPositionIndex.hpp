@@ -0,0 +1,215 @@
+/*
+ * Copyright (C) 2023 Emeric Poupon
+ *
+ * This file is part of LMS.
+ *
+ * LMS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LMS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "som/Matrix.hpp"
+
+namespace Recommendation {
+
+// Objects (tracks, releases or artists) <-> network positions, in both directions
+// Stored in flat arrays: sorted ids, offsets and packed positions, and the same for the inverse mapping
+// Built in one go, read only afterwards
+template <typename IdType>
+class ObjectPositionIndex
+{
+	public:
+		template <typename T>
+		class Range
+		{
+			public:
+				Range() = default;
+				Range(const T* begin, const T* end) : _begin {begin}, _end {end} {}
+
+				const T* begin() const { return _begin; }
+				const T* end() const { return _end; }
+				bool empty() const { return _begin == _end; }
+				std::size_t size() const { return static_cast<std::size_t>(_end - _begin); }
+
+			private:
+				const T* _begin {};
+				const T* _end {};
+		};
+
+		using ObjectPosition = std::pair<IdType, SOM::Position>;
+
+		ObjectPositionIndex() = default;
+		// duplicate entries are allowed
+		ObjectPositionIndex(SOM::Coordinate width, SOM::Coordinate height, std::vector<ObjectPosition> objectPositions);
+
+		bool empty() const { return _ids.empty(); }
+		std::size_t getObjectCount() const { return _ids.size(); }
+		bool contains(IdType id) const { return findIdIndex(id) != _ids.size(); }
+
+		// sorted, empty if the object is unknown
+		Range<SOM::Position> getPositions(IdType id) const;
+		// in a stable pseudo random order, so that big cells do not always favor the same objects
+		Range<IdType> getObjects(const SOM::Position& position) const;
+
+		template <typename Func>
+		void visit(Func func) const;	// func(IdType, const SOM::Position&)
+
+	private:
+		using Offset = std::uint32_t;
+
+		std::size_t findIdIndex(IdType id) const;
+		std::size_t getCellIndex(const SOM::Position& position) const;
+		static std::uint64_t getObjectOrderKey(IdType id);
+
+		SOM::Coordinate				_width {};
+		SOM::Coordinate				_height {};
+
+		std::vector<IdType>			_ids;				// sorted
+		std::vector<Offset>			_positionOffsets;	// _ids.size() + 1 entries, into _positions
+		std::vector<SOM::Position>	_positions;
+
+		std::vector<Offset>			_objectOffsets;		// _width * _height + 1 entries, into _objects
+		std::vector<IdType>			_objects;
+};
+
+template <typename IdType>
+ObjectPositionIndex<IdType>::ObjectPositionIndex(SOM::Coordinate width, SOM::Coordinate height, std::vector<ObjectPosition> objectPositions)
+: _width {width}
+, _height {height}
+{
+	std::sort(std::begin(objectPositions), std::end(objectPositions), [](const ObjectPosition& a, const ObjectPosition& b)
+	{
+		if (a.first == b.first)
+			return a.second < b.second;
+		return a.first < b.first;
+	});
+	objectPositions.erase(std::unique(std::begin(objectPositions), std::end(objectPositions), [](const ObjectPosition& a, const ObjectPosition& b)
+	{
+		return a.first == b.first && !(a.second < b.second) && !(b.second < a.second);
+	}), std::end(objectPositions));
+
+	const std::size_t cellCount {static_cast<std::size_t>(_width) * static_cast<std::size_t>(_height)};
+
+	_positions.reserve(objectPositions.size());
+	_objectOffsets.assign(cellCount + 1, 0);
+	for (const auto& [id, position] : objectPositions)
+	{
+		if (_ids.empty() || _ids.back() != id)
+		{
+			_ids.push_back(id);
+			_positionOffsets.push_back(static_cast<Offset>(_positions.size()));
+		}
+		_positions.push_back(position);
+		_objectOffsets[getCellIndex(position) + 1]++;
+	}
+	_positionOffsets.push_back(static_cast<Offset>(_positions.size()));
+
+	// inverse mapping: counting sort on cells
+	for (std::size_t cellIndex {}; cellIndex < cellCount; ++cellIndex)
+		_objectOffsets[cellIndex + 1] += _objectOffsets[cellIndex];
+
+	_objects.resize(objectPositions.size());
+	{
+		std::vector<Offset> cellFillCounts(cellCount);
+		for (const auto& [id, position] : objectPositions)
+		{
+			const std::size_t cellIndex {getCellIndex(position)};
+			_objects[_objectOffsets[cellIndex] + cellFillCounts[cellIndex]++] = id;
+		}
+	}
+
+	for (std::size_t cellIndex {}; cellIndex < cellCount; ++cellIndex)
+	{
+		std::sort(std::begin(_objects) + _objectOffsets[cellIndex], std::begin(_objects) + _objectOffsets[cellIndex + 1], [](IdType a, IdType b)
+		{
+			return getObjectOrderKey(a) < getObjectOrderKey(b);
+		});
+	}
+}
+
+template <typename IdType>
+typename ObjectPositionIndex<IdType>::template Range<SOM::Position>
+ObjectPositionIndex<IdType>::getPositions(IdType id) const
+{
+	const std::size_t idIndex {findIdIndex(id)};
+	if (idIndex == _ids.size())
+		return {};
+
+	return {_positions.data() + _positionOffsets[idIndex], _positions.data() + _positionOffsets[idIndex + 1]};
+}
+
+template <typename IdType>
+typename ObjectPositionIndex<IdType>::template Range<IdType>
+ObjectPositionIndex<IdType>::getObjects(const SOM::Position& position) const
+{
+	if (_objectOffsets.empty())
+		return {};
+
+	const std::size_t cellIndex {getCellIndex(position)};
+	return {_objects.data() + _objectOffsets[cellIndex], _objects.data() + _objectOffsets[cellIndex + 1]};
+}
+
+template <typename IdType>
+template <typename Func>
+void
+ObjectPositionIndex<IdType>::visit(Func func) const
+{
+	for (std::size_t idIndex {}; idIndex < _ids.size(); ++idIndex)
+	{
+		for (Offset offset {_positionOffsets[idIndex]}; offset < _positionOffsets[idIndex + 1]; ++offset)
+			func(_ids[idIndex], _positions[offset]);
+	}
+}
+
+template <typename IdType>
+std::size_t
+ObjectPositionIndex<IdType>::findIdIndex(IdType id) const
+{
+	const auto it {std::lower_bound(std::cbegin(_ids), std::cend(_ids), id)};
+	if (it == std::cend(_ids) || *it != id)
+		return _ids.size();
+
+	return static_cast<std::size_t>(std::distance(std::cbegin(_ids), it));
+}
+
+template <typename IdType>
+std::size_t
+ObjectPositionIndex<IdType>::getCellIndex(const SOM::Position& position) const
+{
+	assert(position.x < _width);
+	assert(position.y < _height);
+	return position.x + static_cast<std::size_t>(_width) * position.y;
+}
+
+template <typename IdType>
+std::uint64_t
+ObjectPositionIndex<IdType>::getObjectOrderKey(IdType id)
+{
+	std::uint64_t value {static_cast<std::uint64_t>(id.getValue())};
+	value ^= value >> 33;
+	value *= 0xff51afd7ed558ccdULL;
+	value ^= value >> 33;
+	value *= 0xc4ceb9fe1a85ec53ULL;
+	value ^= value >> 33;
+	return value;
+}
+
+} // ns Recommendation
@@ -0,0 +1,661 @@
+/*
+ * Copyright (C) 2023 Emeric Poupon
+ *
+ * This file is part of LMS.
+ *
+ * LMS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LMS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "HnswEngine.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <numeric>
+#include <thread>
+#include <unordered_set>
+
+#include "database/Artist.hpp"
+#include "database/Db.hpp"
+#include "database/Release.hpp"
+#include "database/Session.hpp"
+#include "database/Track.hpp"
+#include "database/TrackArtistLink.hpp"
+#include "database/TrackFeatures.hpp"
+#include "database/TrackList.hpp"
+#include "features/FeaturesEngine.hpp"
+#include "features/FeaturesExtractor.hpp"
+#include "utils/IConfig.hpp"
+#include "utils/ILogger.hpp"
+#include "utils/Service.hpp"
+#include "BinaryFile.hpp"
+
+namespace Recommendation
+{
+    using namespace BinaryFile;
+    using namespace Database;
+
+    std::unique_ptr<IEngine> createHnswEngine(Db& db)
+    {
+        return std::make_unique<HnswEngine>(db);
+    }
+
+    namespace
+    {
+        constexpr HnswIndex::Settings indexSettings{ 16, 100 };
+        constexpr std::size_t searchEf{ 64 };
+        constexpr std::size_t maxVisitedNodeCount{ 4096 };
+        constexpr double maxRemovedNodeRatio{ 0.25 };	// rebuild the index if too many nodes refer to removed tracks
+        constexpr std::size_t transactionTrackCount{ 1000 };
+
+        std::filesystem::path getCacheFilePath()
+        {
+            return Service<IConfig>::get()->getPath("working-dir") / "cache" / "features" / "hnsw.bin";
+        }
+
+        // Cache file layout, in native byte order:
+        // header, normalization factors (dimCount min/max doubles), node track ids (nodeCount int64) and index
+        constexpr std::array<char, 8> cacheMagic{ 'L', 'M', 'S', 'H', 'N', 'S', 'W', '\0' };
+        constexpr std::uint32_t cacheVersion{ 1 };
+        constexpr std::uint32_t cacheByteOrderMark{ 0x01020304 };
+
+        struct CacheHeader
+        {
+            std::array<char, 8> magic;
+            std::uint32_t version;
+            std::uint32_t byteOrderMark;
+            std::uint32_t dimCount;
+            std::uint32_t reserved;
+            std::uint64_t nodeCount;
+            std::uint64_t checksum; // of everything after the header, then of the header itself with a zero checksum
+        };
+        static_assert(sizeof(CacheHeader) == 40);
+
+        FeatureNames getTrainFeatureNames()
+        {
+            const FeatureSettingsMap& featureSettingsMap{ FeaturesEngine::getDefaultTrainFeatureSettings() };
+
+            FeatureNames featureNames;
+            std::transform(std::cbegin(featureSettingsMap), std::cend(featureSettingsMap), std::inserter(featureNames, std::begin(featureNames)),
+                [](const auto& itFeatureSetting) { return itFeatureSetting.first; });
+
+            return featureNames;
+        }
+
+        std::size_t getDimCount(const FeatureNames& featureNames)
+        {
+            return std::accumulate(std::cbegin(featureNames), std::cend(featureNames), std::size_t{ 0 },
+                [](std::size_t sum, const FeatureName& featureName) { return sum + getFeatureDef(featureName).nbDimensions; });
+        }
+    }
+
+    void HnswEngine::load(bool forceReload, const ProgressCallback& progressCallback)
+    {
+        if (forceReload)
+        {
+            std::error_code ec;
+            std::filesystem::remove(getCacheFilePath(), ec);
+        }
+        else if (readCache())
+        {
+            const std::size_t removedNodeCount{ loadObjectMaps() };
+            if (_loadCancelled)
+                return;
+
+            if (removedNodeCount > _nodeTrackIds.size() * maxRemovedNodeRatio)
+            {
+                LMS_LOG(RECOMMENDATION, INFO, "Too many removed tracks (" << removedNodeCount << " out of " << _nodeTrackIds.size() << "), rebuilding index");
+            }
+            else
+            {
+                const std::size_t insertedTrackCount{ insertNewTracks() };
+                if (_loadCancelled)
+                    return;
+
+                if (insertedTrackCount > 0)
+                    writeCache();
+
+                LMS_LOG(RECOMMENDATION, INFO, "Nearest neighbours index successfully loaded (" << _index->getNodeCount() << " tracks, " << insertedTrackCount << " added)");
+                return;
+            }
+        }
+
+        build(progressCallback);
+        if (!_loadCancelled && _index)
+            writeCache();
+    }
+
+    void HnswEngine::requestCancelLoad()
+    {
+        LMS_LOG(RECOMMENDATION, DEBUG, "Requesting init cancellation");
+        _loadCancelled = true;
+    }
+
+    TrackContainer HnswEngine::findSimilarTracksFromTrackList(TrackListId trackListId, std::size_t maxCount) const
+    {
+        const TrackContainer trackIds{ [&]
+        {
+            TrackContainer res;
+
+            Session& session{ _db.getTLSSession() };
+
+            auto transaction{ session.createReadTransaction() };
+
+            const TrackList::pointer trackList{ TrackList::find(session, trackListId) };
+            if (trackList)
+                res = trackList->getTrackIds();
+
+            return res;
+        }() };
+
+        return findSimilarTracks(trackIds, maxCount);
+    }
+
+    TrackContainer HnswEngine::findSimilarTracks(const std::vector<TrackId>& trackIds, std::size_t maxCount) const
+    {
+        TrackContainer res;
+
+        if (!_index)
+            return res;
+
+        std::vector<NodeIndex> indexes;
+        for (const TrackId trackId : trackIds)
+        {
+            const auto itNode{ _trackNodes.find(trackId) };
+            if (itNode != std::cend(_trackNodes))
+                indexes.push_back(itNode->second);
+        }
+
+        if (indexes.empty())
+            return res;
+
+        const std::unordered_set<TrackId> inputTrackIds(std::cbegin(trackIds), std::cend(trackIds));
+        visitClosestNodes(computeCentroid(indexes), [&](NodeIndex index)
+        {
+            const TrackId trackId{ _nodeTrackIds[index] };
+            if (trackId.isValid() && inputTrackIds.find(trackId) == std::cend(inputTrackIds))
+                res.push_back(trackId);
+
+            return res.size() < maxCount;
+        });
+
+        Session& session{ _db.getTLSSession() };
+        {
+            // Report only existing ids, as tracks may have been removed since the index was loaded
+            auto transaction{ session.createReadTransaction() };
+
+            res.erase(std::remove_if(std::begin(res), std::end(res),
+                [&](TrackId trackId)
+                {
+                    return !Track::exists(session, trackId);
+                }), std::end(res));
+        }
+
+        return res;
+    }
+
+    ReleaseContainer HnswEngine::getSimilarReleases(ReleaseId releaseId, std::size_t maxCount) const
+    {
+        ReleaseContainer res;
+
+        if (!_index)
+            return res;
+
+        const auto itNodes{ _releaseNodes.find(releaseId) };
+        if (itNodes == std::cend(_releaseNodes))
+            return res;
+
+        std::unordered_set<ReleaseId> reportedReleaseIds{ releaseId };
+        visitClosestNodes(computeCentroid(itNodes->second), [&](NodeIndex index)
+        {
+            const ReleaseId similarReleaseId{ _nodeReleaseIds[index] };
+            if (similarReleaseId.isValid() && reportedReleaseIds.insert(similarReleaseId).second)
+                res.push_back(similarReleaseId);
+
+            return res.size() < maxCount;
+        });
+
+        Session& session{ _db.getTLSSession() };
+        {
+            // Report only existing ids
+            auto transaction{ session.createReadTransaction() };
+
+            res.erase(std::remove_if(std::begin(res), std::end(res),
+                [&](ReleaseId similarReleaseId)
+                {
+                    return !Release::exists(session, similarReleaseId);
+                }), std::end(res));
+        }
+
+        return res;
+    }
+
+    ArtistContainer HnswEngine::getSimilarArtists(ArtistId artistId, EnumSet<TrackArtistLinkType> linkTypes, std::size_t maxCount) const
+    {
+        ArtistContainer res;
+
+        if (!_index)
+            return res;
+
+        const auto itNodes{ _artistNodes.find(artistId) };
+        if (itNodes == std::cend(_artistNodes))
+            return res;
+
+        // No link types means any link type, as done by the other engines
+        const auto matchesLinkTypes{ [&](TrackArtistLinkType linkType) { return linkTypes.empty() || linkTypes.contains(linkType); } };
+
+        std::vector<NodeIndex> indexes;
+        for (const ArtistNode& artistNode : itNodes->second)
+        {
+            if (matchesLinkTypes(artistNode.linkType))
+                indexes.push_back(artistNode.index);
+        }
+
+        if (indexes.empty())
+            return res;
+
+        std::unordered_set<ArtistId> reportedArtistIds{ artistId };
+        visitClosestNodes(computeCentroid(indexes), [&](NodeIndex index)
+        {
+            for (const ArtistLink& artistLink : _nodeArtistLinks[index])
+            {
+                if (res.size() == maxCount)
+                    break;
+
+                if (matchesLinkTypes(artistLink.linkType) && reportedArtistIds.insert(artistLink.artistId).second)
+                    res.push_back(artistLink.artistId);
+            }
+
+            return res.size() < maxCount;
+        });
+
+        Session& session{ _db.getTLSSession() };
+        {
+            // Report only existing ids
+            auto transaction{ session.createReadTransaction() };
+
+            res.erase(std::remove_if(std::begin(res), std::end(res),
+                [&](ArtistId similarArtistId)
+                {
+                    return !Artist::exists(session, similarArtistId);
+                }), std::end(res));
+        }
+
+        return res;
+    }
+
+    void HnswEngine::build(const ProgressCallback& progressCallback)
+    {
+        LMS_LOG(RECOMMENDATION, INFO, "Building nearest neighbours index...");
+
+        const FeatureNames featureNames{ getTrainFeatureNames() };
+        const std::size_t nbDimensions{ getDimCount(featureNames) };
+
+        std::size_t threadCount{ Service<IConfig>::get()->getULong("features-train-thread-count", 0) };
+        if (threadCount == 0)
+            threadCount = std::max<std::size_t>(1, std::thread::hardware_concurrency());
+
+        std::vector<SOM::InputVector> samples;
+        std::vector<TrackId> samplesTrackIds;
+        extractFeatures(_db, featureNames, nbDimensions, threadCount, [this] { return _loadCancelled.load(); }, samples, samplesTrackIds);
+        if (_loadCancelled)
+            return;
+
+        if (samples.empty())
+        {
+            LMS_LOG(RECOMMENDATION, INFO, "Nothing to index!");
+            return;
+        }
+
+        SOM::DataNormalizer dataNormalizer{ nbDimensions };
+        dataNormalizer.computeNormalizationFactors(samples);
+        setDataNormalizer(dataNormalizer);
+
+        LMS_LOG(RECOMMENDATION, DEBUG, "Inserting " << samples.size() << " tracks...");
+
+        HnswIndex index{ nbDimensions, indexSettings };
+        for (std::size_t i{}; i < samples.size(); ++i)
+        {
+            if (_loadCancelled)
+            {
+                // normalization factors no longer match the previous index
+                _index.reset();
+                return;
+            }
+
+            index.insert(toIndexVector(samples[i]).data());
+
+            if (progressCallback && (i + 1) % 1000 == 0)
+                progressCallback(Progress{ samples.size(), i + 1 });
+        }
+
+        LMS_LOG(RECOMMENDATION, DEBUG, "Inserting tracks DONE");
+
+        _index.emplace(std::move(index));
+        _nodeTrackIds = std::move(samplesTrackIds);
+        loadObjectMaps();
+
+        LMS_LOG(RECOMMENDATION, INFO, "Nearest neighbours index successfully built!");
+    }
+
+    std::size_t HnswEngine::insertNewTracks()
+    {
+        Session& session{ _db.getTLSSession() };
+
+        RangeResults<TrackId> trackIds;
+        {
+            auto transaction{ session.createReadTransaction() };
+            trackIds = TrackFeatures::findTrackIds(session);
+        }
+
+        const FeatureNames featureNames{ getTrainFeatureNames() };
+        const std::size_t nbDimensions{ _index->getDimCount() };
+
+        std::size_t insertedTrackCount{};
+        for (const TrackId trackId : trackIds.results)
+        {
+            if (_loadCancelled)
+                break;
+
+            if (_trackNodes.find(trackId) != std::cend(_trackNodes))
+                continue;
+
+            auto transaction{ session.createReadTransaction() };
+
+            const TrackFeatures::pointer trackFeatures{ TrackFeatures::find(session, trackId) };
+            if (!trackFeatures)
+                continue;
+
+            const FeatureValuesMap featureValuesMap{ trackFeatures->getFeatureValuesMap(featureNames) };
+            if (featureValuesMap.empty())
+                continue;
+
+            SOM::InputVector inputVector{ nbDimensions };
+            if (!convertFeatureValuesMapToInputVector(featureValuesMap, inputVector))
+                continue;
+
+            // normalization factors are not updated, new tracks are placed relatively to the indexed ones
+            const NodeIndex index{ _index->insert(toIndexVector(inputVector).data()) };
+            _nodeTrackIds.push_back(trackId);
+            addNode(session, index);
+
+            insertedTrackCount++;
+        }
+
+        return insertedTrackCount;
+    }
+
+    std::size_t HnswEngine::loadObjectMaps()
+    {
+        _trackNodes.clear();
+        _nodeReleaseIds.assign(_nodeTrackIds.size(), ReleaseId{});
+        _releaseNodes.clear();
+        _nodeArtistLinks.assign(_nodeTrackIds.size(), {});
+        _artistNodes.clear();
+
+        Session& session{ _db.getTLSSession() };
+
+        std::size_t removedNodeCount{};
+        for (std::size_t first{}; first < _nodeTrackIds.size(); first += transactionTrackCount)
+        {
+            if (_loadCancelled)
+                break;
+
+            auto transaction{ session.createReadTransaction() };
+
+            const std::size_t last{ std::min(first + transactionTrackCount, _nodeTrackIds.size()) };
+            for (std::size_t index{ first }; index < last; ++index)
+            {
+                addNode(session, static_cast<NodeIndex>(index));
+                if (!_nodeTrackIds[index].isValid())
+                    removedNodeCount++;
+            }
+        }
+
+        return removedNodeCount;
+    }
+
+    void HnswEngine::addNode(Session& session, NodeIndex index)
+    {
+        if (_nodeReleaseIds.size() <= index)
+        {
+            _nodeReleaseIds.resize(index + 1);
+            _nodeArtistLinks.resize(index + 1);
+        }
+
+        TrackId& trackId{ _nodeTrackIds[index] };
+        if (!trackId.isValid())
+            return;
+
+        const Track::pointer track{ Track::find(session, trackId) };
+        if (!track || !_trackNodes.emplace(trackId, index).second)
+        {
+            // removed, or duplicate
+            trackId = TrackId{};
+            return;
+        }
+
+        if (const Release::pointer release{ track->getRelease() })
+        {
+            _nodeReleaseIds[index] = release->getId();
+            _releaseNodes[release->getId()].push_back(index);
+        }
+
+        for (const TrackArtistLink::pointer& artistLink : track->getArtistLinks())
+        {
+            const ArtistId artistId{ artistLink->getArtist()->getId() };
+
+            _nodeArtistLinks[index].push_back(ArtistLink{ artistId, artistLink->getType() });
+            _artistNodes[artistId].push_back(ArtistNode{ index, artistLink->getType() });
+        }
+    }
+
+    bool HnswEngine::readCache()
+    {
+        const std::filesystem::path path{ getCacheFilePath() };
+        if (!std::filesystem::exists(path))
+            return false;
+
+        LMS_LOG(RECOMMENDATION, INFO, "Reading nearest neighbours index from cache...");
+
+        const MappedFile file{ path };
+        if (!file.getData() || file.getSize() < sizeof(CacheHeader))
+        {
+            LMS_LOG(RECOMMENDATION, ERROR, "Cannot read nearest neighbours cache: file too small");
+            return false;
+        }
+
+        const std::byte* data{ file.getData() };
+        const std::byte* dataEnd{ data + file.getSize() };
+
+        CacheHeader header{ readValue<CacheHeader>(data) };
+        const FeatureNames featureNames{ getTrainFeatureNames() };
+        if (header.magic != cacheMagic || header.version != cacheVersion || header.byteOrderMark != cacheByteOrderMark || header.dimCount != getDimCount(featureNames))
+        {
+            LMS_LOG(RECOMMENDATION, INFO, "Nearest neighbours cache is outdated");
+            return false;
+        }
+
+        {
+            const std::uint64_t expectedChecksum{ header.checksum };
+            header.checksum = 0;
+
+            Checksum checksum;
+            checksum.update(data, dataEnd - data);
+            checksum.update(&header, sizeof(header));
+            if (checksum.getValue() != expectedChecksum)
+            {
+                LMS_LOG(RECOMMENDATION, ERROR, "Cannot read nearest neighbours cache: bad checksum");
+                return false;
+            }
+        }
+
+        const std::size_t fixedSize{ header.dimCount * 2 * sizeof(double) + header.nodeCount * sizeof(std::int64_t) };
+        if (static_cast<std::size_t>(dataEnd - data) < fixedSize)
+        {
+            LMS_LOG(RECOMMENDATION, ERROR, "Cannot read nearest neighbours cache: file too small");
+            return false;
+        }
+
+        SOM::DataNormalizer dataNormalizer{ header.dimCount };
+        for (std::size_t i{}; i < header.dimCount; ++i)
+        {
+            const double min{ readValue<double>(data) };
+            const double max{ readValue<double>(data) };
+            dataNormalizer.setValue(i, { min, max });
+        }
+
+        std::vector<TrackId> nodeTrackIds(header.nodeCount);
+        for (TrackId& trackId : nodeTrackIds)
+        {
+            const std::int64_t value{ readValue<std::int64_t>(data) };
+            if (value >= 0)
+                trackId = TrackId{ value };
+        }
+
+        std::optional<HnswIndex> index{ HnswIndex::read(data, dataEnd) };
+        if (!index || index->getDimCount() != header.dimCount || index->getNodeCount() != header.nodeCount)
+        {
+            LMS_LOG(RECOMMENDATION, ERROR, "Cannot read nearest neighbours cache: bad index");
+            return false;
+        }
+
+        setDataNormalizer(dataNormalizer);
+        _index = std::move(index);
+        _nodeTrackIds = std::move(nodeTrackIds);
+
+        LMS_LOG(RECOMMENDATION, INFO, "Successfully read nearest neighbours cache");
+        return true;
+    }
+
+    void HnswEngine::writeCache() const
+    {
+        const std::filesystem::path path{ getCacheFilePath() };
+        std::filesystem::create_directories(path.parent_path());
+
+        // write in a temporary file first, so that an interrupted write does not leave a truncated cache
+        std::filesystem::path tmpPath{ path };
+        tmpPath += ".tmp";
+
+        {
+            std::ofstream ofs{ tmpPath, std::ios_base::binary | std::ios_base::trunc };
+            if (!ofs)
+            {
+                LMS_LOG(RECOMMENDATION, ERROR, "Cannot create nearest neighbours cache file '" << tmpPath.string() << "'");
+                return;
+            }
+
+            CacheHeader header{};
+            header.magic = cacheMagic;
+            header.version = cacheVersion;
+            header.byteOrderMark = cacheByteOrderMark;
+            header.dimCount = _index->getDimCount();
+            header.nodeCount = _nodeTrackIds.size();
+
+            // the header is written again once the checksum is known
+            ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+            Checksum checksum;
+            for (std::size_t i{}; i < _dataNormalizer->getInputDimCount(); ++i)
+            {
+                writeValue<double>(ofs, checksum, _dataNormalizer->getValue(i).min);
+                writeValue<double>(ofs, checksum, _dataNormalizer->getValue(i).max);
+            }
+
+            for (const TrackId trackId : _nodeTrackIds)
+                writeValue<std::int64_t>(ofs, checksum, trackId.isValid() ? trackId.getValue() : -1);
+
+            _index->write(ofs, checksum);
+
+            checksum.update(&header, sizeof(header));
+            header.checksum = checksum.getValue();
+            ofs.seekp(0);
+            ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+            if (!ofs)
+            {
+                LMS_LOG(RECOMMENDATION, ERROR, "Cannot write nearest neighbours cache file '" << tmpPath.string() << "'");
+                return;
+            }
+        }
+
+        std::error_code ec;
+        std::filesystem::rename(tmpPath, path, ec);
+        if (ec)
+        {
+            LMS_LOG(RECOMMENDATION, ERROR, "Cannot rename nearest neighbours cache file: " << ec.message());
+            return;
+        }
+
+        LMS_LOG(RECOMMENDATION, DEBUG, "Created nearest neighbours cache");
+    }
+
+    void HnswEngine::setDataNormalizer(const SOM::DataNormalizer& dataNormalizer)
+    {
+        _dataNormalizer.reset();
+        _dataNormalizer.emplace(dataNormalizer);
+
+        const SOM::InputVector weights{ getInputVectorWeights(FeaturesEngine::getDefaultTrainFeatureSettings(), dataNormalizer.getInputDimCount()) };
+        _dimFactors.resize(weights.getNbDimensions());
+        for (std::size_t i{}; i < weights.getNbDimensions(); ++i)
+            _dimFactors[i] = static_cast<float>(std::sqrt(weights[i]));
+    }
+
+    std::vector<float> HnswEngine::toIndexVector(SOM::InputVector& inputVector) const
+    {
+        _dataNormalizer->normalizeData(inputVector);
+
+        std::vector<float> res(_dimFactors.size());
+        for (std::size_t i{}; i < res.size(); ++i)
+            res[i] = static_cast<float>(inputVector[i]) * _dimFactors[i];
+
+        return res;
+    }
+
+    std::vector<float> HnswEngine::computeCentroid(const std::vector<NodeIndex>& indexes) const
+    {
+        std::vector<float> res(_index->getDimCount());
+        for (const NodeIndex index : indexes)
+        {
+            const float* vector{ _index->getVector(index) };
+            for (std::size_t i{}; i < res.size(); ++i)
+                res[i] += vector[i];
+        }
+
+        for (float& value : res)
+            value /= indexes.size();
+
+        return res;
+    }
+
+    void HnswEngine::visitClosestNodes(const std::vector<float>& query, const std::function<bool(NodeIndex)>& visitor) const
+    {
+        // Search again with a larger k if the visitor wants more nodes (a release or an artist covers several nodes)
+        std::unordered_set<NodeIndex> visitedIndexes;
+        for (std::size_t k{ searchEf }; ; k *= 4)
+        {
+            for (const HnswIndex::Match& match : _index->search(query.data(), k, std::max(k, searchEf)))
+            {
+                if (!visitedIndexes.insert(match.index).second)
+                    continue;
+
+                if (!visitor(match.index))
+                    return;
+            }
+
+            if (k >= _index->getNodeCount() || k >= maxVisitedNodeCount)
+                return;
+        }
+    }
+} // namespace Recommendation
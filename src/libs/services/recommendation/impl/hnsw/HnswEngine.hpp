@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2023 Emeric Poupon
+ *
+ * This file is part of LMS.
+ *
+ * LMS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LMS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <filesystem>
+#include <functional>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "database/ArtistId.hpp"
+#include "database/ReleaseId.hpp"
+#include "database/TrackId.hpp"
+#include "database/Types.hpp"
+#include "som/DataNormalizer.hpp"
+#include "IEngine.hpp"
+#include "HnswIndex.hpp"
+
+namespace Database
+{
+	class Session;
+}
+
+namespace Recommendation
+{
+	// Ranks tracks using a k nearest neighbours search over their normalized and weighted features
+	class HnswEngine : public IEngine
+	{
+		public:
+			HnswEngine(Database::Db& db) : _db {db} {}
+
+			HnswEngine(const HnswEngine&) = delete;
+			HnswEngine(HnswEngine&&) = delete;
+			HnswEngine& operator=(const HnswEngine&) = delete;
+			HnswEngine& operator=(HnswEngine&&) = delete;
+
+		private:
+			void load(bool forceReload, const ProgressCallback& progressCallback) override;
+			void requestCancelLoad() override;
+
+			TrackContainer findSimilarTracksFromTrackList(Database::TrackListId tracklistId, std::size_t maxCount) const override;
+			TrackContainer findSimilarTracks(const std::vector<Database::TrackId>& tracksId, std::size_t maxCount) const override;
+			ReleaseContainer getSimilarReleases(Database::ReleaseId releaseId, std::size_t maxCount) const override;
+			ArtistContainer getSimilarArtists(Database::ArtistId artistId, EnumSet<Database::TrackArtistLinkType> linkTypes, std::size_t maxCount) const override;
+
+			using NodeIndex = HnswIndex::NodeIndex;
+
+			void build(const ProgressCallback& progressCallback);
+			std::size_t insertNewTracks();
+			std::size_t loadObjectMaps();	// returns the number of nodes whose track no longer exists
+			void addNode(Database::Session& session, NodeIndex index);
+
+			bool readCache();
+			void writeCache() const;
+
+			void setDataNormalizer(const SOM::DataNormalizer& dataNormalizer);
+			std::vector<float> toIndexVector(SOM::InputVector& inputVector) const;	// normalizes and weights
+			std::vector<float> computeCentroid(const std::vector<NodeIndex>& indexes) const;
+			// Visits nodes by increasing distance to query, until visitor returns false or enough nodes have been visited
+			void visitClosestNodes(const std::vector<float>& query, const std::function<bool(NodeIndex)>& visitor) const;
+
+			struct ArtistLink
+			{
+				Database::ArtistId artistId;
+				Database::TrackArtistLinkType linkType;
+			};
+
+			struct ArtistNode
+			{
+				NodeIndex index;
+				Database::TrackArtistLinkType linkType;
+			};
+
+			Database::Db&			_db;
+			std::atomic<bool>		_loadCancelled {};
+			std::optional<HnswIndex>	_index;
+			std::optional<SOM::DataNormalizer>	_dataNormalizer;
+			std::vector<float>		_dimFactors;	// sqrt of the feature weights, so that the euclidean distance is the weighted one
+
+			std::vector<Database::TrackId>	_nodeTrackIds;	// invalid if the track no longer exists
+			std::unordered_map<Database::TrackId, NodeIndex>	_trackNodes;
+			std::vector<Database::ReleaseId>	_nodeReleaseIds;
+			std::unordered_map<Database::ReleaseId, std::vector<NodeIndex>>	_releaseNodes;
+			std::vector<std::vector<ArtistLink>>	_nodeArtistLinks;
+			std::unordered_map<Database::ArtistId, std::vector<ArtistNode>>	_artistNodes;
+	};
+} // namespace Recommendation
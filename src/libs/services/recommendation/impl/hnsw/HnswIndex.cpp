@@ -0,0 +1,429 @@
+/*
+ * Copyright (C) 2023 Emeric Poupon
+ *
+ * This file is part of LMS.
+ *
+ * LMS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LMS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "HnswIndex.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <queue>
+
+namespace Recommendation
+{
+    using namespace BinaryFile;
+
+    namespace
+    {
+        // Marks the nodes visited by a search, reused by each thread
+        class VisitedNodes
+        {
+        public:
+            void reset(std::size_t nodeCount)
+            {
+                if (_marks.size() < nodeCount)
+                    _marks.resize(nodeCount);
+
+                if (++_currentMark == 0)
+                {
+                    std::fill(std::begin(_marks), std::end(_marks), 0);
+                    _currentMark = 1;
+                }
+            }
+
+            // Returns false if the node has already been visited
+            bool visit(HnswIndex::NodeIndex index)
+            {
+                if (_marks[index] == _currentMark)
+                    return false;
+
+                _marks[index] = _currentMark;
+                return true;
+            }
+
+        private:
+            std::vector<std::uint16_t> _marks;
+            std::uint16_t _currentMark{};
+        };
+
+        VisitedNodes& getVisitedNodes()
+        {
+            thread_local VisitedNodes visitedNodes;
+            return visitedNodes;
+        }
+
+        struct CloserFirst
+        {
+            bool operator()(const HnswIndex::Match& a, const HnswIndex::Match& b) const { return a.distance > b.distance; }
+        };
+
+        struct FurtherFirst
+        {
+            bool operator()(const HnswIndex::Match& a, const HnswIndex::Match& b) const { return a.distance < b.distance; }
+        };
+
+        constexpr std::uint32_t defaultSeed{ 42 };
+        constexpr std::uint32_t maxAllowedLevel{ 16 };
+    }
+
+    HnswIndex::HnswIndex(std::size_t dimCount, const Settings& settings)
+        : _dimCount{ dimCount }
+        , _settings{ settings }
+        , _levelFactor{ 1. / std::log(static_cast<double>(std::max<std::size_t>(2, settings.maxNeighbourCount))) }
+        , _randGenerator{ defaultSeed }
+    {
+    }
+
+    HnswIndex::NodeIndex HnswIndex::insert(const float* data)
+    {
+        const NodeIndex index{ static_cast<NodeIndex>(getNodeCount()) };
+        const Level level{ drawLevel() };
+
+        _vectors.insert(std::end(_vectors), data, data + _dimCount);
+        _levels.push_back(level);
+        _layer0Links.resize(_layer0Links.size() + getMaxNeighbourCount(0) + 1);
+        _upperLinks.emplace_back(static_cast<std::size_t>(level) * (getMaxNeighbourCount(1) + 1));
+
+        if (index == 0)
+        {
+            _entryPoint = index;
+            _maxLevel = level;
+            return index;
+        }
+
+        NodeIndex entryPoint{ _entryPoint };
+        for (Level currentLevel{ _maxLevel }; currentLevel > level; --currentLevel)
+            entryPoint = searchClosest(data, entryPoint, currentLevel);
+
+        for (Level currentLevel{ std::min(level, _maxLevel) }; ; --currentLevel)
+        {
+            std::vector<Match> candidates{ searchLayer(data, entryPoint, _settings.efConstruction, currentLevel) };
+            entryPoint = candidates.front().index;
+
+            const std::vector<Match> neighbours{ selectNeighbours(std::move(candidates), _settings.maxNeighbourCount) };
+
+            NodeIndex* links{ getLinks(index, currentLevel) };
+            links[0] = static_cast<NodeIndex>(neighbours.size());
+            for (std::size_t i{}; i < neighbours.size(); ++i)
+            {
+                links[i + 1] = neighbours[i].index;
+                connect(index, neighbours[i].index, currentLevel);
+            }
+
+            if (currentLevel == 0)
+                break;
+        }
+
+        if (level > _maxLevel)
+        {
+            _maxLevel = level;
+            _entryPoint = index;
+        }
+
+        return index;
+    }
+
+    std::vector<HnswIndex::Match> HnswIndex::search(const float* query, std::size_t k, std::size_t ef) const
+    {
+        if (getNodeCount() == 0 || k == 0)
+            return {};
+
+        NodeIndex entryPoint{ _entryPoint };
+        for (Level currentLevel{ _maxLevel }; currentLevel > 0; --currentLevel)
+            entryPoint = searchClosest(query, entryPoint, currentLevel);
+
+        std::vector<Match> res{ searchLayer(query, entryPoint, std::max(ef, k), 0) };
+        if (res.size() > k)
+            res.resize(k);
+
+        return res;
+    }
+
+    void HnswIndex::write(std::ofstream& ofs, Checksum& checksum) const
+    {
+        writeValue<std::uint64_t>(ofs, checksum, _dimCount);
+        writeValue<std::uint64_t>(ofs, checksum, _settings.maxNeighbourCount);
+        writeValue<std::uint64_t>(ofs, checksum, _settings.efConstruction);
+        writeValue<std::uint64_t>(ofs, checksum, getNodeCount());
+        writeValue<std::uint64_t>(ofs, checksum, _entryPoint);
+        writeValue<std::uint64_t>(ofs, checksum, _maxLevel);
+
+        writeValues(ofs, checksum, _vectors.data(), _vectors.size());
+        writeValues(ofs, checksum, _levels.data(), _levels.size());
+        writeValues(ofs, checksum, _layer0Links.data(), _layer0Links.size());
+        for (const std::vector<NodeIndex>& links : _upperLinks)
+            writeValues(ofs, checksum, links.data(), links.size());
+    }
+
+    std::optional<HnswIndex> HnswIndex::read(const std::byte*& data, const std::byte* dataEnd)
+    {
+        auto remainingSize{ [&] { return static_cast<std::size_t>(dataEnd - data); } };
+
+        if (remainingSize() < 6 * sizeof(std::uint64_t))
+            return std::nullopt;
+
+        const std::uint64_t dimCount{ readValue<std::uint64_t>(data) };
+        const std::uint64_t maxNeighbourCount{ readValue<std::uint64_t>(data) };
+        const std::uint64_t efConstruction{ readValue<std::uint64_t>(data) };
+        const std::uint64_t nodeCount{ readValue<std::uint64_t>(data) };
+        const std::uint64_t entryPoint{ readValue<std::uint64_t>(data) };
+        const std::uint64_t maxLevelValue{ readValue<std::uint64_t>(data) };
+
+        if (dimCount == 0 || maxNeighbourCount < 2 || maxNeighbourCount > 1024
+            || nodeCount > std::numeric_limits<NodeIndex>::max()
+            || (nodeCount > 0 && entryPoint >= nodeCount)
+            || maxLevelValue > maxAllowedLevel)
+        {
+            return std::nullopt;
+        }
+
+        HnswIndex res{ dimCount, Settings{ maxNeighbourCount, efConstruction } };
+
+        const std::size_t layer0SlotCount{ res.getMaxNeighbourCount(0) + 1 };
+        const std::size_t upperSlotCount{ res.getMaxNeighbourCount(1) + 1 };
+
+        if (remainingSize() / sizeof(float) / dimCount < nodeCount)
+            return std::nullopt;
+        res._vectors.resize(nodeCount * dimCount);
+        readValues(data, res._vectors.data(), res._vectors.size());
+
+        if (remainingSize() / sizeof(Level) < nodeCount)
+            return std::nullopt;
+        res._levels.resize(nodeCount);
+        readValues(data, res._levels.data(), res._levels.size());
+
+        if (remainingSize() / sizeof(NodeIndex) / layer0SlotCount < nodeCount)
+            return std::nullopt;
+        res._layer0Links.resize(nodeCount * layer0SlotCount);
+        readValues(data, res._layer0Links.data(), res._layer0Links.size());
+
+        res._upperLinks.resize(nodeCount);
+        for (std::size_t index{}; index < nodeCount; ++index)
+        {
+            const Level level{ res._levels[index] };
+            if (level > maxLevelValue)
+                return std::nullopt;
+
+            std::vector<NodeIndex>& links{ res._upperLinks[index] };
+            const std::size_t slotCount{ level * upperSlotCount };
+            if (remainingSize() / sizeof(NodeIndex) < slotCount)
+                return std::nullopt;
+
+            links.resize(slotCount);
+            readValues(data, links.data(), links.size());
+        }
+
+        // Make sure searches will not go out of bounds
+        for (std::size_t index{}; index < nodeCount; ++index)
+        {
+            for (Level level{}; level <= res._levels[index]; ++level)
+            {
+                const NodeIndex* links{ res.getLinks(static_cast<NodeIndex>(index), level) };
+                if (links[0] > res.getMaxNeighbourCount(level))
+                    return std::nullopt;
+
+                for (std::size_t i{}; i < links[0]; ++i)
+                {
+                    if (links[i + 1] >= nodeCount || res._levels[links[i + 1]] < level)
+                        return std::nullopt;
+                }
+            }
+        }
+
+        if (nodeCount > 0 && res._levels[entryPoint] != maxLevelValue)
+            return std::nullopt;
+
+        res._entryPoint = static_cast<NodeIndex>(entryPoint);
+        res._maxLevel = static_cast<Level>(maxLevelValue);
+        res._randGenerator.seed(static_cast<std::uint32_t>(defaultSeed + nodeCount));
+
+        return res;
+    }
+
+    HnswIndex::Distance HnswIndex::computeDistance(const float* a, const float* b) const
+    {
+        // Independent sums let the compiler vectorize the loop
+        Distance sums[4]{};
+
+        std::size_t i{};
+        for (; i + 4 <= _dimCount; i += 4)
+        {
+            for (std::size_t j{}; j < 4; ++j)
+            {
+                const Distance diff{ a[i + j] - b[i + j] };
+                sums[j] += diff * diff;
+            }
+        }
+        for (; i < _dimCount; ++i)
+        {
+            const Distance diff{ a[i] - b[i] };
+            sums[0] += diff * diff;
+        }
+
+        return (sums[0] + sums[1]) + (sums[2] + sums[3]);
+    }
+
+    HnswIndex::NodeIndex* HnswIndex::getLinks(NodeIndex index, Level level)
+    {
+        if (level == 0)
+            return &_layer0Links[static_cast<std::size_t>(index) * (getMaxNeighbourCount(0) + 1)];
+
+        return &_upperLinks[index][(level - 1) * (getMaxNeighbourCount(level) + 1)];
+    }
+
+    const HnswIndex::NodeIndex* HnswIndex::getLinks(NodeIndex index, Level level) const
+    {
+        return const_cast<HnswIndex*>(this)->getLinks(index, level);
+    }
+
+    HnswIndex::Level HnswIndex::drawLevel()
+    {
+        std::uniform_real_distribution<double> distribution{ std::numeric_limits<double>::min(), 1. };
+
+        return std::min(static_cast<Level>(-std::log(distribution(_randGenerator)) * _levelFactor), maxAllowedLevel);
+    }
+
+    HnswIndex::NodeIndex HnswIndex::searchClosest(const float* query, NodeIndex entryPoint, Level level) const
+    {
+        NodeIndex closest{ entryPoint };
+        Distance closestDistance{ computeDistance(query, closest) };
+
+        bool changed{ true };
+        while (changed)
+        {
+            changed = false;
+
+            const NodeIndex* links{ getLinks(closest, level) };
+            for (std::size_t i{}; i < links[0]; ++i)
+            {
+                const Distance distance{ computeDistance(query, links[i + 1]) };
+                if (distance < closestDistance)
+                {
+                    closestDistance = distance;
+                    closest = links[i + 1];
+                    changed = true;
+                }
+            }
+        }
+
+        return closest;
+    }
+
+    std::vector<HnswIndex::Match> HnswIndex::searchLayer(const float* query, NodeIndex entryPoint, std::size_t ef, Level level) const
+    {
+        VisitedNodes& visitedNodes{ getVisitedNodes() };
+        visitedNodes.reset(getNodeCount());
+
+        std::priority_queue<Match, std::vector<Match>, CloserFirst> candidates;
+        std::priority_queue<Match, std::vector<Match>, FurtherFirst> results;
+
+        const Match entry{ entryPoint, computeDistance(query, entryPoint) };
+        visitedNodes.visit(entryPoint);
+        candidates.push(entry);
+        results.push(entry);
+
+        while (!candidates.empty())
+        {
+            const Match candidate{ candidates.top() };
+            if (candidate.distance > results.top().distance && results.size() >= ef)
+                break;
+
+            candidates.pop();
+
+            const NodeIndex* links{ getLinks(candidate.index, level) };
+            for (std::size_t i{}; i < links[0]; ++i)
+            {
+                const NodeIndex neighbour{ links[i + 1] };
+                if (!visitedNodes.visit(neighbour))
+                    continue;
+
+                const Distance distance{ computeDistance(query, neighbour) };
+                if (results.size() < ef || distance < results.top().distance)
+                {
+                    candidates.push(Match{ neighbour, distance });
+                    results.push(Match{ neighbour, distance });
+                    if (results.size() > ef)
+                        results.pop();
+                }
+            }
+        }
+
+        std::vector<Match> res(results.size());
+        for (std::size_t i{ res.size() }; i-- > 0;)
+        {
+            res[i] = results.top();
+            results.pop();
+        }
+
+        return res;
+    }
+
+    std::vector<HnswIndex::Match> HnswIndex::selectNeighbours(std::vector<Match> candidates, std::size_t maxCount) const
+    {
+        if (candidates.size() <= maxCount)
+            return candidates;
+
+        std::sort(std::begin(candidates), std::end(candidates), [](const Match& a, const Match& b) { return a.distance < b.distance; });
+
+        // Keep the candidates that are closer to the base node than to any already selected neighbour, to keep the graph navigable
+        std::vector<Match> res;
+        res.reserve(maxCount);
+        for (const Match& candidate : candidates)
+        {
+            if (res.size() == maxCount)
+                break;
+
+            const bool keep{ std::none_of(std::cbegin(res), std::cend(res), [&](const Match& selected)
+                {
+                    return computeDistance(getVector(candidate.index), selected.index) < candidate.distance;
+                }) };
+
+            if (keep)
+                res.push_back(candidate);
+        }
+
+        return res;
+    }
+
+    void HnswIndex::connect(NodeIndex index, NodeIndex neighbour, Level level)
+    {
+        NodeIndex* links{ getLinks(neighbour, level) };
+        const std::size_t maxCount{ getMaxNeighbourCount(level) };
+
+        if (links[0] < maxCount)
+        {
+            links[links[0] + 1] = index;
+            links[0]++;
+            return;
+        }
+
+        // No room left: select the neighbours again, including the new one
+        const float* neighbourVector{ getVector(neighbour) };
+
+        std::vector<Match> candidates;
+        candidates.reserve(maxCount + 1);
+        candidates.push_back(Match{ index, computeDistance(neighbourVector, index) });
+        for (std::size_t i{}; i < links[0]; ++i)
+            candidates.push_back(Match{ links[i + 1], computeDistance(neighbourVector, links[i + 1]) });
+
+        const std::vector<Match> selected{ selectNeighbours(std::move(candidates), maxCount) };
+        links[0] = static_cast<NodeIndex>(selected.size());
+        for (std::size_t i{}; i < selected.size(); ++i)
+            links[i + 1] = selected[i].index;
+    }
+} // namespace Recommendation
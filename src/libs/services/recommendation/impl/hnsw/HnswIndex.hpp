@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2023 Emeric Poupon
+ *
+ * This file is part of LMS.
+ *
+ * LMS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LMS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <optional>
+#include <random>
+#include <vector>
+
+#include "BinaryFile.hpp"
+
+namespace Recommendation
+{
+	// Hierarchical Navigable Small World graph (Malkov & Yashunin), for approximate k nearest neighbours searches
+	// Distance is the squared euclidean distance between float vectors
+	// Insertions must not be concurrent with searches, searches can be concurrent
+	class HnswIndex
+	{
+		public:
+			using NodeIndex = std::uint32_t;
+			using Distance = float;
+
+			struct Settings
+			{
+				std::size_t maxNeighbourCount {16};	// per node and per layer, doubled on layer 0
+				std::size_t efConstruction {100};	// size of the candidate list when inserting
+			};
+
+			struct Match
+			{
+				NodeIndex index;
+				Distance distance;
+			};
+
+			HnswIndex(std::size_t dimCount, const Settings& settings);
+
+			std::size_t getDimCount() const { return _dimCount; }
+			std::size_t getNodeCount() const { return _levels.size(); }
+			const float* getVector(NodeIndex index) const { return &_vectors[static_cast<std::size_t>(index) * _dimCount]; }
+
+			// data must contain dimCount values
+			NodeIndex insert(const float* data);
+
+			// Returns at most k matches, sorted by increasing distance
+			// ef is the size of the candidate list (the larger, the more accurate and the slower)
+			std::vector<Match> search(const float* query, std::size_t k, std::size_t ef) const;
+
+			void write(std::ofstream& ofs, BinaryFile::Checksum& checksum) const;
+			// Advances data, returns std::nullopt if the data is inconsistent
+			static std::optional<HnswIndex> read(const std::byte*& data, const std::byte* dataEnd);
+
+		private:
+			using Level = std::uint32_t;
+
+			Distance computeDistance(const float* a, const float* b) const;
+			Distance computeDistance(const float* a, NodeIndex b) const { return computeDistance(a, getVector(b)); }
+
+			std::size_t getMaxNeighbourCount(Level level) const { return level == 0 ? _settings.maxNeighbourCount * 2 : _settings.maxNeighbourCount; }
+			// links[0] is the neighbour count, followed by getMaxNeighbourCount(level) slots
+			NodeIndex* getLinks(NodeIndex index, Level level);
+			const NodeIndex* getLinks(NodeIndex index, Level level) const;
+
+			Level drawLevel();
+			NodeIndex searchClosest(const float* query, NodeIndex entryPoint, Level level) const;
+			std::vector<Match> searchLayer(const float* query, NodeIndex entryPoint, std::size_t ef, Level level) const;
+			std::vector<Match> selectNeighbours(std::vector<Match> candidates, std::size_t maxCount) const;
+			void connect(NodeIndex index, NodeIndex neighbour, Level level);
+
+			std::size_t _dimCount;
+			Settings _settings;
+			double _levelFactor;
+			std::mt19937 _randGenerator;
+
+			std::vector<float> _vectors;					// node vectors, contiguous
+			std::vector<Level> _levels;						// top level of each node
+			std::vector<NodeIndex> _layer0Links;			// fixed size slots for each node
+			std::vector<std::vector<NodeIndex>> _upperLinks;	// fixed size slots for levels 1 to top level of each node
+			NodeIndex _entryPoint {};
+			Level _maxLevel {};
+	};
+} // namespace Recommendation
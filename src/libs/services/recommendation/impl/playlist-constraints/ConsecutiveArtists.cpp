@@ -19,42 +19,45 @@
 
 #include "ConsecutiveArtists.hpp"
 
-#include <algorithm>
-
-#include "database/Db.hpp"
-#include "database/Release.hpp"
-#include "database/Session.hpp"
-#include "database/Track.hpp"
-#include "utils/ILogger.hpp"
+#include <cassert>
 
 namespace Recommendation::PlaylistGeneratorConstraint
 {
 	namespace
 	{
 		std::size_t
-		countCommonArtists(const ArtistContainer& artists1, const ArtistContainer& artists2)
+		countCommonArtists(const TrackTable& trackTable, TrackTable::TrackIndex track1, TrackTable::TrackIndex track2)
 		{
-			ArtistContainer intersection;
-
-			std::set_intersection(std::cbegin(artists1), std::cend(artists1),
-						std::cbegin(artists2), std::cend(artists2),
-						std::back_inserter(intersection));
+			// artists are sorted
+			std::size_t res {};
+
+			const Database::ArtistId* it1 {trackTable.getArtistsBegin(track1)};
+			const Database::ArtistId* it2 {trackTable.getArtistsBegin(track2)};
+			while (it1 != trackTable.getArtistsEnd(track1) && it2 != trackTable.getArtistsEnd(track2))
+			{
+				if (*it1 < *it2)
+					++it1;
+				else if (*it2 < *it1)
+					++it2;
+				else
+				{
+					++res;
+					++it1;
+					++it2;
+				}
+			}
 
-			return intersection.size();
+			return res;
 		}
 	}
 
-	ConsecutiveArtists::ConsecutiveArtists(Database::Db& db)
-		: _db {db}
-	{}
-
 	float
-	ConsecutiveArtists::computeScore(const std::vector<Database::TrackId>& trackIds, std::size_t trackIndex)
+	ConsecutiveArtists::computeScore(const TrackTable& trackTable, const std::vector<TrackTable::TrackIndex>& tracks, std::size_t trackIndex)
 	{
-		assert(!trackIds.empty());
-		assert(trackIndex <= trackIds.size() - 1);
+		assert(!tracks.empty());
+		assert(trackIndex <= tracks.size() - 1);
 
-		const ArtistContainer artists {getArtists(trackIds[trackIndex])};
+		const TrackTable::TrackIndex track {tracks[trackIndex]};
 
 		constexpr std::size_t rangeSize{ 3 }; // check up to rangeSize tracks before/after the target track
 		static_assert(rangeSize > 0);
@@ -63,35 +66,12 @@ namespace Recommendation::PlaylistGeneratorConstraint
 		for (std::size_t i {1}; i < rangeSize; ++i)
 		{
 			if (trackIndex >= i)
-				score += countCommonArtists(artists, getArtists(trackIds[trackIndex - i])) / static_cast<float>(i);
+				score += countCommonArtists(trackTable, track, tracks[trackIndex - i]) / static_cast<float>(i);
 
-			if (trackIndex + i < trackIds.size())
-				score += countCommonArtists(artists, getArtists(trackIds[trackIndex + i])) / static_cast<float>(i);
+			if (trackIndex + i < tracks.size())
+				score += countCommonArtists(trackTable, track, tracks[trackIndex + i]) / static_cast<float>(i);
 		}
 
 		return score;
 	}
-
-	ArtistContainer
-	ConsecutiveArtists::getArtists(Database::TrackId trackId)
-	{
-		using namespace Database;
-
-		ArtistContainer res;
-
-		Session& dbSession {_db.getTLSSession()};
-		auto transaction {dbSession.createReadTransaction()};
-
-		const Track::pointer track {Track::find(dbSession, trackId)};
-		if (!track)
-			return res;
-
-		res = track->getArtistIds({});
-		std::sort(std::begin(res), std::end(res));
-
-		return res;
-	}
-
-
 } // namespace Recommendation
-
@@ -21,25 +21,12 @@
 
 #include "IConstraint.hpp"
 
-#include "database/ReleaseId.hpp"
-
-namespace Database
-{
-	class Db;
-}
-
 namespace Recommendation::PlaylistGeneratorConstraint
 {
 	class ConsecutiveArtists : public IConstraint
 	{
-		public:
-			ConsecutiveArtists(Database::Db& db);
-
 		private:
-			 float computeScore(const TrackContainer& trackIds, std::size_t trackIndex) override;
-			 ArtistContainer getArtists(Database::TrackId trackId);
-
-			 Database::Db& _db;
+			 float computeScore(const TrackTable& trackTable, const std::vector<TrackTable::TrackIndex>& tracks, std::size_t trackIndex) override;
 	};
 } // namespace Recommendation::PlaylistGeneratorConstraint
 
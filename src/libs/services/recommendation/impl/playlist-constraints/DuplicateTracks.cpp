@@ -24,9 +24,10 @@
 namespace Recommendation::PlaylistGeneratorConstraint
 {
 	float
-	DuplicateTracks::computeScore(const std::vector<Database::TrackId>& trackIds, std::size_t trackIndex)
+	DuplicateTracks::computeScore(const TrackTable&, const std::vector<TrackTable::TrackIndex>& tracks, std::size_t trackIndex)
 	{
-		const auto count {std::count(std::cbegin(trackIds), std::cend(trackIds), trackIds[trackIndex])};
+		// same index means same track
+		const auto count {std::count(std::cbegin(tracks), std::cend(tracks), tracks[trackIndex])};
 		return count == 1 ? 0 : 1000;
 	}
 } // namespace Recommendation
@@ -26,7 +26,7 @@ namespace Recommendation::PlaylistGeneratorConstraint
 	class DuplicateTracks : public IConstraint
 	{
 		private:
-			float computeScore(const std::vector<Database::TrackId>& trackIds, std::size_t trackIndex) override;
+			float computeScore(const TrackTable& trackTable, const std::vector<TrackTable::TrackIndex>& tracks, std::size_t trackIndex) override;
 	};
 } // namespace Recommendation::PlaylistGeneratorConstraints
 
@@ -21,7 +21,7 @@
 
 #include <vector>
 
-#include "services/recommendation/Types.hpp"
+#include "TrackTable.hpp"
 
 namespace Recommendation::PlaylistGeneratorConstraint
 {
@@ -34,6 +34,7 @@ namespace Recommendation::PlaylistGeneratorConstraint
 			// 0: best
 			// 1: worst
 			// > 1 : violation
-			virtual float computeScore(const TrackContainer& trackIds, std::size_t trackIndex) = 0;
+			// Must not access the database: everything is prefetched in trackTable
+			virtual float computeScore(const TrackTable& trackTable, const std::vector<TrackTable::TrackIndex>& tracks, std::size_t trackIndex) = 0;
 	};
 } // namespace Recommendation
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2023 Emeric Poupon
+ *
+ * This file is part of LMS.
+ *
+ * LMS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LMS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "TrackTable.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <utility>
+
+#include "database/Db.hpp"
+#include "database/Session.hpp"
+#include "database/Track.hpp"
+
+namespace Recommendation::PlaylistGeneratorConstraint
+{
+	TrackTable::TrackTable(Database::Db& db, const std::vector<Database::TrackId>& trackIds)
+		: _trackIds {trackIds}
+	{
+		using namespace Database;
+
+		std::sort(std::begin(_trackIds), std::end(_trackIds));
+		_trackIds.erase(std::unique(std::begin(_trackIds), std::end(_trackIds)), std::end(_trackIds));
+
+		_releaseIds.resize(_trackIds.size());
+
+		std::vector<std::pair<TrackIndex, ArtistId>> trackArtists;
+		{
+			Session& dbSession {db.getTLSSession()};
+			auto transaction {dbSession.createReadTransaction()};
+
+			Track::findReleaseAndArtistIds(dbSession, _trackIds, [&](TrackId trackId, ReleaseId releaseId, const std::vector<ArtistId>& artistIds)
+			{
+				const TrackIndex index {getIndex(trackId)};
+
+				_releaseIds[index] = releaseId;
+				for (const ArtistId artistId : artistIds)
+					trackArtists.emplace_back(index, artistId);
+			});
+		}
+
+		std::sort(std::begin(trackArtists), std::end(trackArtists));
+
+		_artistOffsets.assign(_trackIds.size() + 1, 0);
+		_artistIds.reserve(trackArtists.size());
+		for (const auto& [index, artistId] : trackArtists)
+		{
+			_artistOffsets[index + 1]++;
+			_artistIds.push_back(artistId);
+		}
+
+		for (std::size_t i {1}; i < _artistOffsets.size(); ++i)
+			_artistOffsets[i] += _artistOffsets[i - 1];
+	}
+
+	TrackTable::TrackIndex
+	TrackTable::getIndex(Database::TrackId trackId) const
+	{
+		const auto it {std::lower_bound(std::cbegin(_trackIds), std::cend(_trackIds), trackId)};
+		assert(it != std::cend(_trackIds) && *it == trackId);
+
+		return static_cast<TrackIndex>(std::distance(std::cbegin(_trackIds), it));
+	}
+} // namespace Recommendation::PlaylistGeneratorConstraint
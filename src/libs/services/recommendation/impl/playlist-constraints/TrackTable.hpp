@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2023 Emeric Poupon
+ *
+ * This file is part of LMS.
+ *
+ * LMS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LMS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "database/ArtistId.hpp"
+#include "database/ReleaseId.hpp"
+#include "database/TrackId.hpp"
+
+namespace Database
+{
+	class Db;
+}
+
+namespace Recommendation::PlaylistGeneratorConstraint
+{
+	// Releases and artists of the tracks involved in a playlist generation, fetched at once
+	// Tracks are referred to by their index in the table
+	class TrackTable
+	{
+		public:
+			using TrackIndex = std::uint32_t;
+
+			// trackIds may contain duplicates. Tracks that do not exist have no release and no artist
+			TrackTable(Database::Db& db, const std::vector<Database::TrackId>& trackIds);
+
+			// trackId must be part of the table
+			TrackIndex getIndex(Database::TrackId trackId) const;
+			Database::TrackId getTrackId(TrackIndex index) const { return _trackIds[index]; }
+
+			Database::ReleaseId getReleaseId(TrackIndex index) const { return _releaseIds[index]; }
+			// sorted
+			const Database::ArtistId* getArtistsBegin(TrackIndex index) const { return _artistIds.data() + _artistOffsets[index]; }
+			const Database::ArtistId* getArtistsEnd(TrackIndex index) const { return _artistIds.data() + _artistOffsets[index + 1]; }
+
+		private:
+			std::vector<Database::TrackId> _trackIds;	// sorted
+			std::vector<Database::ReleaseId> _releaseIds;
+			std::vector<std::size_t> _artistOffsets;
+			std::vector<Database::ArtistId> _artistIds;
+	};
+} // namespace Recommendation::PlaylistGeneratorConstraint
@@ -20,6 +20,7 @@
 #pragma once
 
 #include <memory>
+#include <optional>
 #include <vector>
 #include "utils/EnumSet.hpp"
 #include "database/TrackListId.hpp"
@@ -33,19 +34,43 @@ namespace Database
 
 namespace Recommendation
 {
+	enum class EngineType
+	{
+		Clusters,
+		Features,
+		Hnsw,
+	};
+
+	struct CacheStats
+	{
+		std::size_t hits {};
+		std::size_t misses {};
+		std::size_t entryCount {};
+		std::size_t maxEntryCount {};
+	};
+
 	class IRecommendationService
 	{
 		public:
 			virtual ~IRecommendationService() = default;
 
+			// Loads the engine in the background, the previous engine keeps being used until then
+			// A load in progress is cancelled by a new load request
 			virtual void load() = 0;
+			virtual void waitForLoad() = 0;
 
 			virtual TrackContainer findSimilarTracks(Database::TrackListId tracklistId, std::size_t maxCount) const = 0;
 			virtual TrackContainer findSimilarTracks(const std::vector<Database::TrackId>& tracksId, std::size_t maxCount) const = 0;
 			virtual ReleaseContainer getSimilarReleases(Database::ReleaseId releaseId, std::size_t maxCount) const = 0;
 			virtual ArtistContainer getSimilarArtists(Database::ArtistId artistId, EnumSet<Database::TrackArtistLinkType> linkTypes, std::size_t maxCount) const = 0;
+
+			// Results are cached, the cache is flushed each time the engine is reloaded
+			virtual void flushCache() = 0;
+			virtual CacheStats getCacheStats() const = 0;
 	};
 
-	std::unique_ptr<IRecommendationService> createRecommendationService(Database::Db& db);
+	// If engineType is not set, the engine is selected using the scan settings
+	// Otherwise, the given engine is always used (tools, benchmarks)
+	std::unique_ptr<IRecommendationService> createRecommendationService(Database::Db& db, std::optional<EngineType> engineType = std::nullopt);
 } // ns Recommendation
 
@@ -0,0 +1,311 @@
+/*
+ * Copyright (C) 2023 Emeric Poupon
+ *
+ * This file is part of LMS.
+ *
+ * LMS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LMS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "features/FeaturesEngineCache.hpp"
+#include "utils/IConfig.hpp"
+#include "utils/Service.hpp"
+
+namespace Recommendation
+{
+    class FeaturesEngineCacheTest : public ::testing::Test
+    {
+    protected:
+        using TrackPositions = FeaturesEngineCache::TrackPositions;
+        using TrackIds = FeaturesEngineCache::TrackIds;
+
+        void SetUp() override
+        {
+            _workingDir = std::filesystem::temp_directory_path() / ("lms-test-features-cache-" + std::string{ ::testing::UnitTest::GetInstance()->current_test_info()->name() });
+            std::filesystem::remove_all(_workingDir);
+            std::filesystem::create_directories(_workingDir);
+
+            const std::filesystem::path configPath{ _workingDir / "lms.conf" };
+            {
+                std::ofstream ofs{ configPath };
+                ofs << "working-dir = \"" << _workingDir.string() << "\";" << std::endl;
+            }
+            _config.assign(createConfig(configPath));
+        }
+
+        void TearDown() override
+        {
+            std::filesystem::remove_all(_workingDir);
+        }
+
+        std::filesystem::path getCacheDirectory() const
+        {
+            return _workingDir / "cache" / "features";
+        }
+
+        std::filesystem::path getCacheFilePath() const
+        {
+            return getCacheDirectory() / "features.bin";
+        }
+
+        static SOM::Network createNetwork()
+        {
+            SOM::Network network{ 3, 2, 4 };
+
+            SOM::InputVector weights{ 4 };
+            for (std::size_t i{}; i < 4; ++i)
+                weights[i] = 0.5 + static_cast<double>(i);
+            network.setDataWeights(weights);
+
+            for (SOM::Coordinate y{}; y < 2; ++y)
+            {
+                for (SOM::Coordinate x{}; x < 3; ++x)
+                {
+                    SOM::InputVector refVector{ 4 };
+                    for (std::size_t i{}; i < 4; ++i)
+                        refVector[i] = x * 100 + y * 10 + i + 0.25;
+                    network.setRefVector({ x, y }, refVector);
+                }
+            }
+
+            return network;
+        }
+
+        static FeaturesEngineCache createCache(SOM::Network network, TrackPositions trackPositions, std::optional<SOM::DataNormalizer> dataNormalizer = std::nullopt, const TrackClassificationStats& classificationStats = {}, TrackIds rejectedTrackIds = {})
+        {
+            return FeaturesEngineCache{ std::move(network), std::move(trackPositions), std::move(dataNormalizer), classificationStats, std::move(rejectedTrackIds) };
+        }
+
+        static const SOM::Network& getNetwork(const FeaturesEngineCache& cache) { return cache._network; }
+        static const TrackPositions& getTrackPositions(const FeaturesEngineCache& cache) { return cache._trackPositions; }
+        static const std::optional<SOM::DataNormalizer>& getDataNormalizer(const FeaturesEngineCache& cache) { return cache._dataNormalizer; }
+        static const TrackClassificationStats& getClassificationStats(const FeaturesEngineCache& cache) { return cache._classificationStats; }
+        static const TrackIds& getRejectedTrackIds(const FeaturesEngineCache& cache) { return cache._rejectedTrackIds; }
+
+        static void expectSameNetwork(const SOM::Network& network, const SOM::Network& expected)
+        {
+            ASSERT_EQ(network.getWidth(), expected.getWidth());
+            ASSERT_EQ(network.getHeight(), expected.getHeight());
+            ASSERT_EQ(network.getInputDimCount(), expected.getInputDimCount());
+
+            for (std::size_t i{}; i < expected.getInputDimCount(); ++i)
+                EXPECT_EQ(network.getDataWeights()[i], expected.getDataWeights()[i]);
+
+            for (SOM::Coordinate y{}; y < expected.getHeight(); ++y)
+            {
+                for (SOM::Coordinate x{}; x < expected.getWidth(); ++x)
+                {
+                    for (std::size_t i{}; i < expected.getInputDimCount(); ++i)
+                        EXPECT_EQ(network.getRefVector({ x, y })[i], expected.getRefVector({ x, y })[i]);
+                }
+            }
+        }
+
+        void writeValidCache() const
+        {
+            createCache(createNetwork(), { { Database::TrackId{ 1 }, SOM::Position{ 0, 0 } } }, std::nullopt, {}, { Database::TrackId{ 2 } }).write();
+            ASSERT_TRUE(std::filesystem::exists(getCacheFilePath()));
+        }
+
+        void overwriteCacheFile(std::size_t offset, const void* data, std::size_t size) const
+        {
+            std::fstream fs{ getCacheFilePath(), std::ios_base::in | std::ios_base::out | std::ios_base::binary };
+            ASSERT_TRUE(fs);
+            fs.seekp(offset);
+            fs.write(static_cast<const char*>(data), size);
+            ASSERT_TRUE(fs);
+        }
+
+        std::filesystem::path _workingDir;
+        Service<IConfig> _config;
+    };
+
+    TEST_F(FeaturesEngineCacheTest, readNoCache)
+    {
+        EXPECT_FALSE(FeaturesEngineCache::read());
+    }
+
+    TEST_F(FeaturesEngineCacheTest, writeRead)
+    {
+        const SOM::Network network{ createNetwork() };
+        const TrackPositions trackPositions{
+            { Database::TrackId{ 1 }, SOM::Position{ 0, 0 } },
+            { Database::TrackId{ 2 }, SOM::Position{ 2, 1 } },
+            { Database::TrackId{ 2 }, SOM::Position{ 1, 0 } },
+        };
+
+        SOM::DataNormalizer dataNormalizer{ 4 };
+        for (std::size_t i{}; i < 4; ++i)
+            dataNormalizer.setValue(i, { -1.5 * i, 2.5 * i + 1 });
+
+        TrackClassificationStats classificationStats;
+        classificationStats.trainedTrackCount = 42;
+        classificationStats.trainedTrackDistanceMean = 0.125;
+        classificationStats.addedTrackCount = 3;
+        classificationStats.addedTrackDistanceSum = 1.75;
+
+        const TrackIds rejectedTrackIds{ Database::TrackId{ 5 }, Database::TrackId{ 7 } };
+
+        createCache(network, trackPositions, dataNormalizer, classificationStats, rejectedTrackIds).write();
+
+        const std::optional<FeaturesEngineCache> cache{ FeaturesEngineCache::read() };
+        ASSERT_TRUE(cache);
+
+        expectSameNetwork(getNetwork(*cache), network);
+        EXPECT_EQ(getTrackPositions(*cache), trackPositions);
+
+        ASSERT_TRUE(getDataNormalizer(*cache));
+        ASSERT_EQ(getDataNormalizer(*cache)->getInputDimCount(), 4);
+        for (std::size_t i{}; i < 4; ++i)
+        {
+            EXPECT_EQ(getDataNormalizer(*cache)->getValue(i).min, dataNormalizer.getValue(i).min);
+            EXPECT_EQ(getDataNormalizer(*cache)->getValue(i).max, dataNormalizer.getValue(i).max);
+        }
+
+        EXPECT_EQ(getClassificationStats(*cache).trainedTrackCount, classificationStats.trainedTrackCount);
+        EXPECT_EQ(getClassificationStats(*cache).trainedTrackDistanceMean, classificationStats.trainedTrackDistanceMean);
+        EXPECT_EQ(getClassificationStats(*cache).addedTrackCount, classificationStats.addedTrackCount);
+        EXPECT_EQ(getClassificationStats(*cache).addedTrackDistanceSum, classificationStats.addedTrackDistanceSum);
+
+        EXPECT_EQ(getRejectedTrackIds(*cache), rejectedTrackIds);
+    }
+
+    TEST_F(FeaturesEngineCacheTest, writeReadNoOptionalData)
+    {
+        const SOM::Network network{ createNetwork() };
+        const TrackPositions trackPositions{ { Database::TrackId{ 1 }, SOM::Position{ 1, 1 } } };
+
+        createCache(network, trackPositions).write();
+
+        const std::optional<FeaturesEngineCache> cache{ FeaturesEngineCache::read() };
+        ASSERT_TRUE(cache);
+
+        expectSameNetwork(getNetwork(*cache), network);
+        EXPECT_EQ(getTrackPositions(*cache), trackPositions);
+        EXPECT_FALSE(getDataNormalizer(*cache));
+        EXPECT_EQ(getClassificationStats(*cache).trainedTrackCount, 0);
+        EXPECT_TRUE(getRejectedTrackIds(*cache).empty());
+    }
+
+    TEST_F(FeaturesEngineCacheTest, truncatedFile)
+    {
+        writeValidCache();
+
+        std::filesystem::resize_file(getCacheFilePath(), std::filesystem::file_size(getCacheFilePath()) - 1);
+        EXPECT_FALSE(FeaturesEngineCache::read());
+
+        // smaller than the header
+        std::filesystem::resize_file(getCacheFilePath(), 16);
+        EXPECT_FALSE(FeaturesEngineCache::read());
+    }
+
+    TEST_F(FeaturesEngineCacheTest, badMagic)
+    {
+        writeValidCache();
+
+        const char magic{ 'X' };
+        overwriteCacheFile(0, &magic, sizeof(magic));
+        EXPECT_FALSE(FeaturesEngineCache::read());
+    }
+
+    TEST_F(FeaturesEngineCacheTest, badVersion)
+    {
+        writeValidCache();
+
+        // version follows the 8 byte magic
+        const std::uint32_t version{ 1 };
+        overwriteCacheFile(8, &version, sizeof(version));
+        EXPECT_FALSE(FeaturesEngineCache::read());
+    }
+
+    TEST_F(FeaturesEngineCacheTest, badChecksum)
+    {
+        writeValidCache();
+
+        // first data weight, right after the 80 byte header
+        const double weight{ 1234.5 };
+        overwriteCacheFile(80, &weight, sizeof(weight));
+        EXPECT_FALSE(FeaturesEngineCache::read());
+    }
+
+    TEST_F(FeaturesEngineCacheTest, migrateLegacyCache)
+    {
+        std::filesystem::create_directories(getCacheDirectory());
+        {
+            std::ofstream ofs{ getCacheDirectory() / "network" };
+            ofs << "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+                "<width>2</width><height>1</height><dim_count>2</dim_count>"
+                "<weights><weight>1.5</weight><weight>2</weight></weights>"
+                "<ref_vectors>"
+                "<ref_vector><values><value>0.25</value><value>0.5</value></values><coord_x>0</coord_x><coord_y>0</coord_y></ref_vector>"
+                "<ref_vector><values><value>0.75</value><value>1</value></values><coord_x>1</coord_x><coord_y>0</coord_y></ref_vector>"
+                "</ref_vectors>";
+        }
+        {
+            std::ofstream ofs{ getCacheDirectory() / "track_positions" };
+            ofs << "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+                "<objects>"
+                "<object><id>3</id><position><position><x>1</x><y>0</y></position></position></object>"
+                "<object><id>4</id><position><position><x>0</x><y>0</y></position><position><x>1</x><y>0</y></position></position></object>"
+                "</objects>";
+        }
+
+        SOM::Network expectedNetwork{ 2, 1, 2 };
+        {
+            SOM::InputVector weights{ 2 };
+            weights[0] = 1.5;
+            weights[1] = 2;
+            expectedNetwork.setDataWeights(weights);
+
+            SOM::InputVector refVector{ 2 };
+            refVector[0] = 0.25;
+            refVector[1] = 0.5;
+            expectedNetwork.setRefVector({ 0, 0 }, refVector);
+            refVector[0] = 0.75;
+            refVector[1] = 1;
+            expectedNetwork.setRefVector({ 1, 0 }, refVector);
+        }
+        const TrackPositions expectedTrackPositions{
+            { Database::TrackId{ 3 }, SOM::Position{ 1, 0 } },
+            { Database::TrackId{ 4 }, SOM::Position{ 0, 0 } },
+            { Database::TrackId{ 4 }, SOM::Position{ 1, 0 } },
+        };
+
+        {
+            const std::optional<FeaturesEngineCache> cache{ FeaturesEngineCache::read() };
+            ASSERT_TRUE(cache);
+            expectSameNetwork(getNetwork(*cache), expectedNetwork);
+            EXPECT_EQ(getTrackPositions(*cache), expectedTrackPositions);
+            EXPECT_FALSE(getDataNormalizer(*cache));
+        }
+
+        // legacy files are replaced by the binary cache
+        EXPECT_TRUE(std::filesystem::exists(getCacheFilePath()));
+        EXPECT_FALSE(std::filesystem::exists(getCacheDirectory() / "network"));
+        EXPECT_FALSE(std::filesystem::exists(getCacheDirectory() / "track_positions"));
+
+        {
+            const std::optional<FeaturesEngineCache> cache{ FeaturesEngineCache::read() };
+            ASSERT_TRUE(cache);
+            expectSameNetwork(getNetwork(*cache), expectedNetwork);
+            EXPECT_EQ(getTrackPositions(*cache), expectedTrackPositions);
+        }
+    }
+} // namespace Recommendation
@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2023 Emeric Poupon
+ *
+ * This file is part of LMS.
+ *
+ * LMS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LMS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "hnsw/HnswIndex.hpp"
+
+using namespace Recommendation;
+
+namespace
+{
+    std::vector<float> createRandomVectors(std::size_t count, std::size_t dimCount, std::mt19937& randGenerator)
+    {
+        std::uniform_real_distribution<float> distribution{ 0.f, 1.f };
+
+        std::vector<float> res(count * dimCount);
+        std::generate(std::begin(res), std::end(res), [&] { return distribution(randGenerator); });
+
+        return res;
+    }
+
+    HnswIndex createIndex(const std::vector<float>& vectors, std::size_t dimCount)
+    {
+        HnswIndex index{ dimCount, HnswIndex::Settings{} };
+        for (std::size_t i{}; i < vectors.size() / dimCount; ++i)
+            index.insert(&vectors[i * dimCount]);
+
+        return index;
+    }
+
+    std::vector<HnswIndex::NodeIndex> bruteForceSearch(const std::vector<float>& vectors, std::size_t dimCount, const float* query, std::size_t k)
+    {
+        std::vector<std::pair<float, HnswIndex::NodeIndex>> distances;
+        for (std::size_t i{}; i < vectors.size() / dimCount; ++i)
+        {
+            float distance{};
+            for (std::size_t d{}; d < dimCount; ++d)
+                distance += (vectors[i * dimCount + d] - query[d]) * (vectors[i * dimCount + d] - query[d]);
+
+            distances.emplace_back(distance, static_cast<HnswIndex::NodeIndex>(i));
+        }
+
+        std::partial_sort(std::begin(distances), std::begin(distances) + k, std::end(distances));
+
+        std::vector<HnswIndex::NodeIndex> res;
+        std::transform(std::cbegin(distances), std::cbegin(distances) + k, std::back_inserter(res), [](const auto& entry) { return entry.second; });
+
+        return res;
+    }
+
+    std::vector<std::byte> writeIndex(const HnswIndex& index)
+    {
+        const std::filesystem::path path{ std::filesystem::temp_directory_path() / ("lms-test-hnsw-" + std::to_string(::testing::UnitTest::GetInstance()->random_seed()) + ".bin") };
+
+        {
+            std::ofstream ofs{ path, std::ios_base::binary | std::ios_base::trunc };
+            BinaryFile::Checksum checksum;
+            index.write(ofs, checksum);
+        }
+
+        std::ifstream ifs{ path, std::ios_base::binary };
+        std::vector<std::byte> res;
+        std::transform(std::istreambuf_iterator<char>{ ifs }, std::istreambuf_iterator<char>{}, std::back_inserter(res), [](char c) { return static_cast<std::byte>(c); });
+        std::filesystem::remove(path);
+
+        return res;
+    }
+
+    std::optional<HnswIndex> readIndex(const std::vector<std::byte>& buffer)
+    {
+        const std::byte* data{ buffer.data() };
+        return HnswIndex::read(data, buffer.data() + buffer.size());
+    }
+
+    constexpr std::size_t headerSize{ 6 * sizeof(std::uint64_t) };
+}
+
+TEST(HnswIndex, empty)
+{
+    const HnswIndex index{ 4, HnswIndex::Settings{} };
+
+    const std::vector<float> query(4, 0.f);
+    EXPECT_TRUE(index.search(query.data(), 10, 10).empty());
+}
+
+TEST(HnswIndex, recall)
+{
+    constexpr std::size_t dimCount{ 16 };
+    constexpr std::size_t nodeCount{ 5000 };
+    constexpr std::size_t queryCount{ 100 };
+    constexpr std::size_t k{ 10 };
+
+    std::mt19937 randGenerator{ 42 };
+    const std::vector<float> vectors{ createRandomVectors(nodeCount, dimCount, randGenerator) };
+    const std::vector<float> queries{ createRandomVectors(queryCount, dimCount, randGenerator) };
+
+    const HnswIndex index{ createIndex(vectors, dimCount) };
+    ASSERT_EQ(index.getNodeCount(), nodeCount);
+
+    std::size_t foundCount{};
+    for (std::size_t i{}; i < queryCount; ++i)
+    {
+        const float* query{ &queries[i * dimCount] };
+
+        const std::vector<HnswIndex::Match> matches{ index.search(query, k, 100) };
+        ASSERT_EQ(matches.size(), k);
+        EXPECT_TRUE(std::is_sorted(std::cbegin(matches), std::cend(matches), [](const HnswIndex::Match& lhs, const HnswIndex::Match& rhs) { return lhs.distance < rhs.distance; }));
+
+        const std::vector<HnswIndex::NodeIndex> expected{ bruteForceSearch(vectors, dimCount, query, k) };
+        for (const HnswIndex::Match& match : matches)
+        {
+            if (std::find(std::cbegin(expected), std::cend(expected), match.index) != std::cend(expected))
+                foundCount++;
+        }
+    }
+
+    const double recall{ static_cast<double>(foundCount) / (queryCount * k) };
+    EXPECT_GE(recall, 0.95) << "recall@" << k << " = " << recall;
+}
+
+TEST(HnswIndex, exactMatch)
+{
+    constexpr std::size_t dimCount{ 8 };
+
+    std::mt19937 randGenerator{ 1 };
+    const std::vector<float> vectors{ createRandomVectors(1000, dimCount, randGenerator) };
+    const HnswIndex index{ createIndex(vectors, dimCount) };
+
+    for (HnswIndex::NodeIndex i{}; i < 1000; i += 37)
+    {
+        const std::vector<HnswIndex::Match> matches{ index.search(&vectors[i * dimCount], 1, 50) };
+        ASSERT_EQ(matches.size(), 1);
+        EXPECT_EQ(matches.front().index, i);
+        EXPECT_EQ(matches.front().distance, 0.f);
+    }
+}
+
+TEST(HnswIndex, writeRead)
+{
+    constexpr std::size_t dimCount{ 8 };
+
+    std::mt19937 randGenerator{ 2 };
+    const std::vector<float> vectors{ createRandomVectors(2000, dimCount, randGenerator) };
+    const std::vector<float> queries{ createRandomVectors(20, dimCount, randGenerator) };
+    const HnswIndex index{ createIndex(vectors, dimCount) };
+
+    const std::vector<std::byte> buffer{ writeIndex(index) };
+
+    const std::byte* data{ buffer.data() };
+    const std::optional<HnswIndex> readIndex{ HnswIndex::read(data, buffer.data() + buffer.size()) };
+    ASSERT_TRUE(readIndex);
+    EXPECT_EQ(data, buffer.data() + buffer.size());
+
+    ASSERT_EQ(readIndex->getDimCount(), index.getDimCount());
+    ASSERT_EQ(readIndex->getNodeCount(), index.getNodeCount());
+    for (HnswIndex::NodeIndex i{}; i < index.getNodeCount(); ++i)
+        EXPECT_EQ(std::memcmp(readIndex->getVector(i), index.getVector(i), dimCount * sizeof(float)), 0);
+
+    for (std::size_t i{}; i < 20; ++i)
+    {
+        const std::vector<HnswIndex::Match> matches{ index.search(&queries[i * dimCount], 10, 50) };
+        const std::vector<HnswIndex::Match> readMatches{ readIndex->search(&queries[i * dimCount], 10, 50) };
+
+        ASSERT_EQ(matches.size(), readMatches.size());
+        for (std::size_t j{}; j < matches.size(); ++j)
+        {
+            EXPECT_EQ(matches[j].index, readMatches[j].index);
+            EXPECT_EQ(matches[j].distance, readMatches[j].distance);
+        }
+    }
+
+    // the written index is the same
+    EXPECT_EQ(writeIndex(*readIndex), buffer);
+}
+
+TEST(HnswIndex, readCorrupted)
+{
+    constexpr std::size_t dimCount{ 4 };
+    constexpr std::size_t nodeCount{ 200 };
+
+    std::mt19937 randGenerator{ 3 };
+    const std::vector<float> vectors{ createRandomVectors(nodeCount, dimCount, randGenerator) };
+    const std::vector<std::byte> buffer{ writeIndex(createIndex(vectors, dimCount)) };
+    ASSERT_TRUE(readIndex(buffer));
+
+    // truncated
+    for (std::size_t size : { std::size_t{}, headerSize - 1, headerSize, buffer.size() / 2, buffer.size() - 1 })
+    {
+        const std::vector<std::byte> truncatedBuffer(std::cbegin(buffer), std::cbegin(buffer) + size);
+        EXPECT_FALSE(readIndex(truncatedBuffer)) << "size = " << size;
+    }
+
+    auto corruptValue{ [&](std::size_t offset, auto value)
+    {
+        std::vector<std::byte> corruptedBuffer{ buffer };
+        std::memcpy(&corruptedBuffer[offset], &value, sizeof(value));
+        return corruptedBuffer;
+    } };
+
+    // bad header: no dimension, entry point out of range, huge node count
+    EXPECT_FALSE(readIndex(corruptValue(0, std::uint64_t{ 0 })));
+    EXPECT_FALSE(readIndex(corruptValue(4 * sizeof(std::uint64_t), std::uint64_t{ nodeCount })));
+    EXPECT_FALSE(readIndex(corruptValue(3 * sizeof(std::uint64_t), std::uint64_t{ 1 } << 40)));
+
+    // layer 0 links of the first node: neighbour count too large, then neighbour out of range
+    const std::size_t layer0LinksOffset{ headerSize + nodeCount * dimCount * sizeof(float) + nodeCount * sizeof(std::uint32_t) };
+    EXPECT_FALSE(readIndex(corruptValue(layer0LinksOffset, std::uint32_t{ 1000 })));
+    EXPECT_FALSE(readIndex(corruptValue(layer0LinksOffset + sizeof(std::uint32_t), std::uint32_t{ nodeCount })));
+
+    // node level higher than the max level
+    const std::size_t levelsOffset{ headerSize + nodeCount * dimCount * sizeof(float) };
+    EXPECT_FALSE(readIndex(corruptValue(levelsOffset, std::uint32_t{ 100 })));
+}
@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2023 Emeric Poupon
+ *
+ * This file is part of LMS.
+ *
+ * LMS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LMS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <map>
+#include <random>
+#include <set>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "database/TrackId.hpp"
+#include "features/ObjectPositionIndex.hpp"
+
+using namespace Recommendation;
+using Database::TrackId;
+
+namespace
+{
+    using Index = ObjectPositionIndex<TrackId>;
+
+    template <typename T>
+    std::vector<T> toVector(const Index::Range<T>& range)
+    {
+        return std::vector<T>(std::cbegin(range), std::cend(range));
+    }
+}
+
+TEST(ObjectPositionIndex, empty)
+{
+    {
+        const Index index;
+        EXPECT_TRUE(index.empty());
+        EXPECT_FALSE(index.contains(TrackId{ 1 }));
+        EXPECT_TRUE(index.getPositions(TrackId{ 1 }).empty());
+        EXPECT_TRUE(index.getObjects(SOM::Position{ 0, 0 }).empty());
+    }
+
+    {
+        const Index index{ 2, 2, {} };
+        EXPECT_TRUE(index.empty());
+        EXPECT_EQ(index.getObjectCount(), 0);
+        EXPECT_TRUE(index.getObjects(SOM::Position{ 1, 1 }).empty());
+    }
+}
+
+TEST(ObjectPositionIndex, positions)
+{
+    const Index index{ 3, 2,
+        {
+            { TrackId{ 5 }, SOM::Position{ 2, 1 } },
+            { TrackId{ 1 }, SOM::Position{ 0, 0 } },
+            { TrackId{ 5 }, SOM::Position{ 0, 1 } },
+            { TrackId{ 5 }, SOM::Position{ 2, 1 } }, // duplicate
+            { TrackId{ 3 }, SOM::Position{ 0, 0 } },
+            { TrackId{ 1 }, SOM::Position{ 0, 0 } }, // duplicate
+        } };
+
+    EXPECT_FALSE(index.empty());
+    EXPECT_EQ(index.getObjectCount(), 3);
+
+    EXPECT_TRUE(index.contains(TrackId{ 1 }));
+    EXPECT_TRUE(index.contains(TrackId{ 3 }));
+    EXPECT_TRUE(index.contains(TrackId{ 5 }));
+
+    // unknown ids, including ids before, between and after the known ones
+    for (const TrackId unknownId : { TrackId{ 0 }, TrackId{ 2 }, TrackId{ 4 }, TrackId{ 6 } })
+    {
+        EXPECT_FALSE(index.contains(unknownId));
+        EXPECT_TRUE(index.getPositions(unknownId).empty());
+    }
+
+    EXPECT_EQ(toVector(index.getPositions(TrackId{ 1 })), (std::vector<SOM::Position>{ { 0, 0 } }));
+    EXPECT_EQ(toVector(index.getPositions(TrackId{ 3 })), (std::vector<SOM::Position>{ { 0, 0 } }));
+    // multiple positions, sorted, without duplicates
+    EXPECT_EQ(toVector(index.getPositions(TrackId{ 5 })), (std::vector<SOM::Position>{ { 0, 1 }, { 2, 1 } }));
+
+    std::vector<std::pair<TrackId, SOM::Position>> visited;
+    index.visit([&](TrackId id, const SOM::Position& position) { visited.emplace_back(id, position); });
+    EXPECT_EQ(visited, (std::vector<std::pair<TrackId, SOM::Position>>{ { TrackId{ 1 }, { 0, 0 } }, { TrackId{ 3 }, { 0, 0 } }, { TrackId{ 5 }, { 0, 1 } }, { TrackId{ 5 }, { 2, 1 } } }));
+}
+
+TEST(ObjectPositionIndex, cells)
+{
+    constexpr SOM::Coordinate width{ 7 };
+    constexpr SOM::Coordinate height{ 5 };
+
+    // random objects with random positions, some of them duplicated
+    std::mt19937 randGenerator{ 42 };
+    std::uniform_int_distribution<TrackId::ValueType> idDistribution{ 1, 500 };
+    std::uniform_int_distribution<SOM::Coordinate> xDistribution{ 0, width - 1 };
+    std::uniform_int_distribution<SOM::Coordinate> yDistribution{ 0, height - 1 };
+
+    std::vector<Index::ObjectPosition> objectPositions;
+    for (std::size_t i{}; i < 2000; ++i)
+        objectPositions.emplace_back(TrackId{ idDistribution(randGenerator) }, SOM::Position{ xDistribution(randGenerator), yDistribution(randGenerator) });
+
+    std::map<std::pair<SOM::Coordinate, SOM::Coordinate>, std::set<TrackId>> expectedObjectsByCell;
+    std::map<TrackId, std::set<std::pair<SOM::Coordinate, SOM::Coordinate>>> expectedPositionsById;
+    for (const auto& [id, position] : objectPositions)
+    {
+        expectedObjectsByCell[{ position.x, position.y }].insert(id);
+        expectedPositionsById[id].insert({ position.x, position.y });
+    }
+
+    const Index index{ width, height, objectPositions };
+    EXPECT_EQ(index.getObjectCount(), expectedPositionsById.size());
+
+    // each cell holds exactly its objects, once
+    std::size_t totalObjectCount{};
+    for (SOM::Coordinate x{}; x < width; ++x)
+    {
+        for (SOM::Coordinate y{}; y < height; ++y)
+        {
+            const std::vector<TrackId> objects{ toVector(index.getObjects(SOM::Position{ x, y })) };
+            const std::set<TrackId> uniqueObjects(std::cbegin(objects), std::cend(objects));
+            EXPECT_EQ(uniqueObjects.size(), objects.size());
+
+            const auto itExpected{ expectedObjectsByCell.find({ x, y }) };
+            EXPECT_EQ(uniqueObjects, itExpected != std::cend(expectedObjectsByCell) ? itExpected->second : std::set<TrackId>{});
+
+            totalObjectCount += objects.size();
+        }
+    }
+
+    for (const auto& [id, expectedPositions] : expectedPositionsById)
+    {
+        std::set<std::pair<SOM::Coordinate, SOM::Coordinate>> positions;
+        for (const SOM::Position& position : index.getPositions(id))
+            positions.insert({ position.x, position.y });
+
+        EXPECT_EQ(positions, expectedPositions);
+        EXPECT_EQ(index.getPositions(id).size(), expectedPositions.size());
+    }
+
+    std::size_t expectedTotalObjectCount{};
+    for (const auto& [id, expectedPositions] : expectedPositionsById)
+        expectedTotalObjectCount += expectedPositions.size();
+    EXPECT_EQ(totalObjectCount, expectedTotalObjectCount);
+
+    // the order of the objects in a cell does not depend on the insertion order
+    std::shuffle(std::begin(objectPositions), std::end(objectPositions), randGenerator);
+    const Index shuffledIndex{ width, height, objectPositions };
+    for (SOM::Coordinate x{}; x < width; ++x)
+    {
+        for (SOM::Coordinate y{}; y < height; ++y)
+            EXPECT_EQ(toVector(shuffledIndex.getObjects(SOM::Position{ x, y })), toVector(index.getObjects(SOM::Position{ x, y })));
+    }
+}
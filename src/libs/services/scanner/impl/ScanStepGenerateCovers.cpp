@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2023 Emeric Poupon
+ *
+ * This file is part of LMS.
+ *
+ * LMS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LMS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ScanStepGenerateCovers.hpp"
+
+#include <algorithm>
+#include <future>
+#include <boost/asio/post.hpp>
+
+#if defined(__linux__)
+#include <sys/resource.h>
+#endif
+
+#include "database/Artist.hpp"
+#include "database/Db.hpp"
+#include "database/Release.hpp"
+#include "database/Session.hpp"
+#include "services/cover/ICoverService.hpp"
+#include "utils/Exception.hpp"
+#include "utils/IConfig.hpp"
+#include "utils/ILogger.hpp"
+#include "utils/Service.hpp"
+#include "utils/String.hpp"
+
+namespace Scanner
+{
+    namespace
+    {
+        std::vector<Image::ImageSize> constructSizes()
+        {
+            std::vector<Image::ImageSize> res;
+
+            Service<IConfig>::get()->visitStrings("cover-pregenerate-sizes",
+                [&res](std::string_view size)
+                {
+                    if (const std::optional<Image::ImageSize> value{ StringUtils::readAs<Image::ImageSize>(size) }; value && *value > 0)
+                        res.push_back(*value);
+                    else
+                        LMS_LOG(DBUPDATER, ERROR, "Invalid cover pregenerate size '" << size << "'");
+                }, { "128", "512" });
+
+            return res;
+        }
+
+        void lowerCurrentThreadPriority()
+        {
+#if defined(__linux__)
+            // On Linux, this only applies to the calling thread
+            static thread_local const bool done{ [] { return ::setpriority(PRIO_PROCESS, 0, 19) == 0; }() };
+            (void)done;
+#endif
+        }
+
+        // Keep the number of queued jobs bounded, and make it possible to report progress and to abort between batches
+        constexpr std::size_t batchSize{ 20 };
+    }
+
+    ScanStepGenerateCovers::ScanStepGenerateCovers(InitParams& initParams, boost::asio::io_context& ioContext, std::size_t threadCount)
+        : ScanStepBase{ initParams }
+        , _sizes{ constructSizes() }
+        , _ioContext{ ioContext }
+        , _threadCount{ threadCount }
+    {
+    }
+
+    void ScanStepGenerateCovers::process(ScanContext& context)
+    {
+        using namespace Database;
+
+        if (context.stats.nbChanges() == 0 || _threadCount == 0 || _sizes.empty())
+            return;
+
+        Cover::ICoverService* coverService{ Service<Cover::ICoverService>::get() };
+        if (!coverService)
+            return;
+
+        // Tracks that have been added or updated during this scan have their added time set after the scan start time
+        std::vector<ReleaseId> releaseIds;
+        std::vector<ArtistId> artistIds;
+        {
+            Session& dbSession{ _db.getTLSSession() };
+            auto transaction{ dbSession.createReadTransaction() };
+
+            releaseIds = std::move(Release::findIds(dbSession, Release::FindParameters{}.setAddedAfter(context.stats.startTime)).results);
+            artistIds = std::move(Artist::findIds(dbSession, Artist::FindParameters{}.setAddedAfter(context.stats.startTime)).results);
+        }
+
+        context.currentStepStats.totalElems = releaseIds.size() + artistIds.size();
+        LMS_LOG(DBUPDATER, DEBUG, "Generating covers for " << releaseIds.size() << " releases and " << artistIds.size() << " artists");
+
+        // Generate all the formats the UI may ask for
+        std::vector<Image::EncodingFormat> formats{ Image::EncodingFormat::JPEG };
+        if (coverService->isEncodingFormatSupported(Image::EncodingFormat::WebP))
+            formats.push_back(Image::EncodingFormat::WebP);
+
+        auto generateCovers{ [&](const auto& ids, auto generateFunc)
+        {
+            for (std::size_t offset{}; offset < ids.size() && !_abortScan; offset += batchSize)
+            {
+                std::vector<std::future<void>> results;
+
+                for (std::size_t i{ offset }; i < std::min(offset + batchSize, ids.size()); ++i)
+                {
+                    auto task{ std::make_shared<std::packaged_task<void()>>([&, id = ids[i]]
+                        {
+                            if (_abortScan)
+                                return;
+
+                            lowerCurrentThreadPriority();
+
+                            for (const Image::ImageSize size : _sizes)
+                            {
+                                for (const Image::EncodingFormat format : formats)
+                                    generateFunc(id, size, format);
+                            }
+                        }) };
+
+                    results.push_back(task->get_future());
+                    boost::asio::post(_ioContext, [task] { (*task)(); });
+                }
+
+                for (std::future<void>& result : results)
+                {
+                    try
+                    {
+                        result.get();
+                    }
+                    catch (const LmsException& e)
+                    {
+                        LMS_LOG(DBUPDATER, ERROR, "Cannot generate cover: " << e.what());
+                    }
+
+                    context.currentStepStats.processedElems++;
+                }
+
+                _progressCallback(context.currentStepStats);
+            }
+        } };
+
+        generateCovers(releaseIds, [&](ReleaseId releaseId, Image::ImageSize size, Image::EncodingFormat format) { coverService->getFromRelease(releaseId, size, format); });
+        generateCovers(artistIds, [&](ArtistId artistId, Image::ImageSize size, Image::EncodingFormat format) { coverService->getFromArtist(artistId, size, format); });
+
+        LMS_LOG(DBUPDATER, DEBUG, "Generated covers for " << context.currentStepStats.processedElems << " releases and artists");
+    }
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2023 Emeric Poupon
+ *
+ * This file is part of LMS.
+ *
+ * LMS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LMS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <vector>
+#include <boost/asio/io_context.hpp>
+
+#include "image/IEncodedImage.hpp"
+#include "ScanStepBase.hpp"
+
+namespace Scanner
+{
+    class ScanStepGenerateCovers : public ScanStepBase
+    {
+    public:
+        // covers are generated using the threads of ioContext
+        ScanStepGenerateCovers(InitParams& initParams, boost::asio::io_context& ioContext, std::size_t threadCount);
+
+    private:
+        ScanStep getStep() const override { return ScanStep::GeneratingCovers; }
+        std::string_view getStepName() const override { return "Generating covers"; }
+        void process(ScanContext& context) override;
+
+        const std::vector<Image::ImageSize> _sizes;
+        boost::asio::io_context& _ioContext;
+        const std::size_t _threadCount;
+    };
+}
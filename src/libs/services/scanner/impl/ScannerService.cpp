@@ -25,10 +25,12 @@
 #include "database/Cluster.hpp"
 #include "database/TrackFeatures.hpp"
 #include "database/ScanSettings.hpp"
+#include "services/recommendation/IRecommendationService.hpp"
 #include "utils/Exception.hpp"
 #include "utils/IConfig.hpp"
 #include "utils/ILogger.hpp"
 #include "utils/Path.hpp"
+#include "utils/Service.hpp"
 #include "utils/Tuple.hpp"
 
 #include "ScanStepCheckDuplicatedDbFiles.hpp"
@@ -36,6 +38,7 @@
 #include "ScanStepRemoveOrphanDbFiles.hpp"
 #include "ScanStepScanFiles.hpp"
 #include "ScanStepComputeClusterStats.hpp"
+#include "ScanStepGenerateCovers.hpp"
 
 namespace Scanner
 {
@@ -72,6 +75,7 @@ namespace Scanner
     ScannerService::ScannerService(Db& db)
         : _db{ db }
         , _dbSession{ db }
+        , _generateCoversThreadCount{ Service<IConfig>::get()->getULong("cover-pregenerate-thread-count", 1) }
     {
         _ioService.setThreadCount(1);
 
@@ -290,6 +294,10 @@ namespace Scanner
                 _currentScanStepStats.reset();
             }
 
+            // Precomputed similarities depend on the scanned data
+            if (stats.nbChanges() > 0)
+                reloadRecommendationService();
+
             LMS_LOG(DBUPDATER, DEBUG, "Scan not aborted, scheduling next scan!");
             scheduleNextScan();
 
@@ -306,6 +314,15 @@ namespace Scanner
         }
     }
 
+    void ScannerService::reloadRecommendationService()
+    {
+        if (Recommendation::IRecommendationService* recommendationService{ Service<Recommendation::IRecommendationService>::get() })
+        {
+            LMS_LOG(DBUPDATER, DEBUG, "Reloading recommendation service");
+            recommendationService->load();
+        }
+    }
+
     void ScannerService::refreshScanSettings()
     {
         ScannerSettings newSettings{ readSettings() };
@@ -337,6 +354,7 @@ namespace Scanner
         _scanSteps.push_back(std::make_unique<ScanStepRemoveOrphanDbFiles>(params));
         _scanSteps.push_back(std::make_unique<ScanStepComputeClusterStats>(params));
         _scanSteps.push_back(std::make_unique<ScanStepCheckDuplicatedDbFiles>(params));
+        _scanSteps.push_back(std::make_unique<ScanStepGenerateCovers>(params, _generateCoversIoContext, _generateCoversThreadCount));
     }
 
     ScannerSettings ScannerService::readSettings()
@@ -28,12 +28,14 @@
 #include <Wt/WIOService.h>
 #include <Wt/WSignal.h>
 
+#include <boost/asio/io_context.hpp>
 #include <boost/asio/system_timer.hpp>
 
 #include "database/Db.hpp"
 #include "database/Session.hpp"
 #include "database/Types.hpp"
 #include "services/scanner/IScannerService.hpp"
+#include "utils/IOContextRunner.hpp"
 #include "utils/Path.hpp"
 #include "IScanStep.hpp"
 #include "ScannerSettings.hpp"
@@ -97,6 +99,11 @@ namespace Scanner
         Wt::WDateTime						_nextScheduledScan;
 
         ScannerSettings						_settings;
+
+        // Long-lived, so that the cover generation threads (and their database sessions) are reused across scans
+        const std::size_t					_generateCoversThreadCount;
+        boost::asio::io_context				_generateCoversIoContext;
+        IOContextRunner						_generateCoversIoContextRunner{ _generateCoversIoContext, _generateCoversThreadCount };
     };
 } // Scanner
 
@@ -66,8 +66,9 @@ namespace Scanner
         FetchingTrackFeatures,
         ReloadingSimilarityEngine,
         ComputeClusterStats,
+        GeneratingCovers,
     };
-    static inline constexpr unsigned ScanProgressStepCount{ 7 };
+    static inline constexpr unsigned ScanProgressStepCount{ 8 };
 
     // reduced scan stats
     struct ScanStepStats
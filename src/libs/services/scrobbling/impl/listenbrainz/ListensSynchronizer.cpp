@@ -19,6 +19,7 @@
 
 #include "ListensSynchronizer.hpp"
 
+#include <algorithm>
 #include <boost/asio/bind_executor.hpp>
 #include <Wt/Json/Array.h>
 #include <Wt/Json/Object.h>
@@ -44,11 +45,10 @@ namespace
 {
     using namespace Scrobbling::ListenBrainz;
 
-    std::optional<Wt::Json::Object> listenToJsonPayload(Database::Session& session, const Scrobbling::Listen& listen, const Wt::WDateTime& timePoint)
+    // need to be called within a transaction
+    std::optional<Wt::Json::Object> createTrackMetadata(Database::Session& session, Database::TrackId trackId)
     {
-        auto transaction{ session.createReadTransaction() };
-
-        const Database::Track::pointer track{ Database::Track::find(session, listen.trackId) };
+        const Database::Track::pointer track{ Database::Track::find(session, trackId) };
         if (!track)
             return std::nullopt;
 
@@ -98,28 +98,16 @@ namespace
         if (track->getRelease())
             trackMetadata["release_name"] = Wt::Json::Value{ track->getRelease()->getName() };
 
-        Wt::Json::Object payload;
-        payload["track_metadata"] = std::move(trackMetadata);
-        if (timePoint.isValid())
-            payload["listened_at"] = Wt::Json::Value{ static_cast<long long int>(timePoint.toTime_t()) };
-
-        return payload;
+        return trackMetadata;
     }
 
-    std::string listenToJsonString(Database::Session& session, const Scrobbling::Listen& listen, const Wt::WDateTime& timePoint, std::string_view listenType)
+    std::string createSubmitListensBody(std::string_view listenType, Wt::Json::Array&& payloads)
     {
-        std::string res;
-
-        std::optional<Wt::Json::Object> payload{ listenToJsonPayload(session, listen, timePoint) };
-        if (!payload)
-            return res;
-
         Wt::Json::Object root;
         root["listen_type"] = Wt::Json::Value{ std::string {listenType} };
-        root["payload"] = Wt::Json::Array{ std::move(*payload) };
+        root["payload"] = std::move(payloads);
 
-        res = Wt::Json::serialize(root);
-        return res;
+        return Wt::Json::serialize(root);
     }
 
     std::optional<std::size_t> parseListenCount(std::string_view msgBody)
@@ -214,8 +202,9 @@ namespace Scrobbling::ListenBrainz
         , _client{ client }
         , _maxSyncListenCount{ Service<IConfig>::get()->getULong("listenbrainz-max-sync-listen-count", 1000) }
         , _syncListensPeriod{ Service<IConfig>::get()->getULong("listenbrainz-sync-listens-period-hours", 1) }
+        , _maxListensPerSubmission{ std::clamp<std::size_t>(Service<IConfig>::get()->getULong("listenbrainz-max-listens-per-submission", 1000), 1, 1000) } // 1000 is the API limit
     {
-        LOG(INFO, "Starting Listens synchronizer, maxSyncListenCount = " << _maxSyncListenCount << ", _syncListensPeriod = " << _syncListensPeriod.count() << " hours");
+        LOG(INFO, "Starting Listens synchronizer, maxSyncListenCount = " << _maxSyncListenCount << ", _syncListensPeriod = " << _syncListensPeriod.count() << " hours, maxListensPerSubmission = " << _maxListensPerSubmission);
 
         scheduleSync(std::chrono::seconds{ 30 });
     }
@@ -223,62 +212,50 @@ namespace Scrobbling::ListenBrainz
     void ListensSynchronizer::enqueListen(const TimedListen& listen)
     {
         assert(listen.listenedAt.isValid());
-        enqueListen(listen, listen.listenedAt);
-    }
 
-    void ListensSynchronizer::enqueListenNow(const Scrobbling::Listen& listen)
-    {
-        enqueListen(listen, {});
+        // The listen is saved as pending first: it is then submitted along with the other pending listens of the user,
+        // and stays pending in case of failure so that it is sent again during the next sync
+        if (!saveListen(listen, Database::SyncState::PendingAdd))
+            return;
+
+        _strand.dispatch([this, userId = listen.userId]
+            {
+                enquePendingListens(getUserContext(userId));
+            });
     }
 
-    void ListensSynchronizer::enqueListen(const Scrobbling::Listen& listen, const Wt::WDateTime& timePoint)
+    void ListensSynchronizer::enqueListenNow(const Scrobbling::Listen& listen)
     {
-        Http::ClientPOSTRequestParameters request;
-        request.relativeUrl = "/1/submit-listens";
+        Database::Session& session{ _db.getTLSSession() };
 
-        if (timePoint.isValid())
+        std::optional<Wt::Json::Object> trackMetadata;
         {
-            const TimedListen timedListen{ listen, timePoint };
-            // We want the listen to be sent again later in case of failure, so we just save it as pending send
-            saveListen(timedListen, Database::SyncState::PendingAdd);
-
-            request.priority = Http::ClientRequestParameters::Priority::Normal;
-            request.onSuccessFunc = [=](std::string_view)
-                {
-                    _strand.dispatch([=]
-                        {
-                            if (saveListen(timedListen, Database::SyncState::Synchronized))
-                            {
-                                UserContext& context{ getUserContext(listen.userId) };
-                                if (context.listenCount)
-                                    (*context.listenCount)++;
-                            }
-                        });
-                };
-            // on failure, this listen will be sent during the next sync
-        }
-        else
-        {
-            // We want "listen now" to appear as soon as possible
-            request.priority = Http::ClientRequestParameters::Priority::High;
-            // don't retry on failure
+            auto transaction{ session.createReadTransaction() };
+            trackMetadata = createTrackMetadata(session, listen.trackId);
         }
 
-        std::string bodyText{ listenToJsonString(_db.getTLSSession(), listen, timePoint, timePoint.isValid() ? "single" : "playing_now") };
-        if (bodyText.empty())
+        if (!trackMetadata)
         {
             LOG(DEBUG, "Cannot convert listen to json: skipping");
             return;
         }
 
-        const std::optional<UUID> listenBrainzToken{ Utils::getListenBrainzToken(_db.getTLSSession(), listen.userId) };
+        const std::optional<UUID> listenBrainzToken{ Utils::getListenBrainzToken(session, listen.userId) };
         if (!listenBrainzToken)
         {
             LOG(DEBUG, "No listenbrainz token found: skipping");
             return;
         }
 
-        request.message.addBodyText(bodyText);
+        Wt::Json::Object payload;
+        payload["track_metadata"] = std::move(*trackMetadata);
+
+        Http::ClientPOSTRequestParameters request;
+        request.relativeUrl = "/1/submit-listens";
+        // We want "listen now" to appear as soon as possible
+        request.priority = Http::ClientRequestParameters::Priority::High;
+        // don't retry on failure
+        request.message.addBodyText(createSubmitListensBody("playing_now", Wt::Json::Array{ std::move(payload) }));
         request.message.addHeader("Authorization", "Token " + std::string{ listenBrainzToken->getAsString() });
         request.message.addHeader("Content-Type", "application/json");
         _client.sendPOSTRequest(std::move(request));
@@ -317,42 +294,6 @@ namespace Scrobbling::ListenBrainz
         return true;
     }
 
-    void ListensSynchronizer::enquePendingListens()
-    {
-        std::vector<TimedListen> pendingListens;
-
-        {
-            Database::Session& session{ _db.getTLSSession() };
-
-            auto transaction{ session.createWriteTransaction() };
-
-            Database::Listen::FindParameters params;
-            params.setScrobblingBackend(Database::ScrobblingBackend::ListenBrainz)
-                .setSyncState(Database::SyncState::PendingAdd)
-                .setRange(Database::Range{ 0, 100 }); // don't flood too much?
-
-            const Database::RangeResults results{ Database::Listen::find(session, params) };
-            pendingListens.reserve(results.results.size());
-
-            for (Database::ListenId listenId : results.results)
-            {
-                const Database::Listen::pointer listen{ Database::Listen::find(session, listenId) };
-
-                TimedListen timedListen;
-                timedListen.listenedAt = listen->getDateTime();
-                timedListen.userId = listen->getUser()->getId();
-                timedListen.trackId = listen->getTrack()->getId();
-
-                pendingListens.push_back(std::move(timedListen));
-            }
-        }
-
-        LOG(DEBUG, "Queing " << pendingListens.size() << " pending listen");
-
-        for (const TimedListen& pendingListen : pendingListens)
-            enqueListen(pendingListen);
-    }
-
     ListensSynchronizer::UserContext& ListensSynchronizer::getUserContext(Database::UserId userId)
     {
         assert(_strand.running_in_this_thread());
@@ -403,8 +344,6 @@ namespace Scrobbling::ListenBrainz
 
         assert(!isSyncing());
 
-        enquePendingListens();
-
         Database::RangeResults<Database::UserId> userIds;
         {
             Database::Session& session{ _db.getTLSSession() };
@@ -428,6 +367,10 @@ namespace Scrobbling::ListenBrainz
         context.matchedListenCount = 0;
         context.importedListenCount = 0;
 
+        // give another chance to the listens that could not be submitted
+        context.pendingListenCursor = {};
+        enquePendingListens(context);
+
         enqueValidateToken(context);
     }
 
@@ -443,6 +386,110 @@ namespace Scrobbling::ListenBrainz
             });
     }
 
+    void ListensSynchronizer::enquePendingListens(UserContext& context)
+    {
+        assert(_strand.running_in_this_thread());
+
+        if (context.submittingListens)
+            return; // the next batch will be sent once the current one is done
+
+        Database::Session& session{ _db.getTLSSession() };
+
+        std::vector<Database::ListenId> listenIds;
+        std::vector<Database::ListenId> rejectedListenIds;
+        Wt::Json::Array payloads;
+        {
+            auto transaction{ session.createReadTransaction() };
+
+            // listens that cannot be converted are skipped, and marked as rejected so that they are not fetched again
+            std::unordered_map<Database::TrackId, std::optional<Wt::Json::Object>> trackMetadatas;
+            bool moreResults{ true };
+            while (listenIds.empty() && moreResults)
+            {
+                moreResults = false;
+                Database::Listen::find(session, context.userId, Database::ScrobblingBackend::ListenBrainz, Database::SyncState::PendingAdd, context.pendingListenCursor, _maxListensPerSubmission, [&](Database::ListenId listenId, Database::TrackId trackId, const Wt::WDateTime& dateTime)
+                    {
+                        moreResults = true;
+
+                        auto itTrackMetadata{ trackMetadatas.find(trackId) };
+                        if (itTrackMetadata == std::cend(trackMetadatas))
+                            std::tie(itTrackMetadata, std::ignore) = trackMetadatas.emplace(trackId, createTrackMetadata(session, trackId));
+
+                        if (!itTrackMetadata->second)
+                        {
+                            rejectedListenIds.push_back(listenId);
+                            return;
+                        }
+
+                        Wt::Json::Object payload;
+                        payload["track_metadata"] = *itTrackMetadata->second;
+                        payload["listened_at"] = Wt::Json::Value{ static_cast<long long int>(dateTime.toTime_t()) };
+
+                        payloads.push_back(Wt::Json::Value{ std::move(payload) });
+                        listenIds.push_back(listenId);
+                    });
+            }
+        }
+
+        if (!rejectedListenIds.empty())
+        {
+            LOG(DEBUG, "Rejecting " << rejectedListenIds.size() << " pending listens that cannot be submitted");
+
+            auto transaction{ session.createWriteTransaction() };
+            Database::Listen::updateSyncState(session, rejectedListenIds, Database::SyncState::Rejected);
+        }
+
+        if (listenIds.empty())
+            return;
+
+        const std::optional<UUID> listenBrainzToken{ Utils::getListenBrainzToken(session, context.userId) };
+        if (!listenBrainzToken)
+        {
+            LOG(DEBUG, "No listenbrainz token found: skipping");
+            context.pendingListenCursor = {};
+            return;
+        }
+
+        LOG(DEBUG, "Submitting " << listenIds.size() << " pending listens");
+
+        Http::ClientPOSTRequestParameters request;
+        request.relativeUrl = "/1/submit-listens";
+        request.priority = Http::ClientRequestParameters::Priority::Normal;
+        request.message.addBodyText(createSubmitListensBody(listenIds.size() == 1 ? "single" : "import", std::move(payloads)));
+        request.message.addHeader("Authorization", "Token " + std::string{ listenBrainzToken->getAsString() });
+        request.message.addHeader("Content-Type", "application/json");
+        request.onSuccessFunc = [this, &context, listenIds](std::string_view)
+            {
+                _strand.dispatch([this, &context, listenIds]
+                    {
+                        {
+                            Database::Session& session{ _db.getTLSSession() };
+                            auto transaction{ session.createWriteTransaction() };
+
+                            Database::Listen::updateSyncState(session, listenIds, Database::SyncState::Synchronized);
+                        }
+
+                        if (context.listenCount)
+                            *context.listenCount += listenIds.size();
+
+                        context.submittingListens = false;
+                        enquePendingListens(context);
+                    });
+            };
+        request.onFailureFunc = [this, &context]
+            {
+                // listens are left pending, they will be sent again during the next sync
+                _strand.dispatch([&context]
+                    {
+                        context.submittingListens = false;
+                        context.pendingListenCursor = {};
+                    });
+            };
+
+        context.submittingListens = true;
+        _client.sendPOSTRequest(std::move(request));
+    }
+
     void ListensSynchronizer::enqueValidateToken(UserContext& context)
     {
         assert(context.listenBrainzUserName.empty());
@@ -25,6 +25,7 @@
 #include <boost/asio/io_context_strand.hpp>
 #include <boost/asio/steady_timer.hpp>
 
+#include "database/ListenId.hpp"
 #include "database/Types.hpp"
 #include "database/UserId.hpp"
 
@@ -51,11 +52,8 @@ namespace Scrobbling::ListenBrainz
 			void enqueListenNow(const Listen& listen);
 
 		private:
-			void enqueListen(const Listen& listen, const Wt::WDateTime& timePoint);
 			bool saveListen(const TimedListen& listen, Database::SyncState scrobblinState);
 
-			void enquePendingListens();
-
 			struct UserContext
 			{
 				UserContext(Database::UserId id) : userId {id} {}
@@ -69,6 +67,10 @@ namespace Scrobbling::ListenBrainz
 				bool						syncing {};
 				std::optional<std::size_t>	listenCount {};
 
+				// pending listens are submitted by batches, one batch at a time
+				bool						submittingListens {};
+				Database::ListenId			pendingListenCursor; // last pending listen put in a batch
+
 				// resetted at each sync
 				std::string		listenBrainzUserName; // need to be resolved first
 				Wt::WDateTime	maxDateTime;
@@ -83,6 +85,7 @@ namespace Scrobbling::ListenBrainz
 			void startSync();
 			void startSync(UserContext& context);
 			void onSyncEnded(UserContext& context);
+			void enquePendingListens(UserContext& context);
 			void enqueValidateToken(UserContext& context);
 			void enqueGetListenCount(UserContext& context);
 			void enqueGetListens(UserContext& context);
@@ -98,6 +101,7 @@ namespace Scrobbling::ListenBrainz
 
 			const std::size_t			_maxSyncListenCount;
 			const std::chrono::hours	_syncListensPeriod;
+			const std::size_t			_maxListensPerSubmission;
 	};
 } // Scrobbling::ListenBrainz
 
@@ -20,10 +20,13 @@
 #include "som/Network.hpp"
 
 #include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <cmath>
+#include <limits>
 #include <random>
 #include <sstream>
+#include <thread>
 #include <unordered_set>
 
 #include "utils/ILogger.hpp"
@@ -79,21 +82,30 @@ defaultNeighbourhoodFunc(Norm norm, const Network::CurrentIteration& iteration)
 }
 
 Network::Network(Coordinate width, Coordinate height, std::size_t inputDimCount)
+: Network {width, height, inputDimCount, Random::getRandGenerator()}
+{
+}
+
+Network::Network(Coordinate width, Coordinate height, std::size_t inputDimCount, Random::RandGenerator& randGenerator)
 :
 _inputDimCount {inputDimCount},
 _weights {inputDimCount, static_cast<InputVector::value_type>(1)},
 _refVectors {width, height, _inputDimCount},
+_refVectorStore {static_cast<std::size_t>(width) * height, _inputDimCount},
 _distanceFunc {euclidianSquareDistance},
 _learningFactorFunc {defaultLearningFactor},
 _neighbourhoodFunc {defaultNeighbourhoodFunc}
 {
 	// init each vector with a random normalized value
+	std::uniform_real_distribution<InputVector::value_type> dist {0, 1};
 	for (Coordinate y {}; y < _refVectors.getHeight(); ++y)
 	{
 		for (Coordinate x {}; x < _refVectors.getWidth(); ++x)
 		{
 			for (InputVector::value_type& val : _refVectors.get({x,y}))
-				val = Random::getRealRandom<InputVector::value_type>(0, 1);
+				val = dist(randGenerator);
+
+			_refVectorStore.setRefVector(getRefVectorIndex({x, y}), _refVectors.get({x, y}));
 		}
 	}
 }
@@ -104,6 +116,7 @@ Network::setDataWeights(const InputVector& weights)
 	checkSameDimensions(weights, _inputDimCount);
 
 	_weights = weights;
+	_refVectorStore.setWeights(_weights);
 }
 
 void
@@ -112,6 +125,26 @@ Network::setRefVector(const Position& position, const InputVector& data)
 	checkSameDimensions(data, _inputDimCount);
 
 	_refVectors[position] = data;
+	_refVectorStore.setRefVector(getRefVectorIndex(position), data);
+}
+
+void
+Network::setDistanceFunc(DistanceFunc distanceFunc)
+{
+	_distanceFunc = std::move(distanceFunc);
+	_useRefVectorStore = false;
+}
+
+void
+Network::setLearningFactorFunc(LearningFactorFunc learningFactorFunc)
+{
+	_learningFactorFunc = std::move(learningFactorFunc);
+}
+
+void
+Network::setNeighbourhoodFunc(NeighbourhoodFunc neighbourhoodFunc)
+{
+	_neighbourhoodFunc = std::move(neighbourhoodFunc);
 }
 
 InputVector::Distance
@@ -180,10 +213,34 @@ Network::dump(std::ostream& os) const
 Position
 Network::getClosestRefVectorPosition(const InputVector& data) const
 {
-	return _refVectors.getPositionMinElement([&](const auto& a, const auto& b)
+	return getRefVectorPosition(getClosestRefVectorIndex(data));
+}
+
+std::size_t
+Network::getClosestRefVectorIndex(const InputVector& data) const
+{
+	checkSameDimensions(data, _inputDimCount);
+
+	if (_useRefVectorStore)
+		return _refVectorStore.findClosestRefVector(data).index;
+
+	// generic fallback: compute each distance only once
+	std::size_t closestIndex {};
+	InputVector::Distance closestDistance {std::numeric_limits<InputVector::Distance>::max()};
+	for (Coordinate y {}; y < _refVectors.getHeight(); ++y)
+	{
+		for (Coordinate x {}; x < _refVectors.getWidth(); ++x)
+		{
+			const InputVector::Distance distance {_distanceFunc(_refVectors.get({x, y}), data, _weights)};
+			if (distance < closestDistance)
 			{
-				return (_distanceFunc(a, data, _weights) < _distanceFunc(b, data, _weights));
-			});
+				closestDistance = distance;
+				closestIndex = getRefVectorIndex({x, y});
+			}
+		}
+	}
+
+	return closestIndex;
 }
 
 std::optional<Position>
@@ -262,21 +319,63 @@ computePositionNorm(const Position& c1, const Position& c2)
 	return std::sqrt((c1.x - c2.x) * (c1.x - c2.x) + (c1.y - c2.y) * (c1.y - c2.y));
 }
 
+static Coordinate
+absDiff(Coordinate a, Coordinate b)
+{
+	return a > b ? a - b : b - a;
+}
+
+Network::NeighbourhoodFactors
+Network::computeNeighbourhoodFactors(const CurrentIteration& iteration) const
+{
+	constexpr InputVector::value_type minFactor {0.0001};
+
+	NeighbourhoodFactors res {0, 0, Matrix<InputVector::value_type> {getWidth(), getHeight()}};
+	for (Coordinate y {}; y < getHeight(); ++y)
+	{
+		for (Coordinate x {}; x < getWidth(); ++x)
+		{
+			InputVector::value_type factor {_neighbourhoodFunc(computePositionNorm({0, 0}, {x, y}), iteration)};
+			if (std::abs(factor) < minFactor)
+			{
+				factor = 0;
+			}
+			else
+			{
+				res.radiusX = std::max(res.radiusX, x);
+				res.radiusY = std::max(res.radiusY, y);
+			}
+
+			res.factors[{x, y}] = factor;
+		}
+	}
+
+	return res;
+}
+
 void
-Network::updateRefVectors(const Position& closestRefVectorPosition, const InputVector& input, LearningFactor learningFactor, const CurrentIteration& iteration)
+Network::updateRefVectors(const Position& closestRefVectorPosition, const InputVector& input, LearningFactor learningFactor, const NeighbourhoodFactors& neighbourhoodFactors)
 {
-	for (Coordinate y {}; y < _refVectors.getHeight(); ++y)
+	const Coordinate minY {closestRefVectorPosition.y - std::min(closestRefVectorPosition.y, neighbourhoodFactors.radiusY)};
+	const Coordinate maxY {std::min(getHeight() - 1, closestRefVectorPosition.y + neighbourhoodFactors.radiusY)};
+	const Coordinate minX {closestRefVectorPosition.x - std::min(closestRefVectorPosition.x, neighbourhoodFactors.radiusX)};
+	const Coordinate maxX {std::min(getWidth() - 1, closestRefVectorPosition.x + neighbourhoodFactors.radiusX)};
+
+	for (Coordinate y {minY}; y <= maxY; ++y)
 	{
-		for (Coordinate x {}; x < _refVectors.getWidth(); ++x)
+		for (Coordinate x {minX}; x <= maxX; ++x)
 		{
-			InputVector& refVector {_refVectors.get({x, y})};
+			const InputVector::value_type factor {learningFactor * neighbourhoodFactors.factors[{absDiff(x, closestRefVectorPosition.x), absDiff(y, closestRefVectorPosition.y)}]};
+			if (factor == 0)
+				continue;
 
-			const Norm norm {computePositionNorm({x, y}, closestRefVectorPosition)};
+			InputVector& refVector {_refVectors.get({x, y})};
 
-			InputVector delta {input - refVector};
-			delta *= (learningFactor * _neighbourhoodFunc(norm, iteration));
+			auto itInput {std::cbegin(input)};
+			for (InputVector::value_type& value : refVector)
+				value += factor * (*itInput++ - value);
 
-			refVector += delta;
+			_refVectorStore.setRefVector(getRefVectorIndex({x, y}), refVector);
 		}
 	}
 }
@@ -301,6 +400,7 @@ Network::train(const std::vector<InputVector>& inputData, std::size_t nbIteratio
 		Random::shuffleContainer(inputDataShuffled);
 
 		const LearningFactor learningFactor {_learningFactorFunc(curIter)};
+		const NeighbourhoodFactors neighbourhoodFactors {computeNeighbourhoodFactors(curIter)};
 
 		for (const InputVector* input : inputDataShuffled)
 		{
@@ -310,7 +410,7 @@ Network::train(const std::vector<InputVector>& inputData, std::size_t nbIteratio
 			if (stopRequested)
 				return;
 
-			updateRefVectors(getClosestRefVectorPosition(*input), *input, learningFactor, curIter);
+			updateRefVectors(getClosestRefVectorPosition(*input), *input, learningFactor, neighbourhoodFactors);
 		}
 
 		if (stopRequested)
@@ -318,6 +418,136 @@ Network::train(const std::vector<InputVector>& inputData, std::size_t nbIteratio
 	}
 }
 
+// Splits [0, count) in contiguous ranges, processed in parallel. The range starting at 0 is processed by the calling thread
+template <typename Func>
+static void
+parallelForRanges(std::size_t count, std::size_t threadCount, Func func)
+{
+	threadCount = std::max<std::size_t>(1, std::min(threadCount, count));
+	const std::size_t rangeSize {(count + threadCount - 1) / threadCount};
+
+	std::vector<std::thread> threads;
+	for (std::size_t i {1}; i < threadCount; ++i)
+		threads.emplace_back([&func, i, rangeSize, count] { func(i * rangeSize, std::min(count, (i + 1) * rangeSize)); });
+
+	func(0, std::min(count, rangeSize));
+
+	for (std::thread& thread : threads)
+		thread.join();
+}
+
+void
+Network::trainBatch(const std::vector<InputVector>& inputData, std::size_t nbIterations, std::size_t threadCount, ProgressCallback progressCallback, RequestStopCallback requestStopCallback)
+{
+	constexpr std::size_t stopCheckPeriod {64};
+
+	for (const InputVector& input : inputData)
+		checkSameDimensions(input, _inputDimCount);
+
+	const std::size_t refVectorCount {static_cast<std::size_t>(getWidth()) * getHeight()};
+
+	std::vector<std::size_t> bestMatchingUnits(inputData.size());
+	std::vector<InputVector> sums(refVectorCount, InputVector {_inputDimCount});
+	std::vector<std::size_t> counts(refVectorCount);
+
+	std::atomic<bool> stopRequested {false};
+	auto checkStopRequested {[&](std::size_t begin, std::size_t i)
+	{
+		if (begin == 0 && requestStopCallback && (i % stopCheckPeriod) == 0 && requestStopCallback())
+			stopRequested = true;
+
+		return stopRequested.load();
+	}};
+
+	for (std::size_t i {}; i < nbIterations; ++i)
+	{
+		const CurrentIteration curIter {i, nbIterations};
+
+		if (progressCallback)
+			progressCallback(curIter);
+
+		parallelForRanges(inputData.size(), threadCount, [&](std::size_t begin, std::size_t end)
+		{
+			for (std::size_t j {begin}; j < end; ++j)
+			{
+				if (checkStopRequested(begin, j - begin))
+					return;
+
+				bestMatchingUnits[j] = getClosestRefVectorIndex(inputData[j]);
+			}
+		});
+
+		if (stopRequested)
+			return;
+
+		// Reduce in sample order, so that results do not depend on the thread count
+		for (std::size_t refVectorIndex {}; refVectorIndex < refVectorCount; ++refVectorIndex)
+		{
+			std::fill(std::begin(sums[refVectorIndex]), std::end(sums[refVectorIndex]), 0);
+			counts[refVectorIndex] = 0;
+		}
+		for (std::size_t j {}; j < inputData.size(); ++j)
+		{
+			sums[bestMatchingUnits[j]] += inputData[j];
+			counts[bestMatchingUnits[j]]++;
+		}
+
+		const NeighbourhoodFactors neighbourhoodFactors {computeNeighbourhoodFactors(curIter)};
+
+		parallelForRanges(refVectorCount, threadCount, [&](std::size_t begin, std::size_t end)
+		{
+			InputVector numerator {_inputDimCount};
+			for (std::size_t refVectorIndex {begin}; refVectorIndex < end; ++refVectorIndex)
+			{
+				if (checkStopRequested(begin, refVectorIndex - begin))
+					return;
+
+				const Position position {getRefVectorPosition(refVectorIndex)};
+
+				const Coordinate minY {position.y - std::min(position.y, neighbourhoodFactors.radiusY)};
+				const Coordinate maxY {std::min(getHeight() - 1, position.y + neighbourhoodFactors.radiusY)};
+				const Coordinate minX {position.x - std::min(position.x, neighbourhoodFactors.radiusX)};
+				const Coordinate maxX {std::min(getWidth() - 1, position.x + neighbourhoodFactors.radiusX)};
+
+				std::fill(std::begin(numerator), std::end(numerator), 0);
+				InputVector::value_type denominator {};
+				for (Coordinate y {minY}; y <= maxY; ++y)
+				{
+					for (Coordinate x {minX}; x <= maxX; ++x)
+					{
+						const std::size_t matchedRefVectorIndex {getRefVectorIndex({x, y})};
+						if (counts[matchedRefVectorIndex] == 0)
+							continue;
+
+						const InputVector::value_type factor {neighbourhoodFactors.factors[{absDiff(x, position.x), absDiff(y, position.y)}]};
+						if (factor == 0)
+							continue;
+
+						auto itSum {std::cbegin(sums[matchedRefVectorIndex])};
+						for (InputVector::value_type& value : numerator)
+							value += factor * *itSum++;
+
+						denominator += factor * counts[matchedRefVectorIndex];
+					}
+				}
+
+				if (denominator == 0)
+					continue;
+
+				InputVector& refVector {_refVectors.get(position)};
+				auto itNumerator {std::cbegin(numerator)};
+				for (InputVector::value_type& value : refVector)
+					value = *itNumerator++ / denominator;
+
+				_refVectorStore.setRefVector(refVectorIndex, refVector);
+			}
+		});
+
+		if (stopRequested)
+			return;
+	}
+}
+
 const InputVector&
 Network::getRefVector(const Position& position) const
 {
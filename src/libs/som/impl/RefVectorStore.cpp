@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2023 Emeric Poupon
+ *
+ * This file is part of LMS.
+ *
+ * LMS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LMS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "som/RefVectorStore.hpp"
+
+#include <cassert>
+#include <limits>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LMS_SOM_X86 1
+#include <immintrin.h>
+#endif
+
+namespace SOM
+{
+
+static constexpr std::size_t laneCount {8};
+
+// Independent accumulators per lane: lets the compiler vectorize without reordering additions
+static RefVectorStore::value_type
+computeDistanceScalar(const RefVectorStore::value_type* a, const RefVectorStore::value_type* b, const RefVectorStore::value_type* weights, std::size_t size)
+{
+	RefVectorStore::value_type acc[laneCount] {};
+	for (std::size_t i {}; i < size; i += laneCount)
+	{
+		for (std::size_t lane {}; lane < laneCount; ++lane)
+		{
+			const RefVectorStore::value_type diff {a[i + lane] - b[i + lane]};
+			acc[lane] += diff * diff * weights[i + lane];
+		}
+	}
+
+	RefVectorStore::value_type res {};
+	for (RefVectorStore::value_type value : acc)
+		res += value;
+
+	return res;
+}
+
+#if LMS_SOM_X86
+__attribute__((target("avx2,fma")))
+static RefVectorStore::value_type
+computeDistanceAVX2(const RefVectorStore::value_type* a, const RefVectorStore::value_type* b, const RefVectorStore::value_type* weights, std::size_t size)
+{
+	__m256 acc {_mm256_setzero_ps()};
+	for (std::size_t i {}; i < size; i += laneCount)
+	{
+		const __m256 diff {_mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i))};
+		acc = _mm256_fmadd_ps(_mm256_mul_ps(diff, diff), _mm256_loadu_ps(weights + i), acc);
+	}
+
+	const __m128 sum4 {_mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1))};
+	const __m128 sum2 {_mm_add_ps(sum4, _mm_movehl_ps(sum4, sum4))};
+	const __m128 sum1 {_mm_add_ss(sum2, _mm_shuffle_ps(sum2, sum2, 1))};
+
+	return _mm_cvtss_f32(sum1);
+}
+#endif
+
+using DistanceKernel = RefVectorStore::value_type(*)(const RefVectorStore::value_type*, const RefVectorStore::value_type*, const RefVectorStore::value_type*, std::size_t);
+
+static DistanceKernel
+selectDistanceKernel()
+{
+#if LMS_SOM_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		return computeDistanceAVX2;
+#endif
+
+	return computeDistanceScalar;
+}
+
+static DistanceKernel
+getDistanceKernel()
+{
+	static const DistanceKernel kernel {selectDistanceKernel()};
+	return kernel;
+}
+
+RefVectorStore::RefVectorStore(std::size_t refVectorCount, std::size_t inputDimCount)
+: _refVectorCount {refVectorCount}
+, _inputDimCount {inputDimCount}
+, _stride {(inputDimCount + laneCount - 1) / laneCount * laneCount}
+, _weights(_stride, value_type {})
+, _values(_refVectorCount * _stride, value_type {})
+{
+	setWeights(InputVector {inputDimCount, 1});
+}
+
+void
+RefVectorStore::pack(const InputVector& input, value_type* output) const
+{
+	assert(input.getNbDimensions() == _inputDimCount);
+
+	std::size_t i {};
+	for (InputVector::value_type value : input)
+		output[i++] = static_cast<value_type>(value);
+}
+
+void
+RefVectorStore::setRefVector(std::size_t index, const InputVector& refVector)
+{
+	assert(index < _refVectorCount);
+	pack(refVector, &_values[index * _stride]);
+}
+
+void
+RefVectorStore::setWeights(const InputVector& weights)
+{
+	pack(weights, _weights.data());
+}
+
+RefVectorStore::Match
+RefVectorStore::findClosestRefVector(const InputVector& data) const
+{
+	assert(_refVectorCount > 0);
+
+	std::vector<value_type> packedData(_stride, value_type {});
+	pack(data, packedData.data());
+
+	const DistanceKernel computeDistance {getDistanceKernel()};
+
+	Match match {0, std::numeric_limits<InputVector::Distance>::max()};
+	for (std::size_t i {}; i < _refVectorCount; ++i)
+	{
+		const InputVector::Distance distance {computeDistance(&_values[i * _stride], packedData.data(), _weights.data(), _stride)};
+		if (distance < match.distance)
+			match = {i, distance};
+	}
+
+	return match;
+}
+
+} // namespace SOM
@@ -22,6 +22,7 @@
 
 #include <vector>
 #include <cmath>
+#include <ostream>
 
 #include "utils/Exception.hpp"
 
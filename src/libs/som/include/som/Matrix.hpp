@@ -24,6 +24,8 @@
 #include <functional>
 #include <vector>
 
+#include "InputVector.hpp"
+
 namespace SOM
 {
 
@@ -24,8 +24,11 @@
 #include <ostream>
 #include <functional>
 
+#include "utils/Random.hpp"
+
 #include "InputVector.hpp"
 #include "Matrix.hpp"
+#include "RefVectorStore.hpp"
 
 namespace SOM
 {
@@ -42,6 +45,7 @@ class Network
 	public:
 		// Init a network with random values
 		Network(Coordinate width, Coordinate height, std::size_t inputDimCount);
+		Network(Coordinate width, Coordinate height, std::size_t inputDimCount, Random::RandGenerator& randGenerator);
 
 		Coordinate getWidth() const { return _refVectors.getWidth(); }
 		Coordinate getHeight() const { return _refVectors.getHeight(); }
@@ -64,6 +68,11 @@ class Network
 		using RequestStopCallback = std::function<bool()>;
 		void train(const std::vector<InputVector>& dataSamples, std::size_t nbIterations, ProgressCallback = ProgressCallback{}, RequestStopCallback = RequestStopCallback{});
 
+		// Batch training: for each iteration, the best matching units of all the samples are searched in parallel,
+		// then each ref vector is set to the neighbourhood weighted mean of the samples (the learning factor is not used)
+		// Results do not depend on threadCount. RequestStopCallback is only called from the calling thread
+		void trainBatch(const std::vector<InputVector>& dataSamples, std::size_t nbIterations, std::size_t threadCount, ProgressCallback = ProgressCallback{}, RequestStopCallback = RequestStopCallback{});
+
 		const InputVector& getRefVector(const Position& position) const;
 		Position getClosestRefVectorPosition(const InputVector& data) const;
 		std::optional<Position> getClosestRefVectorPosition(const InputVector& data, InputVector::Distance maxDistance) const;
@@ -81,9 +90,10 @@ class Network
 		// i is the current iteration
 		// refVector(i+1) = refVector(i) + LearningFactor(i) * NeighbourhoodFunc(i) * (MatchingRefVector - refVector)
 
+		// Setting a custom distance function disables the packed ref vector store for best matching unit searches
 		using DistanceFunc = std::function<InputVector::Distance(const InputVector& /* a */, const InputVector& /* b */, const InputVector& /* weights */)>;
 		void setDistanceFunc(DistanceFunc distanceFunc);
-		DistanceFunc getDistanceFunc() { return _distanceFunc; }
+		DistanceFunc getDistanceFunc() const { return _distanceFunc; }
 
 		using LearningFactorFunc = std::function<LearningFactor(const CurrentIteration&)>;
 		void setLearningFactorFunc(LearningFactorFunc learningFactorFunc);
@@ -93,11 +103,26 @@ class Network
 
 	private:
 
-		void updateRefVectors(const Position& closestRefVectorPosition, const InputVector& input, LearningFactor learningFactor, const CurrentIteration& iteration);
+		// Neighbourhood factors of an iteration, indexed by the position offset to the matching ref vector
+		// Factors that are too small to matter are set to zero, so that only neurons within the radius need to be visited
+		struct NeighbourhoodFactors
+		{
+			Coordinate radiusX {};
+			Coordinate radiusY {};
+			Matrix<InputVector::value_type> factors;
+		};
+		NeighbourhoodFactors computeNeighbourhoodFactors(const CurrentIteration& iteration) const;
+
+		void updateRefVectors(const Position& closestRefVectorPosition, const InputVector& input, LearningFactor learningFactor, const NeighbourhoodFactors& neighbourhoodFactors);
+		std::size_t getClosestRefVectorIndex(const InputVector& data) const;
+		std::size_t getRefVectorIndex(const Position& position) const { return position.x + static_cast<std::size_t>(position.y) * getWidth(); }
+		Position getRefVectorPosition(std::size_t index) const { return {static_cast<Coordinate>(index % getWidth()), static_cast<Coordinate>(index / getWidth())}; }
 
 		std::size_t _inputDimCount {};
 		InputVector _weights;	// weight for each dimension
 		Matrix<InputVector> _refVectors;
+		RefVectorStore _refVectorStore;	// mirror of _refVectors, used to speed up searches with the default distance function
+		bool _useRefVectorStore {true};
 
 		DistanceFunc _distanceFunc;
 		LearningFactorFunc _learningFactorFunc;
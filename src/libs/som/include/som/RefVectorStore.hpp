@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2023 Emeric Poupon
+ *
+ * This file is part of LMS.
+ *
+ * LMS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LMS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "InputVector.hpp"
+
+namespace SOM
+{
+
+// Packs all the ref vectors of a network in a single contiguous float buffer
+// Each row is padded with zeros (with zero weights) so that SIMD kernels can process it without remainder
+class RefVectorStore
+{
+	public:
+		using value_type = float;
+
+		RefVectorStore(std::size_t refVectorCount, std::size_t inputDimCount);
+
+		std::size_t getRefVectorCount() const { return _refVectorCount; }
+
+		void setRefVector(std::size_t index, const InputVector& refVector);
+		void setWeights(const InputVector& weights);
+
+		struct Match
+		{
+			std::size_t index;
+			InputVector::Distance distance;
+		};
+		// Each distance is computed once, using the weighted square euclidian distance
+		Match findClosestRefVector(const InputVector& data) const;
+
+	private:
+		void pack(const InputVector& input, value_type* output) const;
+
+		std::size_t _refVectorCount {};
+		std::size_t _inputDimCount {};
+		std::size_t _stride {};
+		std::vector<value_type> _weights;
+		std::vector<value_type> _values;
+};
+
+} // namespace SOM
@@ -126,6 +126,122 @@ TEST(som, Network)
 	}
 }
 
+TEST(som, RefVectorStore)
+{
+	constexpr std::size_t inputDimCount {21};
+
+	// non square network: the fast search must give the same positions as the generic one
+	Network network {7, 5, inputDimCount};
+	Network genericNetwork {network.getWidth(), network.getHeight(), inputDimCount};
+	genericNetwork.setDistanceFunc([](const InputVector& a, const InputVector& b, const InputVector& weights)
+	{
+		return a.computeEuclidianSquareDistance(b, weights);
+	});
+
+	InputVector weights {inputDimCount};
+	for (std::size_t i {}; i < inputDimCount; ++i)
+		weights[i] = 1 + static_cast<InputVector::value_type>(i % 3);
+	network.setDataWeights(weights);
+	genericNetwork.setDataWeights(weights);
+
+	for (Coordinate y {}; y < network.getHeight(); ++y)
+	{
+		for (Coordinate x {}; x < network.getWidth(); ++x)
+			genericNetwork.setRefVector({x, y}, network.getRefVector({x, y}));
+	}
+
+	for (Coordinate y {}; y < network.getHeight(); ++y)
+	{
+		for (Coordinate x {}; x < network.getWidth(); ++x)
+		{
+			InputVector input {network.getRefVector({x, y})};
+			input[0] += 0.001;
+
+			const Position expectedPosition {x, y};
+			EXPECT_EQ(network.getClosestRefVectorPosition(input), expectedPosition);
+			EXPECT_EQ(genericNetwork.getClosestRefVectorPosition(input), expectedPosition);
+		}
+	}
+}
+
+TEST(som, NetworkBatch)
+{
+	Random::RandGenerator randGenerator {Random::createSeededGenerator(42)};
+	Network network {2, 2, 1, randGenerator};
+
+	std::vector<InputVector> trainData;
+	for (InputVector::value_type value : {0., 0.05, 0.3, 0.35, 0.6, 0.65, 0.9, 0.95})
+		trainData.push_back(InputVector {1, value});
+
+	network.trainBatch(trainData, 20, 3);
+
+	std::unordered_set<Position> positions;
+	for (std::size_t i {}; i < trainData.size(); i += 2)
+	{
+		const Position position {network.getClosestRefVectorPosition(trainData[i])};
+		EXPECT_EQ(network.getClosestRefVectorPosition(trainData[i + 1]), position);
+		positions.insert(position);
+	}
+	EXPECT_EQ(positions.size(), 4);
+}
+
+TEST(som, NetworkBatchDeterministic)
+{
+	constexpr std::size_t inputDimCount {5};
+
+	Random::RandGenerator dataRandGenerator {Random::createSeededGenerator(1)};
+	std::uniform_real_distribution<InputVector::value_type> dist {0, 1};
+	std::vector<InputVector> trainData;
+	for (std::size_t i {}; i < 200; ++i)
+	{
+		InputVector input {inputDimCount};
+		for (InputVector::value_type& value : input)
+			value = dist(dataRandGenerator);
+		trainData.push_back(input);
+	}
+
+	auto trainNetwork {[&](std::size_t threadCount)
+	{
+		Random::RandGenerator randGenerator {Random::createSeededGenerator(42)};
+		Network network {6, 6, inputDimCount, randGenerator};
+		network.trainBatch(trainData, 5, threadCount);
+		return network;
+	}};
+
+	const Network network1 {trainNetwork(1)};
+	const Network network4 {trainNetwork(4)};
+	for (Coordinate y {}; y < network1.getHeight(); ++y)
+	{
+		for (Coordinate x {}; x < network1.getWidth(); ++x)
+		{
+			const InputVector& refVector1 {network1.getRefVector({x, y})};
+			const InputVector& refVector4 {network4.getRefVector({x, y})};
+			for (std::size_t i {}; i < inputDimCount; ++i)
+				EXPECT_EQ(refVector1[i], refVector4[i]);
+		}
+	}
+}
+
+TEST(som, NetworkNeighbourhoodRadius)
+{
+	Random::RandGenerator randGenerator {Random::createSeededGenerator(42)};
+	Network network {30, 1, 2, randGenerator};
+	const Network initialNetwork {network};
+
+	const std::vector<InputVector> trainData {InputVector {2, 0.5}};
+	const Position closestPosition {network.getClosestRefVectorPosition(trainData.front())};
+	network.train(trainData, 1);
+
+	// far away neurons must not be touched
+	for (Coordinate x {}; x < network.getWidth(); ++x)
+	{
+		const Coordinate distance {x > closestPosition.x ? x - closestPosition.x : closestPosition.x - x};
+		const bool updated {network.getRefVector({x, 0})[0] != initialNetwork.getRefVector({x, 0})[0]};
+
+		EXPECT_EQ(updated, distance <= 2);
+	}
+}
+
 int main(int argc, char **argv)
 {
 	::testing::InitGoogleTest(&argc, argv);
@@ -33,6 +33,7 @@
 #include "utils/FileResourceHandlerCreator.hpp"
 #include "utils/Utils.hpp"
 #include "utils/String.hpp"
+#include "utils/http/ETag.hpp"
 #include "ParameterParsing.hpp"
 #include "SubsonicId.hpp"
 
@@ -250,7 +251,7 @@ namespace API::Subsonic
         }
     }
 
-    void handleGetCoverArt(RequestContext& context, const Wt::Http::Request& /*request*/, Wt::Http::Response& response)
+    void handleGetCoverArt(RequestContext& context, const Wt::Http::Request& request, Wt::Http::Response& response)
     {
         // Mandatory params
         const auto trackId{ getParameterAs<TrackId>(context.parameters, "id") };
@@ -263,16 +264,39 @@ namespace API::Subsonic
         std::size_t size{ getParameterAs<std::size_t>(context.parameters, "size").value_or(1024) };
         size = ::Utils::clamp(size, std::size_t{ 32 }, std::size_t{ 2048 });
 
+        // Non standard: clients have to opt in for WebP covers
+        const Image::EncodingFormat format{ getParameterAs<std::string>(context.parameters, "format").value_or("") == "webp" ? Image::EncodingFormat::WebP : Image::EncodingFormat::JPEG };
+
+        // The tag only depends on the cover source: no need to get the cover to know if the client already has the right one
+        std::string etag;
+        if (trackId)
+            etag = Service<Cover::ICoverService>::get()->getETag(*trackId, size, format);
+        else if (releaseId)
+            etag = Service<Cover::ICoverService>::get()->getETag(*releaseId, size, format);
+        else if (artistId)
+            etag = Service<Cover::ICoverService>::get()->getETag(*artistId, size, format);
+
+        if (!etag.empty())
+        {
+            etag = "\"" + etag + (context.enableDefaultCover ? "-d" : "") + "\"";
+            if (Http::matchesIfNoneMatch(request.headerValue("If-None-Match"), etag))
+            {
+                response.addHeader("ETag", etag);
+                response.setStatus(304);
+                return;
+            }
+        }
+
         std::shared_ptr<Image::IEncodedImage> cover;
         if (trackId)
-            cover = Service<Cover::ICoverService>::get()->getFromTrack(*trackId, size);
+            cover = Service<Cover::ICoverService>::get()->getFromTrack(*trackId, size, format);
         else if (releaseId)
-            cover = Service<Cover::ICoverService>::get()->getFromRelease(*releaseId, size);
+            cover = Service<Cover::ICoverService>::get()->getFromRelease(*releaseId, size, format);
         else if (artistId)
-            cover = Service<Cover::ICoverService>::get()->getFromArtist(*artistId, size);
+            cover = Service<Cover::ICoverService>::get()->getFromArtist(*artistId, size, format);
 
         if (!cover && context.enableDefaultCover && !artistId)
-            cover = Service<Cover::ICoverService>::get()->getDefault(size);
+            cover = Service<Cover::ICoverService>::get()->getDefault(size, format);
 
         if (!cover)
         {
@@ -280,6 +304,9 @@ namespace API::Subsonic
             return;
         }
 
+        response.addHeader("Cache-Control", "private, max-age=604800");
+        if (!etag.empty())
+            response.addHeader("ETag", etag);
         response.out().write(reinterpret_cast<const char*>(cover->getData()), cover->getDataSize());
         response.setMimeType(std::string{ cover->getMimeType() });
     }
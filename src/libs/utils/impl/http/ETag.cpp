@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2023 Emeric Poupon
+ *
+ * This file is part of LMS.
+ *
+ * LMS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LMS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "utils/http/ETag.hpp"
+
+#include "utils/String.hpp"
+
+namespace Http
+{
+	bool matchesIfNoneMatch(std::string_view ifNoneMatch, std::string_view etag)
+	{
+		for (std::string_view candidate : StringUtils::splitString(ifNoneMatch, ","))
+		{
+			candidate = StringUtils::stringTrim(candidate);
+			if (candidate == "*")
+				return true;
+
+			// weak comparison, as per RFC 7232
+			if (candidate.substr(0, 2) == "W/")
+				candidate.remove_prefix(2);
+			if (etag.substr(0, 2) == "W/")
+				etag.remove_prefix(2);
+
+			if (!candidate.empty() && candidate == etag)
+				return true;
+		}
+
+		return false;
+	}
+} // namespace Http
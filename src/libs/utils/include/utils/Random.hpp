@@ -31,18 +31,32 @@ RandGenerator createSeededGenerator(uint_fast32_t seed);
 
 template <typename T>
 T
-getRandom(T min, T max)
+getRandom(RandGenerator& randGenerator, T min, T max)
 {
 	std::uniform_int_distribution<> dist {min, max};
-	return dist (getRandGenerator());
+	return dist (randGenerator);
 }
 
 template <typename T>
 T
-getRealRandom(T min, T max)
+getRandom(T min, T max)
+{
+	return getRandom(getRandGenerator(), min, max);
+}
+
+template <typename T>
+T
+getRealRandom(RandGenerator& randGenerator, T min, T max)
 {
 	std::uniform_real_distribution<> dist {min, max};
-	return dist (getRandGenerator());
+	return dist (randGenerator);
+}
+
+template <typename T>
+T
+getRealRandom(T min, T max)
+{
+	return getRealRandom(getRandGenerator(), min, max);
 }
 
 template <typename Container>
@@ -54,12 +68,19 @@ shuffleContainer(Container& container)
 
 template <typename Container>
 typename Container::const_iterator
-pickRandom(const Container& container)
+pickRandom(RandGenerator& randGenerator, const Container& container)
 {
 	if (container.empty())
 		return std::end(container);
 
-	return std::next(std::begin(container), getRandom(0, static_cast<int>(container.size() - 1)));
+	return std::next(std::begin(container), getRandom(randGenerator, 0, static_cast<int>(container.size() - 1)));
+}
+
+template <typename Container>
+typename Container::const_iterator
+pickRandom(const Container& container)
+{
+	return pickRandom(getRandGenerator(), container);
 }
 
 }
@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2023 Emeric Poupon
+ *
+ * This file is part of LMS.
+ *
+ * LMS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LMS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include "utils/http/ETag.hpp"
+
+TEST(Http, matchesIfNoneMatch)
+{
+	EXPECT_TRUE(Http::matchesIfNoneMatch(R"("abc")", R"("abc")"));
+	EXPECT_TRUE(Http::matchesIfNoneMatch(R"("foo", "abc")", R"("abc")"));
+	EXPECT_TRUE(Http::matchesIfNoneMatch(R"("foo" ,"abc" )", R"("abc")"));
+	EXPECT_TRUE(Http::matchesIfNoneMatch(R"(W/"abc")", R"("abc")"));
+	EXPECT_TRUE(Http::matchesIfNoneMatch(R"("abc")", R"(W/"abc")"));
+	EXPECT_TRUE(Http::matchesIfNoneMatch("*", R"("abc")"));
+
+	EXPECT_FALSE(Http::matchesIfNoneMatch("", R"("abc")"));
+	EXPECT_FALSE(Http::matchesIfNoneMatch(R"("abcd")", R"("abc")"));
+	EXPECT_FALSE(Http::matchesIfNoneMatch(R"("foo", "bar")", R"("abc")"));
+	EXPECT_FALSE(Http::matchesIfNoneMatch(",", R"("abc")"));
+}
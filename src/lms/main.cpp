@@ -294,6 +294,7 @@ int main(int argc, char* argv[])
                 // Flush cover cache even if no changes:
                 // covers may be external files that changed and we don't keep track of them for now (but we should)
                 coverService->flushCache();
+                recommendationService->flushCache();
             });
 
         Service<Feedback::IFeedbackService> feedbackService{ Feedback::createFeedbackService(ioContext, database) };
@@ -271,9 +271,17 @@ ScannerController::refreshContents()
 						.arg(status.currentScanStepStats->progress()));
 					break;
 
-					case Scanner::ScanStep::ComputeClusterStats:
+				case Scanner::ScanStep::ComputeClusterStats:
 					_stepStatus->setText(Wt::WString::tr("Lms.Admin.ScannerController.step-compute-cluster-stats")
 						.arg(status.currentScanStepStats->progress()));
+					break;
+
+				case Scanner::ScanStep::GeneratingCovers:
+					_stepStatus->setText(Wt::WString::tr("Lms.Admin.ScannerController.step-generating-covers")
+						.arg(status.currentScanStepStats->processedElems)
+						.arg(status.currentScanStepStats->totalElems)
+						.arg(status.currentScanStepStats->progress()));
+					break;
 			}
 			break;
 	}
@@ -28,6 +28,7 @@
 #include "utils/ILogger.hpp"
 #include "utils/Service.hpp"
 #include "utils/String.hpp"
+#include "utils/http/ETag.hpp"
 
 #include "LmsApplication.hpp"
 
@@ -35,6 +36,35 @@
 
 namespace UserInterface
 {
+    namespace
+    {
+        Image::EncodingFormat getEncodingFormat(const Wt::Http::Request& request)
+        {
+            // Browsers that can display WebP images advertise it explicitly
+            if (request.headerValue("Accept").find("image/webp") != std::string::npos)
+                return Image::EncodingFormat::WebP;
+
+            return Image::EncodingFormat::JPEG;
+        }
+
+        // Returns true if the client already has the cover identified by etag
+        bool handleNotModified(const Wt::Http::Request& request, Wt::Http::Response& response, const std::string& etag)
+        {
+            if (etag.empty() || !Http::matchesIfNoneMatch(request.headerValue("If-None-Match"), etag))
+                return false;
+
+            response.addHeader("Vary", "Accept");
+            response.addHeader("ETag", etag);
+            response.setStatus(304);
+            return true;
+        }
+
+        std::string quoteETag(const std::string& tag)
+        {
+            return tag.empty() ? tag : "\"" + tag + "\"";
+        }
+    }
+
     CoverResource::CoverResource()
     {
         LmsApp->getScannerEvents().scanComplete.connect(this, [this](const Scanner::ScanStats& stats)
@@ -80,6 +110,9 @@ namespace UserInterface
             return;
         }
 
+        const Image::EncodingFormat format{ getEncodingFormat(request) };
+
+        std::string etag;
         std::shared_ptr<Image::IEncodedImage> cover;
 
         if (trackIdStr)
@@ -93,9 +126,14 @@ namespace UserInterface
                 return;
             }
 
-            cover = Service<Cover::ICoverService>::get()->getFromTrack(*trackId, *size);
+            // The tag only depends on the cover source: no need to get the cover to know if the client already has the right one
+            etag = quoteETag(Service<Cover::ICoverService>::get()->getETag(*trackId, *size, format));
+            if (handleNotModified(request, response, etag))
+                return;
+
+            cover = Service<Cover::ICoverService>::get()->getFromTrack(*trackId, *size, format);
             if (!cover)
-                cover = Service<Cover::ICoverService>::get()->getDefault(*size);
+                cover = Service<Cover::ICoverService>::get()->getDefault(*size, format);
         }
         else if (releaseIdStr)
         {
@@ -105,9 +143,13 @@ namespace UserInterface
             if (!releaseId)
                 return;
 
-            cover = Service<Cover::ICoverService>::get()->getFromRelease(*releaseId, *size);
+            etag = quoteETag(Service<Cover::ICoverService>::get()->getETag(*releaseId, *size, format));
+            if (handleNotModified(request, response, etag))
+                return;
+
+            cover = Service<Cover::ICoverService>::get()->getFromRelease(*releaseId, *size, format);
             if (!cover)
-                cover = Service<Cover::ICoverService>::get()->getDefault(*size);
+                cover = Service<Cover::ICoverService>::get()->getDefault(*size, format);
         }
         else
         {
@@ -116,6 +158,10 @@ namespace UserInterface
         }
 
         response.setMimeType(std::string{ cover->getMimeType() });
+        response.addHeader("Vary", "Accept");
+        response.addHeader("Cache-Control", "private, max-age=604800");
+        if (!etag.empty())
+            response.addHeader("ETag", etag);
 
         response.out().write(reinterpret_cast<const char*>(cover->getData()), cover->getDataSize());
     }
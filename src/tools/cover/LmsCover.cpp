@@ -36,7 +36,7 @@
 
 static
 void
-dumpTrackCovers(Database::Session& session, Image::ImageSize width)
+dumpTrackCovers(Database::Session& session, Image::ImageSize width, Image::EncodingFormat format)
 {
     using namespace Database;
 
@@ -49,7 +49,23 @@ dumpTrackCovers(Database::Session& session, Image::ImageSize width)
     for (const Database::TrackId trackId : trackIds.results)
     {
         std::cout << "Getting cover for track id " << trackId.toString() << std::endl;
-        Service<Cover::ICoverService>::get()->getFromTrack(trackId, width);
+        Service<Cover::ICoverService>::get()->getFromTrack(trackId, width, format);
+    }
+}
+
+static
+void
+dumpCacheStats()
+{
+    const std::vector<Cover::CacheShardStats> stats{ Service<Cover::ICoverService>::get()->getCacheStats() };
+
+    for (std::size_t i{}; i < stats.size(); ++i)
+    {
+        const std::size_t lookupCount{ stats[i].hits + stats[i].misses };
+
+        std::cout << "Cache shard " << i << ": hit ratio = " << (lookupCount ? static_cast<float>(stats[i].hits) / lookupCount : 0)
+            << ", entries = " << stats[i].entryCount
+            << ", size = " << stats[i].size << "/" << stats[i].maxSize << " bytes" << std::endl;
     }
 }
 
@@ -71,6 +87,7 @@ int main(int argc, char* argv[])
             ("tracks,t", "dump covers for tracks")
             ("size,s", po::value<unsigned>()->default_value(512), "Requested cover size")
             ("quality,q", po::value<unsigned>()->default_value(75), "JPEG quality (1-100)")
+            ("webp,w", "encode covers in WebP instead of JPEG")
             ;
 
         po::variables_map vm;
@@ -91,7 +108,10 @@ int main(int argc, char* argv[])
         Database::Session session{ db };
 
         if (vm.count("tracks"))
-            dumpTrackCovers(session, vm["size"].as<unsigned>());
+        {
+            dumpTrackCovers(session, vm["size"].as<unsigned>(), vm.count("webp") ? Image::EncodingFormat::WebP : Image::EncodingFormat::JPEG);
+            dumpCacheStats();
+        }
     }
     catch (std::exception& e)
     {
@@ -17,10 +17,13 @@
  * along with LMS.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <filesystem>
 #include <iostream>
 #include <stdexcept>
 #include <stdlib.h>
+#include <string>
+#include <vector>
 
 #include <boost/program_options.hpp>
 
@@ -36,6 +39,8 @@
 #include "utils/Service.hpp"
 #include "utils/StreamLogger.hpp"
 
+#include "RecommendationBenchmark.hpp"
+
 using namespace Database;
 
 static void dumpTracksRecommendation(Session session, Recommendation::IRecommendationService& recommendationService, unsigned maxSimilarityCount)
@@ -124,6 +129,13 @@ static void dumpArtistsRecommendation(Session session, Recommendation::IRecommen
     }
 }
 
+static constexpr Recommendation::EngineType allEngineTypes[]
+{
+    Recommendation::EngineType::Clusters,
+    Recommendation::EngineType::Features,
+    Recommendation::EngineType::Hnsw,
+};
+
 int main(int argc, char* argv[])
 {
     try
@@ -141,6 +153,11 @@ int main(int argc, char* argv[])
             ("releases,r", "Display recommendation for releases")
             ("tracks,t", "Display recommendation for tracks")
             ("max,m", po::value<unsigned>()->default_value(3), "Max similarity result count")
+            ("benchmark,b", "Benchmark the engines (load time, memory, latency and quality proxies)")
+            ("engines,e", po::value<std::vector<std::string>>()->multitoken()->default_value({ "clusters", "features", "hnsw" }, "clusters features hnsw"), "Engines to benchmark")
+            ("queries,q", po::value<unsigned>()->default_value(1000), "Benchmark query count, per query kind")
+            ("seed", po::value<unsigned>()->default_value(0), "Seed used to pick the benchmark queries")
+            ("genre-cluster-type", po::value<std::string>()->default_value("GENRE"), "Cluster type used as genre by the benchmark")
             ;
 
         po::variables_map vm;
@@ -157,12 +174,32 @@ int main(int argc, char* argv[])
         Db db{ config->getPath("working-dir") / "lms.db" };
         Session session{ db };
 
+        if (vm.count("benchmark"))
+        {
+            Benchmark::Parameters params;
+            for (const std::string& engineName : vm["engines"].as<std::vector<std::string>>())
+            {
+                const auto it{ std::find_if(std::cbegin(allEngineTypes), std::cend(allEngineTypes), [&](Recommendation::EngineType engineType) { return Benchmark::toString(engineType) == engineName; }) };
+                if (it == std::cend(allEngineTypes))
+                    throw std::runtime_error{ "Unknown engine '" + engineName + "'" };
+
+                params.engineTypes.push_back(*it);
+            }
+            params.queryCount = vm["queries"].as<unsigned>();
+            params.maxResultCount = vm["max"].as<unsigned>();
+            params.seed = vm["seed"].as<unsigned>();
+            params.genreClusterTypeName = vm["genre-cluster-type"].as<std::string>();
+
+            Benchmark::run(db, params, std::cout);
+            return EXIT_SUCCESS;
+        }
+
         std::cout << "Creating recommendation service..." << std::endl;
         const auto recommendationService{ Recommendation::createRecommendationService(db) };
         std::cout << "Recommendation service created!" << std::endl;
 
         std::cout << "Loading recommendation service..." << std::endl;
-        recommendationService->load();
+        recommendationService->waitForLoad();
 
         unsigned maxSimilarityCount{ vm["max"].as<unsigned>() };
 
@@ -0,0 +1,326 @@
+/*
+ * Copyright (C) 2023 Emeric Poupon
+ *
+ * This file is part of LMS.
+ *
+ * LMS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LMS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "RecommendationBenchmark.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <unordered_map>
+#include <unordered_set>
+#include <unistd.h>
+
+#include "database/Cluster.hpp"
+#include "database/Db.hpp"
+#include "database/Session.hpp"
+#include "database/Track.hpp"
+#include "database/Types.hpp"
+#include "utils/Random.hpp"
+
+namespace Benchmark
+{
+    using namespace Database;
+
+    namespace
+    {
+        using Clock = std::chrono::steady_clock;
+
+        template <typename IdType, typename RelatedIdType>
+        using RelationMap = std::unordered_map<IdType, std::vector<RelatedIdType>>;
+
+        // What the results are checked against, all vectors are sorted
+        struct GroundTruth
+        {
+            RelationMap<TrackId, ArtistId> trackArtists;
+            RelationMap<TrackId, ClusterId> trackGenres;
+            RelationMap<ReleaseId, ArtistId> releaseArtists;
+            RelationMap<ReleaseId, ClusterId> releaseGenres;
+            RelationMap<ArtistId, ClusterId> artistGenres;
+
+            std::vector<TrackId> trackIds;
+            std::vector<ReleaseId> releaseIds;
+            std::vector<ArtistId> artistIds;
+        };
+
+        struct QueryStats
+        {
+            std::vector<double> latencies;   // in ms
+            std::size_t queriesWithResults{};
+            std::size_t resultCount{};
+            std::size_t sameArtistCount{};   // results that share at least one artist with the query
+            std::size_t sameGenreCount{};    // results that share at least one genre with the query
+        };
+
+        template <typename T>
+        void sortAndRemoveDuplicates(std::vector<T>& values)
+        {
+            std::sort(std::begin(values), std::end(values));
+            values.erase(std::unique(std::begin(values), std::end(values)), std::end(values));
+        }
+
+        template <typename IdType, typename RelatedIdType>
+        std::vector<IdType> finalizeRelations(RelationMap<IdType, RelatedIdType>& relations)
+        {
+            std::vector<IdType> ids;
+            ids.reserve(relations.size());
+
+            for (auto& [id, relatedIds] : relations)
+            {
+                ids.push_back(id);
+                sortAndRemoveDuplicates(relatedIds);
+            }
+
+            // map iteration order is not stable
+            std::sort(std::begin(ids), std::end(ids));
+            return ids;
+        }
+
+        GroundTruth loadGroundTruth(Session& session, const std::string& genreClusterTypeName)
+        {
+            GroundTruth groundTruth;
+
+            std::unordered_set<ClusterId> genreIds;
+            {
+                auto transaction{ session.createReadTransaction() };
+
+                const RangeResults<ClusterId> clusterIds{ Cluster::findIds(session, Cluster::FindParameters{}.setClusterTypeName(genreClusterTypeName)) };
+                genreIds.insert(std::cbegin(clusterIds.results), std::cend(clusterIds.results));
+            }
+
+            constexpr std::size_t trackCountPerTransaction{ 1000 };
+            TrackId lastRetrievedId;
+            while (true)
+            {
+                const std::size_t previousTrackCount{ groundTruth.trackArtists.size() };
+                {
+                    auto transaction{ session.createReadTransaction() };
+
+                    Track::findClusterLinks(session, lastRetrievedId, trackCountPerTransaction, [&](const Track::ClusterLinks& clusterLinks)
+                    {
+                        std::vector<ClusterId>& trackGenres{ groundTruth.trackGenres[clusterLinks.trackId] };
+                        for (const ClusterId clusterId : clusterLinks.clusterIds)
+                        {
+                            if (genreIds.find(clusterId) != std::cend(genreIds))
+                                trackGenres.push_back(clusterId);
+                        }
+
+                        std::vector<ArtistId>& trackArtists{ groundTruth.trackArtists[clusterLinks.trackId] };
+                        for (const auto& [artistId, linkType] : clusterLinks.artistLinks)
+                        {
+                            trackArtists.push_back(artistId);
+
+                            std::vector<ClusterId>& artistGenres{ groundTruth.artistGenres[artistId] };
+                            artistGenres.insert(std::end(artistGenres), std::cbegin(trackGenres), std::cend(trackGenres));
+                        }
+
+                        if (clusterLinks.releaseId.isValid())
+                        {
+                            std::vector<ArtistId>& releaseArtists{ groundTruth.releaseArtists[clusterLinks.releaseId] };
+                            releaseArtists.insert(std::end(releaseArtists), std::cbegin(trackArtists), std::cend(trackArtists));
+
+                            std::vector<ClusterId>& releaseGenres{ groundTruth.releaseGenres[clusterLinks.releaseId] };
+                            releaseGenres.insert(std::end(releaseGenres), std::cbegin(trackGenres), std::cend(trackGenres));
+                        }
+                    });
+                }
+
+                if (groundTruth.trackArtists.size() == previousTrackCount)
+                    break;
+            }
+
+            groundTruth.trackIds = finalizeRelations(groundTruth.trackArtists);
+            finalizeRelations(groundTruth.trackGenres);
+            finalizeRelations(groundTruth.releaseArtists);
+            groundTruth.releaseIds = finalizeRelations(groundTruth.releaseGenres);
+            groundTruth.artistIds = finalizeRelations(groundTruth.artistGenres);
+
+            return groundTruth;
+        }
+
+        template <typename IdType>
+        std::vector<IdType> pickQueryIds(std::vector<IdType> ids, std::size_t count, Random::RandGenerator& randGenerator)
+        {
+            std::shuffle(std::begin(ids), std::end(ids), randGenerator);
+            if (ids.size() > count)
+                ids.resize(count);
+
+            return ids;
+        }
+
+        template <typename IdType, typename RelatedIdType>
+        const std::vector<RelatedIdType>& getRelatedIds(const RelationMap<IdType, RelatedIdType>& relations, IdType id)
+        {
+            static const std::vector<RelatedIdType> empty;
+
+            const auto it{ relations.find(id) };
+            return it != std::cend(relations) ? it->second : empty;
+        }
+
+        template <typename T>
+        bool haveCommonValue(const std::vector<T>& sortedValues1, const std::vector<T>& sortedValues2)
+        {
+            auto it1{ std::cbegin(sortedValues1) };
+            auto it2{ std::cbegin(sortedValues2) };
+            while (it1 != std::cend(sortedValues1) && it2 != std::cend(sortedValues2))
+            {
+                if (*it1 < *it2)
+                    ++it1;
+                else if (*it2 < *it1)
+                    ++it2;
+                else
+                    return true;
+            }
+
+            return false;
+        }
+
+        template <typename IdType, typename QueryFunc>
+        QueryStats runQueries(const std::vector<IdType>& ids, QueryFunc queryFunc, const RelationMap<IdType, ArtistId>* artists, const RelationMap<IdType, ClusterId>& genres)
+        {
+            QueryStats stats;
+            stats.latencies.reserve(ids.size());
+
+            for (const IdType id : ids)
+            {
+                const Clock::time_point start{ Clock::now() };
+                const std::vector<IdType> results{ queryFunc(id) };
+                const Clock::time_point end{ Clock::now() };
+
+                stats.latencies.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+                if (!results.empty())
+                    stats.queriesWithResults++;
+                stats.resultCount += results.size();
+
+                for (const IdType result : results)
+                {
+                    if (artists && haveCommonValue(getRelatedIds(*artists, id), getRelatedIds(*artists, result)))
+                        stats.sameArtistCount++;
+                    if (haveCommonValue(getRelatedIds(genres, id), getRelatedIds(genres, result)))
+                        stats.sameGenreCount++;
+                }
+            }
+
+            return stats;
+        }
+
+        double getPercentile(const std::vector<double>& sortedValues, double percentile)
+        {
+            if (sortedValues.empty())
+                return 0;
+
+            // nearest rank
+            const std::size_t rank{ static_cast<std::size_t>(std::ceil(percentile / 100 * sortedValues.size())) };
+            return sortedValues[std::clamp<std::size_t>(rank, 1, sortedValues.size()) - 1];
+        }
+
+        double toPercent(std::size_t count, std::size_t total)
+        {
+            return total ? (count * 100.0 / total) : 0;
+        }
+
+        void printStats(std::ostream& os, std::string_view name, QueryStats& stats, bool hasArtistProxy)
+        {
+            std::sort(std::begin(stats.latencies), std::end(stats.latencies));
+
+            const std::size_t queryCount{ stats.latencies.size() };
+            os << "  " << std::left << std::setw(8) << name << std::right << ": " << queryCount << " queries"
+                << ", latency (ms) p50 = " << getPercentile(stats.latencies, 50)
+                << ", p90 = " << getPercentile(stats.latencies, 90)
+                << ", p99 = " << getPercentile(stats.latencies, 99)
+                << ", max = " << (stats.latencies.empty() ? 0 : stats.latencies.back())
+                << "; coverage = " << toPercent(stats.queriesWithResults, queryCount) << "%"
+                << ", results/query = " << (queryCount ? static_cast<double>(stats.resultCount) / queryCount : 0);
+            if (hasArtistProxy)
+                os << ", same artist = " << toPercent(stats.sameArtistCount, stats.resultCount) << "%";
+            os << ", same genre = " << toPercent(stats.sameGenreCount, stats.resultCount) << "%" << std::endl;
+        }
+
+        // Linux only, 0 if unknown
+        std::size_t getResidentMemorySize()
+        {
+            std::ifstream statm{ "/proc/self/statm" };
+
+            std::size_t totalPageCount{};
+            std::size_t residentPageCount{};
+            if (!(statm >> totalPageCount >> residentPageCount))
+                return 0;
+
+            return residentPageCount * static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+        }
+
+        double toMiB(std::size_t byteCount)
+        {
+            return byteCount / (1024. * 1024.);
+        }
+    }
+
+    std::string_view toString(Recommendation::EngineType engineType)
+    {
+        switch (engineType)
+        {
+        case Recommendation::EngineType::Clusters: return "clusters";
+        case Recommendation::EngineType::Features: return "features";
+        case Recommendation::EngineType::Hnsw: return "hnsw";
+        }
+
+        return "unknown";
+    }
+
+    void run(Database::Db& db, const Parameters& params, std::ostream& os)
+    {
+        os << "Loading ground truth..." << std::endl;
+        const GroundTruth groundTruth{ loadGroundTruth(db.getTLSSession(), params.genreClusterTypeName) };
+        os << "Ground truth loaded: " << groundTruth.trackIds.size() << " tracks, " << groundTruth.releaseIds.size() << " releases, " << groundTruth.artistIds.size() << " artists" << std::endl;
+
+        // Same queries for all the engines. Ids are distinct, so that results never come from the service cache
+        Random::RandGenerator randGenerator{ Random::createSeededGenerator(params.seed) };
+        const std::vector<TrackId> trackIds{ pickQueryIds(groundTruth.trackIds, params.queryCount, randGenerator) };
+        const std::vector<ReleaseId> releaseIds{ pickQueryIds(groundTruth.releaseIds, params.queryCount, randGenerator) };
+        const std::vector<ArtistId> artistIds{ pickQueryIds(groundTruth.artistIds, params.queryCount, randGenerator) };
+
+        os << std::fixed << std::setprecision(3);
+
+        for (const Recommendation::EngineType engineType : params.engineTypes)
+        {
+            os << "*** Engine '" << toString(engineType) << "' ***" << std::endl;
+
+            const std::size_t residentMemorySizeBefore{ getResidentMemorySize() };
+            const Clock::time_point loadStart{ Clock::now() };
+            const auto recommendationService{ Recommendation::createRecommendationService(db, engineType) };
+            recommendationService->waitForLoad();
+            const Clock::time_point loadEnd{ Clock::now() };
+            const std::size_t residentMemorySizeAfter{ getResidentMemorySize() };
+
+            os << "  load time = " << std::chrono::duration<double>(loadEnd - loadStart).count() << "s"
+                << ", resident memory = +" << toMiB(residentMemorySizeAfter > residentMemorySizeBefore ? residentMemorySizeAfter - residentMemorySizeBefore : 0) << " MiB"
+                << " (" << toMiB(residentMemorySizeAfter) << " MiB total)" << std::endl;
+
+            QueryStats trackStats{ runQueries(trackIds, [&](TrackId trackId) { return recommendationService->findSimilarTracks(std::vector<TrackId>{ trackId }, params.maxResultCount); }, &groundTruth.trackArtists, groundTruth.trackGenres) };
+            printStats(os, "tracks", trackStats, true);
+
+            QueryStats releaseStats{ runQueries(releaseIds, [&](ReleaseId releaseId) { return recommendationService->getSimilarReleases(releaseId, params.maxResultCount); }, &groundTruth.releaseArtists, groundTruth.releaseGenres) };
+            printStats(os, "releases", releaseStats, true);
+
+            QueryStats artistStats{ runQueries(artistIds, [&](ArtistId artistId) { return recommendationService->getSimilarArtists(artistId, { TrackArtistLinkType::Artist, TrackArtistLinkType::ReleaseArtist }, params.maxResultCount); }, static_cast<const RelationMap<ArtistId, ArtistId>*>(nullptr), groundTruth.artistGenres) };
+            printStats(os, "artists", artistStats, false);
+        }
+    }
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2023 Emeric Poupon
+ *
+ * This file is part of LMS.
+ *
+ * LMS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LMS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "services/recommendation/IRecommendationService.hpp"
+
+namespace Database
+{
+    class Db;
+}
+
+namespace Benchmark
+{
+    struct Parameters
+    {
+        std::vector<Recommendation::EngineType> engineTypes;
+        std::size_t queryCount{ 1000 };            // per query kind (tracks, releases, artists)
+        std::size_t maxResultCount{ 10 };
+        unsigned seed{};                            // used to pick the queried ids
+        std::string genreClusterTypeName{ "GENRE" };
+    };
+
+    std::string_view toString(Recommendation::EngineType engineType);
+
+    // Loads each engine in turn, then reports load time, memory footprint,
+    // query latencies and simple quality proxies (shared artists and genres)
+    void run(Database::Db& db, const Parameters& params, std::ostream& os);
+}
@@ -17,21 +17,46 @@
  * along with LMS.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <functional>
+#include <iterator>
 #include <numeric>
+#include <optional>
+#include <stdexcept>
+#include <vector>
 
 #include "utils/Random.hpp"
 
-#include "ParallelFor.hpp"
+#include "WorkStealingPool.hpp"
 
 template<typename Individual>
 class GeneticAlgorithm
 {
 	public:
 		using Score = float;
+		using Seed = Random::RandGenerator::result_type;
 
-		using BreedFunction = std::function<Individual(const Individual&, const Individual&)>;
-		using MutateFunction = std::function<void(Individual&)>;
-		using ScoreFunction = std::function<Score(const Individual&)>;
+		// Breed and mutate are called from the simulation thread, using the simulation generator
+		using BreedFunction = std::function<Individual(const Individual&, const Individual&, Random::RandGenerator&)>;
+		using MutateFunction = std::function<void(Individual&, Random::RandGenerator&)>;
+		// Called concurrently from the pool workers. The seed only depends on the simulation seed and on the individual's birth order
+		using ScoreFunction = std::function<Score(const Individual&, Seed)>;
+
+		struct GenerationStats
+		{
+			std::size_t		generation;		// 0 is the initial population
+			std::size_t		scoredCount;	// individuals that had to be scored in this generation
+			Score			bestScore;
+			Score			meanScore;
+			Score			worstScore;
+			std::chrono::duration<double>	scoreDuration;	// time spent scoring this generation
+			std::chrono::duration<double>	elapsed;		// since the start of the simulation
+		};
+		using GenerationCallback = std::function<void(const GenerationStats&, const Individual& best)>;
 
 		struct Params
 		{
@@ -39,33 +64,41 @@ class GeneticAlgorithm
 			std::size_t		nbGenerations;
 			float			crossoverRatio {0.5};
 			float			mutationProbability {0.05};
+			Seed			seed {};
 			BreedFunction	breedFunction;
 			MutateFunction		mutateFunction;
 			ScoreFunction		scoreFunction;
+			GenerationCallback	generationCallback;	// optional
 		};
 
 		GeneticAlgorithm(const Params& params);
 
 		// Returns the individual that has the maximum score after processing the requested generations
+		// Two simulations using the same params and initial population give the same result, whatever the worker count
 		Individual simulate(const std::vector<Individual>& initialPopulation);
 
 	private:
 		struct ScoredIndividual
 		{
 			Individual individual;
+			Seed seed {};
 			std::optional<Score> score {};
 		};
 
-		void scoreAndSortPopulation(std::vector<ScoredIndividual>& population);
+		std::size_t scoreAndSortPopulation(std::vector<ScoredIndividual>& population);
 		Score getTotalScore(const std::vector<ScoredIndividual>& population) const;
 		typename std::vector<ScoredIndividual>::const_iterator pickRandomRouletteWheel(const std::vector<ScoredIndividual>& population, Score totalScore);
 
 		Params _params;
+		Random::RandGenerator _randGenerator;
+		WorkStealingPool _pool;
 };
 
 template<typename Individual>
 GeneticAlgorithm<Individual>::GeneticAlgorithm(const Params& params)
 : _params {params}
+, _randGenerator {Random::createSeededGenerator(params.seed)}
+, _pool {params.nbWorkers}
 {
 }
 
@@ -74,23 +107,47 @@ template<typename Individual>
 Individual
 GeneticAlgorithm<Individual>::simulate(const std::vector<Individual>& initialPopulation)
 {
+	using Clock = std::chrono::steady_clock;
+
 	const std::size_t childrenCountPerGeneration {static_cast<std::size_t>(initialPopulation.size() * _params.crossoverRatio)};
 	if (initialPopulation.size() < 10)
 		throw std::runtime_error("Initial population must has at least 10 elements");
 
+	_randGenerator.seed(_params.seed);
+	const Clock::time_point start {Clock::now()};
+
 	std::vector<ScoredIndividual> scoredPopulation;
 	scoredPopulation.reserve(initialPopulation.size());
 
 	std::transform(std::cbegin(initialPopulation), std::cend(initialPopulation), std::back_inserter(scoredPopulation ),
-			[](const Individual& individual) { return ScoredIndividual {individual};});
+			[&](const Individual& individual) { return ScoredIndividual {individual, _randGenerator()};});
+
+	auto scoreGeneration {[&](std::size_t generation)
+	{
+		const Clock::time_point scoreStart {Clock::now()};
+		const std::size_t scoredCount {scoreAndSortPopulation(scoredPopulation)};
+		const Clock::time_point scoreEnd {Clock::now()};
+
+		if (_params.generationCallback)
+		{
+			GenerationStats stats;
+			stats.generation = generation;
+			stats.scoredCount = scoredCount;
+			stats.bestScore = *scoredPopulation.front().score;
+			stats.meanScore = getTotalScore(scoredPopulation) / scoredPopulation.size();
+			stats.worstScore = *scoredPopulation.back().score;
+			stats.scoreDuration = scoreEnd - scoreStart;
+			stats.elapsed = scoreEnd - start;
+
+			_params.generationCallback(stats, scoredPopulation.front().individual);
+		}
+	}};
 
-	scoreAndSortPopulation(scoredPopulation);
+	scoreGeneration(0);
 
 	for (std::size_t currentGeneration {}; currentGeneration  < _params.nbGenerations; ++currentGeneration)
 	{
 		assert(scoredPopulation.size() == initialPopulation.size());
-		std::cout << "Processing generation " << currentGeneration << "..." << std::endl;
-		std::cout << "Need to create " << childrenCountPerGeneration << " new children" << std::endl;
 
 		// breed
 		const Score populationTotalScore {getTotalScore(scoredPopulation)};
@@ -106,11 +163,12 @@ GeneticAlgorithm<Individual>::simulate(const std::vector<Individual>& initialPop
 			if (itParent1 == itParent2)
 				continue;
 
-			ScoredIndividual child {_params.breedFunction(itParent1->individual, itParent2->individual)};
-			
-			if (Random::getRealRandom(float {}, float {1}) <= _params.mutationProbability)
-				_params.mutateFunction(child.individual);
+			ScoredIndividual child {_params.breedFunction(itParent1->individual, itParent2->individual, _randGenerator)};
+
+			if (Random::getRealRandom(_randGenerator, float {}, float {1}) <= _params.mutationProbability)
+				_params.mutateFunction(child.individual, _randGenerator);
 
+			child.seed = _randGenerator();
 			children.emplace_back(std::move(child));
 		}
 
@@ -120,29 +178,36 @@ GeneticAlgorithm<Individual>::simulate(const std::vector<Individual>& initialPop
 		scoredPopulation.insert(std::end(scoredPopulation), std::make_move_iterator(std::begin(children)), std::make_move_iterator(std::end(children)));
 		assert(scoredPopulation.size() == initialPopulation.size());
 
-		scoreAndSortPopulation(scoredPopulation);
-
-		std::cout << "Mean score = " << getTotalScore(scoredPopulation) / scoredPopulation.size() << std::endl;
-		std::cout << "Current best score = " << *scoredPopulation.front().score << std::endl;
+		scoreGeneration(currentGeneration + 1);
 	}
 
-	std::cout << "Best score = " << *scoredPopulation.front().score << std::endl;
 	return scoredPopulation.front().individual;
 }
 
 
 template<typename Individual>
-void
+std::size_t
 GeneticAlgorithm<Individual>::scoreAndSortPopulation(std::vector<ScoredIndividual>& scoredPopulation)
 {
-	parallel_foreach(_params.nbWorkers, std::begin(scoredPopulation), std::end(scoredPopulation),
-			[&](ScoredIndividual& scoredIndividual)
+	// Elites keep their score, only score the newcomers
+	std::vector<ScoredIndividual*> toScore;
+	for (ScoredIndividual& scoredIndividual : scoredPopulation)
+	{
+		if (!scoredIndividual.score)
+			toScore.push_back(&scoredIndividual);
+	}
+
+	_pool.parallelFor(toScore.size(),
+			[&](std::size_t index)
 			{
-				if (!scoredIndividual.score)
-					scoredIndividual.score = _params.scoreFunction(scoredIndividual.individual);
+				ScoredIndividual& scoredIndividual {*toScore[index]};
+				scoredIndividual.score = _params.scoreFunction(scoredIndividual.individual, scoredIndividual.seed);
 			});
 
-	std::sort(std::begin(scoredPopulation), std::end(scoredPopulation), [](const ScoredIndividual& a, const ScoredIndividual& b) { return a.score > b.score; });
+	// stable: equal scores keep their previous order, whatever the order they were scored in
+	std::stable_sort(std::begin(scoredPopulation), std::end(scoredPopulation), [](const ScoredIndividual& a, const ScoredIndividual& b) { return *a.score > *b.score; });
+
+	return toScore.size();
 }
 
 template<typename Individual>
@@ -156,7 +221,11 @@ template<typename Individual>
 typename std::vector<typename GeneticAlgorithm<Individual>::ScoredIndividual>::const_iterator
 GeneticAlgorithm<Individual>::pickRandomRouletteWheel(const std::vector<ScoredIndividual>& population, Score totalScore)
 {
-	const Score randomScore {Random::getRealRandom(Score {}, totalScore)};
+	// all scores are 0: uniform pick
+	if (totalScore <= Score {})
+		return Random::pickRandom(_randGenerator, population);
+
+	const Score randomScore {Random::getRealRandom(_randGenerator, Score {}, totalScore)};
 
 	Score curScore{};
 	for (auto itScoredIndividual {std::cbegin(population)}; itScoredIndividual != std::cend(population); ++itScoredIndividual )
@@ -167,7 +236,6 @@ GeneticAlgorithm<Individual>::pickRandomRouletteWheel(const std::vector<ScoredIn
 		curScore += *itScoredIndividual->score;
 	}
 
-	throw std::runtime_error("bad random or empty population");
+	// float rounding may leave randomScore slightly above the accumulated sum
+	return std::prev(std::cend(population));
 }
-
-
@@ -17,25 +17,43 @@
  * along with LMS.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <iostream>
+#include <algorithm>
+#include <cmath>
 #include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <optional>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <boost/program_options.hpp>
 
 #include "database/Artist.hpp"
 #include "database/Cluster.hpp"
 #include "database/Db.hpp"
 #include "database/Release.hpp"
-#include "database/SessionPool.hpp"
+#include "database/Session.hpp"
 #include "database/Track.hpp"
+#include "database/TrackArtistLink.hpp"
 #include "database/TrackFeatures.hpp"
-#include "similarity/features/SimilarityFeaturesSearcher.hpp"
-#include "utils/Config.hpp"
+#include "features/FeaturesDefs.hpp"
+#include "features/FeaturesExtractor.hpp"
+#include "features/ObjectPositionIndex.hpp"
+#include "som/DataNormalizer.hpp"
+#include "som/Network.hpp"
+#include "utils/IConfig.hpp"
+#include "utils/Random.hpp"
 #include "utils/Service.hpp"
 #include "utils/StreamLogger.hpp"
+#include "utils/Utils.hpp"
 
 #include "GeneticAlgorithm.hpp"
 
-using namespace Similarity;
+using namespace Recommendation;
 using SimilarityScore = GeneticAlgorithm<FeatureSettingsMap>::Score;
 
 // An individual is just a FeatureSettingsMap
@@ -160,24 +178,37 @@ const FeatureSettingsMap featuresSettings
 	{ "lowlevel.zerocrossingrate.var",		{1}},
 };
 
+// Features of all the tracks, restricted to the features that may be selected
+using FeaturesCache = std::unordered_map<Database::TrackId, FeatureValuesMap>;
+
 static
-std::unordered_map<Database::IdType, FeatureValuesMap>
+FeaturesCache
 constructFeaturesCache(Database::Session& session, const FeatureSettingsMap& featureSettings)
 {
-	std::unordered_map<Database::IdType, FeatureValuesMap> cache;
+	FeaturesCache cache;
 
 	std::unordered_set<FeatureName> names;
 	std::transform(std::cbegin(featureSettings), std::cend(featureSettings), std::inserter(names, std::begin(names)),
 			[](const auto& itFeature) { return itFeature.first; });
 
-	auto transaction {session.createReadTransaction()};
+	constexpr std::size_t trackFeaturesCountPerTransaction {1000};
 
-	for (auto trackId : Database::Track::getAllIdsWithFeatures(session))
+	Database::TrackFeaturesId lastRetrievedId;
+	bool endReached {};
+	while (!endReached)
 	{
-		const Database::Track::pointer track {Database::Track::getById(session, trackId)};
-		const Database::TrackFeatures::pointer trackFeatures {track->getTrackFeatures()};
+		endReached = true;
+
+		auto transaction {session.createReadTransaction()};
+
+		Database::TrackFeatures::find(session, lastRetrievedId, trackFeaturesCountPerTransaction, [&](Database::TrackId trackId, const std::string& jsonEncodedFeatures)
+		{
+			endReached = false;
 
-		cache[trackId] = trackFeatures->getFeatureValuesMap(names);
+			FeatureValuesMap featureValuesMap {Database::TrackFeatures::parseFeatureValuesMap(jsonEncodedFeatures, names)};
+			if (!featureValuesMap.empty())
+				cache.emplace(trackId, std::move(featureValuesMap));
+		});
 	}
 
 	return cache;
@@ -185,7 +216,7 @@ constructFeaturesCache(Database::Session& session, const FeatureSettingsMap& fea
 
 static
 std::optional<FeatureValuesMap>
-getFeaturesFromCache(const std::unordered_map<Database::IdType, FeatureValuesMap>& cache, Database::IdType trackId, const FeatureNames& names)
+getFeaturesFromCache(const FeaturesCache& cache, Database::TrackId trackId, const FeatureSettingsMap& featureSettings)
 {
 	std::optional<FeatureValuesMap> res;
 
@@ -196,7 +227,7 @@ getFeaturesFromCache(const std::unordered_map<Database::IdType, FeatureValuesMap
 	res = FeatureValuesMap{};
 
 	const FeatureValuesMap& trackFeatures {it->second};
-	for (const FeatureName& name : names)
+	for (const auto& [name, settings] : featureSettings)
 	{
 		auto itFeatures {trackFeatures.find(name)};
 		if (itFeatures == std::cend(trackFeatures))
@@ -205,7 +236,7 @@ getFeaturesFromCache(const std::unordered_map<Database::IdType, FeatureValuesMap
 			break;
 		}
 
-		res->emplace(name, itFeatures ->second);
+		res->emplace(name, itFeatures->second);
 	}
 
 	return res;
@@ -220,94 +251,253 @@ printFeatureSettingsMap(const FeatureSettingsMap& featureSettings)
 		std::cout << "\t" << name << std::endl;
 }
 
+// Relations used as ground truth to evaluate the similarity results
+struct TrackRelations
+{
+	Database::ReleaseId					releaseId;	// invalid if none
+	std::vector<Database::ArtistId>		artistIds;	// sorted
+	std::vector<Database::ClusterId>	clusterIds;	// sorted
+};
+using GroundTruth = std::unordered_map<Database::TrackId, TrackRelations>;
+
+template <typename IdType>
+static
+void
+sortAndRemoveDuplicates(std::vector<IdType>& ids)
+{
+	std::sort(std::begin(ids), std::end(ids));
+	ids.erase(std::unique(std::begin(ids), std::end(ids)), std::end(ids));
+}
+
+// Loaded once, the scoring of all the individuals only uses this in-memory copy
+static
+GroundTruth
+constructGroundTruth(Database::Session& session, const FeaturesCache& featuresCache)
+{
+	GroundTruth groundTruth;
+	groundTruth.reserve(featuresCache.size());
+
+	constexpr std::size_t trackCountPerTransaction {1000};
+
+	Database::TrackId lastRetrievedId;
+	bool endReached {};
+	while (!endReached)
+	{
+		endReached = true;
+
+		auto transaction {session.createReadTransaction()};
+
+		Database::Track::findClusterLinks(session, lastRetrievedId, trackCountPerTransaction, [&](const Database::Track::ClusterLinks& clusterLinks)
+		{
+			endReached = false;
+
+			if (featuresCache.find(clusterLinks.trackId) == std::cend(featuresCache))
+				return;
+
+			TrackRelations relations;
+			relations.releaseId = clusterLinks.releaseId;
+
+			for (const auto& [artistId, linkType] : clusterLinks.artistLinks)
+				relations.artistIds.push_back(artistId);
+			sortAndRemoveDuplicates(relations.artistIds);
+
+			relations.clusterIds = clusterLinks.clusterIds;
+			sortAndRemoveDuplicates(relations.clusterIds);
+
+			groundTruth.emplace(clusterLinks.trackId, std::move(relations));
+		});
+	}
+
+	return groundTruth;
+}
+
+template <typename IdType>
+static
+std::size_t
+countCommonIds(const std::vector<IdType>& ids1, const std::vector<IdType>& ids2)
+{
+	std::size_t count {};
+
+	auto it1 {std::cbegin(ids1)};
+	auto it2 {std::cbegin(ids2)};
+	while (it1 != std::cend(ids1) && it2 != std::cend(ids2))
+	{
+		if (*it1 < *it2)
+			++it1;
+		else if (*it2 < *it1)
+			++it2;
+		else
+		{
+			++count;
+			++it1;
+			++it2;
+		}
+	}
+
+	return count;
+}
+
 static
 std::string
-trackToString(Database::Session& session, Database::IdType trackId)
+trackToString(Database::Session& session, Database::TrackId trackId)
 {
 	std::string res;
 	auto transaction {session.createReadTransaction()};
-	Database::Track::pointer track {Database::Track::getById(session, trackId)};
+	const Database::Track::pointer track {Database::Track::find(session, trackId)};
+	if (!track)
+		return res;
 
 	res += track->getName();
 	if (track->getRelease())
 		res += " [" + track->getRelease()->getName() + "]";
-	for (auto artist : track->getArtists())
+	for (auto artist : track->getArtists({Database::TrackArtistLinkType::Artist}))
 		res += " - " + artist->getName();
 	for (auto cluster : track->getClusters())
-		res += " {" + cluster->getType()->getName() + "-"+ cluster->getName() + "}";
+		res += " {" + std::string {cluster->getType()->getName()} + "-" + std::string {cluster->getName()} + "}";
 
 	return res;
 }
 
 static
 SimilarityScore
-computeTrackScore(Database::Session& session, Database::IdType track1Id, Database::IdType track2Id)
+computeTrackScore(const GroundTruth& groundTruth, Database::TrackId track1Id, Database::TrackId track2Id)
 {
 	SimilarityScore score {};
 
-	auto transaction {session.createReadTransaction()};
+	const auto itTrack1 {groundTruth.find(track1Id)};
+	const auto itTrack2 {groundTruth.find(track2Id)};
+	if (itTrack1 == std::cend(groundTruth) || itTrack2 == std::cend(groundTruth))
+		return score;
 
-	auto track1 {Database::Track::getById(session, track1Id)};
-	auto track2 {Database::Track::getById(session, track2Id)};
+	const TrackRelations& track1 {itTrack1->second};
+	const TrackRelations& track2 {itTrack2->second};
 
-	if (track1->getRelease() == track2->getRelease())
+	if (track1.releaseId.isValid() && track1.releaseId == track2.releaseId)
 		score += 1;
 
-	// Artists in common
-	{
-		auto track1ArtistIds {track1->getArtistIds()};
-		auto track2ArtistIds {track2->getArtistIds()};
+	score += countCommonIds(track1.artistIds, track2.artistIds);
+	score += countCommonIds(track1.clusterIds, track2.clusterIds);
 
-		std::vector<Database::IdType> commonArtistIds;
-		std::set_intersection(std::cbegin(track1ArtistIds), std::cend(track1ArtistIds),
-				std::cbegin(track2ArtistIds), std::cend(track2ArtistIds),
-				std::back_inserter(commonArtistIds));
+	return score;
+}
 
-		score += commonArtistIds.size();
-	}
+// Trains a network on the cached features, then searches similar tracks the same way the features engine does
+class FeaturesClassifier
+{
+	public:
+		struct TrainSettings
+		{
+			std::size_t iterationCount {8};
+			float sampleCountPerNeuron {1.5};
+			FeatureSettingsMap featureSettingsMap;
+		};
+
+		FeaturesClassifier(const FeaturesCache& featuresCache, const std::vector<Database::TrackId>& trackIds, const TrainSettings& trainSettings);
+
+		std::vector<Database::TrackId> getSimilarTracks(Database::TrackId trackId, std::size_t maxCount) const;
+
+	private:
+		std::optional<SOM::Network>	_network;	// not set if there is nothing to classify
+		SOM::InputVector::Distance	_refVectorsDistanceMedian {};
+		ObjectPositionIndex<Database::TrackId>	_trackPositions;
+};
+
+FeaturesClassifier::FeaturesClassifier(const FeaturesCache& featuresCache, const std::vector<Database::TrackId>& trackIds, const TrainSettings& trainSettings)
+{
+	const std::size_t nbDimensions {std::accumulate(std::cbegin(trainSettings.featureSettingsMap), std::cend(trainSettings.featureSettingsMap), std::size_t {0},
+			[](std::size_t sum, const auto& itFeatureSetting) { return sum + getFeatureDef(itFeatureSetting.first).nbDimensions; })};
 
-	// Clusters in common
+	std::vector<SOM::InputVector> samples;
+	std::vector<Database::TrackId> samplesTrackIds;
+	for (const Database::TrackId trackId : trackIds)
 	{
-		auto track1ClusterIds {track1->getClusterIds()};
-		auto track2ClusterIds {track2->getClusterIds()};
+		const std::optional<FeatureValuesMap> featureValuesMap {getFeaturesFromCache(featuresCache, trackId, trainSettings.featureSettingsMap)};
+		if (!featureValuesMap)
+			continue;
 
-		std::vector<Database::IdType> commonClusterIds;
-		std::set_intersection(std::cbegin(track1ClusterIds), std::cend(track1ClusterIds),
-				std::cbegin(track2ClusterIds), std::cend(track2ClusterIds),
-				std::back_inserter(commonClusterIds));
+		SOM::InputVector inputVector {nbDimensions};
+		if (!convertFeatureValuesMapToInputVector(*featureValuesMap, inputVector))
+			continue;
 
-		score += commonClusterIds.size();
+		samples.emplace_back(std::move(inputVector));
+		samplesTrackIds.push_back(trackId);
 	}
 
-	return score;
+	if (samples.empty())
+		return;
+
+	SOM::DataNormalizer dataNormalizer {nbDimensions};
+	dataNormalizer.computeNormalizationFactors(samples);
+	for (SOM::InputVector& sample : samples)
+		dataNormalizer.normalizeData(sample);
+
+	const SOM::Coordinate size {std::max<SOM::Coordinate>(2, static_cast<SOM::Coordinate>(std::sqrt(samples.size() / trainSettings.sampleCountPerNeuron)))};
+
+	_network.emplace(size, size, nbDimensions);
+	_network->setDataWeights(getInputVectorWeights(trainSettings.featureSettingsMap, nbDimensions));
+	_network->train(samples, trainSettings.iterationCount);
+	_refVectorsDistanceMedian = _network->computeRefVectorsDistanceMedian();
+
+	std::vector<ObjectPositionIndex<Database::TrackId>::ObjectPosition> trackPositions;
+	trackPositions.reserve(samples.size());
+	for (std::size_t i {}; i < samples.size(); ++i)
+		trackPositions.emplace_back(samplesTrackIds[i], _network->getClosestRefVectorPosition(samples[i]));
+
+	_trackPositions = ObjectPositionIndex<Database::TrackId> {size, size, std::move(trackPositions)};
 }
 
-static
-SimilarityScore
-computeSimilarityScore(Database::Session& session, FeaturesSearcher::TrainSettings trainSettings)
+std::vector<Database::TrackId>
+FeaturesClassifier::getSimilarTracks(Database::TrackId trackId, std::size_t maxCount) const
 {
-	std::cout << "Compute score of: ";
-	printFeatureSettingsMap(trainSettings.featureSettingsMap);
-	std::cout << std::endl;
+	std::vector<Database::TrackId> res;
 
-	FeaturesSearcher searcher {session, trainSettings};
+	std::vector<SOM::Position> searchedRefVectorsPosition;
+	for (const SOM::Position& position : _trackPositions.getPositions(trackId))
+		Utils::push_back_if_not_present(searchedRefVectorsPosition, position);
 
-	const std::vector<Database::IdType> trackIds = std::invoke([&]()
+	if (searchedRefVectorsPosition.empty())
+		return res;
+
+	while (1)
+	{
+		for (const SOM::Position& position : searchedRefVectorsPosition)
+		{
+			for (const Database::TrackId similarTrackId : _trackPositions.getObjects(position))
 			{
-				auto transaction {session.createReadTransaction()};
-				return Database::Track::getAllIdsWithFeatures(session);
-			});
+				if (res.size() == maxCount)
+					break;
+
+				if (similarTrackId != trackId)
+					Utils::push_back_if_not_present(res, similarTrackId);
+			}
+		}
 
+		if (res.size() == maxCount)
+			break;
+
+		// If there is not enough tracks, try again with closest neighbour until there is too much distance
+		const std::optional<SOM::Position> closestRefVectorPosition {_network->getClosestRefVectorPosition(searchedRefVectorsPosition, _refVectorsDistanceMedian * 0.75)};
+		if (!closestRefVectorPosition)
+			break;
+
+		Utils::push_back_if_not_present(searchedRefVectorsPosition, *closestRefVectorPosition);
+	}
+
+	return res;
+}
+
+static
+SimilarityScore
+computeSimilarityScore(const FeaturesClassifier& classifier, const std::vector<Database::TrackId>& trackIds, const GroundTruth& groundTruth)
+{
 	SimilarityScore score {};
-	for (Database::IdType trackId : trackIds)
+	for (const Database::TrackId trackId : trackIds)
 	{
 		constexpr std::size_t nbSimilarTracks {3};
-//		std::cout << "Processing track '" << trackToString(session, trackId) << "'" << std::endl;
-		SimilarityScore factor {1};		
-		for (Database::IdType similarTrackId : searcher.getSimilarTracks({trackId}, nbSimilarTracks))
+		SimilarityScore factor {1};
+		for (const Database::TrackId similarTrackId : classifier.getSimilarTracks(trackId, nbSimilarTracks))
 		{
-			SimilarityScore trackScore {computeTrackScore(session, trackId, similarTrackId)};
-//			std::cout << "\tScore = " << trackScore << " (*" << factor << ") with track '" << trackToString(session, similarTrackId) << "'" << std::endl;
+			SimilarityScore trackScore {computeTrackScore(groundTruth, trackId, similarTrackId)};
 			trackScore *= factor;
 			score += trackScore;
 
@@ -315,29 +505,19 @@ computeSimilarityScore(Database::Session& session, FeaturesSearcher::TrainSettin
 		}
 	}
 
-	std::cout << "Total score = " << score << std::endl;
-
 	return score;
 }
 
 static
 void
-printBadlyClassifiedTracks(Database::Session& session, FeaturesSearcher::TrainSettings trainSettings)
+printBadlyClassifiedTracks(Database::Session& session, const FeaturesClassifier& classifier, const std::vector<Database::TrackId>& trackIds, const GroundTruth& groundTruth)
 {
-	FeaturesSearcher searcher {session, trainSettings};
-
-	const std::vector<Database::IdType> trackIds = std::invoke([&]()
-			{
-				auto transaction {session.createReadTransaction()};
-				return Database::Track::getAllIdsWithFeatures(session);
-			});
-
-	for (Database::IdType trackId : trackIds)
+	for (const Database::TrackId trackId : trackIds)
 	{
 		constexpr std::size_t nbSimilarTracks {3};
-		for (Database::IdType similarTrackId : searcher.getSimilarTracks({trackId}, nbSimilarTracks))
+		for (const Database::TrackId similarTrackId : classifier.getSimilarTracks(trackId, nbSimilarTracks))
 		{
-			SimilarityScore trackScore {computeTrackScore(session, trackId, similarTrackId)};
+			SimilarityScore trackScore {computeTrackScore(groundTruth, trackId, similarTrackId)};
 			if (trackScore == 0)
 				std::cout << "Badly classified tracks: '" << trackToString(session, trackId) << "'\n\twith track '" << trackToString(session, similarTrackId) << "'" <<std::endl;
 		}
@@ -346,8 +526,8 @@ printBadlyClassifiedTracks(Database::Session& session, FeaturesSearcher::TrainSe
 
 
 static
-FeatureSettingsMap 
-breedFeatureSettingsMap(const FeatureSettingsMap& a, const FeatureSettingsMap& b)
+FeatureSettingsMap
+breedFeatureSettingsMap(const FeatureSettingsMap& a, const FeatureSettingsMap& b, Random::RandGenerator& randGenerator)
 {
 	FeatureSettingsMap res;
 
@@ -357,7 +537,7 @@ breedFeatureSettingsMap(const FeatureSettingsMap& a, const FeatureSettingsMap& b
 	// just kill random elements until size is good
 	while (res.size() > a.size())
 	{
-		const auto itFeature {Random::pickRandom(res)};
+		const auto itFeature {Random::pickRandom(randGenerator, res)};
 		res.erase(itFeature);
 	}
 
@@ -366,89 +546,152 @@ breedFeatureSettingsMap(const FeatureSettingsMap& a, const FeatureSettingsMap& b
 
 static
 void
-mutateFeatureSettingsMap(FeatureSettingsMap& a)
+mutateFeatureSettingsMap(FeatureSettingsMap& a, Random::RandGenerator& randGenerator)
 {
 	const std::size_t size {a.size()};
 	// Replace one of the feature with another one, random
-	a.erase(Random::pickRandom(a));
+	a.erase(Random::pickRandom(randGenerator, a));
 
 	while (a.size() != size)
 	{
-		const auto itFeatureSetting {Random::pickRandom(featuresSettings)};
+		const auto itFeatureSetting {Random::pickRandom(randGenerator, featuresSettings)};
 		a.emplace(itFeatureSetting->first, itFeatureSetting->second);
 	}
 }
 
+static
+std::string
+featureSettingsMapToString(const FeatureSettingsMap& featureSettings)
+{
+	std::string res;
+	for (const auto& [name, settings] : featureSettings)
+	{
+		if (!res.empty())
+			res += ";";
+		res += name;
+	}
+
+	return res;
+}
+
 int main(int argc, char *argv[])
 {
 	try
 	{
-		// log to stdout
-//		ServiceProvider<Logger>::create<StreamLogger>(std::cout);
+		namespace po = boost::program_options;
 
-		if (argc != 3)
+		// log to stdout
+//		Service<ILogger> logger {std::make_unique<StreamLogger>(std::cout)};
+
+		po::options_description desc {"Allowed options"};
+		desc.add_options()
+			("help,h", "print usage message")
+			("conf,c", po::value<std::string>()->default_value("/etc/lms.conf"), "LMS config file")
+			("workers,w", po::value<std::size_t>()->default_value(std::max(std::thread::hardware_concurrency(), 1U)), "Number of individuals scored in parallel")
+			("generations,g", po::value<std::size_t>()->default_value(1), "Number of generations")
+			("population,p", po::value<std::size_t>()->default_value(200), "Population size")
+			("features,f", po::value<std::size_t>()->default_value(5), "Number of features per individual")
+			("seed,s", po::value<GeneticAlgorithm<FeatureSettingsMap>::Seed>()->default_value(0), "Random seed, same seed gives same results")
+			("metrics,m", po::value<std::string>(), "CSV file to write the per-generation metrics to")
+			;
+
+		po::variables_map vm;
+		po::store(po::parse_command_line(argc, argv, desc), vm);
+
+		if (vm.count("help"))
 		{
-			std::cerr << "usage: <lms_conf_file> <nb_workers>" << std::endl;
-			return EXIT_FAILURE;
+			std::cout << desc << std::endl;
+			return EXIT_SUCCESS;
 		}
 
-		const std::filesystem::path configFilePath {std::string(argv[1], 0, 256)};
-		const std::size_t nbWorkers = atoi(argv[2]);
+		const std::filesystem::path configFilePath {vm["conf"].as<std::string>()};
+		const std::size_t nbWorkers {vm["workers"].as<std::size_t>()};
+		const std::size_t populationSize {vm["population"].as<std::size_t>()};
+		const std::size_t nbFeatures {vm["features"].as<std::size_t>()};
+		const auto seed {vm["seed"].as<GeneticAlgorithm<FeatureSettingsMap>::Seed>()};
 
-		ServiceProvider<Config>::create(configFilePath);
+		std::ofstream metricsFile;
+		if (vm.count("metrics"))
+		{
+			metricsFile.open(vm["metrics"].as<std::string>());
+			if (!metricsFile)
+				throw std::runtime_error("Cannot open metrics file '" + vm["metrics"].as<std::string>() + "'");
 
-		Database::Db db {ServiceProvider<Config>::get()->getPath("working-dir") / "lms.db"};
-		Database::SessionPool sessionPool {db, nbWorkers};
+			metricsFile << "generation,scored_count,best_score,mean_score,worst_score,score_duration_s,elapsed_s,best_features" << std::endl;
+		}
 
-		std::cout << "Caching all features..." << std::endl;
-		// Cache all the features of all the music in order to speed up the multiple trainings
-		const auto cachedFeatures { constructFeaturesCache(Database::SessionPool::ScopedSession {sessionPool}.get(), featuresSettings) };
-		std::cout << "Caching all features DONE" << std::endl;
+		Service<IConfig> config {createConfig(configFilePath)};
 
-		FeaturesSearcher::setFeaturesFetchFunc(
-				[&](Database::IdType trackId, const FeatureNames& featureNames)
-				{
-					return getFeaturesFromCache(cachedFeatures, trackId, featureNames);
-				});
+		Database::Db db {config->getPath("working-dir") / "lms.db"};
+		Database::Session& session {db.getTLSSession()};
+
+		std::cout << "Caching all features and ground truth..." << std::endl;
+		// Cache all the features and relations of all the music in order to speed up the multiple trainings
+		const FeaturesCache featuresCache {constructFeaturesCache(session, featuresSettings)};
+		const std::vector<Database::TrackId> trackIds {[&]
+		{
+			std::vector<Database::TrackId> res;
+			res.reserve(featuresCache.size());
+			std::transform(std::cbegin(featuresCache), std::cend(featuresCache), std::back_inserter(res), [](const auto& itFeatures) { return itFeatures.first; });
+			// visit the tracks in a stable order, for reproducible results
+			std::sort(std::begin(res), std::end(res));
+			return res;
+		}()};
+		const GroundTruth groundTruth {constructGroundTruth(session, featuresCache)};
+		std::cout << "Caching all features and ground truth DONE (" << trackIds.size() << " tracks)" << std::endl;
 
 		// Create some random settings (i.e random population)
+		Random::RandGenerator populationRandGenerator {Random::createSeededGenerator(seed)};
 		std::vector<FeatureSettingsMap> initialPopulation;
 
-		constexpr std::size_t populationSize {200};
-		constexpr std::size_t nbFeatures {5};
-
 		for (std::size_t i {}; i < populationSize; ++i)
 		{
 			FeatureSettingsMap settings;
 
 			while (settings.size() < nbFeatures)
 			{
-				const auto itFeatureSetting {Random::pickRandom(featuresSettings)};
+				const auto itFeatureSetting {Random::pickRandom(populationRandGenerator, featuresSettings)};
 				settings.emplace(itFeatureSetting->first, itFeatureSetting->second);
 			}
 
 			initialPopulation.emplace_back(std::move(settings));
 		}
 
-		FeaturesSearcher::TrainSettings trainSettings;
-		trainSettings.iterationCount = 8;
-		trainSettings.sampleCountPerNeuron = 1.5;
+		FeaturesClassifier::TrainSettings trainSettings;
 
 		GeneticAlgorithm<FeatureSettingsMap>::Params params;
 		params.nbWorkers = nbWorkers;
-		params.nbGenerations = 1;
+		params.nbGenerations = vm["generations"].as<std::size_t>();
 		params.crossoverRatio = 0.78;
 		params.mutationProbability = 0.2;
+		params.seed = seed;
 		params.breedFunction = breedFeatureSettingsMap;
 		params.mutateFunction = mutateFeatureSettingsMap;
 		params.scoreFunction =
-			[&](const FeatureSettingsMap& featureSettings)
+			[&](const FeatureSettingsMap& featureSettings, GeneticAlgorithm<FeatureSettingsMap>::Seed individualSeed)
 			{
-				FeaturesSearcher::TrainSettings settings {trainSettings};
+				FeaturesClassifier::TrainSettings settings {trainSettings};
 				settings.featureSettingsMap = featureSettings;
 
-				Database::SessionPool::ScopedSession scopedSession {sessionPool};
-				return computeSimilarityScore(scopedSession.get(), settings);
+				// The training draws from the thread local generator: make it only depend on the individual
+				Random::getRandGenerator().seed(individualSeed);
+
+				const FeaturesClassifier classifier {featuresCache, trackIds, settings};
+				return computeSimilarityScore(classifier, trackIds, groundTruth);
+			};
+		params.generationCallback =
+			[&](const GeneticAlgorithm<FeatureSettingsMap>::GenerationStats& stats, const FeatureSettingsMap& best)
+			{
+				std::cout << "Generation " << stats.generation << ": scored " << stats.scoredCount << " individuals in " << stats.scoreDuration.count() << "s"
+					<< ", best = " << stats.bestScore << ", mean = " << stats.meanScore << ", worst = " << stats.worstScore << std::endl;
+
+				if (metricsFile.is_open())
+				{
+					metricsFile << stats.generation << "," << stats.scoredCount
+						<< "," << stats.bestScore << "," << stats.meanScore << "," << stats.worstScore
+						<< "," << stats.scoreDuration.count() << "," << stats.elapsed.count()
+						<< "," << featureSettingsMapToString(best) << std::endl;
+				}
 			};
 
 		GeneticAlgorithm<FeatureSettingsMap> geneticAlgorithm {params};
@@ -460,8 +703,10 @@ int main(int argc, char *argv[])
 			<< "\tnbFeatures = " << nbFeatures << "\n"
 			<< "\tcrossoverRatio = " << params.crossoverRatio << "\n"
 			<< "\tmutationProbability = " << params.mutationProbability << "\n"
+			<< "\tnbWorkers = " << nbWorkers << "\n"
+			<< "\tseed = " << seed << "\n"
 			<< std::endl;
-			
+
 		std::cout << "Starting simulation..." << std::endl;
 		const FeatureSettingsMap selectedSettings {geneticAlgorithm.simulate(initialPopulation)};
 		std::cout << "Simulation complete! Best result:" << std::endl;
@@ -469,19 +714,18 @@ int main(int argc, char *argv[])
 
 		// print all badly classified tracks
 		{
-			FeaturesSearcher::TrainSettings settings {trainSettings};
+			FeaturesClassifier::TrainSettings settings {trainSettings};
 			settings.featureSettingsMap = selectedSettings;
 
-			Database::SessionPool::ScopedSession scopedSession {sessionPool};
-			printBadlyClassifiedTracks(scopedSession.get(), settings);
+			const FeaturesClassifier classifier {featuresCache, trackIds, settings};
+			printBadlyClassifiedTracks(session, classifier, trackIds, groundTruth);
 		}
 	}
 	catch (std::exception& e)
 	{
 		std::cerr << "Caught exception: " << e.what() << std::endl;
+		return EXIT_FAILURE;
 	}
 
 	return EXIT_SUCCESS;
 }
-
-
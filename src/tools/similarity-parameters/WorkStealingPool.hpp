@@ -0,0 +1,224 @@
+/*
+ * Copyright (C) 2019 Emeric Poupon
+ *
+ * This file is part of LMS.
+ *
+ * LMS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LMS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Persistent pool of workers, kept alive between batches
+// Each worker is given a contiguous share of the batch and steals from the others once its own share is exhausted
+class WorkStealingPool
+{
+	public:
+		WorkStealingPool(std::size_t threadCount);
+		~WorkStealingPool();
+
+		WorkStealingPool(const WorkStealingPool&) = delete;
+		WorkStealingPool(WorkStealingPool&&) = delete;
+		WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+		WorkStealingPool& operator=(WorkStealingPool&&) = delete;
+
+		std::size_t getThreadCount() const { return _threads.size(); }
+
+		// Calls func(index) for each index in [0, count), blocks until all calls are done
+		// Rethrows the first exception thrown by func, if any
+		void parallelFor(std::size_t count, std::function<void(std::size_t)> func);
+
+	private:
+		struct WorkQueue
+		{
+			std::mutex				mutex;
+			std::deque<std::size_t>	indexes;
+		};
+
+		void workerLoop(std::size_t workerIndex);
+		std::optional<std::size_t> popIndex(std::size_t workerIndex);
+		void processBatch(std::size_t workerIndex);
+
+		std::vector<std::unique_ptr<WorkQueue>>	_queues;
+		std::vector<std::thread>			_threads;
+
+		std::mutex					_mutex;
+		std::condition_variable		_batchCondition;
+		std::condition_variable		_doneCondition;
+		std::size_t					_batchGeneration {};
+		std::size_t					_remainingCount {};
+		std::function<void(std::size_t)>	_func;
+		std::exception_ptr			_exception;
+		bool						_stop {};
+};
+
+inline
+WorkStealingPool::WorkStealingPool(std::size_t threadCount)
+{
+	if (threadCount == 0)
+		throw std::runtime_error("Invalid worker count");
+
+	for (std::size_t i {}; i < threadCount; ++i)
+		_queues.emplace_back(std::make_unique<WorkQueue>());
+
+	for (std::size_t i {}; i < threadCount; ++i)
+		_threads.emplace_back([this, i] { workerLoop(i); });
+}
+
+inline
+WorkStealingPool::~WorkStealingPool()
+{
+	{
+		std::scoped_lock lock {_mutex};
+		_stop = true;
+	}
+	_batchCondition.notify_all();
+
+	for (std::thread& thread : _threads)
+		thread.join();
+}
+
+inline
+void
+WorkStealingPool::parallelFor(std::size_t count, std::function<void(std::size_t)> func)
+{
+	if (count == 0)
+		return;
+
+	{
+		std::scoped_lock lock {_mutex};
+
+		_func = std::move(func);
+		_exception = nullptr;
+		_remainingCount = count;
+
+		// Contiguous shares, so that neighbour items tend to be processed by the same worker
+		const std::size_t queueCount {_queues.size()};
+		for (std::size_t queueIndex {}; queueIndex < queueCount; ++queueIndex)
+		{
+			const std::size_t begin {count * queueIndex / queueCount};
+			const std::size_t end {count * (queueIndex + 1) / queueCount};
+
+			WorkQueue& queue {*_queues[queueIndex]};
+			std::scoped_lock queueLock {queue.mutex};
+			for (std::size_t index {begin}; index < end; ++index)
+				queue.indexes.push_back(index);
+		}
+
+		++_batchGeneration;
+	}
+	_batchCondition.notify_all();
+
+	std::unique_lock lock {_mutex};
+	_doneCondition.wait(lock, [this] { return _remainingCount == 0; });
+
+	_func = {};
+	if (_exception)
+		std::rethrow_exception(std::exchange(_exception, nullptr));
+}
+
+inline
+void
+WorkStealingPool::workerLoop(std::size_t workerIndex)
+{
+	std::size_t processedGeneration {};
+
+	while (true)
+	{
+		{
+			std::unique_lock lock {_mutex};
+			_batchCondition.wait(lock, [&] { return _stop || _batchGeneration != processedGeneration; });
+			if (_stop)
+				return;
+
+			processedGeneration = _batchGeneration;
+		}
+
+		processBatch(workerIndex);
+	}
+}
+
+inline
+std::optional<std::size_t>
+WorkStealingPool::popIndex(std::size_t workerIndex)
+{
+	// Own queue first, from the front
+	{
+		WorkQueue& queue {*_queues[workerIndex]};
+		std::scoped_lock lock {queue.mutex};
+		if (!queue.indexes.empty())
+		{
+			const std::size_t index {queue.indexes.front()};
+			queue.indexes.pop_front();
+			return index;
+		}
+	}
+
+	// Then steal from the back of the other queues
+	for (std::size_t i {1}; i < _queues.size(); ++i)
+	{
+		WorkQueue& queue {*_queues[(workerIndex + i) % _queues.size()]};
+		std::scoped_lock lock {queue.mutex};
+		if (!queue.indexes.empty())
+		{
+			const std::size_t index {queue.indexes.back()};
+			queue.indexes.pop_back();
+			return index;
+		}
+	}
+
+	return std::nullopt;
+}
+
+inline
+void
+WorkStealingPool::processBatch(std::size_t workerIndex)
+{
+	while (const std::optional<std::size_t> index {popIndex(workerIndex)})
+	{
+		std::exception_ptr exception;
+		try
+		{
+			_func(*index);
+		}
+		catch (...)
+		{
+			exception = std::current_exception();
+		}
+
+		bool done {};
+		{
+			std::scoped_lock lock {_mutex};
+			if (exception && !_exception)
+				_exception = exception;
+
+			done = (--_remainingCount == 0);
+		}
+
+		if (done)
+			_doneCondition.notify_all();
+	}
+}